@@ -0,0 +1,198 @@
+//
+//  annotation_store_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/annotation_store.h"
+#include <sstream>
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+
+typedef AnnotationStore::AnnotationID AnnotationID;
+
+static std::vector<AnnotationID> Identifiers(const std::vector<const AnnotationStore::Annotation*>& annotations)
+{
+    std::vector<AnnotationID> result;
+    for ( const AnnotationStore::Annotation* annotation : annotations )
+        result.push_back(annotation->identifier);
+    return result;
+}
+
+TEST_CASE("Annotation stores should find the annotations overlapping a range", "")
+{
+    AnnotationStore store("urn:uuid:1234");
+    AnnotationID a = store.Add(AnnotationStore::Kind::Highlight, CFI("/6/4!/4/2,/1:0,/1:10"));
+    AnnotationID b = store.Add(AnnotationStore::Kind::Note, CFI("/6/4!/4,/2/1:5,/6/1:3"), "Who said this?");
+    AnnotationID c = store.Add(AnnotationStore::Kind::Bookmark, CFI("/6/4!/4/8/1:0"));
+    AnnotationID d = store.Add(AnnotationStore::Kind::Highlight, CFI("/6/12!/4/2,/1:0,/1:4"));
+    AnnotationID e = store.Add(AnnotationStore::Kind::Highlight, CFI("/6/6!/4/2,/1:0,/1:4"));
+    REQUIRE(store.Size() == 5);
+    
+    // results come in the order they start
+    typedef std::vector<AnnotationID> IDs;
+    REQUIRE(Identifiers(store.Overlapping(CFI("/6/4!/4,/2/1:8,/4/1:0"))) == (IDs{a, b}));
+    REQUIRE(Identifiers(store.Overlapping(CFI("/6/4!/4,/2/1:0,/12/1:0"))) == (IDs{a, b, c}));
+    REQUIRE(Identifiers(store.Overlapping(CFI("/6/4!/4,/6/1:4,/10/1:0"))) == (IDs{c}));
+    REQUIRE(Identifiers(store.At(CFI("/6/4!/4/2/1:10"))) == (IDs{a, b}));
+    REQUIRE(Identifiers(store.At(CFI("/6/4!/4/2/1:11"))) == (IDs{b}));
+    REQUIRE(Identifiers(store.At(CFI("/6/4!/4/8/1:0"))) == (IDs{c}));
+    REQUIRE(store.At(CFI("/6/4!/4/8/1:1")).empty());
+    
+    // spine positions are ordered numerically
+    REQUIRE(Identifiers(store.Overlapping(CFI("/6,/4!/4/8/1:0,/12!/4/2/1:2"))) == (IDs{c, e, d}));
+    REQUIRE(Identifiers(store.Overlapping(CFI("/6/8!/4,/2/1:0,/2/1:9"))).empty());
+    
+    REQUIRE_THROWS_AS(store.Overlapping(CFI()), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(store.Add(AnnotationStore::Kind::Note, CFI()), CFI::InvalidCFI);
+    REQUIRE(store.Size() == 5);
+}
+
+TEST_CASE("Annotation store queries should match a linear scan", "")
+{
+    AnnotationStore store("urn:uuid:1234");
+    std::vector<std::pair<uint32_t, uint32_t>> spans;
+    uint32_t seed = 12345;
+    auto next = [&seed](uint32_t limit) { seed = seed * 1103515245 + 12345; return (seed >> 8) % limit; };
+    
+    for ( int i = 0; i < 300; i++ )
+    {
+        uint32_t start = next(2000), length = (i % 10 == 0 ? next(1000) : next(20));
+        std::string str = _Str("/6/4!/4/2,/1:", start, ",/1:", start + length);
+        store.Add(AnnotationStore::Kind::Highlight, CFI(str));
+        spans.emplace_back(start, start + length);
+        
+        // remove a few along the way
+        if ( i % 7 == 6 )
+        {
+            AnnotationID victim = next(static_cast<uint32_t>(spans.size())) + 1;
+            if ( store.Remove(victim) )
+                spans[victim-1] = std::make_pair(UINT32_MAX, 0);
+        }
+    }
+    
+    for ( int i = 0; i < 200; i++ )
+    {
+        uint32_t start = next(2200), end = start + next(i % 2 == 0 ? 1 : 60);
+        std::string str = _Str("/6/4!/4/2,/1:", start, ",/1:", end);
+        
+        std::vector<AnnotationID> expected;
+        for ( size_t j = 0; j < spans.size(); j++ )
+        {
+            if ( spans[j].first <= end && spans[j].second >= start )
+                expected.push_back(j + 1);
+        }
+        
+        std::vector<AnnotationID> found = Identifiers(store.Overlapping(CFI(str)));
+        for ( size_t j = 1; j < found.size(); j++ )
+            REQUIRE(spans[found[j-1]-1].first <= spans[found[j]-1].first);
+        std::sort(found.begin(), found.end());
+        REQUIRE(found == expected);
+    }
+}
+
+TEST_CASE("Annotations can be found, changed and removed by identifier", "")
+{
+    AnnotationStore store("urn:uuid:1234");
+    AnnotationID a = store.Add(AnnotationStore::Kind::Highlight, CFI("/6/4!/4/2,/1:0,/1:10"), "", "yellow");
+    AnnotationID b = store.Add(AnnotationStore::Kind::Note, CFI("/6/4!/4/2,/1:2,/1:4"), "first thoughts");
+    
+    REQUIRE(store.Find(b)->kind == AnnotationStore::Kind::Note);
+    REQUIRE(store.Update(b, "second thoughts", "blue"));
+    REQUIRE(store.Find(b)->note == "second thoughts");
+    REQUIRE(store.Find(b)->style == "blue");
+    REQUIRE_FALSE(store.Update(b + 100, "", ""));
+    
+    REQUIRE(store.Remove(a));
+    REQUIRE_FALSE(store.Remove(a));
+    REQUIRE(store.Find(a) == nullptr);
+    REQUIRE(store.Find(b)->Location() == CFI("/6/4!/4/2,/1:2,/1:4"));
+    REQUIRE(Identifiers(store.At(CFI("/6/4!/4/2/1:3"))) == std::vector<AnnotationID>{b});
+    
+    // identifiers aren't reused
+    store.Clear();
+    REQUIRE(store.Empty());
+    REQUIRE(store.Add(AnnotationStore::Kind::Bookmark, CFI("/6/4!/4/2/1:0")) > b);
+}
+
+TEST_CASE("Annotation stores should survive a round trip to their binary form", "")
+{
+    AnnotationStore store("urn:uuid:1234");
+    store.Add(AnnotationStore::Kind::Highlight, CFI("/6/4[chap01ref]!/4/2,/1:0[,The],/1:10"), "", "yellow");
+    AnnotationID note = store.Add(AnnotationStore::Kind::Note, CFI(u8"/6/16[夏目漱石]!/4/2/1:3"), u8"吾輩は猫である");
+    store.Add(AnnotationStore::Kind::Bookmark, CFI("/6/4!/4/8/1:0"));
+    
+    std::stringstream stream;
+    REQUIRE(store.Save(stream));
+    std::string data = stream.str();
+    
+    AnnotationStore loaded("urn:uuid:1234");
+    std::istringstream input(data);
+    loaded.Load(input);
+    REQUIRE(loaded.Size() == 3);
+    for ( AnnotationID identifier = 1; identifier <= 3; identifier++ )
+    {
+        const AnnotationStore::Annotation *original = store.Find(identifier), *copy = loaded.Find(identifier);
+        REQUIRE(copy != nullptr);
+        REQUIRE(copy->kind == original->kind);
+        REQUIRE(copy->encodedLocation == original->encodedLocation);
+        REQUIRE(copy->Location() == original->Location());
+        REQUIRE(copy->note == original->note);
+        REQUIRE(copy->style == original->style);
+    }
+    REQUIRE(Identifiers(loaded.At(CFI("/6/4!/4/2/1:5"))) == std::vector<AnnotationID>{1});
+    REQUIRE(loaded.Add(AnnotationStore::Kind::Bookmark, CFI("/6/4!/4/2/1:0")) > note + 1);
+    
+    // bad data is rejected without touching the store
+    AnnotationStore other("urn:uuid:5678");
+    input.clear();
+    input.str(data);
+    REQUIRE_THROWS_AS(other.Load(input), AnnotationStore::FormatError);
+    REQUIRE(other.Empty());
+    
+    input.clear();
+    input.str(data.substr(0, data.size() - 3));
+    REQUIRE_THROWS_AS(loaded.Load(input), AnnotationStore::FormatError);
+    REQUIRE(loaded.Size() == 4);
+    
+    input.clear();
+    input.str("<annotations/>");
+    REQUIRE_THROWS_AS(loaded.Load(input), AnnotationStore::FormatError);
+    
+    // as are write failures
+    std::ostringstream broken;
+    broken.setstate(std::ios::badbit);
+    REQUIRE_FALSE(store.Save(broken));
+}
+
+TEST_CASE("Annotation stores should be keyed by their package's unique identifier", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    AnnotationStore store(pkg);
+    REQUIRE(store.PackageID() == pkg->UniqueID());
+    REQUIRE_FALSE(store.PackageID().empty());
+}
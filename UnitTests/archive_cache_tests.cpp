@@ -0,0 +1,108 @@
+//
+//  archive_cache_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "../ePub3/ePub/archive_cache.h"
+#include "catch.hpp"
+
+using namespace ePub3;
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+static ArchiveCache::Key CacheKey(const std::string& path)
+{
+    return ArchiveCache::Key{"test", path, 0, 0};
+}
+
+TEST_CASE("archive cache respects its budget", "Inserting past the budget should evict entries")
+{
+    ArchiveCache cache(1000, 500);
+    cache.Insert(CacheKey("large"), std::vector<uint8_t>(400));
+    cache.Insert(CacheKey("small"), std::vector<uint8_t>(10));
+    cache.Insert(CacheKey("medium1"), std::vector<uint8_t>(300));
+    cache.Insert(CacheKey("medium2"), std::vector<uint8_t>(300));
+    
+    REQUIRE(cache.BytesUsed() <= cache.Budget());
+    
+    // small entries are cheaper to keep than large ones
+    REQUIRE(cache.Lookup(CacheKey("small")) != nullptr);
+    REQUIRE(cache.Lookup(CacheKey("large")) == nullptr);
+}
+
+TEST_CASE("archive cache probes don't count as hits", "Contains() should leave an entry's eviction rank alone")
+{
+    ArchiveCache cache(1000, 500);
+    cache.Insert(CacheKey("probed"), std::vector<uint8_t>(400));
+    cache.Insert(CacheKey("used"), std::vector<uint8_t>(400));
+    REQUIRE(cache.Lookup(CacheKey("used")) != nullptr);
+    for ( int i = 0; i < 5; i++ )
+        REQUIRE(cache.Contains(CacheKey("probed")));
+    
+    // still the least used, so the first to go
+    cache.Insert(CacheKey("new"), std::vector<uint8_t>(300));
+    REQUIRE_FALSE(cache.Contains(CacheKey("probed")));
+    REQUIRE(cache.Contains(CacheKey("used")));
+    REQUIRE(cache.Contains(CacheKey("new")));
+}
+
+TEST_CASE("archive cache skips large entries", "Entries over the maximum size should not be cached")
+{
+    ArchiveCache cache(1000, 500);
+    ArchiveCache::Buffer buffer = cache.Insert(CacheKey("huge"), std::vector<uint8_t>(600));
+    REQUIRE(buffer->size() == 600);
+    REQUIRE(cache.Lookup(CacheKey("huge")) == nullptr);
+    REQUIRE(cache.BytesUsed() == 0);
+}
+
+TEST_CASE("archive cache purges by archive", "Purging an archive should remove only its entries")
+{
+    ArchiveCache cache;
+    cache.Insert(CacheKey("one"), std::vector<uint8_t>(10));
+    cache.Insert(ArchiveCache::Key{"other", "one", 0, 0}, std::vector<uint8_t>(10));
+    cache.Purge("test");
+    
+    REQUIRE(cache.Lookup(CacheKey("one")) == nullptr);
+    REQUIRE(cache.Lookup(ArchiveCache::Key{"other", "one", 0, 0}) != nullptr);
+    REQUIRE(cache.BytesUsed() == 10);
+}
+
+TEST_CASE("archive readers use the shared cache", "Reading the same entry twice should return identical data")
+{
+    ArchiveCache::SharedCache()->Clear();
+    
+    Auto<Archive> archive(Archive::Open(EPUB_PATH));
+    REQUIRE(archive.get() != nullptr);
+    
+    std::string contents[2];
+    for ( int i = 0; i < 2; i++ )
+    {
+        Auto<ArchiveReader> reader(archive->ReaderAtPath("META-INF/container.xml"));
+        REQUIRE(reader.get() != nullptr);
+        
+        char buf[256];
+        ssize_t num = 0;
+        while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+            contents[i].append(buf, num);
+    }
+    
+    REQUIRE(contents[0].size() > 0);
+    REQUIRE(contents[0] == contents[1]);
+    REQUIRE(ArchiveCache::SharedCache()->Count() == 1);
+}
@@ -0,0 +1,112 @@
+//
+//  archive_xml_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/ePub/archive_xml.h"
+#include <libxml/tree.h>
+#include <chrono>
+#include <iostream>
+#include "catch.hpp"
+
+using namespace ePub3;
+
+// a chapter of roughly 110 bytes per paragraph, compressed within an in-memory archive
+static Archive* LargeDocumentArchive(std::vector<uint8_t>& bytes, size_t paragraphs)
+{
+    std::string doc("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Large</title></head><body>\n");
+    for ( size_t i = 0; i < paragraphs; i++ )
+    {
+        doc += "<p id=\"p" + std::to_string(i) + "\">Paragraph " + std::to_string(i);
+        doc += " with <em>emphasis</em> &amp; some non-ASCII text: \xC3\xA9\xE2\x80\x94 lorem ipsum.</p>\n";
+    }
+    doc += "</body></html>\n";
+    
+    Archive* archive = Archive::Open(bytes);
+    ArchiveWriter* writer = archive->WriterAtPath("large.xhtml");
+    writer->write(doc.data(), doc.size());
+    delete archive;     // writes the archive into bytes
+    
+    return Archive::Open(bytes.data(), bytes.size());
+}
+
+static xmlDocPtr ParseDocument(Archive* archive, bool pipelined, bool html)
+{
+    ArchiveXmlReader reader(archive->ReaderAtPath("large.xhtml"));
+    reader.SetPipelined(pipelined);
+    
+    int flags = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
+    if ( html )
+        return reader.htmlReadDocument("large.xhtml", "utf-8", flags);
+    return reader.xmlReadDocument("large.xhtml", "utf-8", flags);
+}
+
+static std::string Serialized(xmlDocPtr doc)
+{
+    xmlChar* buf = nullptr;
+    int len = 0;
+    xmlDocDumpMemory(doc, &buf, &len);
+    std::string result(reinterpret_cast<char*>(buf), len);
+    xmlFree(buf);
+    return result;
+}
+
+TEST_CASE("pipelined parsing matches sequential parsing", "A pipelined ArchiveXmlReader should produce the same document")
+{
+    std::vector<uint8_t> bytes;
+    Auto<Archive> archive(LargeDocumentArchive(bytes, 20000));
+    
+    for ( bool html : {false, true} )
+    {
+        xmlDocPtr sequential = ParseDocument(archive.get(), false, html);
+        xmlDocPtr pipelined = ParseDocument(archive.get(), true, html);
+        REQUIRE(sequential != nullptr);
+        REQUIRE(pipelined != nullptr);
+        REQUIRE(Serialized(sequential) == Serialized(pipelined));
+        xmlFreeDoc(sequential);
+        xmlFreeDoc(pipelined);
+    }
+}
+
+// hidden: run explicitly with `UnitTests "./benchmark/*"`
+TEST_CASE("./benchmark/pipelined parsing", "Times sequential and pipelined parsing of a multi-megabyte XHTML document")
+{
+    std::vector<uint8_t> bytes;
+    Auto<Archive> archive(LargeDocumentArchive(bytes, 80000));
+    
+    for ( bool pipelined : {false, true} )
+    {
+        double best = 0.0;
+        for ( int i = 0; i < 5; i++ )
+        {
+            auto start = std::chrono::steady_clock::now();
+            xmlDocPtr doc = ParseDocument(archive.get(), pipelined, false);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            REQUIRE(doc != nullptr);
+            xmlFreeDoc(doc);
+            
+            if ( i == 0 || elapsed.count() < best )
+                best = elapsed.count();
+        }
+        std::cout << (pipelined ? "pipelined: " : "sequential: ") << best << "ms" << std::endl;
+    }
+}
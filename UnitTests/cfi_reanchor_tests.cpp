@@ -0,0 +1,126 @@
+//
+//  cfi_reanchor_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/cfi_reanchor.h"
+#include "test_documents.h"
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+using xml::CompactDocument;
+
+static CompactDocument Revision(const char* body)
+{
+    return CompactFromString(std::string("<html><head><title>T</title></head><body>") + body + "</body></html>");
+}
+
+TEST_CASE("CFIs should be kept where their paths and assertions still match", "")
+{
+    CompactDocument doc = Revision("<p id=\"a\">The quick brown fox jumps over the lazy dog.</p><p>Second.</p>");
+    CFIReanchorer reanchorer(doc);
+    
+    CFIReanchorer::Result result = reanchorer.Reanchor(CFI("/4/2[a]/1:10[quick ,brown]"), CFI("/6/4!"));
+    REQUIRE(result.method == CFIReanchorer::Method::Exact);
+    REQUIRE(result.confidence == 1.0f);
+    REQUIRE(result.cfi == CFI("/6/4!/4/2[a]/1:10[quick ,brown]"));
+    
+    // an element's [id] confirms it, but a bare path proves nothing
+    REQUIRE(reanchorer.Reanchor(CFI("/4/2[a]")).method == CFIReanchorer::Method::Exact);
+    REQUIRE(reanchorer.Reanchor(CFI("/4/4/1:3")).method == CFIReanchorer::Method::Unverified);
+    REQUIRE(reanchorer.Reanchor(CFI("/4/4/1:3")).confidence == 0.75f);
+}
+
+TEST_CASE("CFIs should follow their asserted text through revisions", "")
+{
+    CFI original("/4/2[a]/1:10[quick ,brown]");
+    
+    // a paragraph inserted before, and text before the location
+    CompactDocument moved = Revision("<p>A new opening.</p><p id=\"a\">Indeed. The quick brown fox jumps over the lazy dog.</p>");
+    CFIReanchorer::Result result = CFIReanchorer(moved).Reanchor(original);
+    REQUIRE(result.method == CFIReanchorer::Method::Searched);
+    REQUIRE(result.cfi == CFI("/4/4[a]/1:18[quick ,brown]"));
+    REQUIRE(result.confidence > 0.5f);
+    REQUIRE(result.confidence < 0.9f);
+    
+    // the text after the location was edited
+    CompactDocument edited = Revision("<p id=\"a\">The quick red fox jumps over the lazy dog.</p>");
+    result = CFIReanchorer(edited).Reanchor(original);
+    REQUIRE(result.method == CFIReanchorer::Method::Partial);
+    REQUIRE(result.cfi == CFI("/4/2[a]/1:10[quick ,red f]"));
+    
+    // the text is gone, though the path remains
+    CompactDocument rewritten = Revision("<p id=\"a\">Lorem ipsum dolor sit amet.</p>");
+    result = CFIReanchorer(rewritten).Reanchor(original);
+    REQUIRE(result.method == CFIReanchorer::Method::PathOnly);
+    REQUIRE(result.cfi == original);
+    REQUIRE(result.confidence == 0.2f);
+    
+    // both are gone
+    CompactDocument emptied = Revision("<div/>");
+    result = CFIReanchorer(emptied).Reanchor(original);
+    REQUIRE(result.method == CFIReanchorer::Method::Failed);
+    REQUIRE(result.cfi.Empty());
+    
+    // too far away to find
+    std::string filler(200, 'x');
+    CompactDocument distant = Revision(("<p id=\"a\">" + filler + "</p><p>The quick brown fox.</p>").c_str());
+    REQUIRE(CFIReanchorer(distant, UTFOffsetMap::Unit::CodePoint, 100).Reanchor(original).method == CFIReanchorer::Method::PathOnly);
+    REQUIRE(CFIReanchorer(distant, UTFOffsetMap::Unit::CodePoint, 300).Reanchor(original).method == CFIReanchorer::Method::Searched);
+}
+
+TEST_CASE("Ranges should be relocated end by end", "")
+{
+    CompactDocument moved = Revision("<p>A new opening.</p><p id=\"a\">Indeed. The quick brown fox jumps over the lazy dog.</p>");
+    CFIReanchorer::Result result = CFIReanchorer(moved).Reanchor(CFI("/4/2[a],/1:4[The ,quick],/1:15[brown, fox]"));
+    REQUIRE(result.method == CFIReanchorer::Method::Searched);
+    REQUIRE(result.cfi == CFI("/4/4[a],/1:12[The ,quick],/1:23[brown, fox]"));
+}
+
+TEST_CASE("A publication's CFIs should be relocated together", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    std::vector<CFI> cfis = {
+        CFI("/6/6[s04]!/4/2[pgepubid00492]/4/1:8[SECTION ,IV]"),
+        CFI("/6/200[s04]!/4/2[pgepubid00492]/4/1:8[SECTION ,IV]"),      // past the end of the spine
+        CFI("/6/6[s04]!/4/2[pgepubid00492]/4/1:2[SECTION ,IV]"),        // wrong offset
+        CFI("/6/6[nope]!/4/2/1:0"),
+        CFI("/6/6[s04]!,/4/2[pgepubid00492]/4/1:0[,SECTION],/4/2[pgepubid00492]/4/1:8[SECTION ,IV]"),  // split at the spine step
+    };
+    
+    std::vector<CFIReanchorer::Result> results = CFIReanchorer::ReanchorAll(pkg, cfis);
+    REQUIRE(results.size() == cfis.size());
+    REQUIRE(results[0].method == CFIReanchorer::Method::Exact);
+    REQUIRE(results[0].cfi == cfis[0]);
+    REQUIRE(results[1].method == CFIReanchorer::Method::Exact);
+    REQUIRE(results[1].cfi == cfis[0]);
+    REQUIRE(results[2].method == CFIReanchorer::Method::Searched);
+    REQUIRE(results[2].cfi == cfis[0]);
+    REQUIRE(results[3].method == CFIReanchorer::Method::Failed);
+    REQUIRE(results[4].method == CFIReanchorer::Method::Exact);
+    REQUIRE(results[4].cfi == CFI("/6/6[s04]!/4/2[pgepubid00492]/4,/1:0[,SECTION],/1:8[SECTION ,IV]"));
+}
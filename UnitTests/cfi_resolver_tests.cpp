@@ -0,0 +1,285 @@
+//
+//  cfi_resolver_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/cfi_resolver.h"
+#include "test_documents.h"
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+using xml::CompactDocument;
+
+static std::string TextAt(const CompactDocument& doc, CompactDocument::NodeIndex n)
+{
+    size_t length = 0;
+    const char* text = doc.Text(n, &length);
+    return std::string(text, length);
+}
+
+static CFIResolver::Resolution Resolve(const CompactDocument& doc, const char* str)
+{
+    CFI cfi(str);
+    return CFIResolver(doc).Resolve(cfi);
+}
+
+TEST_CASE("CFIs should resolve to the nodes and offsets they describe", "")
+{
+    CompactDocument doc = CompactFromString("<html><head><title>T</title></head><body id=\"b\"><p id=\"p1\">caf\xC3\xA9 one</p><p>two<em id=\"e\">three</em>four</p><div><p id=\"deep\">x</p></div></body></html>");
+    
+    CFIResolver::Resolution result = Resolve(doc, "epubcfi(/4[b]/2[p1]/1:5)");
+    REQUIRE_FALSE(result.isRange);
+    REQUIRE(TextAt(doc, result.start.node) == "caf\xC3\xA9 one");
+    REQUIRE(result.start.hasCharacterOffset);
+    REQUIRE(result.start.characterOffset == 5);
+    
+    REQUIRE(TextAt(doc, Resolve(doc, "epubcfi(/4/4/2/1:2)").start.node) == "three");
+    REQUIRE(TextAt(doc, Resolve(doc, "epubcfi(/4/4/3)").start.node) == "four");
+    
+    // offsets count code points, not bytes
+    REQUIRE_NOTHROW(Resolve(doc, "epubcfi(/4/2/1:8)"));
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/2/1:9)"), CFI::InvalidCFI);
+    
+    // the empty chunk before an element
+    result = Resolve(doc, "epubcfi(/4/6/1:0)");
+    REQUIRE(result.start.node == CompactDocument::NoNode);
+    REQUIRE(result.start.parent == doc.Parent(doc.ElementWithID("deep")));
+    REQUIRE(result.start.step == 1);
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/6/1:1)"), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/6/1/2)"), CFI::InvalidCFI);
+    
+    // steps which don't exist
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/8)"), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/9)"), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/2/1/1)"), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/2[nope]/1)"), CFI::InvalidCFI);
+    
+    // an assertion which doesn't match corrects the path
+    CFI cfi("epubcfi(/4/2[e]/1:1)");
+    result = CFIResolver(doc).Resolve(cfi);
+    REQUIRE(doc.Parent(result.start.node) == doc.ElementWithID("e"));
+    REQUIRE(cfi.String() == "epubcfi(/4[b]/4/2[e]/1:1)");
+    
+    // ranges
+    result = Resolve(doc, "epubcfi(/4/4,/1:1,/2/1:3)");
+    REQUIRE(result.isRange);
+    REQUIRE(TextAt(doc, result.start.node) == "two");
+    REQUIRE(result.start.characterOffset == 1);
+    REQUIRE(TextAt(doc, result.end.node) == "three");
+    REQUIRE(result.end.characterOffset == 3);
+    REQUIRE_THROWS_AS(Resolve(doc, "epubcfi(/4/4/1,/1:1,/1:3)"), CFI::InvalidCFI);
+}
+
+TEST_CASE("CFIs generated for locations should resolve back to them", "")
+{
+    CompactDocument doc = CompactFromString("<html><head><title>T</title></head><body id=\"b\"><p id=\"p1\">caf\xC3\xA9 one</p><p>two<em id=\"e\">three</em>four</p><div><p id=\"deep\">x</p></div></body></html>");
+    CFIResolver resolver(doc);
+    
+    CompactDocument::NodeIndex three = doc.FirstChild(doc.ElementWithID("e"));
+    CFIResolver::Location location{three, CompactDocument::NoNode, 0, true, 2};
+    CFI cfi = resolver.CFIForLocation(location);
+    REQUIRE(cfi == "epubcfi(/4[b]/4/2[e]/1:2)");
+    
+    CFIResolver::Resolution result = resolver.Resolve(cfi);
+    REQUIRE(result.start.node == three);
+    REQUIRE(result.start.characterOffset == 2);
+    
+    // an empty chunk of character data
+    result = resolver.Resolve(cfi = "/4/6/1:0");
+    REQUIRE(resolver.CFIForLocation(result.start) == "epubcfi(/4[b]/6/1:0)");
+    
+    // appended to a spine item's CFI
+    REQUIRE(resolver.CFIForLocation(location, CFI("/6/4[s01]!")) == "epubcfi(/6/4[s01]!/4[b]/4/2[e]/1:2)");
+    REQUIRE_THROWS_AS(resolver.CFIForLocation(location, CFI("/6/4!/4,/1:1,/1:2")), CFI::RangedCFIAppendAttempt);
+    
+    // ranges share as much of their path as they can
+    CFIResolver::Location two{doc.FirstChild(doc.Parent(doc.ElementWithID("e"))), CompactDocument::NoNode, 0, true, 1};
+    cfi = resolver.CFIForRange(two, location);
+    REQUIRE(cfi == "epubcfi(/4[b]/4,/1:1,/2[e]/1:2)");
+    result = resolver.Resolve(cfi);
+    REQUIRE(result.isRange);
+    REQUIRE(result.start.node == two.node);
+    REQUIRE(result.end.node == three);
+    
+    location.characterOffset = 4;
+    CFIResolver::Location start = location;
+    start.characterOffset = 1;
+    REQUIRE(resolver.CFIForRange(start, location) == "epubcfi(/4[b]/4/2[e],/1:1,/1:4)");
+    REQUIRE_THROWS_AS(resolver.CFIForRange(location, start), std::invalid_argument);
+    REQUIRE_THROWS_AS(resolver.CFIForRange(location, two), std::invalid_argument);
+}
+
+TEST_CASE("Batches of CFIs should resolve as they would one at a time", "")
+{
+    CompactDocument doc = CompactFromString("<html><head><title>T</title></head><body id=\"b\"><p id=\"p1\">caf\xC3\xA9 one</p><p>two<em id=\"e\">three</em>four</p><div><p id=\"deep\">x</p></div></body></html>");
+    CFIResolver resolver(doc);
+    
+    const char* strings[] = {
+        "/4/4/3:1", "/4/2/1:9", "/4/4/2/1:2", "/4/2/1:5", "/4/2[e]/1:1",
+        "/4/4/2/1:0", "/4/6/1/2", "/4/4,/1:1,/2/1:3", "/4/8", "/4/4/1:0",
+    };
+    std::vector<CFI> cfis;
+    for ( const char* str : strings )
+        cfis.emplace_back(str);
+    
+    std::vector<CFIResolver::BatchResult> results = resolver.ResolveAll(cfis);
+    REQUIRE(results.size() == cfis.size());
+    
+    for ( size_t i = 0; i < cfis.size(); i++ )
+    {
+        CFI cfi(strings[i]);
+        try
+        {
+            CFIResolver::Resolution expected = resolver.Resolve(cfi);
+            REQUIRE(results[i].resolved);
+            REQUIRE(results[i].resolution.start.node == expected.start.node);
+            REQUIRE(results[i].resolution.start.characterOffset == expected.start.characterOffset);
+            REQUIRE(results[i].resolution.end.node == expected.end.node);
+            REQUIRE(results[i].resolution.isRange == expected.isRange);
+        }
+        catch (CFI::InvalidCFI& e)
+        {
+            REQUIRE_FALSE(results[i].resolved);
+            REQUIRE(results[i].error == e.what());
+        }
+        
+        // corrections are made as before
+        REQUIRE(cfis[i] == cfi);
+    }
+    
+    REQUIRE_FALSE(results[1].resolved);
+    REQUIRE(cfis[4] == "epubcfi(/4[b]/4/2[e]/1:1)");
+}
+
+TEST_CASE("CFI character offsets can count UTF-16 code units", "")
+{
+    // "a😀b中😀😀c": 10 UTF-16 code units, 7 code points
+    CompactDocument doc = CompactFromString("<html><body><p>a\xF0\x9F\x98\x80" "b\xE4\xB8\xAD\xF0\x9F\x98\x80\xF0\x9F\x98\x80" "c</p></body></html>");
+    CFIResolver resolver(doc, UTFOffsetMap::Unit::UTF16);
+    
+    CFI cfi("/2/2/1:7");
+    CFIResolver::Resolution result = resolver.Resolve(cfi);
+    REQUIRE(result.start.characterOffset == 5);
+    REQUIRE(resolver.CFIForLocation(result.start) == CFI("/2/2/1:7"));
+    
+    cfi = "/2/2,/1:1,/1:10";
+    result = resolver.Resolve(cfi);
+    REQUIRE(result.start.characterOffset == 1);
+    REQUIRE(result.end.characterOffset == 7);
+    REQUIRE(resolver.CFIForRange(result.start, result.end) == CFI("/2/2,/1:1,/1:10"));
+    REQUIRE_THROWS_AS(Resolve(doc, "/2/2/1:10"), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(resolver.Resolve(cfi = "/2/2/1:11"), CFI::InvalidCFI);
+}
+
+TEST_CASE("CFIs should resolve within a package's content documents", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    CFI cfi("epubcfi(/6/6[s04]!/4/2[pgepubid00492]/4/1:8)"), remainder;
+    const ManifestItem* item = pkg->ManifestItemForCFI(cfi, &remainder);
+    REQUIRE(item != nullptr);
+    REQUIRE(item->Identifier() == "s04");
+    
+    Auto<CompactDocument> doc(item->ReferencedCompactDocument());
+    REQUIRE(doc != nullptr);
+    CFIResolver resolver(*doc);
+    
+    CFIResolver::Resolution result = resolver.Resolve(remainder);
+    REQUIRE(TextAt(*doc, result.start.node) == "SECTION IV ");
+    REQUIRE(result.start.characterOffset == 8);
+    
+    // the nested section is the third child element, not the first
+    remainder = "/4/2/2[pgepubid00495]/2/2/1:0";
+    result = resolver.Resolve(remainder);
+    REQUIRE(TextAt(*doc, result.start.node) == "170");
+    REQUIRE(remainder == CFI("/4/2[pgepubid00492]/6[pgepubid00495]/2/2/1:0"));
+    
+    // every text node's CFI should lead back to it, singly or in a batch
+    std::vector<CFI> batch;
+    std::vector<CompactDocument::NodeIndex> nodes;
+    for ( CompactDocument::NodeIndex n = doc->NodeCount(); n-- > 0; )
+    {
+        if ( !doc->IsText(n) )
+            continue;
+        
+        CFIResolver::Location location{n, CompactDocument::NoNode, 0, true, 0};
+        CFI generated = resolver.CFIForLocation(location, pkg->CFIForManifestItem(item));
+        REQUIRE(pkg->ManifestItemForCFI(generated, &remainder) == item);
+        REQUIRE(resolver.Resolve(remainder).start.node == n);
+        
+        batch.push_back(remainder);
+        nodes.push_back(n);
+    }
+    
+    std::vector<CFIResolver::BatchResult> results = resolver.ResolveAll(batch);
+    for ( size_t i = 0; i < results.size(); i++ )
+    {
+        REQUIRE(results[i].resolved);
+        REQUIRE(results[i].resolution.start.node == nodes[i]);
+    }
+}
+
+TEST_CASE("Package lookups should report bad CFIs without exceptions", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    const ManifestItem* item = nullptr;
+    CFI remainder;
+    CFI cfi("/6/6[s04]!/4/2/1:0");
+    REQUIRE(pkg->TryManifestItemForCFI(cfi, &item, &remainder) == Package::CFILookupError::None);
+    REQUIRE(item == pkg->ManifestItemForCFI(cfi, nullptr));
+    REQUIRE(remainder == CFI("/4/2/1:0"));
+    
+    // a CFI of the spine item alone leaves nothing over
+    cfi = "/6/6[s04]!";
+    REQUIRE(pkg->TryManifestItemForCFI(cfi, &item, &remainder) == Package::CFILookupError::None);
+    REQUIRE(item->Identifier() == "s04");
+    REQUIRE(remainder.Empty());
+    
+    // a range which splits at the spine item keeps both its ends
+    cfi = "/6/6[s04]!,/4/2/1:0,/4/6/1:5";
+    REQUIRE(pkg->TryManifestItemForCFI(cfi, &item, &remainder) == Package::CFILookupError::None);
+    REQUIRE(item->Identifier() == "s04");
+    REQUIRE(remainder.IsRangeTriplet());
+    REQUIRE(!remainder.Empty());
+    REQUIRE(remainder.String() == "epubcfi(,/4/2/1:0,/4/6/1:5)");
+    
+    struct { const char* cfi; Package::CFILookupError error; } failures[] = {
+        { "/6",                 Package::CFILookupError::TooShort },
+        { "/4/6!/4",            Package::CFILookupError::NotSpine },
+        { "/6/6/4",             Package::CFILookupError::NoIndirection },
+        { "/6/7!/4",            Package::CFILookupError::SpineIndexOutOfRange },
+        { "/6/9000!/4",         Package::CFILookupError::SpineIndexOutOfRange },
+        { "/6/6[nope]!/4",      Package::CFILookupError::UnmatchedQualifier },
+    };
+    for ( auto& failure : failures )
+    {
+        cfi = failure.cfi;
+        REQUIRE(pkg->TryManifestItemForCFI(cfi, &item, nullptr) == failure.error);
+        REQUIRE(item == nullptr);
+        REQUIRE_THROWS_AS(pkg->ManifestItemForCFI(cfi, nullptr), CFI::InvalidCFI);
+    }
+}
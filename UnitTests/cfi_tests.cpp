@@ -20,10 +20,36 @@
 //
 
 #include "../ePub3/ePub/cfi.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include "catch.hpp"
 
 using namespace ePub3;
 
+// counts heap allocations made while a test has switched counting on
+static std::atomic<bool>   gCountAllocations(false);
+static std::atomic<size_t> gAllocations(0);
+
+void* operator new(std::size_t size)
+{
+    if ( gCountAllocations )
+        ++gAllocations;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if ( p == nullptr )
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
 TEST_CASE("CFIs should be constructable from valid strings", "")
 {
     // valid strings
@@ -32,6 +58,7 @@ TEST_CASE("CFIs should be constructable from valid strings", "")
     REQUIRE_NOTHROW(CFI("/6/4[chap01]!/4/52/3:22"));
     REQUIRE_NOTHROW(CFI("/6/4[chap01]!/4/52,/3:22,/5:12"));
     REQUIRE_NOTHROW(CFI("epubcfi(/6/4[chap01]!/4/52,/3:22,/5:12)"));
+    REQUIRE_NOTHROW(CFI("epubcfi(/6/4[chap01]!/4,/2/6/1:3,/4/1:1)"));   // delimiters of different depths
     REQUIRE_NOTHROW(CFI(u8"epubcfi(/6/16[夏目漱石]!)"));        // utf-8
     REQUIRE_NOTHROW(CFI(u"epubcfi(/6/16[夏目漱石]!)"));         // utf-16
     REQUIRE_NOTHROW(CFI(U"epubcfi(/6/16[夏目漱石]!)"));         // utf-32
@@ -54,6 +81,39 @@ TEST_CASE("CFIs should be constructable from valid strings", "")
     // "epubcfi(/6/4!/4/2/2:20)" -- char index on even-numbered node: is this equivalent to someTag/text():20 ?
 }
 
+TEST_CASE("CFI strings should be parseable without exceptions", "")
+{
+    CFI cfi;
+    REQUIRE(CFI::TryParse("epubcfi(/6/4[chap01]!/4/52,/3:22,/5:12)", &cfi) == CFI::ParseError::None);
+    REQUIRE(cfi == CFI("/6/4[chap01]!/4/52,/3:22,/5:12"));
+    REQUIRE(CFI::TryParse("/6/4[chap01]!/4/52/3:22", &cfi) == CFI::ParseError::None);
+    REQUIRE(cfi == CFI("/6/4[chap01]!/4/52/3:22"));
+    
+    // each failure has its reason, and leaves the result alone
+    REQUIRE(CFI::TryParse("", &cfi) == CFI::ParseError::NotACFI);
+    REQUIRE(CFI::TryParse("6/4", &cfi) == CFI::ParseError::NotACFI);
+    REQUIRE(CFI::TryParse("epubcfi()", &cfi) == CFI::ParseError::NotACFI);
+    REQUIRE(CFI::TryParse("/6/4[chap01!/4", &cfi) == CFI::ParseError::UnterminatedQualifier);
+    REQUIRE(CFI::TryParse("/:22", &cfi) == CFI::ParseError::InvalidStep);
+    REQUIRE(CFI::TryParse("/6/4!,/1:22", &cfi) == CFI::ParseError::InvalidRange);
+    REQUIRE(CFI::TryParse("/6/4!/4/52,/5:12,/3:22", &cfi) == CFI::ParseError::InvalidRange);
+    REQUIRE(cfi == CFI("/6/4[chap01]!/4/52/3:22"));
+    
+    // the constructor reports all of these the same way
+    REQUIRE_THROWS_AS(CFI("/6/4[chap01!/4"), CFI::InvalidCFI);
+}
+
+TEST_CASE("CFIs should keep the assertions on their final step", "")
+{
+    REQUIRE(CFI("/6/4[chap01]!/4/2[para05]").String() == "epubcfi(/6/4[chap01]!/4/2[para05])");
+    REQUIRE(CFI("/6/4[chap01]!/4/2[para05]") != CFI("/6/4[chap01]!/4/2"));
+    REQUIRE(CFI("/6/4!/4/2/1:10[yyy]").String() == "epubcfi(/6/4!/4/2/1:10[yyy])");
+    
+    // a text assertion at the very start of the text is still a text assertion
+    REQUIRE(CFI("/6/4!/4/2/1:0[,abc]").String() == "epubcfi(/6/4!/4/2/1:0[,abc])");
+    REQUIRE(CFI("/6/4!/4/2/1:0[,abc]") != CFI("/6/4!/4/2/1:0"));
+}
+
 TEST_CASE("Location CFIs should be appendable using valid CFIs and strings; Range CFIs should not", "")
 {
     CFI base("/6/4!");
@@ -89,3 +149,102 @@ TEST_CASE("Location and Range CFIs should be reassignable by CFI or string, even
     REQUIRE_NOTHROW(base = "/6/4!/4/3:5");
     REQUIRE_FALSE(base.IsRangeTriplet());
 }
+
+TEST_CASE("CFIs should survive a round trip through their binary form", "")
+{
+    const char* strings[] = {
+        "/6/4[chap01]!/4/52/3:22",
+        "/6/4[chap01]!/4[body01]/10[para05]/3:10",
+        "/6/14[chap05ref]!/4[body01]/10/2/1:3[2^[1^]]",
+        "/6/4[chap01]!/4/52,/3:22,/5:12",
+        "/6/4!/4/300/70000/3:100000",
+        "/6/4!/4/2~23.5@50:-50.5",
+        "/6/4[chap01]!",
+        u8"/6/16[夏目漱石]!/4/2/1:3",
+    };
+    for ( const char* str : strings )
+    {
+        CFI cfi(str);
+        std::vector<uint8_t> data = cfi.Encoded();
+        REQUIRE(data[0] == CFI::EncodingVersion);
+        REQUIRE(data.size() < cfi.String().utf8_size());
+        REQUIRE(CFI::Decode(data.data(), data.size()) == cfi);
+    }
+    
+    std::vector<uint8_t> data = CFI("/6/4[chap01]!/4/52/3:22").Encoded();
+    REQUIRE_THROWS_AS(CFI::Decode(data.data(), 0), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(CFI::Decode(data.data(), data.size() - 3), CFI::InvalidCFI);
+    data[0] = CFI::EncodingVersion + 1;
+    REQUIRE_THROWS_AS(CFI::Decode(data.data(), data.size()), CFI::InvalidCFI);
+}
+
+TEST_CASE("Binary CFIs should sort in document order, and share their container's prefix", "")
+{
+    // in the order they appear in the document
+    const char* strings[] = {
+        "/6/4!/4/2/1:0",
+        "/6/4!/4/2/1:9",
+        "/6/4!/4/2/1:240",
+        "/6/4!/4/2/1:70000",
+        "/6/4!/4/2/3:0",
+        "/6/4!/4/10/1:0",
+        "/6/4!/4/300",
+        "/6/4!/4/300/1:0",
+        "/6/6!/2",
+    };
+    std::vector<std::vector<uint8_t>> keys;
+    for ( const char* str : strings )
+        keys.push_back(CFI(str).Encoded());
+    REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+    
+    // every location and range within /4/2 starts with its key, less the terminator
+    std::vector<uint8_t> container = CFI("/6/4!/4/2").Encoded();
+    container.pop_back();
+    for ( const char* str : { "/6/4!/4/2/1:9", "/6/4!/4/2/3:0", "/6/4!/4/2,/1:0,/3:5", "/6/4!/4/2[x]/1:0" } )
+    {
+        std::vector<uint8_t> key = CFI(str).Encoded();
+        REQUIRE(std::equal(container.begin(), container.end(), key.begin()));
+    }
+}
+
+TEST_CASE("CFI copies should be independent, however many steps they hold", "")
+{
+    CFI deep("/6/4[chap01ref]!/4[body01]/10/2/4/6/8/10/12/14/16[para05]/3:10");
+    CFI copy(deep);
+    REQUIRE(copy == deep);
+    REQUIRE(copy.String() == deep.String());
+    
+    copy = CFI("/6/4!/4/2/1:0");
+    REQUIRE(deep.String() == "epubcfi(/6/4[chap01ref]!/4[body01]/10/2/4/6/8/10/12/14/16[para05]/3:10)");
+    
+    CFI moved(std::move(copy));
+    REQUIRE(moved == CFI("/6/4!/4/2/1:0"));
+    
+    moved = deep;
+    CFI& alias = moved;
+    moved = alias;
+    REQUIRE(moved == deep);
+}
+
+TEST_CASE("Copying a CFI should share its steps rather than allocate", "")
+{
+    CFI location("/6/4[chap01ref]!/4[body01]/10/2/4/6/3:10");
+    CFI range("/6/4[chap01ref]!/4[body01]/10,/2/4/6/3:10,/4/2/8/1:5");
+    
+    gAllocations = 0;
+    gCountAllocations = true;
+    CFI locationCopy(location);
+    CFI rangeCopy(range);
+    CFI assigned;
+    assigned = range;
+    gCountAllocations = false;
+    
+    REQUIRE(gAllocations.load() == 0);
+    REQUIRE(locationCopy == location);
+    REQUIRE(rangeCopy == range);
+    REQUIRE(assigned == range);
+    
+    // changing a copy detaches it, leaving the original alone
+    locationCopy.Append(CFI("/2/1:0"));
+    REQUIRE(location.String() == "epubcfi(/6/4[chap01ref]!/4[body01]/10/2/4/6/3:10)");
+}
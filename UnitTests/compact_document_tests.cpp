@@ -0,0 +1,149 @@
+//
+//  compact_document_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/xml/tree/compact_document.h"
+#include "test_documents.h"
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+using xml::CompactDocument;
+
+// checks names, attributes, content and CFI indices of an element and its descendants
+static void CompareTrees(const CompactDocument& compact, CompactDocument::NodeIndex node, xmlNodePtr xml)
+{
+    REQUIRE(compact.IsElement(node));
+    REQUIRE(std::string(compact.Name(node)) == reinterpret_cast<const char*>(xml->name));
+    
+    for ( xmlAttrPtr attr = xml->properties; attr != nullptr; attr = attr->next )
+    {
+        xmlChar* value = xmlNodeGetContent(reinterpret_cast<xmlNodePtr>(attr));
+        const char* nsURI = (attr->ns != nullptr ? reinterpret_cast<const char*>(attr->ns->href) : nullptr);
+        const char* compactValue = compact.Attribute(node, reinterpret_cast<const char*>(attr->name), nsURI);
+        REQUIRE(compactValue != nullptr);
+        REQUIRE(std::string(compactValue) == reinterpret_cast<const char*>(value));
+        xmlFree(value);
+    }
+    
+    CompactDocument::NodeIndex child = compact.FirstChild(node);
+    uint32_t elements = 0;
+    for ( xmlNodePtr xmlChild = xml->children; xmlChild != nullptr; xmlChild = xmlChild->next )
+    {
+        if ( xmlChild->type != XML_ELEMENT_NODE )
+            continue;
+        
+        while ( child != CompactDocument::NoNode && compact.IsText(child) )
+            child = compact.NextSibling(child);
+        REQUIRE(child != CompactDocument::NoNode);
+        REQUIRE(compact.Parent(child) == node);
+        
+        elements++;
+        REQUIRE(compact.CFIIndex(child) == elements * 2);
+        REQUIRE(compact.ChildAtCFIIndex(node, elements * 2) == child);
+        
+        CompareTrees(compact, child, xmlChild);
+        child = compact.NextSibling(child);
+    }
+}
+
+TEST_CASE("Compact documents merge character data as CFIs count it", "")
+{
+    CompactDocument doc = CompactFromString("<r xmlns:x='urn:x'>a<![CDATA[b]]><!--c-->d<e x:f='1' id='q'/>g<?pi?></r>");
+    
+    // <r>, "abd", <e>, "g"
+    REQUIRE(doc.NodeCount() == 4);
+    
+    size_t len = 0;
+    const char* text = doc.Text(doc.ChildAtCFIIndex(doc.Root(), 1), &len);
+    REQUIRE(std::string(text, len) == "abd");
+    
+    CompactDocument::NodeIndex e = doc.ChildAtCFIIndex(doc.Root(), 2);
+    REQUIRE(std::string(doc.Name(e)) == "e");
+    REQUIRE(std::string(doc.Attribute(e, "f", "urn:x")) == "1");
+    REQUIRE(doc.Attribute(e, "f") == nullptr);
+    REQUIRE(doc.ElementWithID("q") == e);
+    REQUIRE(doc.ElementWithID("r") == CompactDocument::NoNode);
+    
+    REQUIRE(doc.CFIIndex(doc.ChildAtCFIIndex(doc.Root(), 3)) == 3);
+    REQUIRE(doc.ChildAtCFIIndex(doc.Root(), 4) == CompactDocument::NoNode);
+    REQUIRE(doc.Content(doc.Root()) == "abdg");
+    REQUIRE(doc.Content(e).empty());
+}
+
+TEST_CASE("Compact documents convert text offsets between UTF-8, UTF-16 and code points", "")
+{
+    // "a😀b中😀😀c": 18 bytes, 10 UTF-16 code units, 7 code points
+    CompactDocument doc = CompactFromString("<r>a\xF0\x9F\x98\x80" "b\xE4\xB8\xAD\xF0\x9F\x98\x80\xF0\x9F\x98\x80" "c</r>");
+    typedef UTFOffsetMap::Unit Unit;
+    
+    CompactDocument::NodeIndex text = doc.FirstChild(doc.Root());
+    const UTFOffsetMap& map = doc.OffsetMap(text);
+    REQUIRE(&map == &doc.OffsetMap(text));
+    REQUIRE(map.Length(Unit::UTF8) == 18);
+    REQUIRE(map.Length(Unit::UTF16) == 10);
+    REQUIRE(map.Length(Unit::CodePoint) == 7);
+    
+    // the start of each code point
+    uint32_t bytes[] = { 0, 1, 5, 6, 9, 13, 17, 18 };
+    uint32_t utf16[] = { 0, 1, 3, 4, 5, 7, 9, 10 };
+    for ( uint32_t i = 0; i < 8; i++ )
+    {
+        REQUIRE(map.Convert(i, Unit::CodePoint, Unit::UTF8) == bytes[i]);
+        REQUIRE(map.Convert(i, Unit::CodePoint, Unit::UTF16) == utf16[i]);
+        REQUIRE(map.Convert(bytes[i], Unit::UTF8, Unit::CodePoint) == i);
+        REQUIRE(map.Convert(utf16[i], Unit::UTF16, Unit::UTF8) == bytes[i]);
+    }
+    
+    // offsets within a code point mean its start, and those past the end mean the end
+    REQUIRE(map.Convert(8, Unit::UTF16, Unit::CodePoint) == 5);
+    REQUIRE(map.Convert(11, Unit::UTF8, Unit::UTF16) == 5);
+    REQUIRE(map.Convert(100, Unit::UTF16, Unit::UTF8) == 18);
+    
+    // ASCII or single-script text needs no more than its start and end
+    REQUIRE(UTFOffsetMap("plain", 5).MemoryUsage() <= 2 * UTFOffsetMap().MemoryUsage());
+}
+
+TEST_CASE("Compact documents should match the documents they were built from", "")
+{
+    Container c(EPUB_PATH);
+    const ManifestItem* item = c.Packages()[0]->ManifestItemWithID("s04");
+    
+    xmlDocPtr doc = item->ReferencedDocument();
+    Auto<CompactDocument> compact(item->ReferencedCompactDocument());
+    REQUIRE(doc != nullptr);
+    REQUIRE(compact != nullptr);
+    
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    CompareTrees(*compact, compact->Root(), root);
+    
+    xmlChar* content = xmlNodeGetContent(root);
+    REQUIRE(compact->Content(compact->Root()) == reinterpret_cast<const char*>(content));
+    xmlFree(content);
+    
+    // the chapter's source is 330KB; libxml's tree is nearly three times that
+    REQUIRE(compact->MemoryUsage() < 512 * 1024);
+    
+    xmlFreeDoc(doc);
+}
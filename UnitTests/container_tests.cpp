@@ -20,6 +20,13 @@
 //
 
 #include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/utilities/crc32.h"
+#include <zlib.h>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <algorithm>
 #include "catch.hpp"
 
 using namespace ePub3;
@@ -50,3 +57,216 @@ TEST_CASE("", "Version should be 1.0")
     Container container(EPUB_PATH);
     REQUIRE(container.Version() == "1.0");
 }
+
+TEST_CASE("opening a container from memory", "A container should open from an in-memory archive")
+{
+    std::ifstream file(EPUB_PATH, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    REQUIRE(bytes.size() > 0);
+    
+    Archive* archive = Archive::Open(bytes.data(), bytes.size());
+    REQUIRE(archive != nullptr);
+    REQUIRE(archive->ContainsItem("META-INF/container.xml"));
+    
+    Container container(archive);
+    REQUIRE(container.Version() == "1.0");
+    REQUIRE(container.Packages().size() > 0);
+}
+
+TEST_CASE("writing to an in-memory archive", "Changes should be written back into the buffer when the archive is deleted")
+{
+    std::vector<uint8_t> bytes;
+    Archive* archive = Archive::Open(bytes);
+    REQUIRE(archive != nullptr);
+    
+    ArchiveWriter* writer = archive->WriterAtPath("test.txt");
+    REQUIRE(writer != nullptr);
+    REQUIRE(writer->write("hello", 5) == 5);
+    delete archive;
+    
+    REQUIRE(bytes.size() > 0);
+    
+    archive = Archive::Open(bytes.data(), bytes.size());
+    REQUIRE(archive != nullptr);
+    REQUIRE(archive->ContainsItem("test.txt"));
+    delete archive;
+}
+
+TEST_CASE("emptying an in-memory archive", "Deleting every item should leave the buffer empty")
+{
+    std::vector<uint8_t> bytes;
+    Archive* archive = Archive::Open(bytes);
+    REQUIRE(archive != nullptr);
+    REQUIRE(archive->WriterAtPath("test.txt")->write("hello", 5) == 5);
+    REQUIRE(archive->Close());
+    delete archive;
+    REQUIRE(bytes.size() > 0);
+    
+    std::vector<uint8_t> saved(bytes);
+    archive = Archive::Open(bytes);
+    REQUIRE(archive->Close());
+    REQUIRE(bytes == saved);        // unchanged, so not rewritten
+    delete archive;
+    
+    archive = Archive::Open(bytes);
+    REQUIRE(archive->DeleteItem("test.txt"));
+    REQUIRE(archive->Close());
+    REQUIRE(bytes.empty());
+    delete archive;
+}
+
+TEST_CASE("enumerating archive entries", "Every entry in the archive's directory should be listed")
+{
+    Auto<Archive> archive(Archive::Open(EPUB_PATH));
+    REQUIRE(archive.get() != nullptr);
+    
+    std::vector<std::string> paths;
+    for ( const ArchiveEntry& entry : archive->Entries() )
+    {
+        paths.push_back(entry.Path());
+        
+        ArchiveItemInfo info = archive->InfoAtPath(entry.Path());
+        REQUIRE(entry.uncompressedSize == info.UncompressedSize());
+        REQUIRE(entry.compressedSize == info.CompressedSize());
+        REQUIRE(entry.crc == info.CRC());
+        REQUIRE(entry.method == info.Method());
+    }
+    
+    REQUIRE(paths.size() == 8);
+    REQUIRE(paths[0] == "mimetype");
+    REQUIRE(std::find(paths.begin(), paths.end(), "EPUB/package.opf") != paths.end());
+}
+
+TEST_CASE("enumerating a modified archive", "Deleted entries should be skipped and added entries listed")
+{
+    std::vector<uint8_t> bytes;
+    Auto<Archive> archive(Archive::Open(bytes));
+    REQUIRE(archive.get() != nullptr);
+    REQUIRE((archive->Entries().begin() == archive->Entries().end()));
+    
+    archive->CreateFolder("one");
+    archive->CreateFolder("two");
+    archive->DeleteItem("one/");
+    
+    std::vector<std::string> paths;
+    for ( const ArchiveEntry& entry : archive->Entries() )
+        paths.push_back(entry.Path());
+    
+    REQUIRE(paths.size() == 1);
+    REQUIRE(paths[0] == "two/");
+}
+
+TEST_CASE("accelerated CRC32 matches zlib", "CRC32() should give the same results as zlib's crc32() for any alignment and length")
+{
+    std::vector<uint8_t> data(70000);
+    for ( size_t i = 0; i < data.size(); i++ )
+        data[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+    
+    for ( size_t offset = 0; offset < 16; offset++ )
+    {
+        for ( size_t len : {0, 1, 15, 16, 63, 64, 65, 127, 128, 4099, 65543} )
+        {
+            uint32_t expected = static_cast<uint32_t>(crc32(0, data.data() + offset, static_cast<uInt>(len)));
+            REQUIRE(CRC32(0, data.data() + offset, len) == expected);
+            
+            // running CRCs should work too
+            uint32_t running = CRC32(CRC32(0, data.data() + offset, len / 3), data.data() + offset + len / 3, len - len / 3);
+            REQUIRE(running == expected);
+        }
+    }
+}
+
+TEST_CASE("verifying an archive", "A corrupted entry should be reported by Verify() and refused in verify-on-read mode")
+{
+    std::ifstream file(EPUB_PATH, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    
+    Auto<Archive> archive(Archive::Open(bytes.data(), bytes.size()));
+    for ( bool parallel : {false, true} )
+    {
+        ArchiveVerificationReport report = archive->Verify(parallel);
+        REQUIRE(report.size() == 8);
+        for ( auto& result : report )
+        {
+            CAPTURE(result.path);
+            REQUIRE(result.status == ArchiveItemVerification::Valid);
+        }
+    }
+    
+    // flip a bit in the (stored) mimetype entry: local header, 8-byte name, then data
+    bytes[30 + 8 + 5] ^= 1;
+    archive.reset(Archive::Open(bytes.data(), bytes.size()));
+    
+    ArchiveVerificationReport report = archive->Verify();
+    REQUIRE(report[0].path == "mimetype");
+    REQUIRE(report[0].status == ArchiveItemVerification::CRCMismatch);
+    for ( size_t i = 1; i < report.size(); i++ )
+        REQUIRE(report[i].status == ArchiveItemVerification::Valid);
+    
+    archive->SetVerifiesReads(true);
+    REQUIRE(archive->ReaderAtPath("mimetype") == nullptr);
+    
+    Auto<ArchiveReader> reader(archive->ReaderAtPath("EPUB/package.opf"));
+    REQUIRE(reader.get() != nullptr);
+}
+
+TEST_CASE("verifying archives concurrently", "Simultaneous parallel verifications should share the worker pool and agree")
+{
+    std::ifstream file(EPUB_PATH, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    
+    std::vector<ArchiveVerificationReport> reports(4);
+    std::vector<std::thread> threads;
+    for ( size_t i = 0; i < reports.size(); i++ )
+    {
+        threads.emplace_back([&bytes, &reports, i]() {
+            Auto<Archive> archive(Archive::Open(bytes.data(), bytes.size()));
+            reports[i] = archive->Verify(true);
+        });
+    }
+    for ( auto& thread : threads )
+        thread.join();
+    
+    for ( auto& report : reports )
+    {
+        REQUIRE(report.size() == 8);
+        for ( auto& result : report )
+            REQUIRE(result.status == ArchiveItemVerification::Valid);
+    }
+}
+
+TEST_CASE("reading entries in place", "Stored and cached entries should expose their bytes without copying")
+{
+    std::ifstream file(EPUB_PATH, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    
+    Auto<Archive> archive(Archive::Open(bytes.data(), bytes.size()));
+    Auto<ArchiveReader> reader(archive->ReaderAtPath("mimetype"));
+    REQUIRE(reader.get() != nullptr);
+    
+    // a stored entry in an in-memory archive points into the caller's buffer
+    const void* data = nullptr;
+    size_t len = 0;
+    REQUIRE(reader->ContiguousData(&data, &len));
+    REQUIRE(len == 20);
+    REQUIRE(data > bytes.data());
+    REQUIRE(data < bytes.data() + bytes.size());
+    REQUIRE(std::string(reinterpret_cast<const char*>(data), len) == "application/epub+zip");
+    
+    // and the read position is honoured
+    char buf[12];
+    REQUIRE(reader->read(buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(reader->ContiguousData(&data, &len));
+    REQUIRE(std::string(reinterpret_cast<const char*>(data), len) == "epub+zip");
+    
+    // on disk, stored entries are mapped (or cached, when small)
+    archive.reset(Archive::Open(EPUB_PATH));
+    reader.reset(archive->ReaderAtPath("mimetype"));
+    REQUIRE(reader->ContiguousData(&data, &len));
+    REQUIRE(std::string(reinterpret_cast<const char*>(data), len) == "application/epub+zip");
+    
+    // small compressed entries come from the decompressed-entry cache
+    reader.reset(archive->ReaderAtPath("META-INF/container.xml"));
+    REQUIRE(reader->ContiguousData(&data, &len));
+    REQUIRE(len == 251);
+}
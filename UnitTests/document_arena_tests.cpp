@@ -0,0 +1,119 @@
+//
+//  document_arena_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "../ePub3/xml/utilities/document_arena.h"
+#include <libxml/globals.h>
+#include <libxml/parser.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "catch.hpp"
+
+using ePub3::xml::DocumentArena;
+
+static const std::string ArenaTestDocument("<root xmlns='urn:test'><p id='a'>one</p><p>two <b>three</b></p></root>");
+
+static xmlDocPtr ParseInArena()
+{
+    return DocumentArena::Parse([]() {
+        return xmlReadMemory(ArenaTestDocument.data(), static_cast<int>(ArenaTestDocument.size()), "test.xml", nullptr, 0);
+    });
+}
+
+// counts the nodes xmlFreeDoc() frees, which releasing an arena in one step doesn't visit
+static int gDeregistered = 0;
+static xmlDeregisterNodeFunc gNextDeregister = nullptr;
+static void CountDeregistered(xmlNodePtr node)
+{
+    gDeregistered++;
+    if ( gNextDeregister != nullptr )
+        gNextDeregister(node);
+}
+
+// frees the document, returning the number of nodes freed one by one
+static int NodesFreedReleasing(xmlDocPtr doc, std::function<void(xmlDocPtr)> release)
+{
+    gDeregistered = 0;
+    gNextDeregister = xmlDeregisterNodeDefault(&CountDeregistered);
+    release(doc);
+    xmlDeregisterNodeDefault(gNextDeregister);
+    return gDeregistered;
+}
+
+TEST_CASE("Arena documents should be released in one step", "")
+{
+    // UnitTests installs the allocator before anything else uses libxml
+    REQUIRE(DocumentArena::IsInstalled());
+    
+    xmlDocPtr doc = ParseInArena();
+    REQUIRE(doc != nullptr);
+    REQUIRE(DocumentArena::ForDocument(doc) != nullptr);
+    
+    // parsed nodes get their wrappers on demand
+    xmlNodePtr text = xmlDocGetRootElement(doc)->children->children;
+    REQUIRE(text->type == XML_TEXT_NODE);
+    REQUIRE(text->_private == nullptr);
+    
+    REQUIRE(NodesFreedReleasing(doc, DocumentArena::FreeDocument) == 0);
+}
+
+TEST_CASE("Modified arena documents should be freed node by node", "")
+{
+    std::vector<std::function<void(xmlDocPtr)>> changes = {
+        [](xmlDocPtr doc) {
+            xmlAddChild(xmlDocGetRootElement(doc), xmlNewDocNode(doc, nullptr, BAD_CAST "aside", BAD_CAST "four"));
+        },
+        [](xmlDocPtr doc) {
+            // a node with only familiar names has to be pointed out
+            xmlAddChild(xmlDocGetRootElement(doc), xmlNewDocNode(doc, nullptr, BAD_CAST "p", nullptr));
+            DocumentArena::MarkModified(doc);
+        },
+        [](xmlDocPtr doc) {
+            xmlNodeSetContent(xmlDocGetRootElement(doc)->children, BAD_CAST "replaced");
+        },
+        [](xmlDocPtr doc) {
+            xmlNodeAddContent(xmlDocGetRootElement(doc)->children->next->children, BAD_CAST "and a half ");
+        },
+        [](xmlDocPtr doc) {
+            xmlSetProp(xmlDocGetRootElement(doc)->children, BAD_CAST "class", BAD_CAST "first");
+        },
+    };
+    
+    for ( auto& change : changes )
+    {
+        xmlDocPtr doc = ParseInArena();
+        REQUIRE(DocumentArena::ForDocument(doc) != nullptr);
+        change(doc);
+        
+        // anything added lives on the heap, so the document must be freed through xmlFreeDoc()
+        REQUIRE(NodesFreedReleasing(doc, DocumentArena::FreeDocument) > 0);
+    }
+}
+
+TEST_CASE("Arena documents may be freed with xmlFreeDoc", "")
+{
+    xmlDocPtr doc = ParseInArena();
+    REQUIRE(DocumentArena::ForDocument(doc) != nullptr);
+    
+    // the arena goes with the document
+    REQUIRE(NodesFreedReleasing(doc, xmlFreeDoc) > 0);
+}
@@ -24,6 +24,7 @@
 #include "catch.hpp"
 #include "../ePub3/ePub/archive.h"
 #include "../ePub3/xml/utilities/io.h"
+#include "../ePub3/xml/utilities/document_arena.h"
 
 extern "C" void DumpXMLString(xmlNodePtr node)
 {
@@ -44,6 +45,8 @@ int main(int argc, char * const argv[])
     // global setup here
     //////////////////////////////////////
     
+    // before anything else uses libxml, so every test runs with document arenas
+    ePub3::xml::DocumentArena::InstallAllocator();
     ePub3::Archive::Initialize();
     
     int result = Catch::Main(argc, argv);
@@ -22,8 +22,15 @@
 #include "../ePub3/ePub/container.h"
 #include "../ePub3/ePub/package.h"
 #include "../ePub3/ePub/content_handler.h"
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/ePub/filter.h"
+#include "../ePub3/xml/utilities/document_arena.h"
+#include "../ePub3/xml/tree/compact_document.h"
 #include "catch.hpp"
 #include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <zlib.h>
 
 #define EPUB_PATH "TestData/childrens-literature-20120722.epub"
 #define BINDINGS_EPUB_PATH "TestData/widget-figure-gallery-20121022.epub"
@@ -136,3 +143,269 @@ TEST_CASE("Package should parse bindings correctly.", "")
     IRI target = handler->Target("test.xml", ContentHandler::ParameterList());
     REQUIRE(target.URIString() == _Str("epub3://", pkg->PackageID(), "/EPUB/figure-gallery-widget/figure-gallery-impl.xhtml?src=test.xml"));
 }
+
+static std::string ReadAll(ArchiveReader* reader)
+{
+    std::string result;
+    char buf[4096];
+    ssize_t num = 0;
+    while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+        result.append(buf, num);
+    return result;
+}
+
+TEST_CASE("Manifest items should provide raw DEFLATE data", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const ManifestItem* item = pkg->ManifestItemWithID("css");
+    REQUIRE(item != nullptr);
+    
+    Auto<ArchiveReader> raw(item->RawReader(c.EncryptionInfoForPath(item->AbsolutePath())));
+    REQUIRE(raw.get() != nullptr);
+    std::string compressed = ReadAll(raw.get());
+    
+    Auto<ArchiveReader> reader(item->Reader());
+    std::string expected = ReadAll(reader.get());
+    
+    // inflate it ourselves and compare
+    std::string inflated(expected.size(), '\0');
+    z_stream strm = {};
+    REQUIRE(inflateInit2(&strm, -MAX_WBITS) == Z_OK);
+    strm.next_in = reinterpret_cast<Bytef*>(&compressed[0]);
+    strm.avail_in = static_cast<uInt>(compressed.size());
+    strm.next_out = reinterpret_cast<Bytef*>(&inflated[0]);
+    strm.avail_out = static_cast<uInt>(inflated.size());
+    REQUIRE(inflate(&strm, Z_FINISH) == Z_STREAM_END);
+    inflateEnd(&strm);
+    
+    REQUIRE(inflated == expected);
+    
+    Auto<Archive> archive(Archive::Open(EPUB_PATH));
+    ArchiveItemInfo info = archive->InfoAtPath(item->AbsolutePath().stl_str());
+    REQUIRE(info.IsCompressed());
+    REQUIRE(info.Method() == ArchiveItemInfo::DeflateMethod);
+    REQUIRE(info.CompressedSize() == compressed.size());
+    REQUIRE(info.UncompressedSize() == expected.size());
+    REQUIRE(info.CRC() == crc32(0, reinterpret_cast<const Bytef*>(expected.data()), static_cast<uInt>(expected.size())));
+    
+    // with a gzip header and the stored CRC and size, it's a valid gzip stream
+    std::string gzipped("\x1f\x8b\x08\0\0\0\0\0\0\xff", 10);
+    gzipped += compressed;
+    for ( uint32_t word : {info.CRC(), static_cast<uint32_t>(info.UncompressedSize())} )
+    {
+        for ( int i = 0; i < 4; i++ )
+            gzipped += static_cast<char>((word >> (i * 8)) & 0xff);
+    }
+    std::string gunzipped(expected.size(), '\0');
+    strm = z_stream();
+    REQUIRE(inflateInit2(&strm, 16 + MAX_WBITS) == Z_OK);
+    strm.next_in = reinterpret_cast<Bytef*>(&gzipped[0]);
+    strm.avail_in = static_cast<uInt>(gzipped.size());
+    strm.next_out = reinterpret_cast<Bytef*>(&gunzipped[0]);
+    strm.avail_out = static_cast<uInt>(gunzipped.size());
+    REQUIRE(inflate(&strm, Z_FINISH) == Z_STREAM_END);
+    inflateEnd(&strm);
+    REQUIRE(gunzipped == expected);
+}
+
+class MatchAllFilter : public ContentFilter
+{
+public:
+    MatchAllFilter() : ContentFilter([](const ManifestItem*, const EncryptionInfo*) { return true; }) {}
+    virtual void * FilterData(void *data, size_t len, size_t *outputLen) { *outputLen = len; return data; }
+};
+
+TEST_CASE("Raw DEFLATE data should not be available when a filter applies", "")
+{
+    Container c(EPUB_PATH);
+    const ManifestItem* item = c.Packages()[0]->ManifestItemWithID("css");
+    REQUIRE(item != nullptr);
+    
+    MatchAllFilter filter;
+    REQUIRE(item->RawReader(nullptr, &filter) == nullptr);
+}
+
+TEST_CASE("Prefetching spine items should not disturb reading them", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const SpineItem* first = pkg->FirstSpineItem();
+    REQUIRE(first != nullptr);
+    
+    // the resource scan runs in the background, while the next item is read here
+    std::future<void> scan = pkg->PrefetchSpineItemsAfter(first, 2, true);
+    REQUIRE(scan.valid());
+    
+    const SpineItem* next = first->NextStep();
+    REQUIRE(next != nullptr);
+    xmlDocPtr doc = next->ManifestItem()->ReferencedDocument();
+    REQUIRE(doc != nullptr);
+    xmlFreeDoc(doc);
+    
+    scan.wait();
+}
+
+TEST_CASE("Package should read many manifest items in one pass", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    
+    std::vector<const ManifestItem*> items;
+    for ( auto pair : pkg->Manifest() )
+        items.push_back(pair.second);
+    
+    for ( bool parallel : {false, true} )
+    {
+        size_t count = 0;
+        pkg->ReadManifestItems(items, [&](const ManifestItem* item, std::vector<uint8_t>* data) {
+            REQUIRE(data != nullptr);
+            
+            Auto<ArchiveReader> reader(item->Reader());
+            std::string expected = ReadAll(reader.get());
+            REQUIRE(std::string(data->begin(), data->end()) == expected);
+            count++;
+        }, parallel);
+        
+        REQUIRE(count == items.size());
+    }
+}
+
+// converts a code point offset into UTF-8 text into a byte offset
+static size_t ByteOffset(const char* utf8, size_t len, uint32_t codePoints)
+{
+    size_t i = 0;
+    for ( ; i < len && codePoints > 0; codePoints-- )
+    {
+        i++;
+        while ( i < len && (utf8[i] & 0xC0) == 0x80 )
+            i++;
+    }
+    return i;
+}
+
+TEST_CASE("Extracted text runs should point at their text", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const ManifestItem* item = pkg->ManifestItemWithID("s04");
+    Auto<xml::CompactDocument> doc(item->ReferencedCompactDocument());
+    REQUIRE(doc != nullptr);
+    
+    size_t runs = 0;
+    TextExtractor::Result result = item->ExtractText([&](const TextRun& run) {
+        REQUIRE(!run.steps.empty());
+        REQUIRE(run.steps.back() % 2 == 1);
+        
+        xml::CompactDocument::NodeIndex node = doc->Root();
+        for ( uint32_t step : run.steps )
+        {
+            node = doc->ChildAtCFIIndex(node, step);
+            REQUIRE(node != xml::CompactDocument::NoNode);
+        }
+        REQUIRE(doc->IsText(node));
+        
+        size_t len = 0;
+        const char* text = doc->Text(node, &len);
+        size_t start = ByteOffset(text, len, run.offset);
+        REQUIRE(start + run.text.size() <= len);
+        REQUIRE(std::string(text + start, run.text.size()) == run.text);
+        
+        runs++;
+        return true;
+    });
+    
+    REQUIRE(result == TextExtractor::Result::Complete);
+    REQUIRE(runs > 1000);
+}
+
+TEST_CASE("Extracted text runs should only share a block within one", "")
+{
+    std::string doc("<html><body><p>one <em>two</em> three</p><p>four<br/>five</p><div>six <span>seven</span></div></body></html>");
+    std::vector<std::string> texts;
+    std::vector<uint32_t> blocks;
+    TextExtractor::Result result = TextExtractor::Extract(doc.data(), doc.size(), "test.xhtml", false, [&](const TextRun& run) {
+        texts.push_back(run.text);
+        blocks.push_back(run.block);
+        return true;
+    });
+    REQUIRE(result == TextExtractor::Result::Complete);
+    REQUIRE(texts == std::vector<std::string>({"one ", "two", " three", "four", "five", "six ", "seven"}));
+
+    // inline markup doesn't break a block; paragraphs, line breaks and divisions do
+    REQUIRE(blocks[0] == blocks[1]);
+    REQUIRE(blocks[1] == blocks[2]);
+    REQUIRE(blocks[2] != blocks[3]);
+    REQUIRE(blocks[3] != blocks[4]);
+    REQUIRE(blocks[4] != blocks[5]);
+    REQUIRE(blocks[5] == blocks[6]);
+
+    REQUIRE(TextExtractor::IsBlockElement(BAD_CAST "P"));
+    REQUIRE(TextExtractor::IsBlockElement(BAD_CAST "title"));
+    REQUIRE(!TextExtractor::IsBlockElement(BAD_CAST "span"));
+    REQUIRE(!TextExtractor::IsBlockElement(BAD_CAST "a"));
+}
+
+TEST_CASE("Package text extraction should visit the spine in order, and stop when asked", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    
+    std::vector<size_t> indices;
+    TextExtractor::Result result = pkg->ExtractText([&](const SpineItem* item, const TextRun& run) {
+        if ( indices.empty() || indices.back() != item->Index() )
+            indices.push_back(item->Index());
+        return true;
+    });
+    REQUIRE(result == TextExtractor::Result::Complete);
+    REQUIRE(indices.size() > 1);
+    REQUIRE(std::is_sorted(indices.begin(), indices.end()));
+    
+    size_t runs = 0;
+    result = pkg->ExtractText([&](const SpineItem* item, const TextRun& run) { return ++runs < 10; });
+    REQUIRE(result == TextExtractor::Result::Stopped);
+    REQUIRE(runs == 10);
+}
+
+// hidden: run explicitly with `UnitTests "./arena-benchmark/*"`
+TEST_CASE("./arena-benchmark/release", "Time taken to release 50 chapters, with and without document arenas")
+{
+    REQUIRE(xml::DocumentArena::IsInstalled());
+    
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const ManifestItem* item = pkg->ManifestItemWithID("s04");
+    string path = item->BaseHref();
+    
+    for ( bool arena : {false, true} )
+    {
+        std::vector<xmlDocPtr> chapters;
+        for ( int i = 0; i < 50; i++ )
+        {
+            if ( arena )
+            {
+                chapters.push_back(item->ReferencedDocument());
+                REQUIRE(xml::DocumentArena::ForDocument(chapters.back()) != nullptr);
+            }
+            else
+            {
+                Auto<ArchiveXmlReader> reader(pkg->XmlReaderForRelativePath(path));
+                chapters.push_back(reader->xmlReadDocument(path.c_str(), "utf-8", XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR));
+                REQUIRE(xml::DocumentArena::ForDocument(chapters.back()) == nullptr);
+            }
+        }
+        
+        if ( arena )
+        {
+            xml::DocumentArena::Statistics stats = xml::DocumentArena::ForDocument(chapters.front())->Stats();
+            std::cout << "one arena: " << stats.chunks << " chunks, " << stats.bytesReserved / 1024 << "KB reserved, " << stats.bytesUsed / 1024 << "KB used, " << stats.bytesFreed / 1024 << "KB freed in place, " << stats.allocations << " allocations" << std::endl;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        for ( xmlDocPtr doc : chapters )
+            xml::DocumentArena::FreeDocument(doc);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        
+        std::cout << (arena ? "arena documents: " : "heap documents: ") << elapsed.count() << "ms to release" << std::endl;
+    }
+}
@@ -0,0 +1,157 @@
+//
+//  reading_progress_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/reading_progress.h"
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/ePub/cfi_resolver.h"
+#include "test_documents.h"
+#include <fstream>
+#include <iterator>
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+
+TEST_CASE("Reading progress should weight spine items by their size", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    ReadingProgress progress(pkg);
+    
+    size_t count = 0;
+    for ( const SpineItem* item = pkg->FirstSpineItem(); item != nullptr; item = item->Next() )
+        count++;
+    REQUIRE(progress.SpineCount() == count);
+    REQUIRE(progress.TotalWeight() > 0);
+    
+    // each item starts where the last ended, and its CFI is placed at its start
+    double previous = 0.0;
+    size_t index = 0;
+    for ( const SpineItem* item = pkg->FirstSpineItem(); item != nullptr; item = item->Next(), index++ )
+    {
+        double fraction = progress.Fraction(pkg->CFIForSpineItem(item));
+        REQUIRE(fraction == progress.Fraction(index));
+        REQUIRE(fraction >= previous);
+        previous = fraction;
+        
+        if ( progress.Weight(index) == 0 )
+            continue;
+        ReadingProgress::Position position = progress.PositionAt(progress.Fraction(index, 0.5));
+        REQUIRE(position.spineIndex == index);
+        REQUIRE(position.withinItem == Approx(0.5));
+        REQUIRE(progress.CFIAt(progress.Fraction(index, 0.5)) == pkg->CFIForSpineItem(item));
+    }
+    REQUIRE(progress.Fraction(0) == 0.0);
+    REQUIRE(progress.PositionAt(1.0).withinItem == 1.0);
+    
+    REQUIRE_THROWS_AS(progress.Fraction(CFI("/4/2!/4")), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(progress.Fraction(CFI("/6/6[nope]!/4")), CFI::InvalidCFI);
+    REQUIRE_THROWS_AS(progress.Fraction(count), std::out_of_range);
+}
+
+TEST_CASE("Reading progress by characters should place CFIs within their spine items", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    ReadingProgress progress(pkg, ReadingProgress::Weighting::Characters);
+    REQUIRE(progress.TotalWeight() > 0);
+    
+    // "SECTION IV", eight characters in
+    CFI cfi("epubcfi(/6/6[s04]!/4/2[pgepubid00492]/4/1:8)");
+    double fraction = progress.Fraction(cfi);
+    size_t index = progress.SpineIndexForCFI(cfi);
+    REQUIRE(fraction > progress.Fraction(index));
+    REQUIRE(fraction < progress.Fraction(index, 1.0));
+    REQUIRE(progress.CFIAt(fraction).String() == "epubcfi(/6/6[s04]!/4/2/4/1:8)");
+    
+    // scrubbing through the book lands on CFIs which lead back, in order
+    double previous = 0.0;
+    for ( int i = 0; i <= 200; i++ )
+    {
+        double target = i / 200.0;
+        CFI location = progress.CFIAt(target);
+        double actual = progress.Fraction(location);
+        REQUIRE(actual >= previous);
+        REQUIRE(actual == Approx(target).epsilon(1.0 / progress.TotalWeight() + 1e-9));
+        previous = actual;
+    }
+}
+
+TEST_CASE("Reading progress should give spine items missing from the archive no weight", "")
+{
+    std::ifstream file(EPUB_PATH, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Archive* archive = Archive::Open(bytes);
+    REQUIRE(archive->DeleteItem("EPUB/s04.xhtml"));
+    
+    Container c(archive);
+    Package* pkg = c.Packages()[0];
+    for ( ReadingProgress::Weighting weighting : {ReadingProgress::Weighting::ArchiveSize, ReadingProgress::Weighting::Characters} )
+    {
+        ReadingProgress progress(pkg, weighting);
+        REQUIRE(progress.SpineCount() == 3);
+        REQUIRE(progress.Weight(2) == 0);
+        REQUIRE(progress.TotalWeight() > 0);
+        REQUIRE(progress.PositionAt(1.0).spineIndex < 2);
+    }
+}
+
+TEST_CASE("Reading progress should count character offsets in the unit it's given", "")
+{
+    // "x😀 moon": the `m` is code point 3, or UTF-16 unit 4
+    std::vector<uint8_t> bytes;
+    Container c(SingleChapterArchive(bytes, "<p>x\xF0\x9F\x98\x80 moon</p>"));
+    const Package* pkg = c.DefaultPackage();
+    REQUIRE(pkg != nullptr);
+    
+    ReadingProgress codePoints(pkg, ReadingProgress::Weighting::Characters);
+    ReadingProgress utf16(pkg, ReadingProgress::Weighting::Characters, UTFOffsetMap::Unit::UTF16);
+    REQUIRE(codePoints.OffsetUnit() == UTFOffsetMap::Unit::CodePoint);
+    REQUIRE(utf16.OffsetUnit() == UTFOffsetMap::Unit::UTF16);
+    REQUIRE(utf16.TotalWeight() == codePoints.TotalWeight());
+    
+    // the same character, in each unit, is the same distance through
+    TextPattern pattern("moon", TextPattern::Literal);
+    CFI moonInCodePoints = pkg->FindText(pattern, 1)[0];
+    CFI moonInUTF16 = pkg->FindText(pattern, 1, UTFOffsetMap::Unit::UTF16)[0];
+    double fraction = codePoints.Fraction(moonInCodePoints);
+    REQUIRE(fraction > 0.0);
+    REQUIRE(utf16.Fraction(moonInUTF16) == fraction);
+    REQUIRE(codePoints.Fraction(moonInUTF16) != fraction);
+    
+    // and leads back to it
+    CFI location = utf16.CFIAt(fraction);
+    REQUIRE_FALSE(location == codePoints.CFIAt(fraction));
+    REQUIRE(utf16.Fraction(location) == Approx(fraction));
+    
+    CFI remainder;
+    const ManifestItem* item = pkg->ManifestItemForCFI(location, &remainder);
+    REQUIRE(item != nullptr);
+    Auto<xml::CompactDocument> doc(item->ReferencedCompactDocument());
+    REQUIRE(doc != nullptr);
+    CFIResolver::Resolution result = CFIResolver(*doc, UTFOffsetMap::Unit::UTF16).Resolve(remainder);
+    REQUIRE(result.start.characterOffset == 3);
+}
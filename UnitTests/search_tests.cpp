@@ -0,0 +1,285 @@
+//
+//  search_tests.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/search_index.h"
+#include "../ePub3/ePub/text_pattern.h"
+#include "../ePub3/ePub/cfi_resolver.h"
+#include "test_documents.h"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+
+TEST_CASE("Search terms should be folded to lower case, with code point offsets", "")
+{
+    std::vector<std::pair<std::string, uint32_t>> terms;
+    SearchIndex::Tokenize("Hello, WORLD\xE2\x80\x94" "caf\xC3\x89 x2", [&](const std::string& term, uint32_t offset) {
+        terms.emplace_back(term, offset);
+    });
+    
+    REQUIRE(terms.size() == 4);
+    REQUIRE(terms[0].first == "hello");
+    REQUIRE(terms[1].first == "world");
+    REQUIRE(terms[2].first == "caf\xC3\xA9");
+    REQUIRE(terms[2].second == 13);
+    REQUIRE(terms[3].first == "x2");
+}
+
+TEST_CASE("CJK text should be split into characters and pairs, and long terms cut short", "")
+{
+    std::vector<std::pair<std::string, uint32_t>> terms;
+    auto collect = [&](const std::string& term, uint32_t offset) { terms.emplace_back(term, offset); };
+
+    // "A東京都b": one Latin term either side
+    SearchIndex::Tokenize("A\xE6\x9D\xB1\xE4\xBA\xAC\xE9\x83\xBD" "b", collect);
+    REQUIRE(terms.size() == 7);
+    REQUIRE(terms[0] == std::make_pair(std::string("a"), 0u));
+    REQUIRE(terms[1] == std::make_pair(std::string("\xE6\x9D\xB1"), 1u));
+    REQUIRE(terms[2] == std::make_pair(std::string("\xE6\x9D\xB1\xE4\xBA\xAC"), 1u));
+    REQUIRE(terms[3] == std::make_pair(std::string("\xE4\xBA\xAC"), 2u));
+    REQUIRE(terms[4] == std::make_pair(std::string("\xE4\xBA\xAC\xE9\x83\xBD"), 2u));
+    REQUIRE(terms[5] == std::make_pair(std::string("\xE9\x83\xBD"), 3u));
+    REQUIRE(terms[6] == std::make_pair(std::string("b"), 4u));
+
+    terms.clear();
+    SearchIndex::Tokenize(std::string(63, 'x') + "\xC3\xA9" + "yz end", collect);
+    REQUIRE(terms.size() == 2);
+    REQUIRE(terms[0].first == std::string(63, 'x'));
+    REQUIRE(terms[1] == std::make_pair(std::string("end"), 67u));
+}
+
+TEST_CASE("Search indexes should match within blocks, across inline markup", "")
+{
+    // the emoji takes two UTF-16 units
+    std::string doc("<html><body><p>A \xF0\x9F\x98\x80 fan<em>tas</em>tic little <b>bear</b></p><p>bear one</p><p>little two</p></body></html>");
+    SearchIndex::Builder builder("test");
+    TextExtractor::Extract(doc.data(), doc.size(), "test.xhtml", false, [&](const TextRun& run) {
+        builder.AddRun(0, run);
+        return true;
+    });
+    Auto<SearchIndex> index(builder.Finish());
+
+    std::vector<SearchIndex::Match> matches = index->Query("fantastic", 10);
+    REQUIRE(matches.size() == 1);
+    REQUIRE(matches[0].steps == std::vector<uint32_t>({2, 2, 1}));
+    REQUIRE(matches[0].offset == 5);
+
+    // reported at the first term
+    matches = index->Query("little bear", 10);
+    REQUIRE(matches.size() == 1);
+    REQUIRE(matches[0].steps == std::vector<uint32_t>({2, 2, 3}));
+    REQUIRE(matches[0].offset == 4);
+
+    REQUIRE(index->Query("bear", 10).size() == 2);
+    REQUIRE(index->Query("one two", 10).empty());
+}
+
+TEST_CASE("Package search should return ranked CFIs", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    
+    Auto<SearchIndex> index(pkg->BuildSearchIndex());
+    REQUIRE(index != nullptr);
+    REQUIRE(index->Identifier() == pkg->UniqueID().stl_str());
+    REQUIRE(index->TermCount() > 1000);
+    
+    std::vector<Package::SearchHit> hits = pkg->Search(index.get(), "the Moon", 10);
+    REQUIRE(!hits.empty());
+    REQUIRE(hits.size() <= 10);
+    for ( size_t i = 1; i < hits.size(); i++ )
+        REQUIRE(hits[i-1].score >= hits[i].score);
+    
+    // each hit lies within a spine item's document
+    CFI remainder;
+    CFI location = hits[0].location;
+    REQUIRE(pkg->ManifestItemForCFI(location, &remainder) != nullptr);
+    REQUIRE(!remainder.Empty());
+    
+    REQUIRE(pkg->Search(index.get(), "the zzzqqq", 10).empty());
+}
+
+// a fresh directory for index files, removed along with `file` when done
+struct TemporaryDirectory
+{
+    std::string path;
+    std::string file;
+    
+    TemporaryDirectory(const std::string& name) {
+        const char* tmp = std::getenv("TMPDIR");
+        std::string pattern = std::string(tmp != nullptr && *tmp != '\0' ? tmp : "/tmp") + "/epub3-search-XXXXXX";
+        std::vector<char> buf(pattern.begin(), pattern.end());
+        buf.push_back('\0');
+        if ( mkdtemp(buf.data()) != nullptr )
+            path = buf.data();
+        file = path + "/" + name;
+    }
+    ~TemporaryDirectory() {
+        std::remove(file.c_str());
+        rmdir(path.c_str());
+    }
+};
+
+TEST_CASE("Search indexes should be saved and reloaded", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    TemporaryDirectory tmp("childrens-literature.searchindex");
+    REQUIRE(!tmp.path.empty());
+    
+    Auto<SearchIndex> built(pkg->LoadSearchIndex(tmp.file));
+    REQUIRE(built != nullptr);
+    
+    Auto<SearchIndex> opened(SearchIndex::Open(tmp.file));
+    REQUIRE(opened != nullptr);
+    REQUIRE(opened->Size() == built->Size());
+    
+    std::vector<Package::SearchHit> a = pkg->Search(built.get(), "little bear", 20);
+    std::vector<Package::SearchHit> b = pkg->Search(opened.get(), "little bear", 20);
+    REQUIRE(a.size() == b.size());
+    for ( size_t i = 0; i < a.size(); i++ )
+        REQUIRE(a[i].location == b[i].location);
+}
+
+TEST_CASE("Saved search indexes should be rebuilt when a chapter changes", "")
+{
+    TemporaryDirectory tmp("single-chapter.searchindex");
+    REQUIRE(!tmp.path.empty());
+    
+    // same identifier, no modification date to tell them apart
+    std::vector<uint8_t> before, after;
+    Container original(SingleChapterArchive(before, "<p>Goodnight moon.</p>"));
+    Container edited(SingleChapterArchive(after, "<p>Goodnight room.</p>"));
+    REQUIRE(original.DefaultPackage()->UniqueID() == edited.DefaultPackage()->UniqueID());
+    
+    Auto<SearchIndex> stale(original.DefaultPackage()->LoadSearchIndex(tmp.file));
+    REQUIRE(stale != nullptr);
+    REQUIRE(original.DefaultPackage()->Search(stale.get(), "moon", 10).size() == 1);
+    
+    Auto<SearchIndex> rebuilt(edited.DefaultPackage()->LoadSearchIndex(tmp.file));
+    REQUIRE(rebuilt != nullptr);
+    REQUIRE(rebuilt->Identifier() != stale->Identifier());
+    REQUIRE(edited.DefaultPackage()->Search(rebuilt.get(), "moon", 10).empty());
+    REQUIRE(edited.DefaultPackage()->Search(rebuilt.get(), "room", 10).size() == 1);
+    
+    // and the rebuilt index replaced the saved one
+    Auto<SearchIndex> reopened(SearchIndex::Open(tmp.file));
+    REQUIRE(reopened != nullptr);
+    REQUIRE(reopened->Identifier() == rebuilt->Identifier());
+}
+
+static std::vector<std::pair<size_t, size_t>> FindAll(const TextPattern& pattern, const std::string& text)
+{
+    std::vector<uint32_t> codePoints;
+    TextPattern::AppendCodePoints(text, codePoints);
+    
+    std::vector<std::pair<size_t, size_t>> matches;
+    pattern.FindAll(codePoints.data(), codePoints.size(), [&](size_t start, size_t end) {
+        matches.emplace_back(start, end);
+        return true;
+    });
+    return matches;
+}
+
+TEST_CASE("Text patterns should match leftmost-first, without overlapping", "")
+{
+    typedef std::vector<std::pair<size_t, size_t>> Matches;
+    
+    REQUIRE(FindAll(TextPattern("a{2,3}"), "aaaaaaa") == Matches({{0, 3}, {3, 6}}));
+    REQUIRE(FindAll(TextPattern("a{2,3}?"), "aaaaa") == Matches({{0, 2}, {2, 4}}));
+    REQUIRE(FindAll(TextPattern("(a|ab)(c|bcd)"), "abcd") == Matches({{0, 4}}));
+    REQUIRE(FindAll(TextPattern("\\bthe\\b"), "the other theme, the") == Matches({{0, 3}, {17, 20}}));
+    REQUIRE(FindAll(TextPattern("caf\\u00e9", TextPattern::CaseInsensitive), "caf\xC3\xA9 CAF\xC3\x89") == Matches({{0, 4}, {5, 9}}));
+    REQUIRE(FindAll(TextPattern("x*"), "aaa").empty());
+    
+    // literal whitespace matches any whitespace
+    REQUIRE(FindAll(TextPattern("a.c d", TextPattern::Literal), "abc d a.c\n\td") == Matches({{6, 12}}));
+    
+    REQUIRE_THROWS_AS(TextPattern(""), std::invalid_argument);
+    REQUIRE_THROWS_AS(TextPattern("(a"), std::invalid_argument);
+    REQUIRE_THROWS_AS(TextPattern("[a-"), std::invalid_argument);
+    REQUIRE_THROWS_AS(TextPattern("a**"), std::invalid_argument);
+    REQUIRE_THROWS_AS(TextPattern("a{1000}"), std::invalid_argument);
+}
+
+TEST_CASE("Package text search should return range CFIs in spine order", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    
+    std::vector<CFI> hits = pkg->FindText(TextPattern("the moon", TextPattern::Literal|TextPattern::CaseInsensitive), 10);
+    REQUIRE(hits.size() == 10);
+    for ( CFI& hit : hits )
+    {
+        REQUIRE(hit.IsRangeTriplet());
+        
+        CFI remainder;
+        REQUIRE(pkg->ManifestItemForCFI(hit, &remainder) != nullptr);
+    }
+    
+    // stopping early gives the same first hits
+    std::vector<CFI> first = pkg->FindText(TextPattern("the moon", TextPattern::Literal|TextPattern::CaseInsensitive), 3);
+    REQUIRE(first.size() == 3);
+    for ( size_t i = 0; i < first.size(); i++ )
+        REQUIRE(first[i] == hits[i]);
+    
+    REQUIRE(pkg->FindText(TextPattern("zzz+qqq"), 10).empty());
+}
+
+TEST_CASE("Package text search should count offsets in the unit the resolver uses", "")
+{
+    // "x😀 moon": the match starts at code point 3, or UTF-16 unit 4
+    std::vector<uint8_t> bytes;
+    Container c(SingleChapterArchive(bytes, "<p>x\xF0\x9F\x98\x80 moon</p>"));
+    const Package* pkg = c.DefaultPackage();
+    REQUIRE(pkg != nullptr);
+    
+    TextPattern pattern("moon", TextPattern::Literal);
+    REQUIRE(pkg->FindText(pattern, 10) == pkg->FindText(pattern, 10, UTFOffsetMap::Unit::CodePoint));
+    
+    for ( UTFOffsetMap::Unit unit : {UTFOffsetMap::Unit::CodePoint, UTFOffsetMap::Unit::UTF16} )
+    {
+        std::vector<CFI> hits = pkg->FindText(pattern, 10, unit);
+        REQUIRE(hits.size() == 1);
+        
+        CFI remainder;
+        const ManifestItem* item = pkg->ManifestItemForCFI(hits[0], &remainder);
+        REQUIRE(item != nullptr);
+        Auto<xml::CompactDocument> doc(item->ReferencedCompactDocument());
+        REQUIRE(doc != nullptr);
+        
+        // resolved locations always count code points
+        CFIResolver::Resolution result = CFIResolver(*doc, unit).Resolve(remainder);
+        REQUIRE(result.isRange);
+        REQUIRE(result.start.characterOffset == 3);
+        REQUIRE(result.end.characterOffset == 7);
+    }
+    
+    // the surrogate pair shifts the UTF-16 offsets by one
+    REQUIRE_FALSE(pkg->FindText(pattern, 10, UTFOffsetMap::Unit::UTF16)[0] == pkg->FindText(pattern, 10)[0]);
+}
@@ -0,0 +1,75 @@
+//
+//  test_documents.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3_UnitTests_test_documents__
+#define __ePub3_UnitTests_test_documents__
+
+#include "../ePub3/xml/tree/compact_document.h"
+#include "../ePub3/ePub/archive.h"
+#include <libxml/parser.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "catch.hpp"
+
+// parses a document from a string, keeping only its compact form
+static inline ePub3::xml::CompactDocument CompactFromString(const std::string& str)
+{
+    xmlDocPtr doc = xmlReadMemory(str.data(), static_cast<int>(str.size()), "test.xml", nullptr, 0);
+    REQUIRE(doc != nullptr);
+    ePub3::xml::CompactDocument result(doc);
+    xmlFreeDoc(doc);
+    return result;
+}
+
+// builds a one-chapter EPUB in memory, whose body is `body`
+static inline ePub3::Archive* SingleChapterArchive(std::vector<uint8_t>& bytes, const std::string& body)
+{
+    std::map<std::string, std::string> files = {
+        {"META-INF/container.xml",
+            "<?xml version=\"1.0\"?>\n"
+            "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\"><rootfiles>"
+            "<rootfile full-path=\"EPUB/package.opf\" media-type=\"application/oebps-package+xml\"/>"
+            "</rootfiles></container>\n"},
+        {"EPUB/package.opf",
+            "<?xml version=\"1.0\"?>\n"
+            "<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"3.0\" unique-identifier=\"uid\">"
+            "<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\"><dc:identifier id=\"uid\">urn:test:single-chapter</dc:identifier>"
+            "<dc:title>Single Chapter</dc:title><dc:language>en</dc:language></metadata>"
+            "<manifest><item id=\"c1\" href=\"c1.xhtml\" media-type=\"application/xhtml+xml\"/></manifest>"
+            "<spine><itemref idref=\"c1\"/></spine></package>\n"},
+        {"EPUB/c1.xhtml",
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>One</title></head><body>" + body + "</body></html>\n"},
+    };
+    
+    ePub3::Archive* archive = ePub3::Archive::Open(bytes);
+    for ( auto& file : files )
+    {
+        ePub3::ArchiveWriter* writer = archive->WriterAtPath(file.first);
+        writer->write(file.second.data(), file.second.size());
+    }
+    delete archive;     // writes the archive into bytes
+    
+    return ePub3::Archive::Open(bytes.data(), bytes.size());
+}
+
+#endif
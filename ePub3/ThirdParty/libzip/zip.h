@@ -180,6 +180,8 @@ struct zip_source;
 ZIP_EXTERN int zip_add(struct zip *, const char *, struct zip_source *);
 ZIP_EXTERN int zip_add_dir(struct zip *, const char *);
 ZIP_EXTERN int zip_close(struct zip *);
+ZIP_EXTERN int zip_close_filep(struct zip *, FILE *);
+ZIP_EXTERN void zip_discard(struct zip *);
 ZIP_EXTERN int zip_delete(struct zip *, int);
 ZIP_EXTERN void zip_error_clear(struct zip *);
 ZIP_EXTERN void zip_error_get(struct zip *, int *, int *);
@@ -199,6 +201,7 @@ ZIP_EXTERN const char *zip_get_name(struct zip *, int, int);
 ZIP_EXTERN int zip_get_num_files(struct zip *);
 ZIP_EXTERN int zip_name_locate(struct zip *, const char *, int);
 ZIP_EXTERN struct zip *zip_open(const char *, int, int *);
+ZIP_EXTERN struct zip *zip_open_filep(FILE *, int, int *);
 ZIP_EXTERN int zip_rename(struct zip *, int, const char *);
 ZIP_EXTERN int zip_replace(struct zip *, int, struct zip_source *);
 ZIP_EXTERN int zip_set_archive_comment(struct zip *, const char *, int);
@@ -55,6 +55,7 @@ static int write_cdir(struct zip *, struct zip_cdir *, FILE *);
 static int _zip_cdir_set_comment(struct zip_cdir *, struct zip *);
 static int _zip_changed(struct zip *, int *);
 static char *_zip_create_temp_output(struct zip *, FILE **);
+static int _zip_write_archive(struct zip *, int, FILE *);
 static int _zip_torrentzip_cmp(const void *, const void *);
 
 
@@ -70,15 +71,10 @@ ZIP_EXTERN int
 zip_close(struct zip *za)
 {
     int survivors;
-    int i, j, error;
     char *temp;
     FILE *out;
     mode_t mask;
-    struct zip_cdir *cd;
-    struct zip_dirent de;
-    struct filelist *filelist;
     int reopen_on_error;
-    int new_torrentzip;
     
     reopen_on_error = 0;
     
@@ -102,6 +98,118 @@ zip_close(struct zip *za)
         return 0;
     }
     
+    /* archives opened through zip_open_filep() have no file name */
+    if (za->zn == NULL) {
+        _zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    
+    if ((temp=_zip_create_temp_output(za, &out)) == NULL)
+        return -1;
+    
+    if (_zip_write_archive(za, survivors, out) < 0) {
+        fclose(out);
+        remove(temp);
+        free(temp);
+        return -1;
+    }
+    
+    if (fclose(out) != 0) {
+        _zip_error_set(&za->error, ZIP_ER_CLOSE, errno);
+        remove(temp);
+        free(temp);
+        return -1;
+    }
+    
+    if (za->zp) {
+        fclose(za->zp);
+        za->zp = NULL;
+        reopen_on_error = 1;
+    }
+    if (_zip_rename(temp, za->zn) != 0) {
+        _zip_error_set(&za->error, ZIP_ER_RENAME, errno);
+        remove(temp);
+        free(temp);
+        if (reopen_on_error) {
+            /* ignore errors, since we're already in an error case */
+            za->zp = fopen(za->zn, "rb");
+        }
+        return -1;
+    }
+    mask = umask(0);
+    umask(mask);
+    chmod(za->zn, 0666&~mask);
+    
+    _zip_free(za);
+    free(temp);
+    
+    return 0;
+}
+
+
+
+/* zip_close_filep:
+   like zip_close, but the updated archive is written to `out' instead
+   of replacing the file the archive was opened from.  Returns 1,
+   writing nothing, if the archive is unchanged, and 0 once the
+   changes are written; nothing is written if no entries are left.
+   `out' must be seekable; it is neither flushed nor closed. */
+
+ZIP_EXTERN int
+zip_close_filep(struct zip *za, FILE *out)
+{
+    int survivors;
+    
+    if (za == NULL)
+        return -1;
+    
+    if (out == NULL) {
+        _zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    
+    if (!_zip_changed(za, &survivors)) {
+        _zip_free(za);
+        return 1;
+    }
+    
+    if (survivors == 0) {
+        _zip_free(za);
+        return 0;
+    }
+    
+    if (_zip_write_archive(za, survivors, out) < 0)
+        return -1;
+    
+    _zip_free(za);
+    return 0;
+}
+
+
+
+/* zip_discard:
+   closes the archive, throwing away any changes. */
+
+ZIP_EXTERN void
+zip_discard(struct zip *za)
+{
+    if (za == NULL)
+        return;
+    
+    _zip_free(za);
+}
+
+
+
+static int
+_zip_write_archive(struct zip *za, int survivors, FILE *out)
+{
+    int i, j, error;
+    struct zip_cdir *cd;
+    struct zip_dirent de;
+    struct filelist *filelist;
+    int new_torrentzip;
+    
     if ((filelist=(struct filelist *)malloc(sizeof(filelist[0])*survivors))
         == NULL)
         return -1;
@@ -134,13 +242,6 @@ zip_close(struct zip *za)
         }
     }
     
-    if ((temp=_zip_create_temp_output(za, &out)) == NULL) {
-        _zip_cdir_free(cd);
-        free(filelist);
-        return -1;
-    }
-    
-    
     /* create list of files with index into original archive  */
     for (i=j=0; i<za->nentry; i++) {
         if (za->entry[i].state == ZIP_ST_DELETED)
@@ -282,41 +383,9 @@ zip_close(struct zip *za)
     
     if (error) {
         _zip_dirent_finalize(&de);
-        fclose(out);
-        remove(temp);
-        free(temp);
         return -1;
     }
     
-    if (fclose(out) != 0) {
-        _zip_error_set(&za->error, ZIP_ER_CLOSE, errno);
-        remove(temp);
-        free(temp);
-        return -1;
-    }
-    
-    if (za->zp) {
-        fclose(za->zp);
-        za->zp = NULL;
-        reopen_on_error = 1;
-    }
-    if (_zip_rename(temp, za->zn) != 0) {
-        _zip_error_set(&za->error, ZIP_ER_RENAME, errno);
-        remove(temp);
-        free(temp);
-        if (reopen_on_error) {
-            /* ignore errors, since we're already in an error case */
-            za->zp = fopen(za->zn, "rb");
-        }
-        return -1;
-    }
-    mask = umask(0);
-    umask(mask);
-    chmod(za->zn, 0666&~mask);
-    
-    _zip_free(za);
-    free(temp);
-    
     return 0;
 }
 
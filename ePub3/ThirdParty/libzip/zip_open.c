@@ -44,6 +44,7 @@
 
 static void set_error(int *, struct zip_error *, int);
 static struct zip *_zip_allocate_new(const char *, int *);
+static struct zip *_zip_open(const char *, FILE *, int, int *);
 static int _zip_checkcons(FILE *, struct zip_cdir *, struct zip_error *);
 static void _zip_check_torrentzip(struct zip *);
 static struct zip_cdir *_zip_find_central_dir(FILE *, int, int *, off_t);
@@ -61,10 +62,6 @@ ZIP_EXTERN struct zip *
 zip_open(const char *fn, int flags, int *zep)
 {
     FILE *fp;
-    struct zip *za;
-    struct zip_cdir *cdir;
-    int i;
-    off_t len;
     
     switch (_zip_file_exists(fn, flags, zep)) {
     case -1:
@@ -80,6 +77,39 @@ zip_open(const char *fn, int flags, int *zep)
 	return NULL;
     }
 
+    return _zip_open(fn, fp, flags, zep);
+}
+
+
+
+/* zip_open_filep:
+   opens an archive from an already-open, seekable stream, such as one
+   returned by fmemopen() or funopen().  The archive takes ownership of
+   `fp' and closes it when the archive is freed, or immediately if the
+   open fails.  Such an archive has no file name, so it can only be
+   written out through zip_close_filep(). */
+
+ZIP_EXTERN struct zip *
+zip_open_filep(FILE *fp, int flags, int *zep)
+{
+    if (fp == NULL) {
+	set_error(zep, NULL, ZIP_ER_INVAL);
+	return NULL;
+    }
+
+    return _zip_open(NULL, fp, flags, zep);
+}
+
+
+
+static struct zip *
+_zip_open(const char *fn, FILE *fp, int flags, int *zep)
+{
+    struct zip *za;
+    struct zip_cdir *cdir;
+    int i;
+    off_t len;
+
     fseeko(fp, 0, SEEK_END);
     len = ftello(fp);
 
@@ -122,7 +152,7 @@ zip_open(const char *fn, int flags, int *zep)
     return za;
 }
 
-
+
 
 static void
 set_error(int *zep, struct zip_error *err, int ze)
@@ -428,6 +458,9 @@ _zip_allocate_new(const char *fn, int *zep)
 	return NULL;
     }
 	
+    if (fn == NULL)
+	return za;
+
     za->zn = strdup(fn);
     if (!za->zn) {
 	_zip_free(za);
@@ -0,0 +1,384 @@
+//
+//  annotation_store.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "annotation_store.h"
+#include "package.h"
+#include <algorithm>
+#include <iterator>
+
+EPUB3_BEGIN_NAMESPACE
+
+const uint8_t AnnotationStore::FormatVersion;
+
+static const char Magic[4] = { 'e', 'P', '3', 'A' };
+
+// identifiers and lengths are written as little-endian base-128 varints
+static void AppendVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while ( value >= 0x80 )
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+static bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint64_t* value)
+{
+    uint64_t result = 0;
+    for ( int shift = 0; shift < 64; shift += 7 )
+    {
+        if ( p == end )
+            return false;
+        uint8_t byte = *p++;
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ( (byte & 0x80) == 0 )
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+static void AppendBytes(std::vector<uint8_t>& out, const void* bytes, size_t length)
+{
+    AppendVarint(out, length);
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes);
+    out.insert(out.end(), p, p + length);
+}
+static bool ReadBytes(const uint8_t*& p, const uint8_t* end, const uint8_t** bytes, size_t* length)
+{
+    uint64_t size = 0;
+    if ( !ReadVarint(p, end, &size) || size > static_cast<uint64_t>(end - p) )
+        return false;
+    *bytes = p;
+    *length = static_cast<size_t>(size);
+    p += size;
+    return true;
+}
+
+AnnotationStore::AnnotationStore(const string& packageID) : _packageID(packageID), _entries(), _positions(), _nextID(1), _indexLock(), _indexValid(false), _byStart(), _nodes()
+{
+}
+AnnotationStore::AnnotationStore(const Package* package) : AnnotationStore(package->UniqueID())
+{
+}
+AnnotationStore::AnnotationID AnnotationStore::Add(Kind kind, const CFI &location, const std::string &note, const std::string &style)
+{
+    Entry entry{Annotation{_nextID, kind, std::vector<uint8_t>(), note, style}, Key(), Key()};
+    MakeKeys(location, &entry.start, &entry.end);
+    location.Encode(entry.annotation.encodedLocation);
+    
+    _positions[_nextID] = static_cast<EntryIndex>(_entries.size());
+    _entries.push_back(std::move(entry));
+    _indexValid = false;
+    return _nextID++;
+}
+bool AnnotationStore::Update(AnnotationID identifier, const std::string &note, const std::string &style)
+{
+    auto found = _positions.find(identifier);
+    if ( found == _positions.end() )
+        return false;
+    
+    Annotation& annotation = _entries[found->second].annotation;
+    annotation.note = note;
+    annotation.style = style;
+    return true;
+}
+bool AnnotationStore::Remove(AnnotationID identifier)
+{
+    auto found = _positions.find(identifier);
+    if ( found == _positions.end() )
+        return false;
+    
+    // fill the gap with the last entry
+    EntryIndex index = found->second;
+    _positions.erase(found);
+    if ( index != _entries.size() - 1 )
+    {
+        _entries[index] = std::move(_entries.back());
+        _positions[_entries[index].annotation.identifier] = index;
+    }
+    _entries.pop_back();
+    _indexValid = false;
+    return true;
+}
+void AnnotationStore::Clear()
+{
+    _entries.clear();
+    _positions.clear();
+    _indexValid = false;
+}
+const AnnotationStore::Annotation* AnnotationStore::Find(AnnotationID identifier) const
+{
+    auto found = _positions.find(identifier);
+    if ( found == _positions.end() )
+        return nullptr;
+    return &_entries[found->second].annotation;
+}
+std::vector<const AnnotationStore::Annotation*> AnnotationStore::Overlapping(const CFI &range) const
+{
+    Key start, end;
+    MakeKeys(range, &start, &end);
+    EnsureIndex();
+    
+    // those which begin at or before the range and reach it, then those which begin within it
+    std::vector<EntryIndex> found;
+    Stab(start, found);
+    std::sort(found.begin(), found.end(), [this](EntryIndex a, EntryIndex b) { return StartsBefore(a, b); });
+    
+    auto pos = std::upper_bound(_byStart.begin(), _byStart.end(), start, [this](const Key& key, EntryIndex index) {
+        return key < _entries[index].start;
+    });
+    for ( ; pos != _byStart.end() && !(end < _entries[*pos].start); ++pos )
+        found.push_back(*pos);
+    
+    std::vector<const Annotation*> result;
+    result.reserve(found.size());
+    for ( EntryIndex index : found )
+        result.push_back(&_entries[index].annotation);
+    return result;
+}
+bool AnnotationStore::Save(std::ostream &stream) const
+{
+    std::vector<uint8_t> data(std::begin(Magic), std::end(Magic));
+    data.push_back(FormatVersion);
+    AppendBytes(data, _packageID.c_str(), _packageID.utf8_size());
+    AppendVarint(data, _nextID);
+    AppendVarint(data, _entries.size());
+    
+    for ( const Entry& entry : _entries )
+    {
+        const Annotation& annotation = entry.annotation;
+        AppendVarint(data, annotation.identifier);
+        data.push_back(static_cast<uint8_t>(annotation.kind));
+        AppendBytes(data, annotation.encodedLocation.data(), annotation.encodedLocation.size());
+        AppendBytes(data, annotation.note.data(), annotation.note.size());
+        AppendBytes(data, annotation.style.data(), annotation.style.size());
+    }
+    
+    stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    stream.flush();
+    return !stream.fail();
+}
+void AnnotationStore::Load(std::istream &stream)
+{
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    const uint8_t* p = data.data();
+    const uint8_t* end = p + data.size();
+    
+    if ( data.size() <= sizeof(Magic) || !std::equal(std::begin(Magic), std::end(Magic), p) )
+        throw FormatError("Not an annotation store");
+    p += sizeof(Magic);
+    if ( *p != FormatVersion )
+        throw FormatError(_Str("Unsupported annotation store version ", static_cast<int>(*p)));
+    p++;
+    
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+    uint64_t nextID = 0, count = 0;
+    if ( !ReadBytes(p, end, &bytes, &length) || !ReadVarint(p, end, &nextID) || !ReadVarint(p, end, &count) )
+        throw FormatError("Truncated annotation store");
+    if ( std::string(reinterpret_cast<const char*>(bytes), length) != _packageID.stl_str() )
+        throw FormatError("The annotations belong to another publication");
+    
+    // every annotation takes at least five bytes, so a bad count can't run away with memory
+    if ( count > static_cast<uint64_t>(end - p) / 5 )
+        throw FormatError("Truncated annotation store");
+    
+    std::vector<Entry> entries;
+    std::unordered_map<AnnotationID, EntryIndex> positions;
+    entries.reserve(static_cast<size_t>(count));
+    for ( uint64_t i = 0; i < count; i++ )
+    {
+        Entry entry;
+        Annotation& annotation = entry.annotation;
+        if ( !ReadVarint(p, end, &annotation.identifier) || p == end )
+            throw FormatError("Truncated annotation store");
+        if ( *p > static_cast<uint8_t>(Kind::Bookmark) )
+            throw FormatError(_Str("Unknown annotation kind ", static_cast<int>(*p)));
+        annotation.kind = static_cast<Kind>(*p++);
+        
+        if ( !ReadBytes(p, end, &bytes, &length) )
+            throw FormatError("Truncated annotation store");
+        try
+        {
+            MakeKeys(CFI::Decode(bytes, length), &entry.start, &entry.end);
+            annotation.encodedLocation.assign(bytes, bytes + length);
+        }
+        catch (CFI::InvalidCFI& e)
+        {
+            throw FormatError(_Str("Invalid annotation location: ", e.what()));
+        }
+        
+        if ( !ReadBytes(p, end, &bytes, &length) )
+            throw FormatError("Truncated annotation store");
+        annotation.note.assign(reinterpret_cast<const char*>(bytes), length);
+        if ( !ReadBytes(p, end, &bytes, &length) )
+            throw FormatError("Truncated annotation store");
+        annotation.style.assign(reinterpret_cast<const char*>(bytes), length);
+        
+        if ( annotation.identifier >= nextID || !positions.emplace(annotation.identifier, static_cast<EntryIndex>(entries.size())).second )
+            throw FormatError(_Str("Invalid annotation identifier ", annotation.identifier));
+        entries.push_back(std::move(entry));
+    }
+    if ( p != end )
+        throw FormatError("Unexpected data after the annotations");
+    
+    _entries.swap(entries);
+    _positions.swap(positions);
+    _nextID = nextID;
+    _indexValid = false;
+}
+void AnnotationStore::MakeKeys(const CFI &cfi, Key *start, Key *end)
+{
+    if ( cfi.Empty() )
+        throw CFI::InvalidCFI("An annotation needs a location");
+    
+    start->clear();
+    end->clear();
+    if ( !cfi.IsRangeTriplet() )
+    {
+        CFI::EncodePath(*start, cfi.Components());
+        *end = *start;
+        return;
+    }
+    
+    if ( cfi.RangeStart().empty() || cfi.RangeEnd().empty() )
+        throw CFI::InvalidCFI("CFI range is missing its start or end");
+    
+    // each end is the shared path followed by its own
+    CFI::ComponentVector path(cfi.Components());
+    size_t shared = path.size();
+    path.insert(path.end(), cfi.RangeStart().begin(), cfi.RangeStart().end());
+    CFI::EncodePath(*start, path);
+    path.erase(path.begin() + shared, path.end());
+    path.insert(path.end(), cfi.RangeEnd().begin(), cfi.RangeEnd().end());
+    CFI::EncodePath(*end, path);
+    
+    if ( *end < *start )
+        throw CFI::InvalidCFI("CFI range ends before it starts");
+}
+bool AnnotationStore::StartsBefore(EntryIndex a, EntryIndex b) const
+{
+    const Entry &x = _entries[a], &y = _entries[b];
+    if ( x.start != y.start )
+        return x.start < y.start;
+    return x.annotation.identifier < y.annotation.identifier;
+}
+void AnnotationStore::EnsureIndex() const
+{
+    std::lock_guard<std::mutex> _(_indexLock);
+    if ( _indexValid )
+        return;
+    
+    _byStart.resize(_entries.size());
+    for ( size_t i = 0; i < _byStart.size(); i++ )
+        _byStart[i] = static_cast<EntryIndex>(i);
+    std::sort(_byStart.begin(), _byStart.end(), [this](EntryIndex a, EntryIndex b) { return StartsBefore(a, b); });
+    
+    _nodes.clear();
+    std::vector<EntryIndex> all(_byStart);
+    BuildNode(all);
+    _indexValid = true;
+}
+int32_t AnnotationStore::BuildNode(std::vector<EntryIndex> &entries) const
+{
+    if ( entries.empty() )
+        return -1;
+    
+    // centering on the median endpoint leaves at most half the entries to either side
+    std::vector<const Key*> points;
+    points.reserve(entries.size() * 2);
+    for ( EntryIndex index : entries )
+    {
+        points.push_back(&_entries[index].start);
+        points.push_back(&_entries[index].end);
+    }
+    auto median = points.begin() + points.size() / 2;
+    std::nth_element(points.begin(), median, points.end(), [](const Key* a, const Key* b) { return *a < *b; });
+    const Key* center = *median;
+    
+    // the entry whose endpoint this is contains it, so each side is smaller than the whole
+    std::vector<EntryIndex> here, before, after;
+    for ( EntryIndex index : entries )
+    {
+        const Entry& entry = _entries[index];
+        if ( entry.end < *center )
+            before.push_back(index);
+        else if ( *center < entry.start )
+            after.push_back(index);
+        else
+            here.push_back(index);
+    }
+    entries.clear();
+    entries.shrink_to_fit();
+    
+    int32_t result = static_cast<int32_t>(_nodes.size());
+    _nodes.push_back(IndexNode{center, here, here, -1, -1});
+    IndexNode& node = _nodes.back();
+    std::sort(node.byStart.begin(), node.byStart.end(), [this](EntryIndex a, EntryIndex b) { return StartsBefore(a, b); });
+    std::sort(node.byEnd.begin(), node.byEnd.end(), [this](EntryIndex a, EntryIndex b) { return _entries[b].end < _entries[a].end; });
+    
+    // the children may move the nodes
+    int32_t child = BuildNode(before);
+    _nodes[result].before = child;
+    child = BuildNode(after);
+    _nodes[result].after = child;
+    return result;
+}
+void AnnotationStore::Stab(const Key &point, std::vector<EntryIndex> &found) const
+{
+    int32_t current = (_nodes.empty() ? -1 : 0);
+    while ( current >= 0 )
+    {
+        const IndexNode& node = _nodes[current];
+        if ( point < *node.center )
+        {
+            // everything here reaches the center, so it covers the point if it starts in time
+            for ( EntryIndex index : node.byStart )
+            {
+                if ( point < _entries[index].start )
+                    break;
+                found.push_back(index);
+            }
+            current = node.before;
+        }
+        else if ( *node.center < point )
+        {
+            for ( EntryIndex index : node.byEnd )
+            {
+                if ( _entries[index].end < point )
+                    break;
+                found.push_back(index);
+            }
+            current = node.after;
+        }
+        else
+        {
+            found.insert(found.end(), node.byStart.begin(), node.byStart.end());
+            break;
+        }
+    }
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,197 @@
+//
+//  annotation_store.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#ifndef __ePub3__annotation_store__
+#define __ePub3__annotation_store__
+
+#include "epub3.h"
+#include "cfi.h"
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+class Package;
+
+/**
+ One reader's highlights, notes and bookmarks within a single publication.
+ 
+ Each annotation covers a range of the publication given by a complete CFI (one
+ beginning at the package document's spine); a location CFI covers just that point.
+ The store keeps an interval tree over the ranges, ordered by spine position and then
+ by path, so finding everything which overlaps a range (say, the visible part of a
+ page) or touches a point takes O(log n + k) time for k results.
+ 
+ Ranges are closed, so an annotation ending where a query begins overlaps it. A step
+ to an element stands for the point just before the element's contents.
+ 
+ The store is identified by its package's UniqueID(), which is recorded when it's
+ saved and checked when it's loaded. Queries may be made from several threads at
+ once, but changes must not overlap with anything else; the interval tree is rebuilt
+ on the first query after a change.
+ */
+class AnnotationStore
+{
+public:
+    typedef uint64_t            AnnotationID;
+    
+    ///
+    /// The version of the format written by Save(), which follows its magic number.
+    static const uint8_t        FormatVersion = 1;
+    
+    enum class Kind : uint8_t
+    {
+        Highlight,
+        Note,
+        Bookmark,
+    };
+    
+    struct Annotation
+    {
+        AnnotationID            identifier;
+        Kind                    kind;
+        std::vector<uint8_t>    encodedLocation;    ///< A complete range or location CFI, as written by CFI::Encode().
+        std::string             note;               ///< The reader's text, in UTF-8.
+        std::string             style;              ///< Free-form presentation details, such as a highlight colour.
+        
+        ///
+        /// Decodes the location. CFIs are large, so only their encoded form is kept.
+        CFI                     Location()  const   { return CFI::Decode(encodedLocation.data(), encodedLocation.size()); }
+    };
+    
+    class FormatError : public std::runtime_error
+    {
+    public:
+        FormatError(const std::string& str) : std::runtime_error(str) {}
+        FormatError(const char * str) : std::runtime_error(str) {}
+        virtual ~FormatError() {}
+    };
+    
+                        AnnotationStore(const string& packageID);
+                        AnnotationStore(const Package* package);
+                        AnnotationStore(const AnnotationStore&) = delete;
+                        ~AnnotationStore() {}
+    
+    const string&       PackageID()             const   { return _packageID; }
+    size_t              Size()                  const   { return _entries.size(); }
+    bool                Empty()                 const   { return _entries.empty(); }
+    
+    /**
+     Adds an annotation.
+     @param location A complete range or location CFI.
+     @result The new annotation's identifier, which is never reused by this store.
+     @throws CFI::InvalidCFI if the location is empty, or a range missing its start or end.
+     */
+    AnnotationID        Add(Kind kind, const CFI& location, const std::string& note = std::string(), const std::string& style = std::string());
+    
+    ///
+    /// Replaces an annotation's note and style. Returns false if there's no such annotation.
+    bool                Update(AnnotationID identifier, const std::string& note, const std::string& style);
+    
+    ///
+    /// Returns false if there's no such annotation.
+    bool                Remove(AnnotationID identifier);
+    
+    void                Clear();
+    
+    ///
+    /// The annotation with an identifier, or `nullptr`. Valid until the store is next changed.
+    const Annotation*   Find(AnnotationID identifier)   const;
+    
+    /**
+     Finds the annotations which overlap a range.
+     @param range A complete range or location CFI.
+     @result The annotations, in order of where they start; the pointers are valid until
+     the store is next changed.
+     @throws CFI::InvalidCFI if the range is empty, or missing its start or end.
+     */
+    std::vector<const Annotation*>  Overlapping(const CFI& range)   const;
+    
+    ///
+    /// Finds the annotations which cover a location, in order of where they start.
+    std::vector<const Annotation*>  At(const CFI& location)         const   { return Overlapping(location); }
+    
+    /**
+     Writes the store in a compact binary form: CFIs in their encoded form, and
+     identifiers and lengths as varints.
+     @result `false` if the stream couldn't be written or flushed.
+     */
+    bool                Save(std::ostream& stream)      const;
+    
+    /**
+     Replaces the store's contents with those written by Save().
+     @throws FormatError if the data is malformed, of another version, or belongs to
+     another publication; the store is left unchanged.
+     */
+    void                Load(std::istream& stream);
+    
+protected:
+    typedef std::vector<uint8_t>    Key;
+    typedef uint32_t                EntryIndex;
+    
+    struct Entry
+    {
+        Annotation      annotation;
+        Key             start;              // the encoded paths of each end; see MakeKeys()
+        Key             end;
+    };
+    
+    // A node of a centered interval tree. It holds the entries which contain its
+    //  center, sorted both ways; those wholly before or after are in its children.
+    struct IndexNode
+    {
+        const Key*                  center;
+        std::vector<EntryIndex>     byStart;        // ascending start
+        std::vector<EntryIndex>     byEnd;          // descending end
+        int32_t                     before;
+        int32_t                     after;
+    };
+    
+    string                          _packageID;
+    std::vector<Entry>              _entries;
+    std::unordered_map<AnnotationID, EntryIndex>    _positions;
+    AnnotationID                    _nextID;
+    
+    mutable std::mutex              _indexLock;
+    mutable bool                    _indexValid;
+    mutable std::vector<EntryIndex> _byStart;       // every entry, in ascending start order
+    mutable std::vector<IndexNode>  _nodes;         // the root is first
+    
+    static void         MakeKeys(const CFI& cfi, Key* start, Key* end);
+    bool                StartsBefore(EntryIndex a, EntryIndex b)    const;
+    
+    void                EnsureIndex()                               const;
+    int32_t             BuildNode(std::vector<EntryIndex>& entries) const;
+    void                Stab(const Key& point, std::vector<EntryIndex>& found)  const;
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__annotation_store__) */
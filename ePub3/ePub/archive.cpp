@@ -21,22 +21,35 @@
 
 #include "archive.h"
 #include "zip_archive.h"
+#include "crc32.h"
 #include <map>
 
 EPUB3_BEGIN_NAMESPACE
 
 Archive::ArchiveRegistrationDomain Archive::RegistrationDomain;
+Archive::ArchiveBufferRegistrationDomain Archive::BufferRegistrationDomain;
 
 void Archive::RegisterArchive(ArchiveTypeSniffer sniffer, ArchiveFactory factory)
 {
     RegistrationDomain[sniffer] = factory;
 }
+void Archive::RegisterBufferArchive(ArchiveBufferSniffer sniffer, ArchiveBufferFactory factory)
+{
+    BufferRegistrationDomain[sniffer] = factory;
+}
 void Archive::Initialize()
 {
     RegisterArchive([](const std::string& path) { return path.rfind(".zip") == path.size()-4; },
                     [](const std::string& path) { return new ZipArchive(path); });
     RegisterArchive([](const std::string& path) { return path.rfind(".epub") == path.size()-5; },
                     [](const std::string& path) { return new ZipArchive(path); });
+    
+    RegisterBufferArchive([](const void* data, size_t len) { return ZipArchive::IsZipData(data, len); },
+                          [](const void* data, size_t len, std::vector<uint8_t>* output) -> Archive* {
+                              if ( output != nullptr )
+                                  return new ZipArchive(*output);
+                              return new ZipArchive(data, len);
+                          });
 }
 Archive * Archive::Open(const std::string& path)
 {
@@ -48,6 +61,26 @@ Archive * Archive::Open(const std::string& path)
     
     return nullptr;
 }
+Archive * Archive::Open(const void *data, size_t len)
+{
+    for ( auto item : BufferRegistrationDomain )
+    {
+        if ( item.first(data, len) )
+            return item.second(data, len, nullptr);
+    }
+    
+    return nullptr;
+}
+Archive * Archive::Open(std::vector<uint8_t>& buffer)
+{
+    for ( auto item : BufferRegistrationDomain )
+    {
+        if ( item.first(buffer.data(), buffer.size()) )
+            return item.second(buffer.data(), buffer.size(), &buffer);
+    }
+    
+    return nullptr;
+}
 bool Archive::ShouldCompress(const std::string &path, const std::string &mimeType, size_t size) const
 {
     // check MIME type for known pre-compressed data formats
@@ -64,6 +97,62 @@ bool Archive::ShouldCompress(const std::string &path, const std::string &mimeTyp
     
     return true;
 }
+void Archive::ReadItems(const std::vector<std::string> &paths, BatchReadCallback callback, bool parallel) const
+{
+    for ( auto& path : paths )
+    {
+        Auto<ArchiveReader> reader(ReaderAtPath(path));
+        if ( !reader )
+        {
+            callback(path, nullptr);
+            continue;
+        }
+        
+        std::vector<uint8_t> data;
+        uint8_t buf[4096];
+        ssize_t num = 0;
+        while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+            data.insert(data.end(), buf, buf + num);
+        
+        callback(path, (num < 0 ? nullptr : &data));
+    }
+}
+ArchiveVerificationReport Archive::Verify(bool parallel) const
+{
+    ArchiveVerificationReport report;
+    for ( const ArchiveEntry& entry : Entries() )
+    {
+        ArchiveItemVerification result{entry.Path(), ArchiveItemVerification::Valid, entry.crc, 0};
+        
+        Auto<ArchiveReader> reader(ReaderAtPath(result.path));
+        if ( !reader )
+        {
+            result.status = ArchiveItemVerification::ReadError;
+            report.push_back(std::move(result));
+            continue;
+        }
+        
+        uint8_t buf[16384];
+        ssize_t num = 0;
+        uint64_t total = 0;
+        while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+        {
+            result.actualCRC = CRC32(result.actualCRC, buf, num);
+            total += num;
+        }
+        
+        if ( num < 0 )
+            result.status = ArchiveItemVerification::ReadError;
+        else if ( total != entry.uncompressedSize )
+            result.status = ArchiveItemVerification::SizeMismatch;
+        else if ( result.actualCRC != result.expectedCRC )
+            result.status = ArchiveItemVerification::CRCMismatch;
+        
+        report.push_back(std::move(result));
+    }
+    
+    return report;
+}
 ArchiveItemInfo Archive::InfoAtPath(const std::string &path) const
 {
     ArchiveItemInfo info;
@@ -25,6 +25,9 @@
 #include "epub3.h"
 #include <iostream>
 #include <map>
+#include <functional>
+#include <vector>
+#include <iterator>
 #include <zlib.h>
 #include <sys/acl.h>
 
@@ -33,6 +36,51 @@ EPUB3_BEGIN_NAMESPACE
 class ArchiveItemInfo;
 class ArchiveReader;
 class ArchiveWriter;
+class ArchiveEntryRange;
+
+/**
+ The result of checking a single archive entry's integrity.
+ */
+struct ArchiveItemVerification
+{
+    enum Status
+    {
+        Valid,
+        CRCMismatch,            ///< The data doesn't match the CRC in the directory.
+        SizeMismatch,           ///< The data is longer or shorter than the directory says.
+        ReadError,              ///< The data couldn't be read or decompressed.
+        UnsupportedMethod       ///< The entry uses a compression method we can't decode.
+    };
+    
+    std::string     path;
+    Status          status;
+    uint32_t        expectedCRC;
+    uint32_t        actualCRC;
+};
+
+typedef std::vector<ArchiveItemVerification>   ArchiveVerificationReport;
+
+/**
+ A compact view of one entry in an archive's directory.
+ 
+ Unlike ArchiveItemInfo, this involves no allocation: the path points into the
+ archive's own directory, and remains valid until the archive is modified or closed.
+ Entries added or replaced since the archive was opened report zero sizes, CRC and
+ offset, since these aren't known until the archive is written.
+ */
+struct ArchiveEntry
+{
+    const char *    path;               ///< Not NUL-terminated in general; use pathLength.
+    size_t          pathLength;
+    uint64_t        compressedSize;
+    uint64_t        uncompressedSize;
+    uint64_t        localHeaderOffset;  ///< Offset of the entry's local file header.
+    time_t          modified;
+    uint32_t        crc;
+    uint16_t        method;             ///< An ArchiveItemInfo::CompressionMethod value.
+    
+    std::string Path() const { return std::string(path, pathLength); }
+};
 
 class Archive
 {
@@ -63,10 +111,39 @@ protected:
     static ArchiveRegistrationDomain RegistrationDomain;
     static void RegisterArchive(ArchiveTypeSniffer sniffer, ArchiveFactory factory);
     
+    // in-memory archives are sniffed by content rather than by path
+    // the output vector is nullptr for read-only (caller-owned region) archives
+    typedef std::function<Archive*(const void*, size_t, std::vector<uint8_t>*)>   ArchiveBufferFactory;
+    typedef std::function<bool(const void*, size_t)>                            ArchiveBufferSniffer;
+    typedef std::map<ArchiveBufferSniffer, ArchiveBufferFactory, func_less<ArchiveBufferSniffer> >  ArchiveBufferRegistrationDomain;
+    
+    static ArchiveBufferRegistrationDomain BufferRegistrationDomain;
+    static void RegisterBufferArchive(ArchiveBufferSniffer sniffer, ArchiveBufferFactory factory);
+    
 public:
     static void Initialize();
     static Archive * Open(const std::string& path);
     
+    /**
+     Opens a read-only archive from a caller-owned region of memory.
+     
+     No copy of the data is made, so the region must outlive the returned archive.
+     @result A new archive, or `nullptr` if the data isn't in a recognised format.
+     */
+    static Archive * Open(const void * data, size_t len);
+    
+    /**
+     Opens an archive backed by a caller-owned byte vector.
+     
+     The archive reads directly from the vector's storage; any modifications are
+     written back into the vector when the archive is closed or deleted. An empty
+     vector creates a new, empty archive, and deleting every item empties it again.
+     The vector must outlive the returned archive, and must not be modified while
+     the archive is open.
+     @result A new archive, or `nullptr` if the data isn't in a recognised format.
+     */
+    static Archive * Open(std::vector<uint8_t>& buffer);
+    
 public:
     virtual ~Archive() {}
     
@@ -78,8 +155,50 @@ public:
     virtual bool CreateFolder(const std::string & path) = 0;
     
     virtual ArchiveReader* ReaderAtPath(const std::string & path) const = 0;
+    
+    /**
+     Returns a reader for an item's compressed bytes, exactly as stored.
+     
+     This is only available for items compressed with the DEFLATE method. The bytes
+     are a bare DEFLATE stream (RFC 1951) with no framing, which HTTP clients won't
+     accept as they are: `Content-Encoding: deflate` means the zlib format (RFC 1950),
+     so callers must wrap the stream before sending it. Either send the two-byte zlib
+     header `78 01`, the stream, and the big-endian Adler-32 of the *uncompressed*
+     item, which means inflating it once; or use `Content-Encoding: gzip` and send a
+     ten-byte gzip header (RFC 1952), the stream, and then the little-endian CRC-32
+     and uncompressed size from InfoAtPath(), which needs no decompression at all.
+     @result A reader, or `nullptr` if the item isn't stored using DEFLATE. Use
+     ReaderAtPath() to read the item in that case.
+     */
+    virtual ArchiveReader* RawReaderAtPath(const std::string & path) const { return nullptr; }
     virtual ArchiveWriter* WriterAtPath(const std::string & path, bool compress=true, bool create=true) = 0;
     
+    typedef std::function<void(const std::string& path, std::vector<uint8_t>* data)>   BatchReadCallback;
+    
+    /**
+     Reads a number of items in a single pass.
+     
+     Items are read in the order they're stored in the archive rather than the order
+     given, so the underlying storage sees one sequential sweep instead of a seek per
+     item.
+     @param paths The items to read.
+     @param callback Called once for each path, always on the calling thread. `data`
+     holds the item's uncompressed contents and may be moved from; it is `nullptr`
+     if the item doesn't exist or couldn't be read.
+     @param parallel If `true`, items are decompressed on the shared WorkerPool
+     while the sweep continues.
+     */
+    virtual void ReadItems(const std::vector<std::string>& paths, BatchReadCallback callback, bool parallel=false) const;
+    
+    /**
+     Hints that the given items will be read soon.
+     
+     Implementations may ask the OS to start reading the items' data into memory in
+     the background, hiding storage latency from the subsequent reads. This never
+     blocks on I/O, and paths which don't exist are ignored.
+     */
+    virtual void Prefetch(const std::vector<std::string>& paths) const {}
+    
     virtual bool ShouldCompress(const std::string& path, const std::string& mimeType, size_t size) const;
     
     virtual void SetPOSIXPermissions(const std::string & path, mode_t privs) {}
@@ -90,35 +209,93 @@ public:
     
     virtual ArchiveItemInfo InfoAtPath(const std::string & path) const;
     
+    /**
+     Saves any changes and closes the archive.
+     
+     Deleting an archive does the same, but has no way to report a failure. Once
+     closed, an archive can only be deleted.
+     @result `false` if the changes couldn't be saved, in which case they're lost.
+     */
+    virtual bool Close() { return true; }
+    
+    /**
+     The number of directory slots; some may be empty, e.g. if an item was deleted.
+     */
+    virtual size_t EntryCount() const { return 0; }
+    
+    /**
+     Fills in the entry at a given directory slot.
+     @result `false` if there's no entry at that index.
+     */
+    virtual bool EntryAtIndex(size_t idx, ArchiveEntry* entry) const { return false; }
+    
+    /**
+     Iterates every entry in the archive, in directory order.
+     
+     ```
+     for ( const ArchiveEntry& entry : archive->Entries() )
+         total += entry.uncompressedSize;
+     ```
+     */
+    ArchiveEntryRange Entries() const;
+    
+    /**
+     Checks the CRC of every entry in the archive.
+     @param parallel If `true`, entries are decompressed and checked on the shared
+     WorkerPool while the archive is read sequentially, with at most two entries per
+     pool thread held in memory at once.
+     @result One result per entry, in directory order.
+     */
+    virtual ArchiveVerificationReport Verify(bool parallel=true) const;
+    
+    /**
+     Whether ReaderAtPath() and RawReaderAtPath() check an item's CRC first.
+     
+     In this mode, each item is verified in full the first time a reader is
+     requested for it, and no reader is returned if the item is corrupt. This is
+     off by default.
+     */
+    bool VerifiesReads() const { return _verifyReads; }
+    void SetVerifiesReads(bool verify) { _verifyReads = verify; }
+    
     // scary Ghostbusters Zuul voice: "there is no copy, only move"
     Archive & operator = (const Archive &) = delete;
     Archive & operator = (Archive &&) { return *this; }
     
 protected:
-    Archive() {}
-    Archive(const std::string & path) : _path(path) {}
+    Archive() : _verifyReads(false) {}
+    Archive(const std::string & path) : _path(path), _verifyReads(false) {}
     Archive(const Archive &) = delete;  // copying is not allowed
-    Archive(Archive && o) : _path(std::move(o._path)) {} // moving is allowed
+    Archive(Archive && o) : _path(std::move(o._path)), _verifyReads(o._verifyReads) {} // moving is allowed
     
     std::string         _path;
+    bool                _verifyReads;
     
 };
 
 class ArchiveItemInfo
 {
 public:
-    ArchiveItemInfo() {}
-    ArchiveItemInfo(const ArchiveItemInfo & o) : _path(o._path), _isCompressed(o._isCompressed), _compressedSize(o._compressedSize), _uncompressedSize(o._uncompressedSize), _posix(o._posix) {
+    // the zip compression method values
+    typedef int CompressionMethod;
+    static const CompressionMethod StoredMethod = 0;
+    static const CompressionMethod DeflateMethod = 8;
+    
+public:
+    ArchiveItemInfo() : _isCompressed(false), _method(StoredMethod), _crc(0), _compressedSize(0), _uncompressedSize(0), _posix(0), _acl(nullptr) {}
+    ArchiveItemInfo(const ArchiveItemInfo & o) : _path(o._path), _isCompressed(o._isCompressed), _method(o._method), _crc(o._crc), _compressedSize(o._compressedSize), _uncompressedSize(o._uncompressedSize), _posix(o._posix), _acl(nullptr) {
         if ( o._acl != nullptr )
             _acl = acl_dup(o._acl);
     }
-    ArchiveItemInfo(ArchiveItemInfo && o) : _path(std::move(o._path)), _isCompressed(o._isCompressed), _compressedSize(o._compressedSize), _uncompressedSize(o._uncompressedSize), _posix(o._posix), _acl(o._acl) {
+    ArchiveItemInfo(ArchiveItemInfo && o) : _path(std::move(o._path)), _isCompressed(o._isCompressed), _method(o._method), _crc(o._crc), _compressedSize(o._compressedSize), _uncompressedSize(o._uncompressedSize), _posix(o._posix), _acl(o._acl) {
             o._acl = nullptr;
     }
     virtual ~ArchiveItemInfo() { if (_acl != nullptr) acl_free(_acl); }
     
     virtual std::string Path() const { return _path; }
     virtual bool IsCompressed() const { return _isCompressed; }
+    virtual CompressionMethod Method() const { return _method; }
+    virtual uint32_t CRC() const { return _crc; }
     virtual size_t CompressedSize() const { return _compressedSize; }
     virtual size_t UncompressedSize() const { return _uncompressedSize; }
     virtual mode_t POSIXPermissions() const { return _posix; }
@@ -127,6 +304,8 @@ public:
     virtual void SetPath(const std::string & path) { _path = path; }
     virtual void SetPath(std::string &&path) { _path = path; }
     virtual void SetIsCompressed(bool flag) { _isCompressed = flag;}
+    virtual void SetMethod(CompressionMethod method) { _method = method; }
+    virtual void SetCRC(uint32_t crc) { _crc = crc; }
     virtual void SetCompressedSize(size_t size) { _compressedSize = size; }
     virtual void SetUncompressedSize(size_t size) { _uncompressedSize = size; }
     virtual void SetPOSIXPermissions(mode_t perms) { _posix = perms; }
@@ -135,6 +314,8 @@ public:
 protected:
     std::string                 _path;
     bool                        _isCompressed;
+    CompressionMethod           _method;
+    uint32_t                    _crc;
     size_t                      _compressedSize;
     size_t                      _uncompressedSize;
     
@@ -151,12 +332,74 @@ public:
     virtual bool operator !() const { return true; }
     virtual ssize_t read(void *p, size_t len) const { return 0; }
     
+    /**
+     Provides the reader's unread content as a single block of memory, if it has one.
+     
+     Readers which serve data already held in memory (a cached, decompressed entry, or
+     an uncompressed entry within a mapped or in-memory archive) return `true` and let
+     consumers such as the XML parser use the bytes in place, rather than copying them
+     out in chunks through read(). The memory remains valid for the lifetime of the
+     reader, and doesn't move the read position.
+     @param data On success, set to the first unread byte.
+     @param len On success, set to the number of unread bytes.
+     @result `true` if the content is contiguous in memory, otherwise `false`.
+     */
+    virtual bool ContiguousData(const void ** data, size_t * len) const { return false; }
+    
 protected:
     ArchiveReader() = default;
     ArchiveReader(const ArchiveReader &) = delete;
     ArchiveReader(ArchiveReader &&) = default;
 };
 
+class ArchiveEntryIterator : public std::iterator<std::forward_iterator_tag, const ArchiveEntry>
+{
+public:
+    ArchiveEntryIterator() : _archive(nullptr), _idx(0), _count(0) {}
+    ArchiveEntryIterator(const Archive* archive, size_t idx) : _archive(archive), _idx(idx), _count(archive->EntryCount()) { Settle(); }
+    ArchiveEntryIterator(const ArchiveEntryIterator&) = default;
+    
+    ArchiveEntryIterator& operator = (const ArchiveEntryIterator&) = default;
+    
+    reference operator * () const { return _entry; }
+    pointer operator -> () const { return &_entry; }
+    
+    ArchiveEntryIterator& operator ++ () { _idx++; Settle(); return *this; }
+    ArchiveEntryIterator operator ++ (int) { ArchiveEntryIterator r(*this); ++(*this); return r; }
+    
+    bool operator == (const ArchiveEntryIterator& o) const { return _idx == o._idx && _archive == o._archive; }
+    bool operator != (const ArchiveEntryIterator& o) const { return !(*this == o); }
+    
+protected:
+    const Archive*  _archive;
+    size_t          _idx;
+    size_t          _count;
+    ArchiveEntry    _entry;
+    
+    // skip empty slots, stopping at the end
+    void Settle() {
+        while ( _idx < _count && !_archive->EntryAtIndex(_idx, &_entry) )
+            _idx++;
+    }
+};
+
+class ArchiveEntryRange
+{
+public:
+    ArchiveEntryRange(const Archive* archive) : _archive(archive) {}
+    
+    ArchiveEntryIterator begin() const { return ArchiveEntryIterator(_archive, 0); }
+    ArchiveEntryIterator end() const { return ArchiveEntryIterator(_archive, _archive->EntryCount()); }
+    
+protected:
+    const Archive*  _archive;
+};
+
+inline ArchiveEntryRange Archive::Entries() const
+{
+    return ArchiveEntryRange(this);
+}
+
 class ArchiveWriter
 {
 public:
@@ -0,0 +1,214 @@
+//
+//  archive_cache.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "archive_cache.h"
+#include <cstring>
+
+EPUB3_BEGIN_NAMESPACE
+
+ArchiveCache* ArchiveCache::SharedCache()
+{
+    // never destroyed, so archives closed during static destruction can still purge
+    static ArchiveCache* __shared = new ArchiveCache();
+    return __shared;
+}
+ArchiveCache::ArchiveCache(size_t budget, size_t maxEntrySize) : _bytesUsed(0), _budget(budget), _maxEntrySize(maxEntrySize), _inflation(0.0)
+{
+}
+void ArchiveCache::SetBudget(size_t bytes)
+{
+    _budget = bytes;
+    Evict();
+}
+size_t ArchiveCache::Count() const
+{
+    size_t count = 0;
+    for ( Shard& shard : _shards )
+    {
+        std::lock_guard<std::mutex> _(shard.lock);
+        count += shard.entries.size();
+    }
+    return count;
+}
+ArchiveCache::Buffer ArchiveCache::Lookup(const Key &key)
+{
+    Shard& shard = ShardForKey(key);
+    std::lock_guard<std::mutex> _(shard.lock);
+
+    auto found = shard.entries.find(key);
+    if ( found == shard.entries.end() )
+        return nullptr;
+
+    // re-rank the entry with its new hit count
+    Entry& entry = found->second;
+    shard.queue.erase(RankedKey(entry.priority, &found->first));
+    entry.hits++;
+    entry.priority = Priority(entry);
+    shard.queue.insert(RankedKey(entry.priority, &found->first));
+
+    return entry.data;
+}
+bool ArchiveCache::Contains(const Key &key) const
+{
+    Shard& shard = ShardForKey(key);
+    std::lock_guard<std::mutex> _(shard.lock);
+    return shard.entries.find(key) != shard.entries.end();
+}
+ArchiveCache::Buffer ArchiveCache::Insert(const Key &key, std::vector<uint8_t> &&data)
+{
+    Buffer buffer = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+    if ( !ShouldCache(buffer->size()) )
+        return buffer;
+
+    {
+        Shard& shard = ShardForKey(key);
+        std::lock_guard<std::mutex> _(shard.lock);
+
+        auto inserted = shard.entries.insert(EntryMap::value_type(key, Entry{buffer, 0.0, 1}));
+        if ( !inserted.second )
+        {
+            // someone else got here first; use theirs
+            return inserted.first->second.data;
+        }
+
+        Entry& entry = inserted.first->second;
+        entry.priority = Priority(entry);
+        shard.queue.insert(RankedKey(entry.priority, &inserted.first->first));
+        _bytesUsed += buffer->size();
+    }
+
+    if ( _bytesUsed > _budget )
+        Evict();
+
+    return buffer;
+}
+void ArchiveCache::Purge(const std::string &archive)
+{
+    for ( Shard& shard : _shards )
+    {
+        std::lock_guard<std::mutex> _(shard.lock);
+        for ( auto pos = shard.entries.begin(); pos != shard.entries.end(); )
+        {
+            if ( pos->first.archive != archive )
+            {
+                ++pos;
+                continue;
+            }
+
+            shard.queue.erase(RankedKey(pos->second.priority, &pos->first));
+            _bytesUsed -= pos->second.data->size();
+            pos = shard.entries.erase(pos);
+        }
+    }
+}
+void ArchiveCache::Clear()
+{
+    for ( Shard& shard : _shards )
+    {
+        std::lock_guard<std::mutex> _(shard.lock);
+        for ( auto& pair : shard.entries )
+            _bytesUsed -= pair.second.data->size();
+        shard.queue.clear();
+        shard.entries.clear();
+    }
+}
+size_t ArchiveCache::KeyHash::operator()(const Key &key) const
+{
+    std::hash<std::string> strhash;
+    size_t h = strhash(key.archive);
+    h ^= strhash(key.path) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<uint32_t>()(key.crc) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+ArchiveCache::Shard& ArchiveCache::ShardForKey(const Key &key) const
+{
+    return _shards[KeyHash()(key) % NumShards];
+}
+double ArchiveCache::Priority(const Entry &entry) const
+{
+    // GDSF with a uniform fetch cost: frequency over size, aged by the inflation value
+    return _inflation.load() + static_cast<double>(entry.hits) / static_cast<double>(entry.data->size());
+}
+void ArchiveCache::Evict()
+{
+    // one evictor at a time, so concurrent inserts don't each evict for the other
+    std::lock_guard<std::mutex> __evict(_evictionLock);
+
+    while ( _bytesUsed > _budget )
+    {
+        // find the shard holding the lowest-priority entry
+        Shard* victim = nullptr;
+        double lowest = 0.0;
+        for ( Shard& shard : _shards )
+        {
+            std::lock_guard<std::mutex> _(shard.lock);
+            if ( shard.queue.empty() )
+                continue;
+            if ( victim == nullptr || shard.queue.begin()->first < lowest )
+            {
+                victim = &shard;
+                lowest = shard.queue.begin()->first;
+            }
+        }
+
+        if ( victim == nullptr )
+            break;
+
+        // its queue may have changed since we looked; evict whatever is lowest now
+        std::lock_guard<std::mutex> _(victim->lock);
+        if ( victim->queue.empty() )
+            continue;
+
+        auto ranked = victim->queue.begin();
+        auto found = victim->entries.find(*ranked->second);
+        double priority = ranked->first;
+
+        _bytesUsed -= found->second.data->size();
+        victim->queue.erase(ranked);
+        victim->entries.erase(found);
+
+        if ( priority > _inflation.load() )
+            _inflation = priority;
+    }
+}
+
+ssize_t CachedArchiveReader::read(void *p, size_t len) const
+{
+    if ( _buffer == nullptr || _pos >= _buffer->size() )
+        return 0;
+
+    size_t toRead = std::min(len, _buffer->size() - _pos);
+    std::memcpy(p, _buffer->data() + _pos, toRead);
+    _pos += toRead;
+    return static_cast<ssize_t>(toRead);
+}
+bool CachedArchiveReader::ContiguousData(const void **data, size_t *len) const
+{
+    if ( _buffer == nullptr )
+        return false;
+    
+    size_t pos = std::min(_pos, _buffer->size());
+    *data = _buffer->data() + pos;
+    *len = _buffer->size() - pos;
+    return true;
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,161 @@
+//
+//  archive_cache.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__archive_cache__
+#define __ePub3__archive_cache__
+
+#include "epub3.h"
+#include "archive.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+// A process-wide cache of decompressed archive entries, shared by every open
+//  archive. Stylesheets, fonts and images referenced from every content document
+//  would otherwise be inflated again on each request.
+//
+// Entries are keyed by the identity of their archive, their path within it, and
+//  the CRC and modification time from the zip directory, so a file which is
+//  replaced on disk never serves stale data. All entries share a single byte
+//  budget; when it is exceeded, entries are evicted according to GreedyDual-Size-
+//  Frequency, which prefers to keep small, frequently-used items.
+//
+// Lookups and insertions lock only one of a fixed number of shards, so readers on
+//  different threads rarely contend.
+class ArchiveCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<uint8_t>>    Buffer;
+
+    struct Key
+    {
+        std::string     archive;        // ZipArchive::CacheIdentity()
+        std::string     path;
+        uint32_t        crc;
+        time_t          mtime;
+
+        bool operator == (const Key& o) const {
+            return crc == o.crc && mtime == o.mtime && path == o.path && archive == o.archive;
+        }
+    };
+
+    static const size_t DefaultBudget = 16 * 1024 * 1024;
+    static const size_t DefaultMaxEntrySize = 1024 * 1024;
+
+public:
+    // access the singleton instance
+    static ArchiveCache*    SharedCache();
+
+                            ArchiveCache(size_t budget=DefaultBudget, size_t maxEntrySize=DefaultMaxEntrySize);
+                            ArchiveCache(const ArchiveCache&)   = delete;
+                            ArchiveCache(ArchiveCache&&)        = delete;
+    virtual                 ~ArchiveCache()                     = default;
+
+    // a budget of zero disables the cache; shrinking it evicts immediately
+    size_t                  Budget()                    const   { return _budget; }
+    void                    SetBudget(size_t bytes);
+
+    // entries larger than this are never cached
+    size_t                  MaxEntrySize()              const   { return _maxEntrySize; }
+    void                    SetMaxEntrySize(size_t bytes)       { _maxEntrySize = bytes; }
+
+    bool                    ShouldCache(size_t size)    const   { return size > 0 && size <= _maxEntrySize && size <= _budget; }
+
+    size_t                  BytesUsed()                 const   { return _bytesUsed; }
+    size_t                  Count()                     const;
+
+    // returns nullptr on a miss
+    Buffer                  Lookup(const Key& key);
+
+    // unlike Lookup(), this doesn't count as a hit, so it leaves the entry's rank alone
+    bool                    Contains(const Key& key)    const;
+
+    // returns the cached buffer, which may be one inserted by another thread
+    Buffer                  Insert(const Key& key, std::vector<uint8_t>&& data);
+
+    // drops all entries belonging to an archive
+    void                    Purge(const std::string& archive);
+    void                    Clear();
+
+protected:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry
+    {
+        Buffer      data;
+        double      priority;
+        uint32_t    hits;
+    };
+
+    typedef std::unordered_map<Key, Entry, KeyHash>     EntryMap;
+    typedef std::pair<double, const Key*>               RankedKey;
+
+    struct Shard
+    {
+        std::mutex              lock;
+        EntryMap                entries;
+        std::set<RankedKey>     queue;      // lowest priority first
+    };
+
+    static const size_t     NumShards = 16;
+
+    mutable Shard           _shards[NumShards];
+    std::atomic<size_t>     _bytesUsed;
+    std::atomic<size_t>     _budget;
+    std::atomic<size_t>     _maxEntrySize;
+
+    // the GDSF inflation value: the priority of the last evicted entry
+    std::mutex              _evictionLock;
+    std::atomic<double>     _inflation;
+
+    Shard&                  ShardForKey(const Key& key)  const;
+    double                  Priority(const Entry& entry) const;
+    void                    Evict();
+
+};
+
+// An ArchiveReader which serves bytes from a cached buffer.
+class CachedArchiveReader : public ArchiveReader
+{
+public:
+    CachedArchiveReader(ArchiveCache::Buffer buffer) : _buffer(buffer), _pos(0) {}
+    virtual ~CachedArchiveReader() {}
+
+    virtual bool operator !() const { return _buffer == nullptr || _pos >= _buffer->size(); }
+    virtual ssize_t read(void* p, size_t len) const;
+    virtual bool ContiguousData(const void** data, size_t* len) const;
+
+protected:
+    ArchiveCache::Buffer    _buffer;
+    mutable size_t          _pos;
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__archive_cache__) */
@@ -20,16 +20,25 @@
 //
 
 #include "archive_xml.h"
+#include "spsc_ring_buffer.h"
+#include <libxml/HTMLparser.h>
+#include <libxml/parserInternals.h>
+#include <climits>
 #include <sstream>
+#include <thread>
 
 EPUB3_BEGIN_NAMESPACE
 
-ArchiveXmlReader::ArchiveXmlReader(ArchiveReader * r) : _reader(r)
+// the producer hands over data in pieces no larger than this, so parsing starts early
+static const size_t PipelineChunkSize = 32 * 1024;
+static const size_t PipelineBufferSize = 256 * 1024;
+
+ArchiveXmlReader::ArchiveXmlReader(ArchiveReader * r) : _reader(r), _pipelined(false)
 {
     if ( _reader == nullptr )
         throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": Nil ArchiveReader supplied");
 }
-ArchiveXmlReader::ArchiveXmlReader(ArchiveXmlReader&& o) : _reader(o._reader)
+ArchiveXmlReader::ArchiveXmlReader(ArchiveXmlReader&& o) : _reader(o._reader), _pipelined(o._pipelined)
 {
     o._reader = nullptr;
 }
@@ -43,8 +52,8 @@ size_t ArchiveXmlReader::read(uint8_t *buf, size_t len)
     ssize_t r = _reader->read(buf, len);
     if ( r < 0 )
     {
-        std::stringstream s(std::string(__PRETTY_FUNCTION__) + ": ArchiveReader::Read() returned ");
-        s << r;
+        std::stringstream s;
+        s << __PRETTY_FUNCTION__ << ": ArchiveReader::Read() returned " << r;
         throw std::runtime_error(s.str());
     }
     
@@ -54,6 +63,156 @@ bool ArchiveXmlReader::close()
 {
     return true;
 }
+bool ArchiveXmlReader::ShouldPipeline(size_t uncompressedSize)
+{
+    return uncompressedSize >= MinimumPipelinedSize && std::thread::hardware_concurrency() > 1;
+}
+xmlDocPtr ArchiveXmlReader::xmlReadDocument(const char *url, const char *encoding, int options)
+{
+    const char * data = nullptr;
+    size_t len = 0;
+    if ( _pipelined && !contiguousData(&data, &len) )
+        return PipelinedRead(url, encoding, options, false);
+    return InputBuffer::xmlReadDocument(url, encoding, options);
+}
+xmlDocPtr ArchiveXmlReader::htmlReadDocument(const char *url, const char *encoding, int options)
+{
+    const char * data = nullptr;
+    size_t len = 0;
+    if ( _pipelined && !contiguousData(&data, &len) )
+        return PipelinedRead(url, encoding, options, true);
+    return InputBuffer::htmlReadDocument(url, encoding, options);
+}
+xmlDocPtr ArchiveXmlReader::PipelinedRead(const char *url, const char *encoding, int options, bool html)
+{
+    xmlParserCtxtPtr ctx = nullptr;
+    if ( html )
+    {
+        ctx = htmlCreatePushParserCtxt(nullptr, nullptr, nullptr, 0, url, XML_CHAR_ENCODING_NONE);
+        if ( ctx != nullptr )
+            htmlCtxtUseOptions(ctx, options);
+    }
+    else
+    {
+        ctx = xmlCreatePushParserCtxt(nullptr, nullptr, nullptr, 0, url);
+        if ( ctx != nullptr )
+            xmlCtxtUseOptions(ctx, options);
+    }
+    if ( ctx == nullptr )
+        return nullptr;
+    
+    // as for xmlReadIO(): an explicit encoding overrides the document's declaration
+    if ( encoding != nullptr )
+    {
+        xmlCharEncodingHandlerPtr handler = xmlFindCharEncodingHandler(encoding);
+        if ( handler != nullptr )
+            xmlSwitchToEncoding(ctx, handler);
+    }
+    
+    // the producer reads straight into the ring, which the parser then reads in place
+    SPSCRingBuffer ring(PipelineBufferSize);
+    ssize_t readError = 0;
+    std::thread producer([&]() {
+        try
+        {
+            while ( !ring.IsCancelled() )
+            {
+                uint8_t * region = nullptr;
+                size_t space = ring.WritableRegion(&region);
+                if ( space == 0 )
+                {
+                    ring.WaitToWrite();
+                    continue;
+                }
+                
+                ssize_t num = _reader->read(region, std::min(space, PipelineChunkSize));
+                if ( num <= 0 )
+                {
+                    readError = num;
+                    break;
+                }
+                ring.Commit(static_cast<size_t>(num));
+            }
+        }
+        catch (...)
+        {
+            readError = -1;
+        }
+        ring.Finish();
+    });
+    
+    try
+    {
+        while ( !ring.IsCancelled() )
+        {
+            const uint8_t * region = nullptr;
+            size_t avail = ring.ReadableRegion(&region);
+            if ( avail == 0 )
+            {
+                if ( ring.AtEnd() )
+                    break;
+                ring.WaitToRead();
+                continue;
+            }
+            
+            int chunk = static_cast<int>(std::min<size_t>(avail, INT_MAX));
+            const char * p = reinterpret_cast<const char*>(region);
+            int err = (html ? htmlParseChunk(ctx, p, chunk, 0) : xmlParseChunk(ctx, p, chunk, 0));
+            ring.Consume(chunk);
+            
+            // a fatal error stops the parser; there's no point reading any more
+            if ( err != 0 && ctx->disableSAX )
+                ring.Cancel();
+        }
+    }
+    catch (...)
+    {
+        ring.Cancel();
+        producer.join();
+        xmlFreeDoc(ctx->myDoc);
+        xmlFreeParserCtxt(ctx);
+        throw;
+    }
+    
+    producer.join();
+    
+    if ( html )
+        htmlParseChunk(ctx, nullptr, 0, 1);
+    else
+        xmlParseChunk(ctx, nullptr, 0, 1);
+    
+    xmlDocPtr result = ctx->myDoc;
+    ctx->myDoc = nullptr;
+    if ( !html && !ctx->wellFormed && !ctx->recovery )
+    {
+        // matches the behaviour of xmlReadIO()
+        xmlFreeDoc(result);
+        result = nullptr;
+    }
+    xmlFreeParserCtxt(ctx);
+    
+    // the HTML push parser doesn't record an encoding it was told to use
+    if ( result != nullptr && result->encoding == nullptr && encoding != nullptr )
+        result->encoding = xmlStrdup(BAD_CAST encoding);
+    
+    if ( readError < 0 )
+    {
+        xmlFreeDoc(result);
+        std::stringstream s;
+        s << __PRETTY_FUNCTION__ << ": ArchiveReader::Read() returned " << readError;
+        throw std::runtime_error(s.str());
+    }
+    
+    return result;
+}
+bool ArchiveXmlReader::contiguousData(const char **data, size_t *len)
+{
+    const void * p = nullptr;
+    if ( !_reader->ContiguousData(&p, len) )
+        return false;
+    *data = reinterpret_cast<const char*>(p);
+    return true;
+}
 
 ArchiveXmlWriter::ArchiveXmlWriter(ArchiveWriter* w) : _writer(w)
 {
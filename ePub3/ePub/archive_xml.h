@@ -31,6 +31,9 @@ EPUB3_BEGIN_NAMESPACE
 class ArchiveXmlReader : public xml::InputBuffer
 {
 public:
+    // documents smaller than this gain nothing from a pipelined parse
+    static const size_t MinimumPipelinedSize = 1024 * 1024;
+    
     ArchiveXmlReader(ArchiveReader * r);
     ArchiveXmlReader(const ArchiveXmlReader&) = delete;
     ArchiveXmlReader(ArchiveXmlReader&& o);
@@ -39,11 +42,30 @@ public:
     operator ArchiveReader* () { return _reader; }
     operator const ArchiveReader* () const { return _reader; }
     
+    /**
+     In pipelined mode, the entry is read (and so decompressed) on a separate thread
+     while the calling thread parses what has been read so far using libxml's push
+     parser, so inflation and tokenization overlap. Content which is already in memory
+     is always parsed in place instead.
+     */
+    bool Pipelined() const { return _pipelined; }
+    void SetPipelined(bool pipelined) { _pipelined = pipelined; }
+    
+    // true if a document of this size is worth pipelining on this machine
+    static bool ShouldPipeline(size_t uncompressedSize);
+    
+    virtual xmlDocPtr xmlReadDocument(const char * url, const char * encoding, int options);
+    virtual xmlDocPtr htmlReadDocument(const char * url, const char * encoding, int options);
+    
 protected:
     ArchiveReader *     _reader;
+    bool                _pipelined;
     
     virtual size_t read(uint8_t * buf, size_t len);
     virtual bool close();
+    virtual bool contiguousData(const char ** data, size_t * len);
+    
+    xmlDocPtr PipelinedRead(const char * url, const char * encoding, int options, bool html);
 };
 
 class ArchiveXmlWriter : public xml::OutputBuffer
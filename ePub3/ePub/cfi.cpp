@@ -20,29 +20,74 @@
 //
 
 #include "cfi.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 
 EPUB3_BEGIN_NAMESPACE
 
-CFI::CFI(const CFI& base, const CFI& start, const CFI& end) : _components(base._components), _rangeStart(start._components), _rangeEnd(end._components), _options(RangeTriplet)
+const uint8_t CFI::EncodingVersion;
+
+CFI::CFI(const CFI& base, const CFI& start, const CFI& end) : CFI()
 {
+    Path& path = MutablePath();
+    path.components = base.Components();
+    path.rangeStart = start.Components();
+    path.rangeEnd = end.Components();
+    _options = RangeTriplet;
 }
 CFI::CFI(const string& str) : CFI()
 {
-    if ( CompileCFI(str) == false )
+    if ( CompileCFI(str) != ParseError::None )
         throw InvalidCFI(std::string("Invalid CFI string: ") + str.stl_str());
 }
+CFI::ParseError CFI::TryParse(const string &str, CFI *pResult) noexcept
+{
+    CFI cfi;
+    ParseError error = cfi.CompileCFI(str);
+    if ( error == ParseError::None )
+        *pResult = std::move(cfi);
+    return error;
+}
+const CFI::Path& CFI::EmptyPath()
+{
+    static const Path empty;
+    return empty;
+}
+void CFI::Release()
+{
+    if ( _path != nullptr && _path->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+        delete _path;
+    _path = nullptr;
+}
+CFI::Path& CFI::MutablePath()
+{
+    if ( _path == nullptr )
+    {
+        _path = new Path;
+    }
+    else if ( _path->refs.load(std::memory_order_acquire) != 1 )
+    {
+        Path* copy = new Path(*_path);
+        Release();
+        _path = copy;
+    }
+    return *_path;
+}
 bool CFI::operator==(const ePub3::CFI &o) const
 {
     if ( _options != o._options )
         return false;
+    if ( _path == o._path )
+        return true;
     
-    if ( _components != o._components )
+    if ( Components() != o.Components() )
         return false;
     
     if ( IsRangeTriplet() )
     {
-        return _rangeStart == o._rangeStart && _rangeEnd == o._rangeEnd;
+        return RangeStart() == o.RangeStart() && RangeEnd() == o.RangeEnd();
     }
     
     return true;
@@ -72,28 +117,36 @@ CFI& CFI::Assign(const string &str)
 }
 CFI& CFI::Assign(const CFI& o)
 {
-    _components = o._components;
-    _rangeStart = o._rangeStart;
-    _rangeEnd = o._rangeEnd;
+    if ( _path != o._path )
+    {
+        Path* path = o._path;
+        if ( path != nullptr )
+            path->refs.fetch_add(1, std::memory_order_relaxed);
+        Release();
+        _path = path;
+    }
     _options = o._options;
     return *this;
 }
 CFI& CFI::Assign(const ePub3::CFI &o, size_t fromIndex)
 {
-    if ( fromIndex >= o._components.size() )
-        throw std::out_of_range(_Str("Component index ", fromIndex, " out of range [0..", _components.size(), "]"));
+    if ( fromIndex > o.Components().size() )
+        throw std::out_of_range(_Str("Component index ", fromIndex, " out of range [0..", o.Components().size(), "]"));
     
-    _components.assign(o._components.begin()+fromIndex, o._components.end());
-    if ( o.IsRangeTriplet() )
+    // the source may share this CFI's buffer, or be this CFI
+    CFI source(o);
+    Path& path = MutablePath();
+    path.components.assign(source.Components().begin()+fromIndex, source.Components().end());
+    if ( source.IsRangeTriplet() )
     {
-        _rangeStart = o._rangeStart;
-        _rangeEnd = o._rangeEnd;
+        path.rangeStart = source.RangeStart();
+        path.rangeEnd = source.RangeEnd();
         _options |= RangeTriplet;
     }
     else if ( IsRangeTriplet() )
     {
-        _rangeStart.clear();
-        _rangeEnd.clear();
+        path.rangeStart.clear();
+        path.rangeEnd.clear();
         _options &= ~RangeTriplet;
     }
     
@@ -101,9 +154,12 @@ CFI& CFI::Assign(const ePub3::CFI &o, size_t fromIndex)
 }
 CFI& CFI::Assign(CFI&& o)
 {
-    _components = std::move(o._components);
-    _rangeStart = std::move(o._rangeStart);
-    _rangeEnd = std::move(o._rangeEnd);
+    if ( this != &o )
+    {
+        Release();
+        _path = o._path;
+        o._path = nullptr;
+    }
     _options = o._options;
     return *this;
 }
@@ -115,11 +171,13 @@ CFI& CFI::Append(const ePub3::CFI& cfi)
         throw RangedCFIAppendAttempt("Appending to a ranged CFI-- what to do here?");
     }
     
-    _components.insert(_components.end(), cfi._components.begin(), cfi._components.end());
-    if ( cfi.IsRangeTriplet() )
+    CFI source(cfi);
+    Path& path = MutablePath();
+    path.components.insert(path.components.end(), source.Components().begin(), source.Components().end());
+    if ( source.IsRangeTriplet() )
     {
-        _rangeStart = cfi._rangeStart;
-        _rangeEnd = cfi._rangeEnd;
+        path.rangeStart = source.RangeStart();
+        path.rangeEnd = source.RangeEnd();
         _options |= RangeTriplet;
     }
     
@@ -134,11 +192,12 @@ CFI& CFI::Append(const string &str)
     }
     
     CFI tmp(str);
-    _components.insert(_components.end(), tmp._components.begin(), tmp._components.end());
+    Path& path = MutablePath();
+    path.components.insert(path.components.end(), tmp.Components().begin(), tmp.Components().end());
     if ( tmp.IsRangeTriplet() )
     {
-        _rangeStart = std::move(tmp._rangeStart);
-        _rangeEnd = std::move(tmp._rangeEnd);
+        path.rangeStart = tmp.RangeStart();
+        path.rangeEnd = tmp.RangeEnd();
         _options |= RangeTriplet;
     }
     
@@ -146,9 +205,9 @@ CFI& CFI::Append(const string &str)
 }
 size_t CFI::TotalComponents() const
 {
-    size_t result = _components.size();
+    size_t result = Components().size();
     if ( IsRangeTriplet() )
-        result += _rangeStart.size() + _rangeEnd.size();
+        result += RangeStart().size() + RangeEnd().size();
     return result;
 }
 string CFI::SubCFIFromIndex(size_t index) const
@@ -156,19 +215,19 @@ string CFI::SubCFIFromIndex(size_t index) const
     if ( index >= TotalComponents() )
         throw std::range_error((std::stringstream() << "Index " << index << " is out of bounds.").str());
     
-    return Stringify(_components.begin()+index, _components.end());
+    return Stringify(Components().begin()+index, Components().end());
 }
 string CFI::Stringify(ComponentList::const_iterator start, ComponentList::const_iterator end) const
 {
     std::stringstream builder;
     builder << "epubcfi(";
     AppendComponents(builder, start, end);
-    if ( end == _components.end() && IsRangeTriplet() )
+    if ( end == Components().end() && IsRangeTriplet() )
     {
         builder << ",";
-        AppendComponents(builder, _rangeStart.begin(), _rangeStart.end());
+        AppendComponents(builder, RangeStart().begin(), RangeStart().end());
         builder << ",";
-        AppendComponents(builder, _rangeEnd.begin(), _rangeEnd.end());
+        AppendComponents(builder, RangeEnd().begin(), RangeEnd().end());
     }
     builder << ")";
     
@@ -212,9 +271,9 @@ void CFI::AppendComponents(std::stringstream& builder, ComponentList::const_iter
         ++pos;
     }
 }
-CFI::StringList CFI::CFIComponentStrings(const string &cfi, const string& delimiter)
+bool CFI::CFIComponentStrings(const string &cfi, StringList* components, const string& delimiter)
 {
-    CFI::StringList components;
+    components->clear();
     string breaks = delimiter + "[";
     string tmp;
     string::size_type pos = 0, loc = 0;
@@ -227,8 +286,6 @@ CFI::StringList CFI::CFIComponentStrings(const string &cfi, const string& delimi
             if ( loc == string::npos )
             {
                 tmp.append(cfi, pos, cfi.size()-pos);
-                if ( !tmp.empty() )
-                    components.push_back(tmp);
                 break;
             }
             else
@@ -242,7 +299,7 @@ CFI::StringList CFI::CFIComponentStrings(const string &cfi, const string& delimi
         {
             loc = cfi.find_first_of(']', loc);
             if ( loc == string::npos )
-                throw std::range_error((std::stringstream() << "CFI '" << cfi << "' has an unterminated qualifier").str());
+                return false;
             
             ++loc;
             tmp.append(cfi, pos, loc-pos);
@@ -251,7 +308,7 @@ CFI::StringList CFI::CFIComponentStrings(const string &cfi, const string& delimi
         {
             // delimiter found, push the current string
             if ( !tmp.empty() )
-                components.push_back(tmp);
+                components->push_back(tmp);
             tmp.clear();
             
             if ( loc == string::npos )
@@ -262,9 +319,13 @@ CFI::StringList CFI::CFIComponentStrings(const string &cfi, const string& delimi
         pos = loc;
     }
     
-    return components;
+    // whatever follows the last delimiter, which may end with a qualifier
+    if ( !tmp.empty() )
+        components->push_back(tmp);
+    
+    return true;
 }
-bool CFI::CompileCFI(const string &str)
+CFI::ParseError CFI::CompileCFI(const string &str)
 {
     // strip the 'epubcfi(...)' wrapping
     string cfi(str);
@@ -275,78 +336,84 @@ bool CFI::CompileCFI(const string &str)
     else if ( str.size() == 0 || str[0] != '/' )
     {
         // invalid CFI
-        return false;
+        return ParseError::NotACFI;
     }
     
-    StringList rangePieces = RangedCFIComponents(cfi);
+    StringList rangePieces, steps;
+    if ( RangedCFIComponents(cfi, &rangePieces) == false )
+        return ParseError::UnterminatedQualifier;
+    if ( rangePieces.empty() )
+        return ParseError::NotACFI;
     if ( rangePieces.size() != 1 && rangePieces.size() != 3 )
-        return false;
+        return ParseError::InvalidRange;
     
-    if ( CompileComponentsToList(CFIComponentStrings(rangePieces[0]), &_components) == false )
-        return false;
+    if ( CFIComponentStrings(rangePieces[0], &steps) == false )
+        return ParseError::UnterminatedQualifier;
+    Path& path = MutablePath();
+    if ( CompileComponentsToList(steps, &path.components) == false )
+        return ParseError::InvalidStep;
     
     if ( rangePieces.size() == 3 )
     {
-        if ( CompileComponentsToList(CFIComponentStrings(rangePieces[1]), &_rangeStart) == false )
-            return false;
-        if ( CompileComponentsToList(CFIComponentStrings(rangePieces[2]), &_rangeEnd) == false )
-            return false;
+        if ( CFIComponentStrings(rangePieces[1], &steps) == false )
+            return ParseError::UnterminatedQualifier;
+        if ( CompileComponentsToList(steps, &path.rangeStart) == false )
+            return ParseError::InvalidStep;
+        if ( CFIComponentStrings(rangePieces[2], &steps) == false )
+            return ParseError::UnterminatedQualifier;
+        if ( CompileComponentsToList(steps, &path.rangeEnd) == false )
+            return ParseError::InvalidStep;
         
         // now sanity-check the range delimiters:
         
         // neither should be empty
-        if ( _rangeStart.empty() || _rangeEnd.empty() )
-            return false;
+        if ( path.rangeStart.empty() || path.rangeEnd.empty() )
+            return ParseError::InvalidRange;
         
         // check the offsets at the end of each— they should be the same type
-        if ( (_rangeStart.back().flags & Component::OffsetsMask) != (_rangeEnd.back().flags & Component::OffsetsMask) )
-            return false;
+        if ( (path.rangeStart.back().flags & Component::OffsetsMask) != (path.rangeEnd.back().flags & Component::OffsetsMask) )
+            return ParseError::InvalidRange;
         
         // where the delimiters' component ranges overlap, start must be <= end
-        auto maxsz = std::max(_rangeStart.size(), _rangeEnd.size());
+        auto minsz = std::min(path.rangeStart.size(), path.rangeEnd.size());
         bool inequalNodeIndexFound = false;
-        for ( decltype(maxsz) i = 0; i < maxsz; i++ )
+        for ( decltype(minsz) i = 0; i < minsz && !inequalNodeIndexFound; i++ )
         {
-            if ( _rangeStart[i].nodeIndex > _rangeEnd[i].nodeIndex )
-                return false;
-            else if ( !inequalNodeIndexFound && _rangeStart[i].nodeIndex < _rangeEnd[i].nodeIndex )
+            if ( path.rangeStart[i].nodeIndex > path.rangeEnd[i].nodeIndex )
+                return ParseError::InvalidRange;
+            else if ( path.rangeStart[i].nodeIndex < path.rangeEnd[i].nodeIndex )
                 inequalNodeIndexFound = true;
         }
         
         // if the two ranges are equal aside from their offsets, the end offset must be > the start offset
-        if ( !inequalNodeIndexFound && _rangeStart.size() == _rangeEnd.size() )
+        if ( !inequalNodeIndexFound && path.rangeStart.size() == path.rangeEnd.size() )
         {
-            Component &s = _rangeStart.back(), &e = _rangeEnd.back();
+            Component &s = path.rangeStart.back(), &e = path.rangeEnd.back();
             if ( s.HasCharacterOffset() && s.characterOffset > e.characterOffset )
             {
-                return false;
+                return ParseError::InvalidRange;
             }
             else
             {
                 if ( s.HasTemporalOffset() && s.temporalOffset > e.temporalOffset )
-                    return false;
+                    return ParseError::InvalidRange;
                 if ( s.HasSpatialOffset() && s.spatialOffset > e.spatialOffset )
-                    return false;
+                    return ParseError::InvalidRange;
             }
         }
         
         _options |= RangeTriplet;
     }
     
-    return true;
+    return ParseError::None;
 }
 bool CFI::CompileComponentsToList(const StringList &strings, ComponentList *list)
 {
-    try
-    {
-        for ( auto str : strings )
-        {
-            list->emplace_back(str);
-        }
-    }
-    catch (...)
+    for ( auto& str : strings )
     {
-        return false;
+        list->emplace_back();
+        if ( list->back().Parse(str) == false )
+            return false;
     }
     
     return true;
@@ -358,12 +425,271 @@ bool CFI::CompileComponentsToList(const StringList &strings, ComponentList *list
 
 CFI::Component::Component(const string& str) : Component()
 {
-    Parse(str);
+    if ( Parse(str) == false )
+        throw std::invalid_argument(_Str("Invalid string supplied to CFI::Component: '", str, "'"));
+}
+// Binary encoding markers. Every byte which starts a varint is at least FirstValueByte,
+//  so a marker can always be told apart from a step, and sorts before one.
+enum : uint8_t
+{
+    EndOfPath           = 0x00,
+    NextStep            = 0x01,
+    IndirectionMark     = 0x02,
+    CharacterOffsetMark = 0x03,
+    TemporalOffsetMark  = 0x04,
+    SpatialOffsetMark   = 0x05,
+    RangeMark           = 0x06,
+    
+    QualifierMark       = 0x01,
+    TextQualifierMark   = 0x02,
+    
+    FirstValueByte      = 0x08,
+    LongValueByte       = 0xF0,
+};
+
+// Values below this take one byte; larger ones take a length byte and up to four
+//  big-endian bytes, so the encoding sorts in numeric order.
+static const uint32_t SmallValueLimit = LongValueByte - FirstValueByte;
+
+static void AppendOrderedVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    if ( value < SmallValueLimit )
+    {
+        out.push_back(static_cast<uint8_t>(value + FirstValueByte));
+        return;
+    }
+    
+    int bytes = (value > 0xFFFFFF ? 4 : (value > 0xFFFF ? 3 : (value > 0xFF ? 2 : 1)));
+    out.push_back(static_cast<uint8_t>(LongValueByte + bytes));
+    for ( int i = bytes - 1; i >= 0; i-- )
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+static bool ReadOrderedVarint(const uint8_t*& p, const uint8_t* end, uint32_t* value)
+{
+    if ( p == end || *p < FirstValueByte )
+        return false;
+    
+    uint8_t first = *p++;
+    if ( first < LongValueByte )
+    {
+        *value = first - FirstValueByte;
+        return true;
+    }
+    
+    int bytes = first - LongValueByte;
+    if ( bytes < 1 || bytes > 4 || end - p < bytes )
+        return false;
+    
+    uint32_t result = 0;
+    while ( bytes-- > 0 )
+        result = (result << 8) | *p++;
+    *value = result;
+    return true;
+}
+// IEEE floats sort as integers once negative values have all their bits flipped, and
+//  positive ones just the sign bit
+static void AppendOrderedFloat(std::vector<uint8_t>& out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits = ((bits & 0x80000000) != 0 ? ~bits : bits | 0x80000000);
+    for ( int i = 3; i >= 0; i-- )
+        out.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+}
+static bool ReadOrderedFloat(const uint8_t*& p, const uint8_t* end, float* value)
+{
+    if ( end - p < 4 )
+        return false;
+    
+    uint32_t bits = 0;
+    for ( int i = 0; i < 4; i++ )
+        bits = (bits << 8) | *p++;
+    bits = ((bits & 0x80000000) != 0 ? bits & 0x7FFFFFFF : ~bits);
+    std::memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+void CFI::Encode(std::vector<uint8_t> &out) const
+{
+    out.push_back(EncodingVersion);
+    EncodePath(out, Components());
+    
+    if ( IsRangeTriplet() )
+    {
+        out.back() = RangeMark;
+        EncodePath(out, RangeStart());
+        EncodePath(out, RangeEnd());
+    }
+    
+    EncodeAssertions(out, 0, Components());
+    if ( IsRangeTriplet() )
+    {
+        EncodeAssertions(out, 1, RangeStart());
+        EncodeAssertions(out, 2, RangeEnd());
+    }
+}
+CFI CFI::Decode(const void *data, size_t length)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + length;
+    
+    if ( p == end || *p != EncodingVersion )
+        throw InvalidCFI(_Str("Unsupported binary CFI version ", (p == end ? 0 : static_cast<int>(*p))));
+    p++;
+    
+    CFI result;
+    Path& path = result.MutablePath();
+    if ( DecodePath(p, end, &path.components) == RangeMark )
+    {
+        if ( DecodePath(p, end, &path.rangeStart) != EndOfPath || DecodePath(p, end, &path.rangeEnd) != EndOfPath )
+            throw InvalidCFI("Malformed binary CFI range");
+        if ( path.rangeStart.empty() || path.rangeEnd.empty() )
+            throw InvalidCFI("Malformed binary CFI range");
+        result._options |= RangeTriplet;
+    }
+    
+    // assertions: which list, which component, which kind, then the length-prefixed bytes
+    ComponentList* lists[] = { &path.components, &path.rangeStart, &path.rangeEnd };
+    while ( p != end )
+    {
+        uint8_t part = *p++;
+        uint32_t index = 0, size = 0;
+        if ( part > 2 || p == end || !ReadOrderedVarint(p, end, &index) || index >= lists[part]->size() )
+            throw InvalidCFI("Malformed binary CFI assertion");
+        
+        uint8_t kind = (p == end ? 0 : *p++);
+        if ( (kind != QualifierMark && kind != TextQualifierMark) || !ReadOrderedVarint(p, end, &size) || static_cast<size_t>(end - p) < size )
+            throw InvalidCFI("Malformed binary CFI assertion");
+        
+        Component& component = (*lists[part])[index];
+        SharedString value(reinterpret_cast<const char*>(p), size);
+        p += size;
+        
+        if ( kind == QualifierMark )
+        {
+            component.flags |= Component::Qualifier;
+            component.qualifier = std::move(value);
+        }
+        else
+        {
+            component.flags |= Component::TextQualifier;
+            component.textQualifier = std::move(value);
+        }
+    }
+    
+    return result;
+}
+void CFI::EncodePath(std::vector<uint8_t> &out, const ComponentList &list)
+{
+    for ( size_t i = 0; i < list.size(); i++ )
+    {
+        const Component& component = list[i];
+        if ( i > 0 )
+            out.push_back(NextStep);
+        
+        AppendOrderedVarint(out, component.nodeIndex);
+        if ( component.HasCharacterOffset() )
+        {
+            out.push_back(CharacterOffsetMark);
+            AppendOrderedVarint(out, component.characterOffset);
+        }
+        if ( component.HasTemporalOffset() )
+        {
+            out.push_back(TemporalOffsetMark);
+            AppendOrderedFloat(out, component.temporalOffset);
+        }
+        if ( component.HasSpatialOffset() )
+        {
+            out.push_back(SpatialOffsetMark);
+            AppendOrderedFloat(out, component.spatialOffset.x);
+            AppendOrderedFloat(out, component.spatialOffset.y);
+        }
+        if ( component.IsIndirector() )
+            out.push_back(IndirectionMark);
+    }
+    
+    out.push_back(EndOfPath);
+}
+void CFI::EncodeAssertions(std::vector<uint8_t> &out, uint8_t part, const ComponentList &list)
+{
+    for ( size_t i = 0; i < list.size(); i++ )
+    {
+        const Component& component = list[i];
+        for ( uint8_t kind : { QualifierMark, TextQualifierMark } )
+        {
+            if ( !component.HasFlag(kind == QualifierMark ? Component::Qualifier : Component::TextQualifier) )
+                continue;
+            
+            const SharedString& value = (kind == QualifierMark ? component.qualifier : component.textQualifier);
+            out.push_back(part);
+            AppendOrderedVarint(out, static_cast<uint32_t>(i));
+            out.push_back(kind);
+            AppendOrderedVarint(out, static_cast<uint32_t>(value.size()));
+            out.insert(out.end(), value.data(), value.data() + value.size());
+        }
+    }
 }
-void CFI::Component::Parse(const string &str)
+uint8_t CFI::DecodePath(const uint8_t *&p, const uint8_t *end, ComponentList *list)
+{
+    // an empty path is just its terminator
+    if ( p != end && (*p == EndOfPath || *p == RangeMark) )
+        return *p++;
+    
+    while ( true )
+    {
+        uint32_t nodeIndex = 0;
+        if ( !ReadOrderedVarint(p, end, &nodeIndex) )
+            throw InvalidCFI("Malformed binary CFI step");
+        list->emplace_back(nodeIndex);
+        Component& component = list->back();
+        
+        // offsets and indirection, then the marker which ends the step
+        uint8_t marker = EndOfPath;
+        while ( true )
+        {
+            if ( p == end )
+                throw InvalidCFI("Truncated binary CFI");
+            
+            bool valid = true;
+            marker = *p++;
+            if ( marker == CharacterOffsetMark )
+            {
+                component.flags |= Component::CharacterOffset;
+                valid = ReadOrderedVarint(p, end, &component.characterOffset);
+            }
+            else if ( marker == TemporalOffsetMark )
+            {
+                component.flags |= Component::TemporalOffset;
+                valid = ReadOrderedFloat(p, end, &component.temporalOffset);
+            }
+            else if ( marker == SpatialOffsetMark )
+            {
+                component.flags |= Component::SpatialOffset;
+                valid = ReadOrderedFloat(p, end, &component.spatialOffset.x) && ReadOrderedFloat(p, end, &component.spatialOffset.y);
+            }
+            else if ( marker == IndirectionMark )
+            {
+                component.flags |= Component::Indirector;
+            }
+            else
+            {
+                break;
+            }
+            
+            if ( !valid )
+                throw InvalidCFI("Malformed binary CFI step");
+        }
+        
+        if ( marker == EndOfPath || marker == RangeMark )
+            return marker;
+        if ( marker != NextStep )
+            throw InvalidCFI("Malformed binary CFI step");
+    }
+}
+bool CFI::Component::Parse(const string &str)
 {
     if ( str.empty() )
-        throw std::invalid_argument("Empty string supplied to CFI::Component");
+        return false;
     
     std::string utf8 = str.stl_str();
     std::istringstream iss(utf8);
@@ -371,7 +697,7 @@ void CFI::Component::Parse(const string &str)
     // read an integer
     iss >> nodeIndex;
     if ( nodeIndex == 0 && iss.fail() )
-        throw std::invalid_argument(_Str("No node value at start of CFI::Component string '", str, "'"));
+        return false;
     
     while ( !iss.eof() )
     {
@@ -387,9 +713,9 @@ void CFI::Component::Parse(const string &str)
                 size_t end = ((size_t)iss.tellg()) - 1;
                 
                 if ( iss.eof() )
-                    throw std::invalid_argument(_Str("Invalid string supplied to CFI::Component: ", str));
+                    return false;
                 
-                if ( characterOffset != 0 )
+                if ( HasCharacterOffset() )
                 {
                     // this is a text qualifier
                     textQualifier = utf8.substr(pos, end-pos);
@@ -468,6 +794,8 @@ void CFI::Component::Parse(const string &str)
                 break;
         }
     }
+    
+    return true;
 }
 bool CFI::Component::operator==(const ePub3::CFI::Component &o) const
 {
@@ -523,9 +851,54 @@ CFI::Component& CFI::Component::operator=(const string &str)
     qualifier.clear();
     textQualifier.clear();
     
-    Parse(str);
+    if ( Parse(str) == false )
+        throw std::invalid_argument(_Str("Invalid string supplied to CFI::Component: '", str, "'"));
+    return *this;
+}
+
+CFI::SharedString::SharedString(const char* str, size_t length) : _buffer(nullptr)
+{
+    if ( length == 0 )
+        return;
+    
+    _buffer = static_cast<Buffer*>(std::malloc(offsetof(Buffer, bytes) + length + 1));
+    if ( _buffer == nullptr )
+        throw std::bad_alloc();
+    
+    ::new (&_buffer->refs) std::atomic<uint32_t>(1);
+    _buffer->length = static_cast<uint32_t>(length);
+    std::memcpy(_buffer->bytes, str, length);
+    _buffer->bytes[length] = '\0';
+}
+CFI::SharedString& CFI::SharedString::operator=(const SharedString &o)
+{
+    if ( _buffer != o._buffer )
+    {
+        Release();
+        _buffer = o._buffer;
+        Retain();
+    }
+    return *this;
+}
+CFI::SharedString& CFI::SharedString::operator=(SharedString &&o)
+{
+    if ( this != &o )
+    {
+        Release();
+        _buffer = o._buffer;
+        o._buffer = nullptr;
+    }
     return *this;
 }
+void CFI::SharedString::Release()
+{
+    if ( _buffer != nullptr && _buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+    {
+        _buffer->refs.~atomic();
+        std::free(_buffer);
+    }
+    _buffer = nullptr;
+}
 
 bool CFI::Component::Point::operator<(const ePub3::CFI::Component::Point &o) const
 {
@@ -24,6 +24,10 @@
 
 #include "epub3.h"
 #include "utfstring.h"
+#include "small_vector.h"
+#include <atomic>
+#include <cstring>
+#include <ostream>
 #include <vector>
 
 EPUB3_BEGIN_NAMESPACE
@@ -31,18 +35,18 @@ EPUB3_BEGIN_NAMESPACE
 class CFI
 {
 public:
-                    CFI() : _components(), _rangeStart(), _rangeEnd(), _options(0) {}
+                    CFI() : _path(nullptr), _options(0) {}
                     CFI(const CFI& base, const CFI& start, const CFI& end);
                     CFI(const string& str);
-                    CFI(const CFI& o) : _components(o._components), _rangeStart(o._rangeStart), _rangeEnd(o._rangeEnd), _options(o._options) {}
+                    CFI(const CFI& o) : _path(o._path), _options(o._options) { Retain(); }
                     CFI(const CFI& o, size_t fromIndex);
-                    CFI(CFI&& o) : _components(std::move(o._components)), _rangeStart(std::move(o._rangeStart)), _rangeEnd(std::move(o._rangeEnd)), _options(o._options) {}
-    virtual         ~CFI() {}
+                    CFI(CFI&& o) : _path(o._path), _options(o._options) { o._path = nullptr; }
+    virtual         ~CFI() { Release(); }
     
-    string          String()                const           { return Stringify(_components.begin(), _components.end()); }
+    string          String()                const           { return Stringify(Components().begin(), Components().end()); }
     bool            IsRangeTriplet()        const           { return (_options & RangeTriplet) == RangeTriplet; }
-    bool            Empty()                 const           { return _components.empty(); }
-    void            Clear()                                 { _components.clear(); }
+    bool            Empty()                 const           { return Components().empty() && !IsRangeTriplet(); }
+    void            Clear()                                 { if ( !Components().empty() ) MutableComponents().clear(); }
     
     bool            operator==(const CFI& o)        const;
     bool            operator==(const string& str)   const;
@@ -55,7 +59,7 @@ public:
     CFI&            Assign(const string& str);
     
     CFI&            operator=(const CFI& o)                 { return Assign(o); }
-    CFI&            operator=(CFI&& o)                      { return Assign(o); }
+    CFI&            operator=(CFI&& o)                      { return Assign(std::move(o)); }
     CFI&            operator=(const string& str)            { return Assign(str); }
     
     CFI&            Append(const CFI& cfi);
@@ -66,6 +70,49 @@ public:
     CFI             operator+(const CFI& cfi)       const   { return CFI(*this).Append(cfi); }
     CFI             operator+(const string& str)    const   { return CFI(*this).Append(str); }
     
+    ///
+    /// The version of the binary form written by Encode(), which is its first byte.
+    static const uint8_t    EncodingVersion = 1;
+    
+    /**
+     Appends a compact binary form of the CFI to a buffer.
+     
+     Step indices and offsets are written as order-preserving varints, and any
+     assertions follow the whole path, so comparing two encoded CFIs bytewise (the
+     shorter first where one is a prefix of the other) orders them by path. The CFIs
+     of everything within an element, ranges included, start with the encoding of the
+     element's own CFI less its final byte, making these suitable keys for range
+     scans in a sorted store.
+     */
+    void                    Encode(std::vector<uint8_t>& out)   const;
+    std::vector<uint8_t>    Encoded()                           const   { std::vector<uint8_t> result; Encode(result); return result; }
+    
+    /**
+     Reads a CFI written by Encode(), straight from the buffer.
+     @throws InvalidCFI if the data is truncated or malformed, or is of another version.
+     */
+    static CFI              Decode(const void* data, size_t length);
+    
+    ///
+    /// The reasons TryParse() can reject a string.
+    enum class ParseError : uint8_t
+    {
+        None,                   ///< The string is a valid CFI.
+        NotACFI,                ///< The string is empty, or is neither a path nor wrapped in `epubcfi(...)`.
+        UnterminatedQualifier,  ///< A `[` has no matching `]`.
+        InvalidStep,            ///< A step has no index, or is otherwise malformed.
+        InvalidRange,           ///< A range without three parts, with an empty start or end, or whose ends are out of order or of different kinds.
+    };
+    
+    /**
+     Parses a CFI string without throwing, for callers which expect to see malformed
+     input often enough that unwinding from the constructor would be a cost.
+     @param str The CFI, with or without its `epubcfi(...)` wrapper.
+     @param pResult Receives the parsed CFI; it is left untouched on failure.
+     @result ParseError::None, or the reason the string was rejected.
+     */
+    static ParseError       TryParse(const string& str, CFI* pResult)  noexcept;
+    
     class InvalidCFI : public std::logic_error
     {
     public:
@@ -82,6 +129,53 @@ public:
     };
     
 protected:
+    // An immutable string held in a shared, reference-counted buffer, so copying one
+    //  (and so copying a Component) never allocates.
+    class SharedString
+    {
+    public:
+                        SharedString()                          : _buffer(nullptr) {}
+                        SharedString(const char* str)           : SharedString(str, std::strlen(str)) {}
+                        SharedString(const char* str, size_t length);
+                        SharedString(const std::string& str)    : SharedString(str.data(), str.size()) {}
+                        SharedString(const string& str)         : SharedString(str.stl_str()) {}
+                        SharedString(const SharedString& o)     : _buffer(o._buffer) { Retain(); }
+                        SharedString(SharedString&& o)          : _buffer(o._buffer) { o._buffer = nullptr; }
+                        ~SharedString()                         { Release(); }
+        
+        SharedString&   operator=(const SharedString& o);
+        SharedString&   operator=(SharedString&& o);
+        
+        // the UTF-8 bytes, which are always NUL-terminated
+        const char*     data()                      const   { return (_buffer == nullptr ? "" : _buffer->bytes); }
+        size_t          size()                      const   { return (_buffer == nullptr ? 0 : _buffer->length); }
+        bool            empty()                     const   { return size() == 0; }
+        void            clear()                             { Release(); }
+        std::string     stl_str()                   const   { return std::string(data(), size()); }
+        
+        bool            operator==(const SharedString& o)   const   { return _buffer == o._buffer || (size() == o.size() && std::memcmp(data(), o.data(), size()) == 0); }
+        bool            operator!=(const SharedString& o)   const   { return !(*this == o); }
+        bool            operator==(const string& o)         const   { return size() == o.utf8_size() && std::memcmp(data(), o.c_str(), size()) == 0; }
+        bool            operator!=(const string& o)         const   { return !(*this == o); }
+        
+        friend bool     operator==(const string& a, const SharedString& b)  { return b == a; }
+        friend bool     operator!=(const string& a, const SharedString& b)  { return !(b == a); }
+        friend std::ostream& operator<<(std::ostream& stream, const SharedString& str)  { return stream.write(str.data(), static_cast<std::streamsize>(str.size())); }
+        
+    private:
+        struct Buffer
+        {
+            std::atomic<uint32_t>   refs;
+            uint32_t                length;
+            char                    bytes[1];
+        };
+        
+        Buffer*         _buffer;
+        
+        void            Retain()                            { if ( _buffer != nullptr ) _buffer->refs.fetch_add(1, std::memory_order_relaxed); }
+        void            Release();
+    };
+    
     struct Component
     {
         enum Flags : uint8_t
@@ -114,11 +208,11 @@ protected:
         
         uint8_t         flags;
         uint32_t        nodeIndex;
-        string          qualifier;
+        SharedString    qualifier;
         uint32_t        characterOffset;
         float           temporalOffset;
         Point           spatialOffset;
-        string          textQualifier;
+        SharedString    textQualifier;
         
         ////////////////////////////////////////////////////////////////////////////
         
@@ -145,7 +239,10 @@ protected:
         bool            HasSpatialTemporalOffset()          const   { return HasFlag(SpatialTemporalOffset); }
         
     private:
-        void            Parse(const string& str);
+        friend class    CFI;
+        
+        // returns false if the string isn't a valid component
+        bool            Parse(const string& str);
     };
     
     enum Options : uint8_t
@@ -153,17 +250,54 @@ protected:
         RangeTriplet        = 1<<0,
     };
     
-    typedef std::vector<Component>  ComponentList;
+    // Code which works with component lists of any size uses ComponentList, and
+    //  ComponentVector for temporary lists of its own.
+    typedef SmallVectorImpl<Component>  ComponentList;
+    typedef SmallVector<Component, 8>   ComponentVector;
     
-    ComponentList   _components;
-    uint8_t         _options;
+    // A CFI's component lists live in one immutable, reference-counted buffer, so
+    //  copying a CFI only adds a reference. The lists are sized so a package CFI (the
+    //  spine step, its indirection, then the steps within the document) and the ends
+    //  of a typical range need no allocation beyond the buffer itself.
+    struct Path
+    {
+        std::atomic<uint32_t>       refs;
+        ComponentVector             components;
+        SmallVector<Component, 4>   rangeStart;
+        SmallVector<Component, 4>   rangeEnd;
+        
+                        Path()                  : refs(1) {}
+                        Path(const Path& o)     : refs(1), components(o.components), rangeStart(o.rangeStart), rangeEnd(o.rangeEnd) {}
+    };
+    
+    Path*                           _path;          // nullptr if there are no components
+    uint8_t                         _options;
+    
+    static const Path&  EmptyPath();
+    void                Retain()                            { if ( _path != nullptr ) _path->refs.fetch_add(1, std::memory_order_relaxed); }
+    void                Release();
     
-    ComponentList   _rangeStart;
-    ComponentList   _rangeEnd;
+    // gives this CFI a buffer of its own, which it can then change
+    Path&               MutablePath();
+    
+    // the shared path, and the two ends of a range; reading these never copies anything
+    const ComponentList&    Components()            const   { return (_path == nullptr ? EmptyPath() : *_path).components; }
+    const ComponentList&    RangeStart()            const   { return (_path == nullptr ? EmptyPath() : *_path).rangeStart; }
+    const ComponentList&    RangeEnd()              const   { return (_path == nullptr ? EmptyPath() : *_path).rangeEnd; }
+    
+    // these copy the buffer first if it's shared, so references into them mustn't be
+    //  held while the CFI is copied
+    ComponentList&          MutableComponents()             { return MutablePath().components; }
+    ComponentList&          MutableRangeStart()             { return MutablePath().rangeStart; }
+    ComponentList&          MutableRangeEnd()               { return MutablePath().rangeEnd; }
     
     // PackageBase should be able to work with components
     friend class    PackageBase;
     friend class    Package;
+    friend class    CFIResolver;
+    friend class    CFIReanchorer;
+    friend class    AnnotationStore;
+    friend class    ReadingProgress;
     
     size_t              TotalComponents()                   const;
     string              SubCFIFromIndex(size_t index)       const;
@@ -172,10 +306,15 @@ protected:
     static void         AppendComponents(std::stringstream& stream, ComponentList::const_iterator start, ComponentList::const_iterator end);
     
     typedef std::vector<string>    StringList;
-    static StringList   CFIComponentStrings(const string& cfi, const string& delimiter = "/");
-    static StringList   RangedCFIComponents(const string& cfi)          { return CFIComponentStrings(cfi, ","); }
+    // these return false if a qualifier is unterminated
+    static bool         CFIComponentStrings(const string& cfi, StringList* components, const string& delimiter = "/");
+    static bool         RangedCFIComponents(const string& cfi, StringList* components)     { return CFIComponentStrings(cfi, components, ","); }
     static bool         CompileComponentsToList(const StringList& strings, ComponentList* list);
-    bool                CompileCFI(const string& str);
+    ParseError          CompileCFI(const string& str);
+    
+    static void         EncodePath(std::vector<uint8_t>& out, const ComponentList& list);
+    static void         EncodeAssertions(std::vector<uint8_t>& out, uint8_t part, const ComponentList& list);
+    static uint8_t      DecodePath(const uint8_t*& p, const uint8_t* end, ComponentList* list);
 };
 
 EPUB3_END_NAMESPACE
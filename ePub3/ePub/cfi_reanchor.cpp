@@ -0,0 +1,451 @@
+//
+//  cfi_reanchor.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "cfi_reanchor.h"
+#include "package.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+EPUB3_BEGIN_NAMESPACE
+
+const uint32_t CFIReanchorer::DefaultSearchRadius;
+
+static const CFIReanchorer::NodeIndex NoNode = xml::CompactDocument::NoNode;
+
+// contexts shorter than this many bytes match too often to be worth searching for
+static const size_t MinimumContext = 4;
+
+// see CFIReanchorer::Result
+static const float ExactConfidence      = 1.0f;
+static const float UnverifiedConfidence = 0.75f;
+static const float SearchedConfidence   = 0.9f;
+static const float PartialConfidence    = 0.6f;
+static const float PathOnlyConfidence   = 0.2f;
+
+// the characters a text assertion escapes with a circumflex
+static const char* const SpecialCharacters = "^[](),;=";
+
+// splits a text assertion into the text before and after its location, unescaping it
+//  and dropping any parameters; a lone value is the text before
+static void ParseAssertion(const char* str, size_t length, std::string* before, std::string* after)
+{
+    std::string* current = before;
+    for ( size_t i = 0; i < length; i++ )
+    {
+        if ( str[i] == '^' && i+1 < length )
+            current->push_back(str[++i]);
+        else if ( str[i] == ',' && current == before )
+            current = after;
+        else if ( str[i] == ';' )
+            break;
+        else
+            current->push_back(str[i]);
+    }
+}
+static void AppendEscaped(std::string& out, const char* str, size_t length)
+{
+    for ( size_t i = 0; i < length; i++ )
+    {
+        if ( str[i] != '\0' && std::strchr(SpecialCharacters, str[i]) != nullptr )
+            out.push_back('^');
+        out.push_back(str[i]);
+    }
+}
+
+// calls `found` with the start of each occurrence of `needle` within `text[lo, hi)`,
+//  comparing bytes only where a rolling hash of the window matches the needle's
+template <class _Function>
+static void FindOccurrences(const char* text, size_t lo, size_t hi, const std::string& needle, _Function found)
+{
+    const uint32_t Base = 257;
+    size_t length = needle.size();
+    if ( length == 0 || hi < lo + length )
+        return;
+    
+    uint32_t target = 0, hash = 0, power = 1;
+    for ( size_t i = 0; i < length; i++ )
+    {
+        target = target * Base + static_cast<uint8_t>(needle[i]);
+        hash = hash * Base + static_cast<uint8_t>(text[lo+i]);
+        if ( i > 0 )
+            power *= Base;
+    }
+    
+    for ( size_t pos = lo; ; pos++ )
+    {
+        if ( hash == target && std::memcmp(text + pos, needle.data(), length) == 0 )
+            found(pos);
+        if ( pos + length >= hi )
+            break;
+        hash = (hash - static_cast<uint8_t>(text[pos]) * power) * Base + static_cast<uint8_t>(text[pos+length]);
+    }
+}
+
+// scales a search's base confidence by how far the match lies from where it was
+//  expected, and by whether it was the only one
+static float SearchConfidence(float base, size_t distance, uint32_t radius, size_t matches)
+{
+    float result = base * (1.0f - 0.5f * static_cast<float>(distance) / static_cast<float>(radius + 1));
+    if ( matches > 1 )
+        result *= 0.8f;
+    return result;
+}
+
+CFIReanchorer::CFIReanchorer(const xml::CompactDocument& document, UTFOffsetMap::Unit offsetUnit, uint32_t searchRadius)
+    : _document(document), _resolver(document, offsetUnit), _searchRadius(searchRadius), _text(nullptr), _textLength(0)
+{
+    _text = document.DocumentText(&_textLength);
+    for ( NodeIndex n = 0; n < document.NodeCount(); n++ )
+    {
+        if ( document.IsText(n) )
+            _textNodes.push_back(n);
+    }
+}
+CFIReanchorer::Result CFIReanchorer::Reanchor(const CFI &cfi, const CFI &base) const
+{
+    Result result{CFI(), 0.0f, Method::Failed};
+    auto setAssertion = [](CFI::Component& component, const Anchor& anchor) {
+        if ( !anchor.hasAssertion )
+            return;
+        component.flags |= CFI::Component::TextQualifier;
+        component.textQualifier = anchor.assertion;
+    };
+    
+    if ( !cfi.IsRangeTriplet() )
+    {
+        if ( cfi.Empty() )
+            return Result{base, ExactConfidence, Method::Exact};
+        
+        CFI path(cfi);
+        Anchor anchor = Relocate(path);
+        if ( anchor.method == Method::Failed )
+            return result;
+        
+        result.cfi = _resolver.CFIForLocation(anchor.location, base);
+        if ( !result.cfi.Components().empty() )
+            setAssertion(result.cfi.MutableComponents().back(), anchor);
+        result.confidence = anchor.confidence;
+        result.method = anchor.method;
+        return result;
+    }
+    
+    // each end of a range is relocated on its own
+    CFI startPath, endPath;
+    CFI::ComponentList& startSteps = startPath.MutableComponents();
+    startSteps.assign(cfi.Components().begin(), cfi.Components().end());
+    startSteps.insert(startSteps.end(), cfi.RangeStart().begin(), cfi.RangeStart().end());
+    CFI::ComponentList& endSteps = endPath.MutableComponents();
+    endSteps.assign(cfi.Components().begin(), cfi.Components().end());
+    endSteps.insert(endSteps.end(), cfi.RangeEnd().begin(), cfi.RangeEnd().end());
+    
+    Anchor start = Relocate(startPath), end = Relocate(endPath);
+    if ( start.method == Method::Failed || end.method == Method::Failed )
+        return result;
+    
+    try
+    {
+        result.cfi = _resolver.CFIForRange(start.location, end.location, base);
+    }
+    catch (std::invalid_argument&)
+    {
+        // the ends were found out of order
+        return result;
+    }
+    
+    setAssertion(result.cfi.MutableRangeStart().back(), start);
+    setAssertion(result.cfi.MutableRangeEnd().back(), end);
+    result.confidence = std::min(start.confidence, end.confidence);
+    result.method = std::max(start.method, end.method);
+    return result;
+}
+std::vector<CFIReanchorer::Result> CFIReanchorer::ReanchorAll(const Package *package, const std::vector<CFI> &cfis,
+                                                              UTFOffsetMap::Unit offsetUnit, uint32_t searchRadius)
+{
+    typedef std::vector<std::pair<size_t, CFI>> RemainderList;
+    std::vector<Result> results(cfis.size(), Result{CFI(), 0.0f, Method::Failed});
+    
+    // the rest of each CFI, grouped by document, in the order the documents are first seen
+    std::unordered_map<const ManifestItem*, RemainderList> documents;
+    std::vector<const ManifestItem*> order;
+    for ( size_t i = 0; i < cfis.size(); i++ )
+    {
+        CFI cfi(cfis[i]), remainder;
+        const ManifestItem* item = nullptr;
+        Package::CFILookupError error = package->TryManifestItemForCFI(cfi, &item, &remainder);
+        if ( error == Package::CFILookupError::SpineIndexOutOfRange && cfi.Components()[1].HasQualifier() )
+        {
+            // the spine has shrunk, but the document may still be in it
+            const SpineItem* spineItem = package->SpineItemWithIDRef(cfi.Components()[1].qualifier.stl_str());
+            item = (spineItem == nullptr ? nullptr : spineItem->ManifestItem());
+            if ( item != nullptr )
+                remainder.Assign(cfi, 2);
+        }
+        else if ( error != Package::CFILookupError::None )
+        {
+            continue;
+        }
+        
+        if ( item == nullptr )
+            continue;
+        
+        RemainderList& list = documents[item];
+        if ( list.empty() )
+            order.push_back(item);
+        list.emplace_back(i, std::move(remainder));
+    }
+    
+    // runs on a worker thread, and writes only its own CFIs' results
+    auto relocate = [&results, offsetUnit, searchRadius](const RemainderList* list, const xml::CompactDocument* document, const CFI& base) {
+        CFIReanchorer reanchorer(*document, offsetUnit, searchRadius);
+        for ( auto& entry : *list )
+            results[entry.first] = reanchorer.Reanchor(entry.second, base);
+    };
+    
+    // the archive is only read here; a window of documents is searched meanwhile
+    TaskWindow<void> pending(WorkerPool::Shared());
+    for ( const ManifestItem* item : order )
+    {
+        Auto<xml::CompactDocument> document;
+        try
+        {
+            document.reset(item->ReferencedCompactDocument());
+        }
+        catch (std::exception&)
+        {
+        }
+        
+        if ( !document )
+            continue;
+        
+        const RemainderList* list = &documents[item];
+        std::shared_ptr<xml::CompactDocument> shared(std::move(document));
+        CFI base = package->CFIForManifestItem(item);
+        pending.Submit([&relocate, list, shared, base]() { relocate(list, shared.get(), base); });
+        while ( pending.IsFull() )
+            pending.Next();
+    }
+    
+    while ( !pending.IsEmpty() )
+        pending.Next();
+    
+    return results;
+}
+CFIReanchorer::Anchor CFIReanchorer::Relocate(CFI &path) const
+{
+    Anchor anchor{Location{NoNode, NoNode, 0, false, 0}, 0.0f, Method::Failed, false, std::string()};
+    
+    // resolving may correct the path, so take what we need from it first
+    std::string before, after;
+    const CFI::Component& last = path.Components().back();
+    bool hasIdentity = last.HasQualifier();
+    if ( last.HasCharacterOffset() && last.HasTextQualifier() )
+    {
+        anchor.hasAssertion = true;
+        anchor.assertion = last.textQualifier.stl_str();
+        ParseAssertion(last.textQualifier.data(), last.textQualifier.size(), &before, &after);
+    }
+    
+    // try the path as it stands
+    bool resolved = false;
+    size_t position = 0;
+    try
+    {
+        anchor.location = _resolver.Resolve(path).start;
+        resolved = true;
+    }
+    catch (CFI::InvalidCFI&)
+    {
+    }
+    
+    if ( resolved )
+    {
+        if ( !anchor.hasAssertion )
+        {
+            anchor.method = (hasIdentity ? Method::Exact : Method::Unverified);
+            anchor.confidence = (hasIdentity ? ExactConfidence : UnverifiedConfidence);
+            return anchor;
+        }
+        
+        position = TextPosition(anchor.location);
+        if ( position >= before.size() && position + after.size() <= _textLength
+            && std::memcmp(_text + position - before.size(), before.data(), before.size()) == 0
+            && std::memcmp(_text + position, after.data(), after.size()) == 0 )
+        {
+            anchor.method = Method::Exact;
+            anchor.confidence = ExactConfidence;
+            return anchor;
+        }
+    }
+    else
+    {
+        // without an assertion there's nothing to look for
+        if ( !anchor.hasAssertion )
+            return anchor;
+        
+        // search around the deepest part of the path which still exists
+        CFI prefix;
+        for ( size_t count = path.Components().size() - 1; count > 0; count-- )
+        {
+            prefix.MutableComponents().assign(path.Components().begin(), path.Components().begin() + count);
+            try
+            {
+                position = TextPosition(_resolver.Resolve(prefix).start);
+                break;
+            }
+            catch (CFI::InvalidCFI&)
+            {
+            }
+        }
+    }
+    
+    // the whole context, then either side of it, in case one was edited
+    size_t found = 0, matches = 0;
+    float base = SearchedConfidence;
+    Method method = Method::Searched;
+    bool success = false;
+    
+    if ( before.size() + after.size() >= MinimumContext )
+        success = FindNearest(before + after, before.size(), position, &found, &matches);
+    
+    if ( !success )
+    {
+        size_t beforeFound = 0, beforeMatches = 0, afterFound = 0, afterMatches = 0;
+        bool hasBefore = (before.size() >= MinimumContext && FindNearest(before, before.size(), position, &beforeFound, &beforeMatches));
+        bool hasAfter = (after.size() >= MinimumContext && FindNearest(after, 0, position, &afterFound, &afterMatches));
+        
+        auto distance = [position](size_t at) { return (at > position ? at - position : position - at); };
+        if ( hasBefore && (!hasAfter || distance(beforeFound) <= distance(afterFound)) )
+        {
+            found = beforeFound;
+            matches = beforeMatches;
+            success = true;
+        }
+        else if ( hasAfter )
+        {
+            found = afterFound;
+            matches = afterMatches;
+            success = true;
+        }
+        
+        base = PartialConfidence;
+        method = Method::Partial;
+    }
+    
+    if ( success )
+    {
+        size_t distance = (found > position ? found - position : position - found);
+        anchor.location = LocationAtTextPosition(found);
+        anchor.assertion = AssertionAt(found, before.size(), after.size());
+        anchor.method = method;
+        anchor.confidence = SearchConfidence(base, distance, _searchRadius, matches);
+    }
+    else if ( resolved )
+    {
+        // keep the old assertion, so it won't look like a match next time either
+        anchor.method = Method::PathOnly;
+        anchor.confidence = PathOnlyConfidence;
+    }
+    
+    return anchor;
+}
+size_t CFIReanchorer::TextPosition(const Location &location) const
+{
+    if ( location.node != NoNode && _document.IsText(location.node) )
+    {
+        uint32_t offset = (location.hasCharacterOffset ? location.characterOffset : 0);
+        return _document.TextOffset(location.node) + _document.OffsetMap(location.node).Convert(offset, UTFOffsetMap::Unit::CodePoint, UTFOffsetMap::Unit::UTF8);
+    }
+    
+    // the text within an element, or following an empty chunk, comes after any text
+    //  node preceding it in document order
+    NodeIndex preceding = location.node;
+    if ( preceding == NoNode && location.parent != NoNode )
+    {
+        NodeIndex next = _document.ChildAtCFIIndex(location.parent, location.step + 1);
+        preceding = (next == NoNode ? location.parent : next - 1);
+    }
+    
+    auto pos = std::upper_bound(_textNodes.begin(), _textNodes.end(), preceding);
+    return (pos == _textNodes.end() ? _textLength : _document.TextOffset(*pos));
+}
+CFIResolver::Location CFIReanchorer::LocationAtTextPosition(size_t position) const
+{
+    // the last text node starting at or before the position, so a position between
+    //  two nodes belongs to the second
+    auto pos = std::upper_bound(_textNodes.begin(), _textNodes.end(), position, [this](size_t value, NodeIndex n) {
+        return value < _document.TextOffset(n);
+    });
+    if ( pos == _textNodes.begin() )
+        return Location{NoNode, NoNode, 0, false, 0};
+    
+    NodeIndex node = *(pos - 1);
+    uint32_t bytes = static_cast<uint32_t>(position - _document.TextOffset(node));
+    uint32_t offset = _document.OffsetMap(node).Convert(bytes, UTFOffsetMap::Unit::UTF8, UTFOffsetMap::Unit::CodePoint);
+    return Location{node, _document.Parent(node), _document.CFIIndex(node), true, offset};
+}
+bool CFIReanchorer::FindNearest(const std::string &needle, size_t mark, size_t center, size_t *position, size_t *matches) const
+{
+    size_t reach = _searchRadius + needle.size();
+    size_t lo = (center > reach ? center - reach : 0);
+    size_t hi = std::min(_textLength, center + reach);
+    
+    bool found = false;
+    size_t bestDistance = 0;
+    *matches = 0;
+    FindOccurrences(_text, lo, hi, needle, [&](size_t start) {
+        size_t at = start + mark;
+        size_t distance = (at > center ? at - center : center - at);
+        if ( distance > _searchRadius )
+            return;
+        
+        (*matches)++;
+        if ( !found || distance < bestDistance )
+        {
+            found = true;
+            bestDistance = distance;
+            *position = at;
+        }
+    });
+    
+    return found;
+}
+std::string CFIReanchorer::AssertionAt(size_t position, size_t beforeLength, size_t afterLength) const
+{
+    size_t start = position - std::min(position, beforeLength);
+    size_t end = std::min(_textLength, position + afterLength);
+    
+    // don't split a code point
+    while ( start < position && (static_cast<uint8_t>(_text[start]) & 0xC0) == 0x80 )
+        start++;
+    while ( end > position && end < _textLength && (static_cast<uint8_t>(_text[end]) & 0xC0) == 0x80 )
+        end--;
+    
+    std::string result;
+    AppendEscaped(result, _text + start, position - start);
+    result.push_back(',');
+    AppendEscaped(result, _text + position, end - position);
+    return result;
+}
+
+EPUB3_END_NAMESPACE
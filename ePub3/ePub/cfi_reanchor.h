@@ -0,0 +1,159 @@
+//
+//  cfi_reanchor.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__cfi_reanchor__
+#define __ePub3__cfi_reanchor__
+
+#include "epub3.h"
+#include "cfi_resolver.h"
+#include <string>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+class Package;
+
+/**
+ Relocates CFIs which were generated against an earlier revision of a publication.
+ 
+ A CFI is tried exactly first. If its path still exists and its text assertion (the
+ `[before,after]` following a character offset) matches the text there, it's kept.
+ Otherwise the text around where the path leads (or the nearest part of it which
+ still exists) is searched for the asserted context with a rolling hash, and the
+ CFI is regenerated for the nearest match, with a fresh assertion.
+ 
+ ```
+ CFIReanchorer reanchorer(*doc);
+ CFIReanchorer::Result result = reanchorer.Reanchor(remainder, package->CFIForManifestItem(item));
+ if ( result.confidence >= 0.5 )
+     annotation.cfi = result.cfi;
+ ```
+ 
+ To migrate a publication's worth of CFIs, use ReanchorAll(), which loads each
+ content document once and relocates the CFIs in different documents in parallel.
+ */
+class CFIReanchorer
+{
+public:
+    typedef xml::CompactDocument::NodeIndex NodeIndex;
+    
+    ///
+    /// How a CFI was relocated, from most to least certain.
+    enum class Method : uint8_t
+    {
+        Exact,          ///< The path leads to the asserted text, or ends at an element with an `[id]` assertion.
+        Unverified,     ///< The path still exists, but there's no assertion to confirm it.
+        Searched,       ///< The asserted text was found near where the path led.
+        Partial,        ///< Only the text before or after the location was found.
+        PathOnly,       ///< The path still exists, but the asserted text wasn't found.
+        Failed,         ///< Neither the path nor the asserted text could be found.
+    };
+    
+    /**
+     A relocated CFI.
+     
+     The confidence is 1 for an exact match, 0.75 for an unverified one, and 0.2 when
+     only the path survives. Text found by searching scores up to 0.9 with both sides
+     of the assertion and 0.6 with one; this falls by up to half as the match gets
+     further from where the path led, and by a fifth if the text occurs more than
+     once within the search radius. A range scores as its weaker end.
+     */
+    struct Result
+    {
+        CFI         cfi;            ///< The relocated CFI; empty if `method` is Failed.
+        float       confidence;
+        Method      method;
+    };
+    
+    ///
+    /// How far either side of the old location to search, in bytes of text.
+    static const uint32_t   DefaultSearchRadius = 4096;
+    
+    /**
+     @param document The revised content document.
+     @param offsetUnit The unit of the CFIs' character offsets; see CFIResolver.
+     @param searchRadius How far either side of the old location to search.
+     */
+                    CFIReanchorer(const xml::CompactDocument& document, UTFOffsetMap::Unit offsetUnit = UTFOffsetMap::Unit::CodePoint,
+                                  uint32_t searchRadius = DefaultSearchRadius);
+                    CFIReanchorer(const CFIReanchorer&) = default;
+                    ~CFIReanchorer() {}
+    
+    /**
+     Relocates a CFI within the document.
+     @param cfi The CFI, without any steps leading to the document.
+     @param base A CFI to append the relocated path to, usually the one returned by
+     Package::CFIForManifestItem() for the document.
+     */
+    Result          Reanchor(const CFI& cfi, const CFI& base = CFI())   const;
+    
+    /**
+     Relocates CFIs against a revised publication.
+     
+     Each CFI's spine step is matched by its `[idref]` assertion where it has one, so
+     CFIs follow their documents if the spine is reordered.
+     @param package The revised package.
+     @param cfis Complete CFIs, as generated against the earlier revision.
+     @result One result for each CFI, in the same order as `cfis`.
+     */
+    static std::vector<Result>  ReanchorAll(const Package* package, const std::vector<CFI>& cfis,
+                                            UTFOffsetMap::Unit offsetUnit = UTFOffsetMap::Unit::CodePoint,
+                                            uint32_t searchRadius = DefaultSearchRadius);
+    
+protected:
+    typedef CFIResolver::Location   Location;
+    
+    // where one location CFI now points, and the text assertion to give it
+    struct Anchor
+    {
+        Location        location;
+        float           confidence;
+        Method          method;
+        bool            hasAssertion;
+        std::string     assertion;      // escaped, as it appears between the brackets
+    };
+    
+    const xml::CompactDocument&     _document;
+    CFIResolver                     _resolver;
+    uint32_t                        _searchRadius;
+    const char*                     _text;
+    size_t                          _textLength;
+    std::vector<NodeIndex>          _textNodes;         // in document order, so also in order of TextOffset()
+    
+    Anchor          Relocate(CFI& path)                         const;
+    
+    // the byte offset within the document's text of a location, or of the text following it
+    size_t          TextPosition(const Location& location)      const;
+    Location        LocationAtTextPosition(size_t position)     const;
+    
+    // finds the occurrence of `needle` whose byte `mark` lies nearest `center`, within
+    //  the search radius; returns false if there is none
+    bool            FindNearest(const std::string& needle, size_t mark, size_t center, size_t* position, size_t* matches) const;
+    
+    // an assertion for the text either side of a position, of the given byte lengths
+    std::string     AssertionAt(size_t position, size_t beforeLength, size_t afterLength)   const;
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__cfi_reanchor__) */
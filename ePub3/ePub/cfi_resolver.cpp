@@ -0,0 +1,319 @@
+//
+//  cfi_resolver.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "cfi_resolver.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+EPUB3_BEGIN_NAMESPACE
+
+static const CFIResolver::NodeIndex NoNode = xml::CompactDocument::NoNode;
+
+CFIResolver::Resolution CFIResolver::Resolve(CFI &cfi) const
+{
+    return Resolve(cfi, nullptr);
+}
+std::vector<CFIResolver::BatchResult> CFIResolver::ResolveAll(std::vector<CFI> &cfis) const
+{
+    // visit the CFIs in path order, so each shares as much of its walk as it can with the last
+    std::vector<size_t> order(cfis.size());
+    for ( size_t i = 0; i < order.size(); i++ )
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&cfis](size_t a, size_t b) {
+        const CFI::ComponentList &x = cfis[a].Components(), &y = cfis[b].Components();
+        return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end(), [](const CFI::Component& l, const CFI::Component& r) {
+            return l.nodeIndex < r.nodeIndex;
+        });
+    });
+    
+    std::vector<BatchResult> results(cfis.size());
+    std::vector<NodeIndex> trail;
+    const CFI::ComponentList* previous = nullptr;
+    
+    for ( size_t index : order )
+    {
+        const CFI::ComponentList& components = cfis[index].Components();
+        
+        // keep the nodes reached by the steps this path shares with the last one
+        size_t shared = 0;
+        if ( previous != nullptr )
+        {
+            size_t limit = std::min(trail.size(), components.size());
+            while ( shared < limit && SameStep(components[shared], (*previous)[shared]) )
+                shared++;
+        }
+        trail.resize(shared);
+        
+        BatchResult& result = results[index];
+        try
+        {
+            result.resolution = Resolve(cfis[index], &trail);
+            result.resolved = true;
+        }
+        catch (CFI::InvalidCFI& e)
+        {
+            result.resolved = false;
+            result.error = e.what();
+        }
+        
+        // a correction gives the CFI new components, which the trail now follows
+        previous = &cfis[index].Components();
+    }
+    
+    return results;
+}
+CFIResolver::Resolution CFIResolver::Resolve(CFI &cfi, std::vector<NodeIndex>* trail) const
+{
+    Resolution result;
+    result.start = Walk(_document.Root(), cfi, cfi.Components(), &CFI::MutableComponents, trail);
+    result.isRange = cfi.IsRangeTriplet();
+    if ( !result.isRange )
+    {
+        result.end = result.start;
+        return result;
+    }
+    
+    // the start and end paths continue from wherever the shared path leads
+    NodeIndex base = result.start.node;
+    if ( base == NoNode || _document.IsText(base) || result.start.hasCharacterOffset )
+        throw CFI::InvalidCFI("CFI range's shared path must lead to an element");
+    if ( cfi.RangeStart().empty() || cfi.RangeEnd().empty() )
+        throw CFI::InvalidCFI("CFI range is missing its start or end");
+    
+    result.start = Walk(base, cfi, cfi.RangeStart(), &CFI::MutableRangeStart);
+    result.end = Walk(base, cfi, cfi.RangeEnd(), &CFI::MutableRangeEnd);
+    
+    // nodes are numbered in document order; an empty chunk has no number to compare
+    if ( result.start.node != NoNode && result.end.node != NoNode )
+    {
+        if ( result.end.node < result.start.node ||
+            (result.end.node == result.start.node && result.end.characterOffset < result.start.characterOffset) )
+            throw CFI::InvalidCFI("CFI range ends before it starts");
+    }
+    
+    return result;
+}
+CFIResolver::Location CFIResolver::Walk(NodeIndex from, CFI& cfi, const CFI::ComponentList& list, MutableList mutableList, std::vector<NodeIndex>* trail) const
+{
+    // read in place, until there's something to correct
+    const CFI::ComponentList* components = &list;
+
+    Location location{from, _document.Parent(from), 0, false, 0};
+    
+    // pick up after any steps the trail has already taken
+    size_t i = 0;
+    if ( trail != nullptr && !trail->empty() )
+    {
+        i = trail->size();
+        NodeIndex parent = (i > 1 ? (*trail)[i-2] : from);
+        location = Location{trail->back(), parent, (*components)[i-1].nodeIndex, false, 0};
+    }
+    
+    for ( ; i < components->size(); i++ )
+    {
+        NodeIndex parent = location.node;
+        if ( parent == NoNode || _document.IsText(parent) )
+            throw CFI::InvalidCFI(_Str("CFI step ", i+1, " continues past character data"));
+        
+        const CFI::Component& component = (*components)[i];
+        if ( component.IsIndirector() )
+            throw CFI::InvalidCFI("CFI indirection within a content document isn't supported");
+        
+        uint32_t index = component.nodeIndex;
+        NodeIndex child = _document.ChildAtCFIIndex(parent, index);
+        if ( (index % 2) == 0 && component.HasQualifier() )
+        {
+            std::string ident = component.qualifier.stl_str();
+            const char* actual = (child == NoNode ? nullptr : _document.Attribute(child, "id"));
+            if ( actual == nullptr || ident != actual )
+            {
+                // the assertion wins, so long as it names somewhere within `from`
+                NodeIndex target = _document.ElementWithID(ident.c_str());
+                NodeIndex ancestor = target;
+                while ( ancestor != NoNode && ancestor != from )
+                    ancestor = _document.Parent(ancestor);
+                if ( target == NoNode || ancestor == NoNode || target == from )
+                    throw CFI::InvalidCFI(_Str("CFI step ", i+1, " asserts id '", ident, "', but no element there has it"));
+                
+                CFI::ComponentList& corrected = (cfi.*mutableList)();
+                i = ReplacePath(from, target, corrected, i+1) - 1;
+                components = &corrected;
+                location = Location{target, _document.Parent(target), corrected[i].nodeIndex, false, 0};
+                
+                if ( trail != nullptr )
+                {
+                    trail->clear();
+                    for ( NodeIndex node = target; node != from; node = _document.Parent(node) )
+                        trail->push_back(node);
+                    std::reverse(trail->begin(), trail->end());
+                }
+                continue;
+            }
+        }
+        
+        if ( child == NoNode )
+        {
+            // odd steps may select an empty chunk of character data, but only to end on
+            bool emptyChunk = (index % 2) == 1 && index <= _document.ChildElementCount(parent) * 2 + 1;
+            if ( !emptyChunk )
+                throw CFI::InvalidCFI(_Str("CFI step ", i+1, " (", index, ") doesn't exist in the document"));
+        }
+        
+        location = Location{child, parent, index, false, 0};
+        if ( trail != nullptr )
+            trail->push_back(child);
+    }
+    
+    if ( components->empty() || !components->back().HasCharacterOffset() )
+        return location;
+    
+    uint32_t offset = components->back().characterOffset;
+    bool valid = true;
+    if ( location.node == NoNode )
+    {
+        valid = (offset == 0);
+    }
+    else if ( _document.IsText(location.node) )
+    {
+        const UTFOffsetMap& map = _document.OffsetMap(location.node);
+        valid = (offset <= map.Length(_offsetUnit));
+        offset = map.Convert(offset, _offsetUnit, UTFOffsetMap::Unit::CodePoint);
+    }
+    if ( !valid )
+        throw CFI::InvalidCFI(_Str("CFI character offset ", offset, " lies beyond the end of its text"));
+    
+    location.hasCharacterOffset = true;
+    location.characterOffset = offset;
+    return location;
+}
+CFI CFIResolver::CFIForLocation(const Location &location, const CFI &base) const
+{
+    if ( base.IsRangeTriplet() )
+        throw CFI::RangedCFIAppendAttempt("Can't append a location to a range CFI");
+    
+    CFI result(base);
+    AppendLocation(location, result.MutableComponents());
+    return result;
+}
+CFI CFIResolver::CFIForRange(const Location &start, const Location &end, const CFI &base) const
+{
+    if ( base.IsRangeTriplet() )
+        throw CFI::RangedCFIAppendAttempt("Can't append a range to a range CFI");
+    
+    if ( start.hasCharacterOffset != end.hasCharacterOffset )
+        throw std::invalid_argument("Both ends of a CFI range need the same kind of offset");
+    
+    CFI::ComponentVector startPath, endPath;
+    AppendLocation(start, startPath);
+    AppendLocation(end, endPath);
+    if ( startPath.empty() || endPath.empty() )
+        throw std::invalid_argument("A CFI range can't start or end at the root element");
+    
+    // the same steps from the root lead to the same nodes
+    size_t common = 0;
+    while ( common < startPath.size() && common < endPath.size() && startPath[common].nodeIndex == endPath[common].nodeIndex )
+        common++;
+    
+    bool ordered;
+    if ( common < startPath.size() && common < endPath.size() )
+        ordered = startPath[common].nodeIndex < endPath[common].nodeIndex;
+    else if ( startPath.size() == endPath.size() )
+        ordered = start.characterOffset <= end.characterOffset;
+    else
+        ordered = startPath.size() < endPath.size();        // an element precedes its contents
+    if ( !ordered )
+        throw std::invalid_argument("CFI range ends before it starts");
+    
+    // leave at least one step for each end
+    common = std::min(common, std::min(startPath.size(), endPath.size()) - 1);
+    
+    CFI result(base);
+    CFI::ComponentList& components = result.MutableComponents();
+    components.insert(components.end(), std::make_move_iterator(startPath.begin()), std::make_move_iterator(startPath.begin() + common));
+    result.MutableRangeStart().assign(std::make_move_iterator(startPath.begin() + common), std::make_move_iterator(startPath.end()));
+    result.MutableRangeEnd().assign(std::make_move_iterator(endPath.begin() + common), std::make_move_iterator(endPath.end()));
+    result._options |= CFI::RangeTriplet;
+    return result;
+}
+void CFIResolver::AppendPath(NodeIndex from, NodeIndex to, CFI::ComponentList &components) const
+{
+    size_t first = components.size();
+    for ( NodeIndex node = to; node != from; node = _document.Parent(node) )
+    {
+        components.emplace_back(_document.CFIIndex(node));
+        
+        const char* ident = (_document.IsElement(node) ? _document.Attribute(node, "id") : nullptr);
+        if ( ident != nullptr )
+        {
+            CFI::Component& component = components.back();
+            component.flags |= CFI::Component::Qualifier;
+            component.qualifier = ident;
+        }
+    }
+    std::reverse(components.begin() + first, components.end());
+}
+void CFIResolver::AppendLocation(const Location &location, CFI::ComponentList &components) const
+{
+    size_t first = components.size();
+    if ( location.node != NoNode )
+    {
+        AppendPath(_document.Root(), location.node, components);
+    }
+    else
+    {
+        AppendPath(_document.Root(), location.parent, components);
+        components.emplace_back(location.step);
+    }
+    
+    // the root has no step to carry an offset
+    if ( location.hasCharacterOffset && components.size() > first )
+    {
+        CFI::Component& component = components.back();
+        component.flags |= CFI::Component::CharacterOffset;
+        component.characterOffset = location.characterOffset;
+        
+        if ( location.node != NoNode && _document.IsText(location.node) && _offsetUnit != UTFOffsetMap::Unit::CodePoint )
+            component.characterOffset = _document.OffsetMap(location.node).Convert(location.characterOffset, UTFOffsetMap::Unit::CodePoint, _offsetUnit);
+    }
+}
+size_t CFIResolver::ReplacePath(NodeIndex from, NodeIndex to, CFI::ComponentList &components, size_t count) const
+{
+    CFI::ComponentVector path;
+    AppendPath(from, to, path);
+    
+    CFI::Component last = components[count-1];
+    last.nodeIndex = path.back().nodeIndex;
+    path.back() = std::move(last);
+    
+    components.erase(components.begin(), components.begin() + count);
+    components.insert(components.begin(), path.begin(), path.end());
+    return path.size();
+}
+bool CFIResolver::SameStep(const CFI::Component &a, const CFI::Component &b)
+{
+    if ( a.nodeIndex != b.nodeIndex || a.HasQualifier() != b.HasQualifier() )
+        return false;
+    return !a.HasQualifier() || a.qualifier == b.qualifier;
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,198 @@
+//
+//  cfi_resolver.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__cfi_resolver__
+#define __ePub3__cfi_resolver__
+
+#include "epub3.h"
+#include "cfi.h"
+#include "../xml/tree/compact_document.h"
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Resolves CFIs against a content document, and generates them, without a browser.
+ 
+ This takes the part of a CFI which lies within a content document, as returned
+ through the `pRemainingCFI` argument of Package::ManifestItemForCFI(), and finds the
+ node and character offset it refers to:
+ 
+ ```
+ CFI remainder;
+ const ManifestItem* item = package->ManifestItemForCFI(cfi, &remainder);
+ Auto<xml::CompactDocument> doc(item->ReferencedCompactDocument());
+ CFIResolver::Resolution result = CFIResolver(*doc).Resolve(remainder);
+ ```
+ 
+ It also does the reverse, generating the CFI for a node and offset:
+ 
+ ```
+ CFIResolver::Location location{node, xml::CompactDocument::NoNode, 0, true, offset};
+ CFI cfi = resolver.CFIForLocation(location, package->CFIForSpineItem(spineItem));
+ ```
+ 
+ Each step is looked up in the document's child-index tables, so either direction
+ takes time proportional to the depth of the path rather than the size of the
+ document.
+ 
+ Character offsets in CFIs count code points by default. CFIs generated by a
+ JavaScript resolver count UTF-16 code units instead, which differ wherever the
+ text holds characters outside the Basic Multilingual Plane; pass
+ UTFOffsetMap::Unit::UTF16 to the constructor to read and write those. Offsets in
+ a Location always count code points.
+ */
+class CFIResolver
+{
+public:
+    typedef xml::CompactDocument::NodeIndex NodeIndex;
+    
+    /**
+     A point within a content document.
+     */
+    struct Location
+    {
+        ///
+        /// The element or text node the path leads to. This is NoNode if the last
+        /// step selects an empty chunk of character data, such as the `/1` between
+        /// two adjacent elements.
+        NodeIndex   node;
+        ///
+        /// The element containing `node`, or the empty chunk; NoNode for the root.
+        NodeIndex   parent;
+        ///
+        /// The index of the last step; needed to place an empty chunk.
+        uint32_t    step;
+        ///
+        /// The character offset, in code points, if the CFI has one.
+        /// This is converted from or to the resolver's offset unit.
+        bool        hasCharacterOffset;
+        uint32_t    characterOffset;
+    };
+    
+    struct Resolution
+    {
+        Location    start;
+        Location    end;            ///< Equal to `start` unless `isRange` is set.
+        bool        isRange;
+    };
+    
+    /**
+     The outcome of resolving one CFI from a batch.
+     */
+    struct BatchResult
+    {
+        Resolution  resolution;     ///< Only valid if `resolved` is set.
+        bool        resolved;
+        std::string error;          ///< Why the CFI couldn't be resolved, if it couldn't.
+    };
+    
+    explicit        CFIResolver(const xml::CompactDocument& document, UTFOffsetMap::Unit offsetUnit = UTFOffsetMap::Unit::CodePoint)
+                        : _document(document), _offsetUnit(offsetUnit) {}
+                    CFIResolver(const CFIResolver&) = default;
+                    ~CFIResolver() {}
+    
+    /**
+     Resolves a CFI relative to the document's root element.
+     
+     Even steps select child elements and odd steps the character data around them.
+     Where a step's `[id]` assertion doesn't match the element it selects, the
+     assertion wins (cf. epub-cfi §3.5): the path resolves to the element with that
+     `id`, and the CFI is corrected to match, which is why it isn't `const`.
+     @param cfi The CFI, without any steps leading to the document.
+     @throws CFI::InvalidCFI if a step doesn't exist in the document, an assertion
+     names no element, a character offset lies beyond the end of its text, the path
+     continues past character data or through another indirection, or a range ends
+     before it starts.
+     */
+    Resolution      Resolve(CFI& cfi)           const;
+    
+    /**
+     Resolves many CFIs against the document at once, as when opening a chapter
+     with many highlights.
+     
+     The CFIs are visited in path order, and each one starts from the deepest node
+     its path shares with the one before, so steps common to many CFIs are only
+     followed once. A CFI which fails to resolve doesn't stop the others.
+     @param cfis The CFIs, without any steps leading to the document. As with
+     Resolve(), any whose assertions don't match are corrected.
+     @result One result for each CFI, in the same order as `cfis`.
+     */
+    std::vector<BatchResult>    ResolveAll(std::vector<CFI>& cfis)  const;
+    
+    /**
+     Generates a CFI for a location within the document.
+     
+     Each element along the path which has an `id` gets an `[id]` assertion. The
+     location's `parent` and `step` are only consulted when `node` is NoNode, for
+     an empty chunk of character data; otherwise they're derived from `node`.
+     @param location The location, as returned by Resolve() or built by hand.
+     @param base A CFI to append the path to, usually the one returned by
+     Package::CFIForSpineItem() for the document.
+     @throws CFI::RangedCFIAppendAttempt if `base` is a range.
+     */
+    CFI             CFIForLocation(const Location& location, const CFI& base = CFI()) const;
+    
+    /**
+     Generates a range CFI between two locations within the document.
+     
+     The path the two locations share goes into the CFI's base, leaving at least
+     one step for each end of the range.
+     @param start The start of the range.
+     @param end The end of the range, which must not precede `start`.
+     @param base A CFI to append the range to, as for CFIForLocation().
+     @throws std::invalid_argument if `end` precedes `start`, if either is the root
+     element, or if only one of them has a character offset.
+     @throws CFI::RangedCFIAppendAttempt if `base` is a range.
+     */
+    CFI             CFIForRange(const Location& start, const Location& end, const CFI& base = CFI()) const;
+    
+protected:
+    const xml::CompactDocument&     _document;
+    UTFOffsetMap::Unit              _offsetUnit;    ///< The unit of character offsets in CFIs.
+    
+    Resolution      Resolve(CFI& cfi, std::vector<NodeIndex>* trail)  const;
+    
+    // one of a CFI's component lists, given a buffer of its own so it can be corrected
+    typedef CFI::ComponentList& (CFI::*MutableList)();
+    
+    // follows a list of steps down from `from`, correcting them in `cfi` as necessary;
+    //  if a trail is given, it starts after the steps it holds, and records the rest
+    Location        Walk(NodeIndex from, CFI& cfi, const CFI::ComponentList& components, MutableList mutableList, std::vector<NodeIndex>* trail = nullptr) const;
+    
+    // appends the steps from `from` down to `to`, with `[id]` assertions
+    void            AppendPath(NodeIndex from, NodeIndex to, CFI::ComponentList& components) const;
+    
+    // appends the steps from the root to a location, with its character offset
+    void            AppendLocation(const Location& location, CFI::ComponentList& components) const;
+    
+    // replaces the first `count` steps with the path from `from` down to `to`,
+    //  keeping the last step's assertion and offsets; returns the new step count
+    size_t          ReplacePath(NodeIndex from, NodeIndex to, CFI::ComponentList& components, size_t count) const;
+    
+    // true if two steps select the same child with the same assertion
+    static bool     SameStep(const CFI::Component& a, const CFI::Component& b);
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__cfi_resolver__) */
@@ -33,23 +33,34 @@ static const char * gRootfilesXPath = "/ocf:container/ocf:rootfiles/ocf:rootfile
 static const char * gRootfilePathsXPath = "/ocf:container/ocf:rootfiles/ocf:rootfile/@full-path";
 static const char * gVersionXPath = "/ocf:container/@version";
 
-Container::Container(const std::string& path) : _archive(Archive::Open(path))
+static Archive* OpenArchiveAtPath(const std::string& path)
 {
-    if ( _archive == nullptr )
+    Archive* archive = Archive::Open(path);
+    if ( archive == nullptr )
         throw std::invalid_argument("Path does not point to a recognised archive file: '" + path + "'");
+    return archive;
+}
+
+Container::Container(const std::string& path) : Container(OpenArchiveAtPath(path))
+{
+}
+Container::Container(Archive* archive) : _archive(archive)
+{
+    if ( _archive == nullptr )
+        throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No archive supplied");
     
     // TODO: Initialize lazily? Doing so would make initialization faster, but require
     // PackageLocations() to become non-const, like Packages().
     ArchiveXmlReader reader(_archive->ReaderAtPath(gContainerFilePath));
     _ocf = reader.xmlReadDocument(gContainerFilePath, nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
     if ( _ocf == nullptr )
-        throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No container.xml in " + path);
+        throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No container.xml in " + _archive->Path());
     
     XPathWrangler xpath(_ocf, {{"ocf", "urn:oasis:names:tc:opendocument:xmlns:container"}});
     xmlNodeSetPtr nodes = xpath.Nodes(reinterpret_cast<const xmlChar*>(gRootfilesXPath));
     
     if ( nodes == nullptr || nodes->nodeNr == 0 )
-        throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No rootfiles in " + path);
+        throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No rootfiles in " + _archive->Path());
     
     for ( int i = 0; i < nodes->nodeNr; i++ )
     {
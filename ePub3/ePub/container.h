@@ -45,6 +45,9 @@ public:
 public:
                 Container(const std::string& path);
                 Container(Locator locator);
+    ///
+    /// Takes ownership of an already-open archive, e.g. one from Archive::Open(data, len).
+                Container(Archive* archive);
                 Container(const Container&)                 = delete;
                 Container(Container&& o);
     virtual     ~Container();
@@ -36,7 +36,7 @@ protected:
     constexpr static const char * const   FontObfuscationAlgorithmID = "http://www.idpf.org/2008/embedding";
     
     static bool FontTypeSniffer(const ManifestItem* item, const EncryptionInfo* encInfo) {
-        if ( encInfo->Algorithm() != FontObfuscationAlgorithmID )
+        if ( encInfo == nullptr || encInfo->Algorithm() != FontObfuscationAlgorithmID )
             return false;
         return std::regex_match(item->MediaType().stl_str(), TypeCheck);
     }
@@ -21,6 +21,9 @@
 
 #include "manifest.h"
 #include "package.h"
+#include "filter.h"
+#include "../xml/utilities/document_arena.h"
+#include "../xml/tree/compact_document.h"
 #include <regex>
 #include <sstream>
 
@@ -205,22 +208,93 @@ xmlDocPtr ManifestItem::ReferencedDocument() const
     // TODO: handle remote URLs
     string path(BaseHref());
     
-    ArchiveXmlReader * reader = _owner->XmlReaderForRelativePath(path);
+    Auto<ArchiveXmlReader> reader(_owner->XmlReaderForRelativePath(path));
     if ( reader == nullptr )
         return nullptr;
     
-    xmlDocPtr result = nullptr;
     int flags = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
-    if ( _mediaType == "text/html" )
-        result = reader->htmlReadDocument(path.c_str(), "utf-8", flags);
-    else
-        result = reader->xmlReadDocument(path.c_str(), "utf-8", flags);
+    bool html = (_mediaType == "text/html");
+    return xml::DocumentArena::Parse([&]() {
+        if ( html )
+            return reader->htmlReadDocument(path.c_str(), "utf-8", flags);
+        return reader->xmlReadDocument(path.c_str(), "utf-8", flags);
+    });
+}
+xml::CompactDocument* ManifestItem::ReferencedCompactDocument() const
+{
+    xmlDocPtr doc = ReferencedDocument();
+    if ( doc == nullptr )
+        return nullptr;
     
+    xml::CompactDocument* result = nullptr;
+    try
+    {
+        result = new xml::CompactDocument(doc);
+    }
+    catch (...)
+    {
+        xml::DocumentArena::FreeDocument(doc);
+        throw;
+    }
+    
+    xml::DocumentArena::FreeDocument(doc);
     return result;
 }
+TextExtractor::Result ManifestItem::ExtractText(const TextRunHandler &handler) const
+{
+    typedef std::unique_ptr<xmlTextReader, void(*)(xmlTextReaderPtr)> TextReaderPtr;
+    
+    if ( _mediaType == "text/html" )
+    {
+        xmlDocPtr doc = ReferencedDocument();
+        if ( doc == nullptr )
+            return TextExtractor::Result::Failed;
+        
+        TextExtractor::Result result = TextExtractor::Result::Failed;
+        try
+        {
+            TextReaderPtr walker(xmlReaderWalker(doc), xmlFreeTextReader);
+            if ( walker )
+                result = TextExtractor::Extract(walker.get(), handler);
+        }
+        catch (...)
+        {
+            xml::DocumentArena::FreeDocument(doc);
+            throw;
+        }
+        
+        xml::DocumentArena::FreeDocument(doc);
+        return result;
+    }
+    
+    string path(BaseHref());
+    Auto<ArchiveXmlReader> reader(_owner->XmlReaderForRelativePath(path));
+    if ( reader == nullptr )
+        return TextExtractor::Result::Failed;
+    
+    TextReaderPtr textReader(reader->xmlReaderForDocument(path.c_str(), "utf-8", XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR), xmlFreeTextReader);
+    if ( !textReader )
+        return TextExtractor::Result::Failed;
+    
+    return TextExtractor::Extract(textReader.get(), handler);
+}
 ArchiveReader* ManifestItem::Reader() const
 {
     return _owner->ReaderForRelativePath(BaseHref());
 }
+ArchiveReader* ManifestItem::RawReader(const EncryptionInfo *encInfo, const ContentFilter *filters) const
+{
+    if ( encInfo != nullptr )
+        return nullptr;
+    
+    for ( const ContentFilter* filter = filters; filter != nullptr; filter = filter->Next() )
+    {
+        ContentFilter::TypeSnifferFn sniffer = filter->TypeSniffer();
+        if ( sniffer && sniffer(this, encInfo) )
+            return nullptr;
+    }
+    
+    return _owner->RawReaderForRelativePath(BaseHref());
+}
 
 EPUB3_END_NAMESPACE
@@ -25,6 +25,7 @@
 #include "epub3.h"
 #include "utfstring.h"
 #include "iri.h"
+#include "text_extractor.h"
 #include <map>
 #include <libxml/tree.h>
 
@@ -33,6 +34,12 @@ EPUB3_BEGIN_NAMESPACE
 class Package;
 class ManifestItem;
 class ArchiveReader;
+class ContentFilter;
+class EncryptionInfo;
+
+namespace xml {
+    class CompactDocument;
+}
 
 typedef std::map<string, ManifestItem*>    ManifestTable;
 
@@ -138,12 +145,34 @@ public:
     bool                HasProperty(ItemProperties::value_type prop)    const   { return _properties.HasProperty(prop); }
     bool                HasProperty(const std::vector<IRI>& properties)  const;
     
-    // one-shot document loader
+    // one-shot document loader; if xml::DocumentArena's allocator is installed, the
+    //  document has its own arena, and xml::DocumentArena::FreeDocument() releases it
+    //  unless it's been changed (see xml::DocumentArena)
     xmlDocPtr           ReferencedDocument()                const;
+    // loads the document into a compact read-only form, for keeping in memory; the
+    //  caller owns the result, which is nullptr if the document couldn't be parsed
+    xml::CompactDocument* ReferencedCompactDocument()       const;
+    
+    /**
+     Streams the item's text, with the CFI location of each run, without building a
+     document tree.
+     
+     HTML documents (as opposed to XHTML) can't be streamed by libxml, so they are
+     parsed in full and then walked.
+     @see TextExtractor
+     */
+    TextExtractor::Result ExtractText(const TextRunHandler& handler) const;
     
     // stream the data
     ArchiveReader*      Reader()                            const;
     
+    // stream the raw DEFLATE data; this has no zlib or gzip framing, which callers must
+    // add before serving it with a `Content-Encoding` (see Archive::RawReaderAtPath())
+    // returns nullptr if the item must be decoded before use: if it's encrypted or
+    // obfuscated, if one of the filters in the chain applies to it, or if it isn't
+    // deflate-compressed. Use Reader() in that case.
+    ArchiveReader*      RawReader(const EncryptionInfo* encInfo, const ContentFilter* filters=nullptr)  const;
+    
 protected:
     const class Package*    _owner;
     
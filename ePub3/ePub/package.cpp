@@ -28,6 +28,11 @@
 #include "glossary.h"
 #include "iri.h"
 #include "basic.h"
+#include "archive_cache.h"
+#include "worker_pool.h"
+#include "crc32.h"
+#include "../xml/utilities/document_arena.h"
+#include <atomic>
 #include <sstream>
 #include <list>
 #include <regex>
@@ -39,6 +44,78 @@ static const xmlChar * OPFNamespace = "http://www.idpf.org/2007/opf"_xml;
 static const xmlChar * DCNamespace = "http://purl.org/dc/elements/1.1/"_xml;
 static const xmlChar * MediaTypeElementName = "mediaType"_xml;
 
+// resources a content document loads for display, as opposed to hyperlinks
+static const xmlChar* gXLinkNamespace = BAD_CAST "http://www.w3.org/1999/xlink";
+
+// decodes `%XX` escapes, leaving any malformed ones as they are
+static std::string PercentDecoded(const std::string& str)
+{
+    if ( str.find('%') == std::string::npos )
+        return str;
+    
+    std::string result;
+    result.reserve(str.size());
+    for ( std::string::size_type i = 0; i < str.size(); i++ )
+    {
+        if ( str[i] == '%' && i + 2 < str.size() && isxdigit(static_cast<unsigned char>(str[i+1])) && isxdigit(static_cast<unsigned char>(str[i+2])) )
+        {
+            result += static_cast<char>(std::stoi(str.substr(i+1, 2), nullptr, 16));
+            i += 2;
+        }
+        else
+        {
+            result += str[i];
+        }
+    }
+    return result;
+}
+
+// resolves a resource reference relative to the document containing it; returns
+// an empty string for references outside the archive
+static std::string ResolvedResourcePath(const std::string& docPath, const std::string& reference)
+{
+    std::string ref = reference.substr(0, reference.find_first_of("?#"));
+    if ( ref.empty() || ref[0] == '/' )
+        return std::string();
+    
+    // anything with a scheme (http:, data:, etc.)
+    std::string::size_type colon = ref.find(':');
+    if ( colon != std::string::npos && colon < ref.find('/') )
+        return std::string();
+    
+    // archive paths are stored decoded, so `my%20image.png` is `my image.png`;
+    //  the document's own path is already an archive path
+    std::vector<std::string> components;
+    std::string base = docPath.substr(0, docPath.rfind('/') + 1);
+    std::istringstream stream(base + ref);
+    std::string component;
+    size_t consumed = 0;
+    while ( std::getline(stream, component, '/') )
+    {
+        consumed += component.size() + 1;
+        if ( consumed > base.size() )
+            component = PercentDecoded(component);
+        if ( component.empty() || component == "." )
+            continue;
+        if ( component == ".." )
+        {
+            if ( !components.empty() )
+                components.pop_back();
+            continue;
+        }
+        components.push_back(component);
+    }
+    
+    std::string result;
+    for ( auto& c : components )
+    {
+        if ( !result.empty() )
+            result += '/';
+        result += c;
+    }
+    return result;
+}
+
 const PackageBase::PropertyVocabularyMap PackageBase::gReservedVocabularies({
     { "", "http://idpf.org/epub/vocab/package/#" },
     { "dcterms", "http://purl.org/dc/terms/" },
@@ -81,7 +158,9 @@ PackageBase::PackageBase(Archive* archive, const string& path, const string& typ
     // TODO: Initialize lazily? Doing so would make initialization faster, but require
     // PackageLocations() to become non-const, like Packages().
     ArchiveXmlReader reader(_archive->ReaderAtPath(path.stl_str()));
-    _opf = reader.xmlReadDocument(path.c_str(), nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+    _opf = xml::DocumentArena::Parse([&]() {
+        return reader.xmlReadDocument(path.c_str(), nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+    });
     if ( _opf == nullptr )
         throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No OPF file at " + path.stl_str());
     
@@ -117,7 +196,7 @@ PackageBase::~PackageBase()
     
     // our Container owns the archive
     if ( _opf != nullptr )
-        xmlFreeDoc(_opf);
+        xml::DocumentArena::FreeDocument(_opf);
 }
 const SpineItem* PackageBase::SpineItemAt(size_t idx) const
 {
@@ -647,60 +726,126 @@ const SpineItem* Package::SpineItemWithIDRef(const string &idref) const
 const CFI Package::CFIForManifestItem(const ManifestItem *item) const
 {
     CFI result;
-    result._components.emplace_back(_spineCFIIndex);
-    result._components.emplace_back(_Str(IndexOfSpineItemWithIDRef(item->Identifier())*2, "[", item->Identifier(), "]!"));
+    result.MutableComponents().emplace_back(_spineCFIIndex);
+    result.MutableComponents().emplace_back(static_cast<uint32_t>(IndexOfSpineItemWithIDRef(item->Identifier())*2));
+    
+    CFI::Component& component = result.MutableComponents().back();
+    component.flags |= CFI::Component::Qualifier|CFI::Component::Indirector;
+    component.qualifier = item->Identifier();
     return result;
 }
 const CFI Package::CFIForSpineItem(const SpineItem *item) const
 {
     CFI result;
-    result._components.emplace_back(_spineCFIIndex);
-    result._components.emplace_back(_Str(item->Index()*2, "[", item->Idref(), "]!"));
+    result.MutableComponents().emplace_back(_spineCFIIndex);
+    result.MutableComponents().emplace_back(static_cast<uint32_t>(item->Index()*2));
+    
+    // built directly rather than parsed, since content paths get appended to these in bulk
+    CFI::Component& component = result.MutableComponents().back();
+    component.flags |= CFI::Component::Qualifier|CFI::Component::Indirector;
+    component.qualifier = item->Idref();
+    return result;
+}
+const CFI Package::CFIForTextLocation(const SpineItem *item, const std::vector<uint32_t> &steps, uint32_t characterOffset) const
+{
+    CFI result = CFIForSpineItem(item);
+    for ( uint32_t step : steps )
+        result.MutableComponents().emplace_back(step);
+    
+    if ( !steps.empty() )
+    {
+        CFI::Component& last = result.MutableComponents().back();
+        last.flags |= CFI::Component::CharacterOffset;
+        last.characterOffset = characterOffset;
+    }
+    
+    return result;
+}
+const CFI Package::CFIForTextRange(const SpineItem *item, const std::vector<uint32_t> &startSteps, uint32_t startOffset,
+                                   const std::vector<uint32_t> &endSteps, uint32_t endOffset) const
+{
+    // the shared path goes in the base, leaving at least the text step for each end
+    size_t common = 0;
+    while ( common + 1 < startSteps.size() && common + 1 < endSteps.size() && startSteps[common] == endSteps[common] )
+        common++;
+    
+    CFI result = CFIForSpineItem(item);
+    for ( size_t i = 0; i < common; i++ )
+        result.MutableComponents().emplace_back(startSteps[i]);
+    
+    auto local = [common](CFI::ComponentList& components, const std::vector<uint32_t>& steps, uint32_t offset) {
+        for ( size_t i = common; i < steps.size(); i++ )
+            components.emplace_back(steps[i]);
+        components.back().flags |= CFI::Component::CharacterOffset;
+        components.back().characterOffset = offset;
+    };
+    local(result.MutableRangeStart(), startSteps, startOffset);
+    local(result.MutableRangeEnd(), endSteps, endOffset);
+    result._options |= CFI::RangeTriplet;
+    
     return result;
 }
 const ManifestItem* Package::ManifestItemForCFI(ePub3::CFI &cfi, CFI* pRemainingCFI) const
 {
     const ManifestItem* result = nullptr;
     
+    switch ( TryManifestItemForCFI(cfi, &result, pRemainingCFI) )
+    {
+        case CFILookupError::None:
+            break;
+        case CFILookupError::TooShort:
+            throw CFI::InvalidCFI("CFI contains less than 2 nodes, so is invalid for package-based lookups.");
+        case CFILookupError::NotSpine:
+            throw CFI::InvalidCFI(_Str("CFI first node index (spine) is ", cfi.Components()[0].nodeIndex, " but should be ", _spineCFIIndex));
+        case CFILookupError::NoIndirection:
+            throw CFI::InvalidCFI("Package-based CFI's second item must be an indirector");
+        case CFILookupError::SpineIndexOutOfRange:
+            throw CFI::InvalidCFI("CFI references out-of-range spine item");
+        case CFILookupError::UnmatchedQualifier:
+            throw CFI::InvalidCFI("CFI spine node qualifier doesn't match any spine item idref");
+        case CFILookupError::NoManifestItem:
+            throw CFI::InvalidCFI("CFI spine item has no corresponding manifest item");
+    }
+    
+    return result;
+}
+Package::CFILookupError Package::TryManifestItemForCFI(ePub3::CFI &cfi, const ManifestItem** pItem, CFI* pRemainingCFI) const noexcept
+{
+    *pItem = nullptr;
+    
     // NB: Package is a friend of CFI, so it can access the components directly
-    if ( cfi._components.size() < 2 )
-        throw CFI::InvalidCFI("CFI contains less than 2 nodes, so is invalid for package-based lookups.");
+    if ( cfi.Components().size() < 2 )
+        return CFILookupError::TooShort;
     
     // first item directs us to the Spine: check the index against the one we know
-    auto component = cfi._components[0];
-    if ( component.nodeIndex != _spineCFIIndex )
-    {
-        throw CFI::InvalidCFI(_Str("CFI first node index (spine) is ", component.nodeIndex, " but should be ", _spineCFIIndex));
-    }
+    if ( cfi.Components()[0].nodeIndex != _spineCFIIndex )
+        return CFILookupError::NotSpine;
     
     // second component is the particular spine item
-    component = cfi._components[1];
+    CFI::Component component = cfi.Components()[1];
     if ( !component.IsIndirector() )
-        throw CFI::InvalidCFI("Package-based CFI's second item must be an indirector");
+        return CFILookupError::NoIndirection;
+    if ( (component.nodeIndex % 2) == 1 )
+        return CFILookupError::SpineIndexOutOfRange;
     
-    try
-    {
-        if ( (component.nodeIndex % 2) == 1 )
-            throw CFI::InvalidCFI("CFI spine item index is odd, which makes no sense for always-empty spine nodes.");
-        const SpineItem* item = _spine->at(component.nodeIndex/2);
-        
-        // check and correct any qualifiers
-        item = ConfirmOrCorrectSpineItemQualifier(item, &component);
-        if ( item == nullptr )
-            throw CFI::InvalidCFI("CFI spine node qualifier doesn't match any spine item idref");
-        
-        // we know it's not null, because SpineItem::at() throws an exception if out of range
-        result = ManifestItemWithID(item->Idref());
-        
-        if ( pRemainingCFI != nullptr )
-            pRemainingCFI->Assign(cfi, 2);
-    }
-    catch (std::out_of_range& e)
-    {
-        throw CFI::InvalidCFI("CFI references out-of-range spine item");
-    }
+    const SpineItem* item = SpineItemAt(component.nodeIndex/2);
+    if ( item == nullptr )
+        return CFILookupError::SpineIndexOutOfRange;
     
-    return result;
+    // check and correct any qualifiers
+    item = ConfirmOrCorrectSpineItemQualifier(item, &component);
+    if ( item == nullptr )
+        return CFILookupError::UnmatchedQualifier;
+    
+    *pItem = ManifestItemWithID(item->Idref());
+    if ( *pItem == nullptr )
+        return CFILookupError::NoManifestItem;
+    
+    // a range may split right after the spine item, leaving no shared path but both ends
+    if ( pRemainingCFI != nullptr )
+        pRemainingCFI->Assign(cfi, 2);
+    
+    return CFILookupError::None;
 }
 const string Package::Title() const
 {
@@ -931,6 +1076,345 @@ const Package::StringList Package::AllMediaTypes() const
     
     return types;
 }
+ArchiveXmlReader* Package::XmlReaderForRelativePath(const string &path) const
+{
+    // held until it's returned, in case looking up the item's size throws
+    Auto<ArchiveXmlReader> reader(new ArchiveXmlReader(ReaderForRelativePath(path)));
+    
+    // the reader exists, so the item does too
+    ArchiveItemInfo info = InfoForRelativePath(path);
+    reader->SetPipelined(ArchiveXmlReader::ShouldPipeline(info.UncompressedSize()));
+    return reader.release();
+}
+void Package::ReadManifestItems(const std::vector<const ManifestItem *> &items, ManifestReadCallback callback, bool parallel) const
+{
+    std::vector<std::string> paths;
+    std::map<std::string, const ManifestItem*> lookup;
+    for ( const ManifestItem* item : items )
+    {
+        std::string path = item->AbsolutePath().stl_str();
+        if ( lookup.insert(std::make_pair(path, item)).second )
+            paths.push_back(path);
+    }
+    
+    _archive->ReadItems(paths, [&](const std::string& path, std::vector<uint8_t>* data) {
+        callback(lookup[path], data);
+    }, parallel);
+}
+// reads each document through to find the resources it references, and prefetches
+//  those; this opens its own handle on the archive, since the package's can't be used
+//  off the thread that reads from it
+static void PrefetchReferencedResources(const std::string& archivePath, const std::vector<std::string>& documents)
+{
+    // the documents are streamed rather than parsed into trees, looking only at the
+    //  attributes of each element
+    typedef std::unique_ptr<xmlTextReader, void(*)(xmlTextReaderPtr)> TextReaderPtr;
+    
+    try
+    {
+        Auto<Archive> archive(Archive::Open(archivePath));
+        if ( !archive )
+            return;
+        
+        std::vector<std::string> paths;
+        for ( const std::string& docPath : documents )
+        {
+            ArchiveReader* archiveReader = archive->ReaderAtPath(docPath);
+            if ( archiveReader == nullptr )
+                continue;
+            
+            // not pipelined: that would wait on the pool from one of its own tasks
+            ArchiveXmlReader reader(archiveReader);
+            TextReaderPtr textReader(reader.xmlReaderForDocument(docPath.c_str(), "utf-8", XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR), xmlFreeTextReader);
+            if ( !textReader )
+                continue;
+            
+            while ( xmlTextReaderRead(textReader.get()) == 1 )
+            {
+                if ( xmlTextReaderNodeType(textReader.get()) != XML_READER_TYPE_ELEMENT )
+                    continue;
+                
+                // `src` on anything, `href` on links, `data` on objects, and `xlink:href`
+                const xmlChar* element = xmlTextReaderConstLocalName(textReader.get());
+                bool link = xmlStrEqual(element, BAD_CAST "link"), object = xmlStrEqual(element, BAD_CAST "object");
+                while ( xmlTextReaderMoveToNextAttribute(textReader.get()) == 1 )
+                {
+                    const xmlChar* name = xmlTextReaderConstLocalName(textReader.get());
+                    const xmlChar* ns = xmlTextReaderConstNamespaceUri(textReader.get());
+                    bool reference = false;
+                    if ( ns == nullptr )
+                        reference = xmlStrEqual(name, BAD_CAST "src") || (link && xmlStrEqual(name, BAD_CAST "href")) || (object && xmlStrEqual(name, BAD_CAST "data"));
+                    else
+                        reference = xmlStrEqual(ns, gXLinkNamespace) && xmlStrEqual(name, BAD_CAST "href");
+                    if ( !reference )
+                        continue;
+                    
+                    std::string path = ResolvedResourcePath(docPath, reinterpret_cast<const char*>(xmlTextReaderConstValue(textReader.get())));
+                    if ( !path.empty() )
+                        paths.push_back(path);
+                }
+            }
+        }
+        
+        archive->Prefetch(paths);
+    }
+    catch (std::exception&)
+    {
+        // it's only a hint
+    }
+}
+std::future<void> Package::PrefetchSpineItemsAfter(const SpineItem *item, size_t count, bool includeResources) const
+{
+    std::vector<std::string> documents;
+    std::vector<std::string> paths;
+    for ( const SpineItem* next = (item == nullptr ? nullptr : item->NextStep()); next != nullptr && paths.size() < count; next = next->NextStep() )
+    {
+        const ManifestItem* manifestItem = next->ManifestItem();
+        if ( manifestItem == nullptr )
+            continue;
+        paths.push_back(manifestItem->AbsolutePath().stl_str());
+        
+        // libxml can't stream HTML
+        if ( manifestItem->MediaType() != "text/html" )
+            documents.push_back(paths.back());
+    }
+    
+    _archive->Prefetch(paths);
+    
+    // in-memory archives are resident already, and have no file to open again
+    std::string archivePath = _archive->Path();
+    if ( !includeResources || documents.empty() || archivePath.empty() )
+    {
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future();
+    }
+    
+    return WorkerPool::Shared()->Submit([archivePath, documents]() {
+        PrefetchReferencedResources(archivePath, documents);
+    });
+}
+TextExtractor::Result Package::ExtractText(const SpineTextRunHandler &handler) const
+{
+    TextExtractor::Result result = TextExtractor::Result::Complete;
+    for ( const SpineItem* item = FirstSpineItem(); item != nullptr; item = item->Next() )
+    {
+        const ManifestItem* manifestItem = item->ManifestItem();
+        if ( manifestItem == nullptr )
+        {
+            result = TextExtractor::Result::Failed;
+            continue;
+        }
+        
+        switch ( manifestItem->ExtractText([&](const TextRun& run) { return handler(item, run); }) )
+        {
+            case TextExtractor::Result::Stopped:
+                return TextExtractor::Result::Stopped;
+            case TextExtractor::Result::Failed:
+                result = TextExtractor::Result::Failed;
+                break;
+            default:
+                break;
+        }
+    }
+    
+    return result;
+}
+std::string Package::SearchIndexIdentifier() const
+{
+    // not every tool bumps the modification date, so fold in the stored size and
+    //  CRC of each spine item too; those come from the zip directory, unread
+    uint32_t fingerprint = 0;
+    for ( const SpineItem* item = FirstSpineItem(); item != nullptr; item = item->Next() )
+    {
+        const ManifestItem* manifestItem = item->ManifestItem();
+        uint32_t entry[2] = {0, 0};
+        if ( manifestItem != nullptr )
+        {
+            try
+            {
+                ArchiveItemInfo info = _archive->InfoAtPath(manifestItem->AbsolutePath().stl_str());
+                entry[0] = static_cast<uint32_t>(info.UncompressedSize());
+                entry[1] = info.CRC();
+            }
+            catch (std::exception&)
+            {
+                // a missing item still counts, as zeroes
+            }
+        }
+        fingerprint = CRC32(fingerprint, entry, sizeof(entry));
+    }
+    
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08x", fingerprint);
+    return _Str(PackageID(), "@", ModificationDate(), "#", hex);
+}
+SearchIndex* Package::BuildSearchIndex() const
+{
+    SearchIndex::Builder builder(SearchIndexIdentifier());
+    
+    // SpineItem::Index() walks the list, so track it here
+    const SpineItem* current = nullptr;
+    uint32_t index = 0;
+    ExtractText([&](const SpineItem* item, const TextRun& run) {
+        if ( item != current )
+        {
+            index = static_cast<uint32_t>(item->Index());
+            current = item;
+        }
+        builder.AddRun(index, run);
+        return true;
+    });
+    
+    return builder.Finish();
+}
+SearchIndex* Package::LoadSearchIndex(const std::string &path) const
+{
+    SearchIndex* index = SearchIndex::Open(path);
+    if ( index != nullptr && index->Identifier() == SearchIndexIdentifier() )
+        return index;
+    delete index;
+    
+    index = BuildSearchIndex();
+    index->Save(path);      // it's still usable if this fails
+    return index;
+}
+std::vector<Package::SearchHit> Package::Search(const SearchIndex *index, const string &query, size_t maxHits) const
+{
+    std::vector<SearchHit> result;
+    if ( index == nullptr )
+        return result;
+    
+    std::vector<const SpineItem*> items;
+    for ( const SpineItem* item = FirstSpineItem(); item != nullptr; item = item->Next() )
+        items.push_back(item);
+    
+    for ( SearchIndex::Match& match : index->Query(query.stl_str(), maxHits) )
+    {
+        // a stale index may refer to items which no longer exist
+        if ( match.spineIndex >= items.size() )
+            continue;
+        result.push_back(SearchHit{CFIForTextLocation(items[match.spineIndex], match.steps, match.offset), match.score});
+    }
+    
+    return result;
+}
+std::vector<CFI> Package::FindText(const TextPattern &pattern, size_t maxHits, UTFOffsetMap::Unit offsetUnit) const
+{
+    std::vector<CFI> result;
+    if ( maxHits == 0 )
+        return result;
+    
+    std::atomic<bool> finished(false);
+    
+    // runs on a worker thread; an item can't contribute more than `maxHits`
+    auto search = [&](const SpineItem* item, std::shared_ptr<ArchiveReader> reader) {
+        std::vector<CFI> hits;
+        const void* data = nullptr;
+        size_t length = 0;
+        if ( !reader || !reader->ContiguousData(&data, &length) )
+            return hits;
+        
+        // the current block's text as code points, and where each run of it starts
+        std::vector<uint32_t> text;
+        std::vector<size_t> runStarts;
+        std::vector<TextRun> runs;
+        
+        // maps a code point index to its run
+        auto runAt = [&](size_t index) {
+            return static_cast<size_t>(std::upper_bound(runStarts.begin(), runStarts.end(), index) - runStarts.begin() - 1);
+        };
+        // the offset of a code point index within its run's character data, in `offsetUnit`
+        auto offsetOf = [&](size_t run, size_t index) -> uint32_t {
+            uint32_t codePoints = runs[run].offset + static_cast<uint32_t>(index - runStarts[run]);
+            if ( offsetUnit == UTFOffsetMap::Unit::CodePoint )
+                return codePoints;
+            
+            // character data never spans a block, so its earlier runs are all here
+            size_t first = run;
+            while ( first > 0 && runs[first-1].steps == runs[run].steps )
+                first--;
+            std::string chunk;
+            for ( size_t i = first; i <= run; i++ )
+                chunk += runs[i].text;
+            return UTFOffsetMap(chunk.data(), chunk.size()).Convert(codePoints, UTFOffsetMap::Unit::CodePoint, offsetUnit);
+        };
+        // blocks are searched one at a time, so no match spans two of them
+        auto searchBlock = [&]() {
+            pattern.FindAll(text.data(), text.size(), [&](size_t start, size_t end) {
+                // the end is placed just past the last code point, within the same run
+                size_t first = runAt(start), last = runAt(end-1);
+                hits.push_back(CFIForTextRange(item, runs[first].steps, offsetOf(first, start), runs[last].steps, offsetOf(last, end)));
+                return hits.size() < maxHits && !finished;
+            });
+            text.clear();
+            runStarts.clear();
+            runs.clear();
+            return hits.size() < maxHits && !finished;
+        };
+        
+        const ManifestItem* manifestItem = item->ManifestItem();
+        std::string url = manifestItem->AbsolutePath().stl_str();
+        bool html = (manifestItem->MediaType() == "text/html");
+        TextExtractor::Result extracted = TextExtractor::Extract(data, length, url.c_str(), html, [&](const TextRun& run) {
+            if ( !runs.empty() && runs.back().block != run.block && !searchBlock() )
+                return false;
+            runStarts.push_back(text.size());
+            runs.push_back(TextRun{run.steps, run.offset, run.block, (offsetUnit == UTFOffsetMap::Unit::CodePoint ? std::string() : run.text)});
+            TextPattern::AppendCodePoints(run.text, text);
+            return !finished;
+        });
+        if ( extracted != TextExtractor::Result::Stopped )
+            searchBlock();
+        
+        return hits;
+    };
+    
+    // a window of items is searched while the next ones are read
+    TaskWindow<std::vector<CFI>> pending(WorkerPool::Shared());
+    auto collect = [&]() {
+        std::vector<CFI> hits = pending.Next();
+        for ( size_t i = 0; i < hits.size() && result.size() < maxHits; i++ )
+            result.push_back(std::move(hits[i]));
+        if ( result.size() >= maxHits )
+            finished = true;
+    };
+    
+    for ( const SpineItem* item = FirstSpineItem(); item != nullptr && !finished; item = item->Next() )
+    {
+        const ManifestItem* manifestItem = item->ManifestItem();
+        if ( manifestItem == nullptr )
+            continue;
+        
+        // the archive is only touched here; readers which need it to produce their
+        //  data are drained into memory first
+        Auto<ArchiveReader> reader(manifestItem->Reader());
+        const void* data = nullptr;
+        size_t length = 0;
+        if ( reader && !reader->ContiguousData(&data, &length) )
+        {
+            std::vector<uint8_t> bytes;
+            uint8_t buf[16384];
+            ssize_t num = 0;
+            while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+                bytes.insert(bytes.end(), buf, buf + num);
+            
+            reader.reset();
+            if ( num == 0 )
+                reader.reset(new CachedArchiveReader(std::make_shared<const std::vector<uint8_t>>(std::move(bytes))));
+        }
+        
+        std::shared_ptr<ArchiveReader> shared(std::move(reader));
+        pending.Submit([&search, item, shared]() { return search(item, shared); });
+        while ( pending.IsFull() )
+            collect();
+    }
+    
+    while ( !pending.IsEmpty() )
+        collect();
+    
+    return result;
+}
 void Package::SetMediaSupport(const MediaSupportList &list)
 {
     _mediaSupport = list;
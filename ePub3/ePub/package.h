@@ -27,6 +27,7 @@
 #include <vector>
 #include <map>
 #include <list>
+#include <future>
 #include <libxml/tree.h>
 #include "spine.h"
 #include "manifest.h"
@@ -38,6 +39,9 @@
 #include "iri.h"
 #include "content_handler.h"
 #include "media_support_info.h"
+#include "search_index.h"
+#include "text_pattern.h"
+#include "utf_offset_map.h"
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -367,9 +371,38 @@ public:
     
     const CFI               CFIForManifestItem(const ManifestItem* item)    const;
     const CFI               CFIForSpineItem(const SpineItem* item)          const;
+    // a CFI for a character offset within a spine item's document, from the steps and
+    //  offset of a TextRun (see ExtractText())
+    const CFI               CFIForTextLocation(const SpineItem* item, const std::vector<uint32_t>& steps, uint32_t characterOffset) const;
+    // a range CFI from one such location to another
+    const CFI               CFIForTextRange(const SpineItem* item, const std::vector<uint32_t>& startSteps, uint32_t startOffset,
+                                            const std::vector<uint32_t>& endSteps, uint32_t endOffset) const;
+    
+    ///
+    /// The reasons TryManifestItemForCFI() can fail to locate an item.
+    enum class CFILookupError : uint8_t
+    {
+        None,                   ///< The item was found.
+        TooShort,               ///< The CFI has fewer than two steps.
+        NotSpine,               ///< The first step isn't the package's `<spine>` element.
+        NoIndirection,          ///< The second step doesn't end in an indirection (`!`).
+        SpineIndexOutOfRange,   ///< The second step's index is odd, or past the end of the spine.
+        UnmatchedQualifier,     ///< The spine step's `[idref]` doesn't match any spine item.
+        NoManifestItem,         ///< The spine item's idref doesn't match any manifest item.
+    };
     
     // note that the CFI is purposely non-const so the package can correct it (cf. epub-cfi §3.5)
     const ManifestItem *    ManifestItemForCFI(CFI& cfi, CFI* pRemainingCFI) const;
+    /**
+     As ManifestItemForCFI(), but reports failures through its result rather than by
+     throwing, for callers which routinely see stale or malformed CFIs.
+     @param cfi The CFI to look up.
+     @param pItem Receives the manifest item, or `nullptr` on failure.
+     @param pRemainingCFI If not `nullptr`, receives the part of the CFI following
+     the spine item, which is empty if there is none.
+     @result CFILookupError::None, or the reason the lookup failed.
+     */
+    CFILookupError          TryManifestItemForCFI(CFI& cfi, const ManifestItem** pItem, CFI* pRemainingCFI) const noexcept;
     xmlDocPtr               DocumentForCFI(CFI& cfi, CFI* pRemainingCFI) const {
         return ManifestItemForCFI(cfi, pRemainingCFI)->ReferencedDocument();
     }
@@ -381,9 +414,109 @@ public:
     ArchiveReader*          ReaderForRelativePath(const string& path) const {
         return _archive->ReaderAtPath((_pathBase + path).stl_str());
     }
-    ArchiveXmlReader*       XmlReaderForRelativePath(const string& path) const {
-        return new ArchiveXmlReader(ReaderForRelativePath(path));
+    ArchiveReader*          RawReaderForRelativePath(const string& path) const {
+        return _archive->RawReaderAtPath((_pathBase + path).stl_str());
     }
+    ArchiveItemInfo         InfoForRelativePath(const string& path) const {
+        return _archive->InfoAtPath((_pathBase + path).stl_str());
+    }
+    // large documents get a pipelined reader (see ArchiveXmlReader::SetPipelined())
+    ArchiveXmlReader*       XmlReaderForRelativePath(const string& path) const;
+    
+    typedef std::function<void(const ManifestItem* item, std::vector<uint8_t>* data)>  ManifestReadCallback;
+    
+    /**
+     Reads the contents of several manifest items in a single pass over the archive.
+     
+     See Archive::ReadItems() for details.
+     @param items The items to read.
+     @param callback Called once per distinct item, on the calling thread, in archive order.
+     `data` is `nullptr` if the item couldn't be read.
+     @param parallel If `true`, items are decompressed on background threads.
+     */
+    void                    ReadManifestItems(const std::vector<const ManifestItem*>& items, ManifestReadCallback callback, bool parallel=false) const;
+    
+    /**
+     Hints that the spine items following a given item will be read soon.
+     
+     The archive is asked to begin reading the next `count` linear spine items (see
+     SpineItem::NextStep()) into memory in the background.
+     @param item The item currently being read.
+     @param count The number of following items to prefetch.
+     @param includeResources If `true`, each of those documents is also read through
+     to find the stylesheets, images and other resources it references, and these
+     are prefetched as well. The documents are streamed rather than parsed into
+     trees, and HTML documents (which libxml can't stream) are skipped. This scan
+     runs on WorkerPool::Shared(), through a separate handle on the archive's file,
+     so it needs an archive opened from a path.
+     
+     The archive can't be used from two threads at once, so this must be called on
+     the thread which reads from the package's archive.
+     @result Ready once the resources have been prefetched; there's no need to wait.
+     */
+    std::future<void>       PrefetchSpineItemsAfter(const SpineItem* item, size_t count, bool includeResources=false) const;
+    
+    typedef std::function<bool(const SpineItem* item, const TextRun& run)>    SpineTextRunHandler;
+    
+    /**
+     Streams the text of each spine item in turn, without building document trees.
+     
+     See ManifestItem::ExtractText() for details.
+     @param handler Called for each run of text; return `false` to stop.
+     @result `Stopped` if the handler stopped extraction, `Failed` if any item couldn't
+     be read (the others are still extracted), otherwise `Complete`.
+     */
+    TextExtractor::Result   ExtractText(const SpineTextRunHandler& handler) const;
+    
+    /**
+     Builds a full-text index of the spine's text.
+     @result A new index, owned by the caller.
+     */
+    SearchIndex*            BuildSearchIndex()              const;
+    
+    /**
+     Opens the index saved at `path`, or if it's missing or was built from a different
+     version of the package, builds a new one and tries to save it there.
+     
+     An index is tied to the package's identifier and modification date, and to the
+     size and CRC of each spine item in the archive, so a chapter edited without
+     updating the date is still noticed.
+     @param path Typically the EPUB's path, with ".searchindex" appended.
+     */
+    SearchIndex*            LoadSearchIndex(const std::string& path) const;
+    
+    struct SearchHit
+    {
+        CFI                 location;       ///< The first matching term.
+        double              score;
+    };
+    
+    /**
+     Runs a query against an index of this package.
+     
+     The hits' character offsets count UTF-16 code units, as a JavaScript CFI
+     resolver expects; see CFIResolver for reading them back.
+     @result At most `maxHits` hits, best first.
+     @see SearchIndex::Query()
+     */
+    std::vector<SearchHit>  Search(const SearchIndex* index, const string& query, size_t maxHits) const;
+    
+    /**
+     Finds the text matching a pattern, without an index.
+     
+     Spine items are read on the calling thread, then streamed through TextExtractor
+     and searched on a pool of background threads, so the archive is never read
+     concurrently. A match may span several text nodes, as when a phrase crosses
+     inline markup, but not several spine items.
+     @param pattern The pattern to find.
+     @param maxHits The search stops once this many matches have been found.
+     @param offsetUnit What the hits' character offsets count. Resolve them with a
+     CFIResolver constructed with the same unit; pass UTFOffsetMap::Unit::UTF16 for a
+     JavaScript CFI resolver.
+     @result A range CFI for each of the first `maxHits` matches, in spine order.
+     */
+    std::vector<CFI>        FindText(const TextPattern& pattern, size_t maxHits=size_t(-1),
+                                     UTFOffsetMap::Unit offsetUnit=UTFOffsetMap::Unit::CodePoint) const;
     
     const class NavigationTable*    TableOfContents()       const       { return NavigationTable("toc"); }
     const class NavigationTable*    ListOfFigures()         const       { return NavigationTable("lof"); }
@@ -427,6 +560,10 @@ public:
 protected:
     virtual bool            Unpack();
     
+    ///
+    /// Identifies the content a search index was built from; see LoadSearchIndex().
+    std::string             SearchIndexIdentifier()             const;
+    
     // default is `true`
     static bool             gValidateSchema;
     
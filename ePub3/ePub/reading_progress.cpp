@@ -0,0 +1,283 @@
+//
+//  reading_progress.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "reading_progress.h"
+#include "package.h"
+#include "cfi_resolver.h"
+#include <algorithm>
+#include <stdexcept>
+
+EPUB3_BEGIN_NAMESPACE
+
+ReadingProgress::ReadingProgress(const Package* package, Weighting weighting, UTFOffsetMap::Unit offsetUnit)
+    : _package(package), _weighting(weighting), _offsetUnit(offsetUnit), _items(), _indexByIdref(), _prefix(), _spineStep(0), _steps(), _marks(), _firstMark()
+{
+    // SpineItemAt() walks the spine, so keep our own table
+    for ( const SpineItem* item = package->FirstSpineItem(); item != nullptr; item = item->Next() )
+    {
+        _indexByIdref.emplace(item->Idref().stl_str(), _items.size());
+        _items.push_back(item);
+    }
+    if ( !_items.empty() )
+        _spineStep = package->CFIForSpineItem(_items[0]).Components()[0].nodeIndex;
+    
+    // each item's weight goes after its predecessors' total, then they're summed in place
+    _prefix.assign(_items.size() + 1, 0);
+    if ( weighting == Weighting::Characters )
+        BuildCharacterWeights();
+    else
+        BuildArchiveWeights();
+    
+    for ( size_t i = 1; i < _prefix.size(); i++ )
+        _prefix[i] += _prefix[i-1];
+}
+size_t ReadingProgress::SpineIndexForCFI(const CFI &cfi) const
+{
+    const CFI::ComponentList& components = cfi.Components();
+    if ( components.size() < 2 || components[0].nodeIndex != _spineStep || !components[1].IsIndirector() )
+        throw CFI::InvalidCFI("CFI doesn't lead to a spine item");
+    
+    const CFI::Component& component = components[1];
+    size_t index = component.nodeIndex / 2;
+    bool valid = (component.nodeIndex % 2) == 0 && index < _items.size();
+    
+    // the idref wins over the index (cf. epub-cfi §3.5)
+    if ( component.HasQualifier() && (!valid || _items[index]->Idref() != component.qualifier) )
+    {
+        auto found = _indexByIdref.find(component.qualifier.stl_str());
+        valid = (found != _indexByIdref.end());
+        if ( valid )
+            index = found->second;
+    }
+    
+    if ( !valid )
+        throw CFI::InvalidCFI(_Str("CFI step 2 (", component.nodeIndex, ") doesn't lead to a spine item"));
+    return index;
+}
+double ReadingProgress::Fraction(size_t spineIndex, double withinItem) const
+{
+    if ( spineIndex >= _items.size() )
+        throw std::out_of_range(_Str("Spine index ", spineIndex, " is out of range"));
+    if ( TotalWeight() == 0 )
+        return 0.0;
+    
+    withinItem = std::min(std::max(withinItem, 0.0), 1.0);
+    return (static_cast<double>(_prefix[spineIndex]) + withinItem * static_cast<double>(Weight(spineIndex))) / static_cast<double>(TotalWeight());
+}
+double ReadingProgress::Fraction(const CFI &cfi) const
+{
+    size_t index = SpineIndexForCFI(cfi);
+    uint64_t weight = Weight(index);
+    if ( _weighting != Weighting::Characters || weight == 0 )
+        return Fraction(index, 0.0);
+    
+    // the path within the item's document, to the start of a range
+    CFI::ComponentVector path;
+    path.insert(path.end(), cfi.Components().begin() + 2, cfi.Components().end());
+    if ( cfi.IsRangeTriplet() )
+        path.insert(path.end(), cfi.RangeStart().begin(), cfi.RangeStart().end());
+    
+    uint32_t offset = (!path.empty() && path.back().HasCharacterOffset() ? path.back().characterOffset : 0);
+    if ( offset != 0 && _offsetUnit != UTFOffsetMap::Unit::CodePoint )
+        offset = CodePointOffset(index, cfi, offset);
+    return Fraction(index, static_cast<double>(CharactersBefore(index, path, offset)) / static_cast<double>(weight));
+}
+ReadingProgress::Position ReadingProgress::PositionAt(double fraction) const
+{
+    if ( TotalWeight() == 0 )
+        return Position{0, 0.0};
+    
+    double target = std::min(std::max(fraction, 0.0), 1.0) * static_cast<double>(TotalWeight());
+    
+    // the last item starting at or before the target, so never one with no weight
+    auto pos = std::upper_bound(_prefix.begin(), _prefix.end(), target, [](double value, uint64_t total) {
+        return value < static_cast<double>(total);
+    });
+    size_t index = static_cast<size_t>(pos - _prefix.begin()) - 1;
+    if ( index < _items.size() )
+        return Position{index, (target - static_cast<double>(_prefix[index])) / static_cast<double>(Weight(index))};
+    
+    // the very end belongs to the last item with any weight
+    index = _items.size() - 1;
+    while ( index > 0 && Weight(index) == 0 )
+        index--;
+    return Position{index, 1.0};
+}
+CFI ReadingProgress::CFIAt(double fraction) const
+{
+    if ( _items.empty() )
+        return CFI();
+    
+    Position position = PositionAt(fraction);
+    const SpineItem* item = _items[position.spineIndex];
+    if ( _weighting != Weighting::Characters || _firstMark[position.spineIndex] == _firstMark[position.spineIndex+1] )
+        return _package->CFIForSpineItem(item);
+    
+    // the nearest character, then the last run starting at or before it; the first starts at zero
+    uint64_t weight = Weight(position.spineIndex);
+    uint32_t target = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(position.withinItem * static_cast<double>(weight) + 0.5), weight));
+    auto first = _marks.begin() + _firstMark[position.spineIndex], last = _marks.begin() + _firstMark[position.spineIndex+1];
+    auto mark = std::upper_bound(first, last, target, [](uint32_t value, const TextMark& m) { return value < m.position; }) - 1;
+    
+    std::vector<uint32_t> steps(_steps.begin() + mark->steps, _steps.begin() + mark->steps + mark->depth);
+    CFI result = _package->CFIForTextLocation(item, steps, mark->offset + (target - mark->position));
+    if ( _offsetUnit != UTFOffsetMap::Unit::CodePoint )
+        ConvertOffset(position.spineIndex, result);
+    return result;
+}
+void ReadingProgress::BuildArchiveWeights()
+{
+    for ( size_t i = 0; i < _items.size(); i++ )
+    {
+        const ManifestItem* manifestItem = _items[i]->ManifestItem();
+        if ( !_items[i]->Linear() || manifestItem == nullptr )
+            continue;
+        
+        // an item missing from the archive weighs nothing
+        try
+        {
+            _prefix[i+1] = _package->InfoForRelativePath(manifestItem->BaseHref()).UncompressedSize();
+        }
+        catch (std::runtime_error&)
+        {
+            _prefix[i+1] = 0;
+        }
+    }
+}
+void ReadingProgress::BuildCharacterWeights()
+{
+    _firstMark.assign(1, 0);
+    for ( size_t i = 0; i < _items.size(); i++ )
+    {
+        // non-linear items weigh nothing, so aren't read at all
+        const ManifestItem* manifestItem = _items[i]->ManifestItem();
+        if ( _items[i]->Linear() && manifestItem != nullptr )
+        {
+            try
+            {
+                manifestItem->ExtractText([&](const TextRun& run) {
+                    uint32_t count = 0;
+                    for ( char ch : run.text )
+                    {
+                        if ( (static_cast<uint8_t>(ch) & 0xC0) != 0x80 )
+                            count++;
+                    }
+                    if ( count == 0 )
+                        return true;
+                    
+                    _marks.push_back(TextMark{static_cast<uint32_t>(_steps.size()), static_cast<uint32_t>(run.steps.size()), run.offset, static_cast<uint32_t>(_prefix[i+1])});
+                    _steps.insert(_steps.end(), run.steps.begin(), run.steps.end());
+                    _prefix[i+1] += count;
+                    return true;
+                });
+            }
+            catch (std::runtime_error&)
+            {
+                // as for an item missing from the archive: forget whatever was read
+                if ( _firstMark.back() < _marks.size() )
+                    _steps.resize(_marks[_firstMark.back()].steps);
+                _marks.resize(_firstMark.back());
+                _prefix[i+1] = 0;
+            }
+        }
+        
+        _firstMark.push_back(static_cast<uint32_t>(_marks.size()));
+    }
+}
+uint64_t ReadingProgress::CharactersBefore(size_t spineIndex, const CFI::ComponentList &path, uint32_t offset) const
+{
+    auto first = _marks.begin() + _firstMark[spineIndex], last = _marks.begin() + _firstMark[spineIndex+1];
+    
+    // the first run which starts after the location
+    auto next = std::upper_bound(first, last, offset, [&](uint32_t value, const TextMark& m) {
+        int order = ComparePath(path, _steps.data() + m.steps, m.depth);
+        return order < 0 || (order == 0 && value < m.offset);
+    });
+    if ( next == first )
+        return 0;
+    
+    // within the preceding run if it's in the same character data, otherwise after it
+    const TextMark& mark = *(next - 1);
+    uint64_t end = (next == last ? Weight(spineIndex) : next->position);
+    if ( ComparePath(path, _steps.data() + mark.steps, mark.depth) != 0 )
+        return end;
+    return std::min<uint64_t>(mark.position + (offset - mark.offset), end);
+}
+uint32_t ReadingProgress::CodePointOffset(size_t spineIndex, const CFI &cfi, uint32_t offset) const
+{
+    // the resolver converts through the text node's OffsetMap; if the item can't be
+    //  read or the CFI doesn't resolve, the offset is taken as it is
+    try
+    {
+        Auto<xml::CompactDocument> document(_items[spineIndex]->ManifestItem()->ReferencedCompactDocument());
+        if ( !document )
+            return offset;
+        
+        CFI local;
+        local.Assign(cfi, 2);
+        CFIResolver::Resolution resolution = CFIResolver(*document, _offsetUnit).Resolve(local);
+        if ( resolution.start.hasCharacterOffset )
+            return resolution.start.characterOffset;
+    }
+    catch (std::exception&)
+    {
+    }
+    return offset;
+}
+void ReadingProgress::ConvertOffset(size_t spineIndex, CFI &cfi) const
+{
+    try
+    {
+        Auto<xml::CompactDocument> document(_items[spineIndex]->ManifestItem()->ReferencedCompactDocument());
+        if ( !document )
+            return;
+        
+        CFI local;
+        local.Assign(cfi, 2);
+        CFIResolver::Location location = CFIResolver(*document).Resolve(local).start;
+        if ( location.node == xml::CompactDocument::NoNode || !document->IsText(location.node) )
+            return;
+        
+        const UTFOffsetMap& map = document->OffsetMap(location.node);
+        cfi.MutableComponents().back().characterOffset = map.Convert(location.characterOffset, UTFOffsetMap::Unit::CodePoint, _offsetUnit);
+    }
+    catch (std::exception&)
+    {
+        // left in code points, as for a CFI which doesn't resolve above
+    }
+}
+int ReadingProgress::ComparePath(const CFI::ComponentList &path, const uint32_t *steps, uint32_t depth)
+{
+    // in document order, so an element precedes its contents
+    size_t count = std::min<size_t>(path.size(), depth);
+    for ( size_t i = 0; i < count; i++ )
+    {
+        if ( path[i].nodeIndex != steps[i] )
+            return (path[i].nodeIndex < steps[i] ? -1 : 1);
+    }
+    if ( path.size() == depth )
+        return 0;
+    return (path.size() < depth ? -1 : 1);
+}
+
+EPUB3_END_NAMESPACE
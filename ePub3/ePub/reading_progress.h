@@ -0,0 +1,173 @@
+//
+//  reading_progress.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#ifndef __ePub3__reading_progress__
+#define __ePub3__reading_progress__
+
+#include "epub3.h"
+#include "cfi.h"
+#include "utf_offset_map.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+class Package;
+class SpineItem;
+
+/**
+ Maps locations in a publication to how far through it they are, and back.
+ 
+ Each spine item is given a weight when the model is built, and the weights are
+ summed in spine order, so the fraction of the way through the publication at any
+ point within an item takes constant time to find, and the item containing a given
+ fraction takes O(log n).
+ 
+ By default the weights are the uncompressed sizes of the items' files, which costs
+ nothing to look up but only places a CFI at the start of its item; the caller
+ supplies how far through the item it is, if known. Weighting by characters reads
+ the text of every linear item once (see ManifestItem::ExtractText()), and also
+ remembers where each run of text lies, so CFIs map to and from points within items
+ too.
+ 
+ Non-linear spine items carry no weight, and aren't read; nor do any which are
+ missing from the archive or can't be read. All are placed where they occur in the
+ spine.
+ 
+ CFIs' character offsets count code points unless another unit is given, as for
+ CFIResolver; pass UTFOffsetMap::Unit::UTF16 to read and write a JavaScript
+ resolver's CFIs. Converting an offset reads the item's document (see
+ CompactDocument::OffsetMap()), so it costs as much as resolving the CFI.
+ 
+ ```
+ ReadingProgress progress(package, ReadingProgress::Weighting::Characters);
+ label = _Str(static_cast<int>(progress.Fraction(cfi) * 100), "%");
+ ...
+ CFI target = progress.CFIAt(slider.value);
+ ```
+ */
+class ReadingProgress
+{
+public:
+    enum class Weighting : uint8_t
+    {
+        ArchiveSize,        ///< Each item's uncompressed size, in bytes.
+        Characters,         ///< The number of code points in each item's text.
+    };
+    
+    ///
+    /// A point within a spine item, as a fraction of the way through it.
+    struct Position
+    {
+        size_t      spineIndex;
+        double      withinItem;
+    };
+    
+                    ReadingProgress(const Package* package, Weighting weighting = Weighting::ArchiveSize,
+                                    UTFOffsetMap::Unit offsetUnit = UTFOffsetMap::Unit::CodePoint);
+                    ReadingProgress(const ReadingProgress&) = default;
+                    ReadingProgress(ReadingProgress&&) = default;
+                    ~ReadingProgress() {}
+    
+    Weighting       GetWeighting()                          const   { return _weighting; }
+    UTFOffsetMap::Unit  OffsetUnit()                        const   { return _offsetUnit; }
+    size_t          SpineCount()                            const   { return _items.size(); }
+    uint64_t        TotalWeight()                           const   { return _prefix.back(); }
+    uint64_t        Weight(size_t spineIndex)               const   { return _prefix[spineIndex+1] - _prefix[spineIndex]; }
+    
+    /**
+     The index of the spine item a CFI leads to, following its `[idref]` assertion if
+     the spine has changed.
+     @throws CFI::InvalidCFI if the CFI doesn't lead to a spine item.
+     */
+    size_t          SpineIndexForCFI(const CFI& cfi)        const;
+    
+    ///
+    /// How far through the publication a point within a spine item lies, from 0 to 1.
+    double          Fraction(size_t spineIndex, double withinItem = 0.0)    const;
+    
+    /**
+     How far through the publication a CFI lies, from 0 to 1.
+     
+     With character weights, the CFI's path and character offset are located among the
+     item's runs of text by binary search; otherwise it's placed at the item's start.
+     A range CFI is placed at its start.
+     @throws CFI::InvalidCFI if the CFI doesn't lead to a spine item.
+     */
+    double          Fraction(const CFI& cfi)                const;
+    
+    ///
+    /// The point a fraction of the way through the publication.
+    Position        PositionAt(double fraction)             const;
+    
+    /**
+     An approximate CFI for the point a fraction of the way through the publication,
+     as when scrubbing a slider.
+     
+     With character weights this is the character at that point; otherwise it's the
+     start of the spine item containing it.
+     */
+    CFI             CFIAt(double fraction)                  const;
+    
+protected:
+    // where a run of text begins, relative to its spine item
+    struct TextMark
+    {
+        uint32_t    steps;              // the first of the run's steps in _steps
+        uint32_t    depth;              // and how many of them there are
+        uint32_t    offset;             // the run's offset within its character data, in code points
+        uint32_t    position;           // the number of code points in the item before the run
+    };
+    
+    const Package*                      _package;
+    Weighting                           _weighting;
+    UTFOffsetMap::Unit                  _offsetUnit;    // the unit of character offsets in CFIs
+    std::vector<const SpineItem*>       _items;
+    std::unordered_map<std::string, size_t> _indexByIdref;
+    std::vector<uint64_t>               _prefix;        // the total weight of the items before each, and of all of them
+    uint32_t                            _spineStep;     // the step leading to the package's spine
+    
+    // character weights only
+    std::vector<uint32_t>               _steps;
+    std::vector<TextMark>               _marks;
+    std::vector<uint32_t>               _firstMark;     // the first of each item's marks, and the end of the last item's
+    
+    void            BuildArchiveWeights();
+    void            BuildCharacterWeights();
+    
+    // the number of code points before a location within an item
+    uint64_t        CharactersBefore(size_t spineIndex, const CFI::ComponentList& path, uint32_t offset)   const;
+    // a CFI's character offset in code points, converted from _offsetUnit
+    uint32_t        CodePointOffset(size_t spineIndex, const CFI& cfi, uint32_t offset)    const;
+    // rewrites the code-point offset a CFI ends with in _offsetUnit
+    void            ConvertOffset(size_t spineIndex, CFI& cfi)  const;
+    // orders a path within a document against a run's steps, as -1, 0 or 1
+    static int      ComparePath(const CFI::ComponentList& path, const uint32_t* steps, uint32_t depth);
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__reading_progress__) */
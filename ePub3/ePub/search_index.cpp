@@ -0,0 +1,577 @@
+//
+//  search_index.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "search_index.h"
+#include "code_points.h"
+#include "utf_offset_map.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+const uint32_t SearchIndex::FormatVersion;
+
+static const char       IndexMagic[8] = { 'e', 'P', 'u', 'b', '3', 'S', 'I', 'X' };
+static const uint32_t   ByteOrderMark = 0x01020304;
+
+// longer terms are cut to this many bytes, as are the query terms matching them
+static const size_t     MaximumTermLength = 64;
+
+// All offsets are from the start of the file; each table is 8-byte aligned.
+struct SearchIndex::FileHeader
+{
+    char        magic[8];
+    uint32_t    byteOrder;
+    uint32_t    version;
+    uint32_t    termCount;
+    uint32_t    locationCount;
+    uint32_t    stepCount;
+    uint32_t    identifierLength;
+    uint64_t    termsOffset;            // TermEntry[termCount], sorted by term
+    uint64_t    locationsOffset;        // LocationEntry[locationCount], in document order
+    uint64_t    stepsOffset;            // uint32_t[stepCount]
+    uint64_t    stringsOffset;          // the identifier, then the terms, unterminated
+    uint64_t    postingsOffset;
+    uint64_t    fileSize;
+};
+struct SearchIndex::TermEntry
+{
+    uint32_t    string;                 // relative to stringsOffset
+    uint32_t    length;
+    uint32_t    postingCount;
+    uint32_t    postingBytes;
+    uint64_t    postings;               // relative to postingsOffset
+};
+struct SearchIndex::LocationEntry
+{
+    uint32_t    spineIndex;
+    uint32_t    firstStep;
+    uint32_t    stepCount;
+    uint32_t    block;                  // counts up from zero, in document order
+};
+
+static inline size_t Aligned8(size_t n)
+{
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+static void AppendVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    while ( value >= 0x80 )
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+static bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint32_t* value)
+{
+    uint32_t result = 0;
+    for ( int shift = 0; shift < 35 && p < end; shift += 7 )
+    {
+        uint8_t byte = *p++;
+        result |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ( (byte & 0x80) == 0 )
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SearchIndex::Tokenize(const std::string &text, const TermHandler &handler)
+{
+    std::string term;
+    uint32_t termStart = 0;
+    uint32_t index = 0;
+    uint32_t previousCJK = 0;
+    
+    auto flush = [&]() {
+        if ( term.empty() )
+            return;
+        if ( term.size() > MaximumTermLength )
+        {
+            // don't split a code point
+            size_t length = MaximumTermLength;
+            while ( length > 0 && (term[length] & 0xC0) == 0x80 )
+                length--;
+            term.resize(length);
+        }
+        handler(term, termStart);
+        term.clear();
+    };
+    
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+    const uint8_t* end = p + text.size();
+    for ( ; p < end; index++ )
+    {
+        uint32_t ch = CodePoints::Next(p, end);
+        if ( CodePoints::IsCJK(ch) )
+        {
+            // with no spaces to go by, each character is a term, as is each pair of
+            //  neighbouring characters
+            flush();
+            std::string single;
+            CodePoints::AppendUTF8(single, ch);
+            if ( previousCJK != 0 )
+            {
+                std::string pair;
+                CodePoints::AppendUTF8(pair, previousCJK);
+                handler(pair + single, index - 1);
+            }
+            handler(single, index);
+            previousCJK = ch;
+            continue;
+        }
+        
+        previousCJK = 0;
+        if ( CodePoints::IsWord(ch) )
+        {
+            if ( term.empty() )
+                termStart = index;
+            CodePoints::AppendUTF8(term, CodePoints::FoldCase(ch));
+        }
+        else
+        {
+            flush();
+        }
+    }
+    flush();
+}
+
+SearchIndex::Builder::Builder(const std::string& identifier) : _identifier(identifier), _blockLength(0), _blockNumber(0), _blockCount(0), _chunkLength(0)
+{
+}
+void SearchIndex::Builder::AddRun(uint32_t spineIndex, const TextRun &run)
+{
+    // runs from the same chunk of character data share a location, and the runs of a
+    //  block are gathered up to be tokenized together
+    bool sameLocation = false, sameBlock = false;
+    if ( !_locations.empty() )
+    {
+        const Location& last = _locations.back();
+        sameBlock = (last.spineIndex == spineIndex && !_blockRuns.empty() && _blockNumber == run.block);
+        sameLocation = (last.spineIndex == spineIndex && last.stepCount == run.steps.size() &&
+                        std::equal(run.steps.begin(), run.steps.end(), _steps.begin() + last.firstStep));
+    }
+    if ( !sameBlock )
+        FinishBlock();
+    if ( !sameLocation )
+    {
+        _locations.push_back(Location{spineIndex, static_cast<uint32_t>(_steps.size()), static_cast<uint32_t>(run.steps.size()), _blockCount});
+        _steps.insert(_steps.end(), run.steps.begin(), run.steps.end());
+        _chunkLength = 0;
+    }
+    
+    _blockRuns.push_back(BlockRun{static_cast<uint32_t>(_locations.size() - 1), _chunkLength, _blockLength});
+    _blockNumber = run.block;
+    _blockText += run.text;
+    for ( unsigned char byte : run.text )
+    {
+        // code points start with anything but a continuation byte; those beyond the
+        //  BMP take two UTF-16 units
+        if ( (byte & 0xC0) != 0x80 )
+        {
+            _blockLength++;
+            _chunkLength++;
+        }
+        if ( byte >= 0xF0 )
+            _chunkLength++;
+    }
+}
+void SearchIndex::Builder::FinishBlock()
+{
+    if ( _blockRuns.empty() )
+        return;
+    
+    UTFOffsetMap map(_blockText.data(), _blockText.size());
+    Tokenize(_blockText, [&](const std::string& term, uint32_t offset) {
+        // the run holding the start of the term
+        auto run = std::upper_bound(_blockRuns.begin(), _blockRuns.end(), offset, [](uint32_t offset, const BlockRun& run) {
+            return offset < run.start;
+        }) - 1;
+        uint32_t units = map.Convert(offset, UTFOffsetMap::Unit::CodePoint, UTFOffsetMap::Unit::UTF16) -
+                         map.Convert(run->start, UTFOffsetMap::Unit::CodePoint, UTFOffsetMap::Unit::UTF16);
+        _postings[term].push_back(Posting{run->location, run->offset + units});
+    });
+    
+    _blockText.clear();
+    _blockRuns.clear();
+    _blockLength = 0;
+    _blockCount++;
+}
+SearchIndex* SearchIndex::Builder::Finish()
+{
+    FinishBlock();
+    
+    std::vector<const std::string*> terms;
+    terms.reserve(_postings.size());
+    for ( auto& pair : _postings )
+        terms.push_back(&pair.first);
+    std::sort(terms.begin(), terms.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+    
+    // encode the postings and gather the strings first, to size the tables
+    std::vector<uint8_t> postings;
+    std::vector<TermEntry> entries;
+    std::string strings(_identifier);
+    entries.reserve(terms.size());
+    for ( const std::string* term : terms )
+    {
+        const std::vector<Posting>& list = _postings[*term];
+        size_t start = postings.size();
+        
+        // postings were added in document order; delta-encode locations, and offsets
+        //  within the same location
+        uint32_t prevLocation = 0, prevOffset = 0;
+        for ( const Posting& posting : list )
+        {
+            uint32_t locationDelta = posting.location - prevLocation;
+            AppendVarint(postings, locationDelta);
+            AppendVarint(postings, (locationDelta == 0 ? posting.offset - prevOffset : posting.offset));
+            prevLocation = posting.location;
+            prevOffset = posting.offset;
+        }
+        
+        entries.push_back(TermEntry{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(term->size()),
+                                    static_cast<uint32_t>(list.size()), static_cast<uint32_t>(postings.size() - start), start});
+        strings += *term;
+    }
+    
+    FileHeader header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+    header.byteOrder = ByteOrderMark;
+    header.version = FormatVersion;
+    header.termCount = static_cast<uint32_t>(entries.size());
+    header.locationCount = static_cast<uint32_t>(_locations.size());
+    header.stepCount = static_cast<uint32_t>(_steps.size());
+    header.identifierLength = static_cast<uint32_t>(_identifier.size());
+    header.termsOffset = Aligned8(sizeof(FileHeader));
+    header.locationsOffset = Aligned8(header.termsOffset + entries.size() * sizeof(TermEntry));
+    header.stepsOffset = Aligned8(header.locationsOffset + _locations.size() * sizeof(LocationEntry));
+    header.stringsOffset = Aligned8(header.stepsOffset + _steps.size() * sizeof(uint32_t));
+    header.postingsOffset = Aligned8(header.stringsOffset + strings.size());
+    header.fileSize = header.postingsOffset + postings.size();
+    
+    SearchIndex* index = new SearchIndex;
+    std::vector<uint8_t>& buf = index->_buffer;
+    buf.resize(header.fileSize, 0);
+    ::memcpy(buf.data(), &header, sizeof(header));
+    if ( !entries.empty() )
+        ::memcpy(&buf[header.termsOffset], entries.data(), entries.size() * sizeof(TermEntry));
+    for ( size_t i = 0; i < _locations.size(); i++ )
+    {
+        LocationEntry entry{_locations[i].spineIndex, _locations[i].firstStep, _locations[i].stepCount, _locations[i].block};
+        ::memcpy(&buf[header.locationsOffset + i * sizeof(LocationEntry)], &entry, sizeof(entry));
+    }
+    if ( !_steps.empty() )
+        ::memcpy(&buf[header.stepsOffset], _steps.data(), _steps.size() * sizeof(uint32_t));
+    ::memcpy(&buf[header.stringsOffset], strings.data(), strings.size());
+    if ( !postings.empty() )
+        ::memcpy(&buf[header.postingsOffset], postings.data(), postings.size());
+    
+    index->_data = buf.data();
+    index->_length = buf.size();
+    
+    _locations.clear();
+    _steps.clear();
+    _postings.clear();
+    _blockCount = 0;
+    return index;
+}
+
+SearchIndex* SearchIndex::Open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        return nullptr;
+    
+    struct stat sb;
+    if ( ::fstat(fd, &sb) != 0 || sb.st_size < static_cast<off_t>(sizeof(FileHeader)) )
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    
+    void* mapping = ::mmap(nullptr, static_cast<size_t>(sb.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if ( mapping == MAP_FAILED )
+        return nullptr;
+    
+    SearchIndex* index = new SearchIndex;
+    index->_mapping = mapping;
+    index->_data = reinterpret_cast<const uint8_t*>(mapping);
+    index->_length = static_cast<size_t>(sb.st_size);
+    
+    if ( !index->Validate() )
+    {
+        delete index;
+        return nullptr;
+    }
+    
+    return index;
+}
+SearchIndex::~SearchIndex()
+{
+    if ( _mapping != nullptr )
+        ::munmap(_mapping, _length);
+}
+bool SearchIndex::Validate() const
+{
+    const FileHeader* header = Header();
+    if ( ::memcmp(header->magic, IndexMagic, sizeof(IndexMagic)) != 0 )
+        return false;
+    if ( header->byteOrder != ByteOrderMark || header->version != FormatVersion || header->fileSize != _length )
+        return false;
+    
+    // every table must lie within the file
+    uint64_t size = header->fileSize;
+    if ( header->termsOffset + static_cast<uint64_t>(header->termCount) * sizeof(TermEntry) > size ||
+         header->locationsOffset + static_cast<uint64_t>(header->locationCount) * sizeof(LocationEntry) > size ||
+         header->stepsOffset + static_cast<uint64_t>(header->stepCount) * sizeof(uint32_t) > size ||
+         header->stringsOffset + header->identifierLength > size || header->postingsOffset > size )
+        return false;
+    if ( (header->termsOffset | header->locationsOffset | header->stepsOffset) % 8 != 0 )
+        return false;
+    
+    uint64_t stringsSize = header->postingsOffset - std::min(header->postingsOffset, header->stringsOffset);
+    uint64_t postingsSize = size - header->postingsOffset;
+    const TermEntry* terms = reinterpret_cast<const TermEntry*>(_data + header->termsOffset);
+    for ( uint32_t i = 0; i < header->termCount; i++ )
+    {
+        if ( static_cast<uint64_t>(terms[i].string) + terms[i].length > stringsSize )
+            return false;
+        if ( terms[i].postings + terms[i].postingBytes > postingsSize )
+            return false;
+    }
+    
+    const LocationEntry* locations = reinterpret_cast<const LocationEntry*>(_data + header->locationsOffset);
+    for ( uint32_t i = 0; i < header->locationCount; i++ )
+    {
+        if ( static_cast<uint64_t>(locations[i].firstStep) + locations[i].stepCount > header->stepCount )
+            return false;
+        if ( i > 0 && locations[i].block < locations[i-1].block )
+            return false;
+    }
+    
+    return true;
+}
+bool SearchIndex::Save(const std::string &path) const
+{
+    // a unique name, so concurrent saves can't write into each other's files
+    std::string tmpPath = path + ".XXXXXX";
+    int fd = ::mkstemp(&tmpPath[0]);
+    if ( fd < 0 )
+        return false;
+    ::fchmod(fd, 0644);     // mkstemp() makes it private to its owner
+    
+    const uint8_t* p = _data;
+    size_t remaining = _length;
+    while ( remaining > 0 )
+    {
+        ssize_t written = ::write(fd, p, remaining);
+        if ( written < 0 && errno == EINTR )
+            continue;
+        if ( written <= 0 )
+            break;
+        p += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    
+    // the data must be on disk before the rename makes it visible
+    bool ok = (remaining == 0 && ::fsync(fd) == 0);
+    if ( ::close(fd) != 0 )
+        ok = false;
+    
+    if ( !ok || ::rename(tmpPath.c_str(), path.c_str()) != 0 )
+    {
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+std::string SearchIndex::Identifier() const
+{
+    return std::string(reinterpret_cast<const char*>(_data + Header()->stringsOffset), Header()->identifierLength);
+}
+size_t SearchIndex::TermCount() const
+{
+    return Header()->termCount;
+}
+size_t SearchIndex::LocationCount() const
+{
+    return Header()->locationCount;
+}
+const SearchIndex::TermEntry* SearchIndex::FindTerm(const std::string &term) const
+{
+    const FileHeader* header = Header();
+    const TermEntry* begin = reinterpret_cast<const TermEntry*>(_data + header->termsOffset);
+    const TermEntry* end = begin + header->termCount;
+    const char* strings = reinterpret_cast<const char*>(_data + header->stringsOffset);
+    
+    // compares as std::string does
+    auto compare = [&](const TermEntry& entry) {
+        int cmp = ::memcmp(strings + entry.string, term.data(), std::min<size_t>(entry.length, term.size()));
+        if ( cmp != 0 )
+            return cmp;
+        return (entry.length < term.size() ? -1 : (entry.length > term.size() ? 1 : 0));
+    };
+    
+    const TermEntry* pos = std::lower_bound(begin, end, term, [&](const TermEntry& entry, const std::string&) {
+        return compare(entry) < 0;
+    });
+    if ( pos == end || compare(*pos) != 0 )
+        return nullptr;
+    return pos;
+}
+std::vector<SearchIndex::Match> SearchIndex::Query(const std::string &query, size_t maxMatches) const
+{
+    std::vector<std::string> terms;
+    Tokenize(query, [&](const std::string& term, uint32_t) {
+        if ( std::find(terms.begin(), terms.end(), term) == terms.end() )
+            terms.push_back(term);
+    });
+    if ( terms.empty() || maxMatches == 0 )
+        return std::vector<Match>();
+    
+    std::vector<const TermEntry*> entries;
+    for ( const std::string& term : terms )
+    {
+        const TermEntry* entry = FindTerm(term);
+        if ( entry == nullptr )
+            return std::vector<Match>();        // every term must match
+        entries.push_back(entry);
+    }
+    
+    // intersect starting from the rarest term, so the candidate set only shrinks
+    std::sort(entries.begin(), entries.end(), [](const TermEntry* a, const TermEntry* b) {
+        return a->postingCount < b->postingCount;
+    });
+    
+    // a block, and the earliest of the terms found in it
+    struct Candidate
+    {
+        uint32_t    block;
+        uint32_t    location;
+        uint32_t    offset;
+        double      score;
+    };
+    
+    const FileHeader* header = Header();
+    const LocationEntry* locations = reinterpret_cast<const LocationEntry*>(_data + header->locationsOffset);
+    double numBlocks = static_cast<double>(header->locationCount == 0 ? 1 : locations[header->locationCount-1].block + 1);
+    std::vector<Candidate> candidates, termHits;
+    for ( size_t t = 0; t < entries.size(); t++ )
+    {
+        // decode this term's postings into per-block counts
+        termHits.clear();
+        const uint8_t* p = _data + header->postingsOffset + entries[t]->postings;
+        const uint8_t* end = p + entries[t]->postingBytes;
+        uint32_t location = 0, offset = 0;
+        for ( uint32_t i = 0; i < entries[t]->postingCount; i++ )
+        {
+            uint32_t locationDelta = 0, value = 0;
+            if ( !ReadVarint(p, end, &locationDelta) || !ReadVarint(p, end, &value) )
+                break;
+            location += locationDelta;
+            offset = (locationDelta == 0 && i > 0 ? offset + value : value);
+            if ( location >= header->locationCount )
+                break;
+            
+            uint32_t block = locations[location].block;
+            if ( !termHits.empty() && termHits.back().block == block )
+                termHits.back().score += 1.0;
+            else
+                termHits.push_back(Candidate{block, location, offset, 1.0});
+        }
+        
+        double idf = std::log(1.0 + numBlocks / static_cast<double>(std::max<size_t>(termHits.size(), 1)));
+        for ( Candidate& hit : termHits )
+            hit.score *= idf;
+        
+        if ( t == 0 )
+        {
+            candidates.swap(termHits);
+            continue;
+        }
+        
+        // both lists are in block order
+        size_t kept = 0;
+        auto hit = termHits.begin();
+        for ( Candidate& candidate : candidates )
+        {
+            while ( hit != termHits.end() && hit->block < candidate.block )
+                ++hit;
+            if ( hit == termHits.end() )
+                break;
+            if ( hit->block != candidate.block )
+                continue;
+            
+            candidate.score += hit->score;
+            if ( hit->location < candidate.location || (hit->location == candidate.location && hit->offset < candidate.offset) )
+            {
+                candidate.location = hit->location;
+                candidate.offset = hit->offset;
+            }
+            candidates[kept++] = candidate;
+        }
+        candidates.resize(kept);
+        
+        if ( candidates.empty() )
+            break;
+    }
+    
+    auto better = [](const Candidate& a, const Candidate& b) {
+        if ( a.score != b.score )
+            return a.score > b.score;
+        return a.block < b.block;
+    };
+    if ( candidates.size() > maxMatches )
+    {
+        std::partial_sort(candidates.begin(), candidates.begin() + maxMatches, candidates.end(), better);
+        candidates.resize(maxMatches);
+    }
+    else
+    {
+        std::sort(candidates.begin(), candidates.end(), better);
+    }
+    
+    const uint32_t* steps = reinterpret_cast<const uint32_t*>(_data + header->stepsOffset);
+    std::vector<Match> result;
+    result.reserve(candidates.size());
+    for ( const Candidate& candidate : candidates )
+    {
+        const LocationEntry& loc = locations[candidate.location];
+        result.push_back(Match{loc.spineIndex, std::vector<uint32_t>(steps + loc.firstStep, steps + loc.firstStep + loc.stepCount), candidate.offset, candidate.score});
+    }
+    
+    return result;
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,186 @@
+//
+//  search_index.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__search_index__
+#define __ePub3__search_index__
+
+#include "epub3.h"
+#include "text_extractor.h"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A full-text index of a package's spine, which can be saved to disk and memory-mapped
+ back in.
+ 
+ The text of each block (a paragraph, heading, list item and so on; see TextRun::block)
+ is split into terms by SearchIndex::Tokenize() as a whole, so inline markup such as
+ `<em>` doesn't break words apart. Each term's postings list the places it occurs: a
+ *location* (a spine index and the CFI steps of a chunk of character data) and a UTF-16
+ offset within that chunk. Postings are stored as varints, delta-encoded in location
+ order, so the index is typically a fraction of the size of the text it covers.
+ 
+ Queries match blocks containing every term, ranked by the sum of each term's
+ frequency there weighted by its inverse document frequency, and report the first
+ term's location. Package::Search() turns the results into CFIs.
+ 
+ The file is written in native byte order, and is rejected if opened on a machine
+ with the other byte order.
+ */
+class SearchIndex
+{
+public:
+    ///
+    /// Changes whenever the file format or the tokenizer changes.
+    static const uint32_t FormatVersion = 3;
+    
+    struct Match
+    {
+        uint32_t                spineIndex;
+        std::vector<uint32_t>   steps;          ///< CFI steps of the chunk of character data.
+        uint32_t                offset;         ///< UTF-16 offset of the first matching term.
+        double                  score;
+    };
+    
+    /**
+     Accumulates text runs, then produces an index.
+     */
+    class Builder
+    {
+    public:
+        // `identifier` is stored in the index; Package uses its UniqueID()
+        Builder(const std::string& identifier);
+        Builder(const Builder&) = delete;
+        
+        // runs must be added in document order
+        void            AddRun(uint32_t spineIndex, const TextRun& run);
+        
+        // the builder is empty afterwards
+        SearchIndex*    Finish();
+        
+    protected:
+        struct Posting
+        {
+            uint32_t    location;
+            uint32_t    offset;
+        };
+        struct Location
+        {
+            uint32_t    spineIndex;
+            uint32_t    firstStep;
+            uint32_t    stepCount;
+            uint32_t    block;
+        };
+        // a run of the block being gathered
+        struct BlockRun
+        {
+            uint32_t    location;
+            uint32_t    offset;         // UTF-16 offset within its chunk of character data
+            uint32_t    start;          // code point offset within the block's text
+        };
+        
+        std::string                                         _identifier;
+        std::vector<Location>                               _locations;
+        std::vector<uint32_t>                               _steps;
+        std::unordered_map<std::string, std::vector<Posting>>   _postings;
+        
+        // the current block, which is tokenized as a whole once it's complete
+        std::string                                         _blockText;
+        std::vector<BlockRun>                               _blockRuns;
+        uint32_t                                            _blockLength;       // in code points
+        uint32_t                                            _blockNumber;       // its TextRun::block
+        uint32_t                                            _blockCount;
+        uint32_t                                            _chunkLength;       // in UTF-16 units
+        
+        void            FinishBlock();
+        
+    };
+    
+    /**
+     Maps an index file into memory.
+     @result The index, or `nullptr` if the file is missing, damaged, or was written
+     with a different FormatVersion.
+     */
+    static SearchIndex* Open(const std::string& path);
+    
+    ~SearchIndex();
+    
+    /**
+     Writes the index to a file, replacing it atomically.
+     
+     The index is written to a uniquely-named file alongside `path` and flushed to
+     disk before being renamed over it, so a crash or a concurrent save never leaves a
+     partial index in its place.
+     @result `false` if the file couldn't be written.
+     */
+    bool                Save(const std::string& path)   const;
+    
+    std::string         Identifier()                    const;
+    size_t              TermCount()                     const;
+    size_t              LocationCount()                 const;
+    size_t              Size()                          const   { return _length; }
+    
+    /**
+     Finds the blocks containing every term in `query`.
+     @result At most `maxMatches` matches, best first; equal scores are in document
+     order.
+     */
+    std::vector<Match>  Query(const std::string& query, size_t maxMatches) const;
+    
+    typedef std::function<void(const std::string& term, uint32_t offset)> TermHandler;
+    
+    /**
+     Splits UTF-8 text into terms: runs of letters and digits, with ASCII and Latin-1
+     letters folded to lower case. `offset` is in code points.
+     
+     Chinese, Japanese and Korean text has no spaces between its words, so each of its
+     characters is a term, and so is each pair of neighbouring characters; a query of
+     several characters then needs every pair of them to match. Terms longer than 64
+     bytes are cut short, at a code point boundary.
+     */
+    static void         Tokenize(const std::string& text, const TermHandler& handler);
+    
+protected:
+    struct FileHeader;
+    struct TermEntry;
+    struct LocationEntry;
+    
+    std::vector<uint8_t>    _buffer;        // when built in memory
+    void*                   _mapping;       // when opened from a file
+    const uint8_t*          _data;
+    size_t                  _length;
+    
+    SearchIndex() : _buffer(), _mapping(nullptr), _data(nullptr), _length(0) {}
+    
+    bool                    Validate()      const;
+    const FileHeader*       Header()        const   { return reinterpret_cast<const FileHeader*>(_data); }
+    const TermEntry*        FindTerm(const std::string& term)   const;
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__search_index__) */
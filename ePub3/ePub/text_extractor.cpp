@@ -0,0 +1,180 @@
+//
+//  text_extractor.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "text_extractor.h"
+#include <algorithm>
+#include <memory>
+#include <libxml/HTMLparser.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+static uint32_t CodePointCount(const xmlChar* utf8)
+{
+    uint32_t count = 0;
+    for ( ; *utf8 != 0; utf8++ )
+    {
+        // count everything but continuation bytes
+        if ( (*utf8 & 0xC0) != 0x80 )
+            count++;
+    }
+    return count;
+}
+
+// sorted, for a binary search
+static const char* const BlockElements[] = {
+    "address", "article", "aside", "blockquote", "body", "br", "caption", "dd", "details",
+    "div", "dl", "dt", "fieldset", "figcaption", "figure", "footer", "form", "h1", "h2",
+    "h3", "h4", "h5", "h6", "head", "header", "hgroup", "hr", "legend", "li", "main", "nav",
+    "ol", "p", "pre", "section", "summary", "table", "tbody", "td", "tfoot", "th", "thead",
+    "title", "tr", "ul"
+};
+
+bool TextExtractor::IsSkippedElement(const xmlChar *localName)
+{
+    return xmlStrcasecmp(localName, BAD_CAST "script") == 0 || xmlStrcasecmp(localName, BAD_CAST "style") == 0;
+}
+bool TextExtractor::IsBlockElement(const xmlChar *localName)
+{
+    auto found = std::lower_bound(std::begin(BlockElements), std::end(BlockElements), localName, [](const char* element, const xmlChar* name) {
+        return xmlStrcasecmp(BAD_CAST element, name) < 0;
+    });
+    return found != std::end(BlockElements) && xmlStrcasecmp(BAD_CAST *found, localName) == 0;
+}
+TextExtractor::Result TextExtractor::Extract(xmlTextReaderPtr reader, const TextRunHandler &handler)
+{
+    // for each open element: the number of child elements seen so far, and the
+    //  number of code points in its current chunk of character data
+    struct Level
+    {
+        uint32_t    elements;
+        uint32_t    chunkLength;
+    };
+    std::vector<Level> levels;
+    
+    TextRun run;
+    run.block = 0;
+    int status = xmlTextReaderRead(reader);
+    while ( status == 1 )
+    {
+        bool skipSubtree = false;
+        
+        switch ( xmlTextReaderNodeType(reader) )
+        {
+            case XML_READER_TYPE_ELEMENT:
+            {
+                bool empty = (xmlTextReaderIsEmptyElement(reader) == 1);
+                if ( levels.empty() )
+                {
+                    // the root element has no step of its own
+                    if ( !empty )
+                        levels.push_back(Level{0, 0});
+                    break;
+                }
+                
+                Level& parent = levels.back();
+                parent.elements++;
+                parent.chunkLength = 0;
+                
+                const xmlChar* name = xmlTextReaderConstLocalName(reader);
+                if ( IsBlockElement(name) )
+                    run.block++;
+                
+                if ( empty )
+                    break;
+                if ( IsSkippedElement(name) )
+                {
+                    skipSubtree = true;
+                    break;
+                }
+                
+                run.steps.push_back(parent.elements * 2);
+                levels.push_back(Level{0, 0});
+                break;
+            }
+            case XML_READER_TYPE_END_ELEMENT:
+                if ( IsBlockElement(xmlTextReaderConstLocalName(reader)) )
+                    run.block++;
+                if ( !levels.empty() )
+                    levels.pop_back();
+                if ( !run.steps.empty() )
+                    run.steps.pop_back();
+                break;
+                
+            case XML_READER_TYPE_TEXT:
+            case XML_READER_TYPE_CDATA:
+            case XML_READER_TYPE_WHITESPACE:
+            case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+            {
+                if ( levels.empty() )
+                    break;
+                
+                const xmlChar* value = xmlTextReaderConstValue(reader);
+                if ( value == nullptr || *value == 0 )
+                    break;
+                
+                Level& level = levels.back();
+                run.steps.push_back(level.elements * 2 + 1);
+                run.offset = level.chunkLength;
+                run.text.assign(reinterpret_cast<const char*>(value));
+                level.chunkLength += CodePointCount(value);
+                
+                bool proceed = handler(run);
+                run.steps.pop_back();
+                if ( !proceed )
+                    return Result::Stopped;
+                break;
+            }
+            default:
+                break;
+        }
+        
+        status = (skipSubtree ? xmlTextReaderNext(reader) : xmlTextReaderRead(reader));
+    }
+    
+    return (status == 0 ? Result::Complete : Result::Failed);
+}
+TextExtractor::Result TextExtractor::Extract(const void *data, size_t length, const char *url, bool html, const TextRunHandler &handler)
+{
+    typedef std::unique_ptr<xmlTextReader, void(*)(xmlTextReaderPtr)> TextReaderPtr;
+    
+    const char* bytes = reinterpret_cast<const char*>(data);
+    int options = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
+    if ( !html )
+    {
+        TextReaderPtr reader(xmlReaderForMemory(bytes, static_cast<int>(length), url, "utf-8", options), xmlFreeTextReader);
+        if ( !reader )
+            return Result::Failed;
+        return Extract(reader.get(), handler);
+    }
+    
+    std::unique_ptr<xmlDoc, void(*)(xmlDocPtr)> doc(htmlReadMemory(bytes, static_cast<int>(length), url, "utf-8", options), xmlFreeDoc);
+    if ( !doc )
+        return Result::Failed;
+    
+    // the walker must go before the document
+    TextReaderPtr walker(xmlReaderWalker(doc.get()), xmlFreeTextReader);
+    if ( !walker )
+        return Result::Failed;
+    return Extract(walker.get(), handler);
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,107 @@
+//
+//  text_extractor.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__text_extractor__
+#define __ePub3__text_extractor__
+
+#include "epub3.h"
+#include <functional>
+#include <string>
+#include <vector>
+#include <libxml/xmlreader.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A run of character data from a content document, and where it sits.
+ */
+struct TextRun
+{
+    ///
+    /// CFI step indices from the root element down to the character data, as in
+    /// `/4/2/1`. The last step is always odd.
+    std::vector<uint32_t>   steps;
+    ///
+    /// The offset, in code points, of the run's start within that character data.
+    uint32_t                offset;
+    ///
+    /// The number of block boundaries (the start or end of a paragraph, heading, list
+    /// item, table cell and so on, or a line break) before the run. Runs with the same
+    /// value read as continuous text; runs with different values don't.
+    uint32_t                block;
+    ///
+    /// The text itself, in UTF-8.
+    std::string             text;
+};
+
+/**
+ Called once per text run; return `false` to stop extracting.
+ */
+typedef std::function<bool(const TextRun& run)> TextRunHandler;
+
+/**
+ Streams the text of a content document from an `xmlTextReader`, without building
+ a tree.
+ 
+ Text within `script` and `style` elements is skipped, though those elements still
+ count towards the CFI steps of their siblings. A single TextRun is reused for every
+ callback, so memory use depends only on the depth of the document and the length
+ of its longest text node.
+ */
+class TextExtractor
+{
+public:
+    enum class Result : uint8_t
+    {
+        Complete,           ///< The whole document was read.
+        Stopped,            ///< The handler returned `false`.
+        Failed              ///< The document couldn't be read, or isn't well-formed.
+    };
+    
+    /**
+     Reads the document to its end, or until the handler returns `false`.
+     @param reader A reader positioned before the document's root element; either a
+     streaming reader or one from `xmlReaderWalker()`.
+     */
+    static Result Extract(xmlTextReaderPtr reader, const TextRunHandler& handler);
+    
+    /**
+     Reads a document held in memory.
+     
+     libxml can't stream HTML, so HTML documents are parsed into a tree and walked;
+     anything else is streamed.
+     @param url The document's URL, used to resolve relative references.
+     @param html `true` if the document is HTML rather than XML.
+     */
+    static Result Extract(const void* data, size_t length, const char* url, bool html, const TextRunHandler& handler);
+    
+    // true for elements whose content isn't text: `script` and `style`
+    static bool IsSkippedElement(const xmlChar* localName);
+    
+    // true for HTML elements which start a new block of text, such as `p` or `br`
+    static bool IsBlockElement(const xmlChar* localName);
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__text_extractor__) */
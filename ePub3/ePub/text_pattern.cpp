@@ -0,0 +1,695 @@
+//
+//  text_pattern.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "text_pattern.h"
+#include "code_points.h"
+#include <algorithm>
+#include <stdexcept>
+
+EPUB3_BEGIN_NAMESPACE
+
+const uint32_t TextPattern::MaximumRepeat;
+
+// no more than this many instructions, after expanding counted repeats
+static const size_t     MaximumProgramSize = 1<<16;
+static const size_t     MaximumNesting = 256;
+static const uint32_t   Unbounded = UINT32_MAX;
+
+// the shorthand classes, as TextPattern::CharacterClass::builtins
+enum Builtin : uint8_t
+{
+    Digit       = 1<<0,
+    NotDigit    = 1<<1,
+    Word        = 1<<2,
+    NotWord     = 1<<3,
+    Space       = 1<<4,
+    NotSpace    = 1<<5
+};
+
+// `\w` takes in the underscore too, as it does elsewhere
+static bool IsWordCodePoint(uint32_t ch)
+{
+    return ch == '_' || CodePoints::IsWord(ch);
+}
+
+void TextPattern::AppendCodePoints(const std::string &utf8, std::vector<uint32_t> &codePoints)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(utf8.data());
+    const uint8_t* end = p + utf8.size();
+    while ( p < end )
+        codePoints.push_back(CodePoints::Next(p, end));
+}
+
+bool TextPattern::CharacterClass::Contains(uint32_t ch) const
+{
+    bool found = false;
+    if ( builtins != 0 )
+    {
+        bool digit = (ch >= '0' && ch <= '9'), word = IsWordCodePoint(ch), space = CodePoints::IsSpace(ch);
+        found = ((builtins & Digit) && digit) || ((builtins & NotDigit) && !digit) ||
+                ((builtins & Word) && word) || ((builtins & NotWord) && !word) ||
+                ((builtins & Space) && space) || ((builtins & NotSpace) && !space);
+    }
+    
+    for ( auto pos = ranges.begin(); !found && pos != ranges.end(); ++pos )
+        found = (ch >= pos->first && ch <= pos->second);
+    
+    return found != negated;
+}
+
+// Parses a pattern into a tree, then flattens the tree into a program. Counted
+//  repeats are expanded by emitting their operand several times, hence the tree.
+class TextPattern::Compiler
+{
+public:
+    struct Node
+    {
+        enum Kind : uint8_t { Char, Any, Class, Assert, Concat, Alternate, Repeat };
+        
+        Kind                kind;
+        uint32_t            arg;
+        uint32_t            min;
+        uint32_t            max;
+        bool                lazy;
+        std::vector<Node>   children;
+        
+        Node(Kind k, uint32_t a=0) : kind(k), arg(a), min(0), max(0), lazy(false), children() {}
+    };
+    
+    Compiler(TextPattern& pattern) : _target(pattern), _text(), _pos(0), _depth(0) {}
+    
+    void Compile()
+    {
+        AppendCodePoints(_target._pattern, _text);
+        if ( _text.empty() )
+            throw std::invalid_argument("TextPattern: empty pattern");
+        
+        Node root(Node::Concat);
+        if ( (_target._options & Literal) != 0 )
+        {
+            // text is often wrapped, so any run of whitespace matches any other
+            Node space(Node::Repeat);
+            space.min = 1;
+            space.max = Unbounded;
+            space.children.push_back(BuiltinClass(Space));
+            for ( size_t i = 0; i < _text.size(); i++ )
+            {
+                if ( !CodePoints::IsSpace(_text[i]) )
+                    root.children.emplace_back(Node::Char, _text[i]);
+                else if ( i == 0 || !CodePoints::IsSpace(_text[i-1]) )
+                    root.children.push_back(space);
+            }
+        }
+        else
+        {
+            root = ParseAlternation();
+            if ( _pos < _text.size() )
+                Fail("unbalanced ')'");
+        }
+        
+        Emit(root);
+        Append(Op::Match);
+    }
+    
+private:
+    TextPattern&            _target;
+    std::vector<uint32_t>   _text;
+    size_t                  _pos;
+    size_t                  _depth;
+    
+    [[noreturn]] void Fail(const char* reason) const
+    {
+        throw std::invalid_argument(std::string("TextPattern: ") + reason + " in '" + _target._pattern + "'");
+    }
+    bool AtEnd() const { return _pos >= _text.size(); }
+    static bool IsQuantifier(uint32_t ch) { return ch == '*' || ch == '+' || ch == '?' || ch == '{'; }
+    uint32_t Peek() const { return _text[_pos]; }
+    
+    Node ParseAlternation()
+    {
+        if ( ++_depth > MaximumNesting )
+            Fail("groups nested too deeply");
+        
+        Node alternation(Node::Alternate);
+        alternation.children.push_back(ParseConcatenation());
+        while ( !AtEnd() && Peek() == '|' )
+        {
+            _pos++;
+            alternation.children.push_back(ParseConcatenation());
+        }
+        
+        _depth--;
+        if ( alternation.children.size() == 1 )
+            return std::move(alternation.children.front());
+        return alternation;
+    }
+    Node ParseConcatenation()
+    {
+        Node concatenation(Node::Concat);
+        while ( !AtEnd() && Peek() != '|' && Peek() != ')' )
+        {
+            Node atom = ParseAtom();
+            if ( !AtEnd() && ParseQuantifier(atom) && !AtEnd() && IsQuantifier(Peek()) )
+                Fail("nothing to repeat");
+            concatenation.children.push_back(std::move(atom));
+        }
+        return concatenation;
+    }
+    Node ParseAtom()
+    {
+        uint32_t ch = _text[_pos++];
+        switch ( ch )
+        {
+            case '(':
+            {
+                if ( _pos + 1 < _text.size() && Peek() == '?' )
+                {
+                    if ( _text[_pos+1] != ':' )
+                        Fail("unsupported group type");
+                    _pos += 2;
+                }
+                Node group = ParseAlternation();
+                if ( AtEnd() || Peek() != ')' )
+                    Fail("missing ')'");
+                _pos++;
+                return group;
+            }
+            case '[':
+                return ParseClass();
+            case '.':
+                return Node(Node::Any);
+            case '^':
+                return Node(Node::Assert, TextStart);
+            case '$':
+                return Node(Node::Assert, TextEnd);
+            case '\\':
+                return ParseEscape(false);
+            case '*': case '+': case '?': case '{':
+                Fail("nothing to repeat");
+            case ')': case ']': case '}':
+                Fail("unbalanced bracket");
+            default:
+                return Node(Node::Char, ch);
+        }
+    }
+    
+    // the node for an escape, or for a class member if `inClass` is set; the
+    //  backslash has been consumed
+    Node ParseEscape(bool inClass)
+    {
+        if ( AtEnd() )
+            Fail("trailing '\\'");
+        
+        uint32_t ch = _text[_pos++];
+        switch ( ch )
+        {
+            case 'd': return BuiltinClass(Digit);
+            case 'D': return BuiltinClass(NotDigit);
+            case 'w': return BuiltinClass(Word);
+            case 'W': return BuiltinClass(NotWord);
+            case 's': return BuiltinClass(Space);
+            case 'S': return BuiltinClass(NotSpace);
+            case 'b': return (inClass ? Node(Node::Char, 0x08) : Node(Node::Assert, WordBoundary));
+            case 'B':
+                if ( inClass )
+                    Fail("'\\B' in a class");
+                return Node(Node::Assert, NotWordBoundary);
+            case 'n': return Node(Node::Char, '\n');
+            case 'r': return Node(Node::Char, '\r');
+            case 't': return Node(Node::Char, '\t');
+            case 'f': return Node(Node::Char, '\f');
+            case 'v': return Node(Node::Char, '\v');
+            case 'x': return Node(Node::Char, ParseHex(2));
+            case 'u': return Node(Node::Char, ParseHex(4));
+            default:
+                // letters and digits are reserved for escapes we don't (yet) support
+                if ( ch < 0x80 && IsWordCodePoint(ch) )
+                    Fail("unsupported escape");
+                return Node(Node::Char, ch);
+        }
+    }
+    uint32_t ParseHex(size_t digits)
+    {
+        uint32_t value = 0;
+        for ( size_t i = 0; i < digits; i++, _pos++ )
+        {
+            uint32_t ch = (AtEnd() ? 0 : CodePoints::FoldCase(Peek()));
+            if ( ch >= '0' && ch <= '9' )
+                value = (value << 4) | (ch - '0');
+            else if ( ch >= 'a' && ch <= 'f' )
+                value = (value << 4) | (ch - 'a' + 10);
+            else
+                Fail("bad hex escape");
+        }
+        return value;
+    }
+    Node BuiltinClass(uint8_t builtin)
+    {
+        Node node(Node::Class, static_cast<uint32_t>(_target._classes.size()));
+        _target._classes.push_back(CharacterClass{{}, builtin, false});
+        return node;
+    }
+    Node ParseClass()
+    {
+        CharacterClass cls{{}, 0, false};
+        if ( !AtEnd() && Peek() == '^' )
+        {
+            cls.negated = true;
+            _pos++;
+        }
+        
+        for ( ;; )
+        {
+            if ( AtEnd() )
+                Fail("missing ']'");
+            
+            uint32_t ch = _text[_pos++];
+            if ( ch == ']' )
+                break;
+            
+            if ( ch == '\\' )
+            {
+                Node escape = ParseEscape(true);
+                if ( escape.kind == Node::Class )
+                {
+                    // merge the shorthand class's flags, and drop the class it made
+                    cls.builtins |= _target._classes[escape.arg].builtins;
+                    _target._classes.pop_back();
+                    continue;
+                }
+                ch = escape.arg;
+            }
+            
+            uint32_t last = ch;
+            if ( _pos + 1 < _text.size() && Peek() == '-' && _text[_pos+1] != ']' )
+            {
+                _pos++;
+                last = _text[_pos++];
+                if ( last == '\\' )
+                {
+                    Node escape = ParseEscape(true);
+                    if ( escape.kind != Node::Char )
+                        Fail("bad class range");
+                    last = escape.arg;
+                }
+                if ( last < ch )
+                    Fail("bad class range");
+            }
+            cls.ranges.emplace_back(ch, last);
+        }
+        
+        Node node(Node::Class, static_cast<uint32_t>(_target._classes.size()));
+        _target._classes.push_back(std::move(cls));
+        return node;
+    }
+    
+    // wraps `atom` in a repeat if a quantifier follows it
+    bool ParseQuantifier(Node& atom)
+    {
+        uint32_t min = 0, max = Unbounded;
+        switch ( Peek() )
+        {
+            case '*':
+                break;
+            case '+':
+                min = 1;
+                break;
+            case '?':
+                max = 1;
+                break;
+            case '{':
+            {
+                _pos++;
+                min = max = ParseCount();
+                if ( !AtEnd() && Peek() == ',' )
+                {
+                    _pos++;
+                    max = (!AtEnd() && Peek() == '}' ? Unbounded : ParseCount());
+                }
+                if ( AtEnd() || Peek() != '}' )
+                    Fail("missing '}'");
+                if ( max < min )
+                    Fail("bad repeat count");
+                break;
+            }
+            default:
+                return false;
+        }
+        _pos++;
+        
+        Node repeat(Node::Repeat);
+        repeat.min = min;
+        repeat.max = max;
+        if ( !AtEnd() && Peek() == '?' )
+        {
+            repeat.lazy = true;
+            _pos++;
+        }
+        repeat.children.push_back(std::move(atom));
+        atom = std::move(repeat);
+        return true;
+    }
+    uint32_t ParseCount()
+    {
+        uint32_t count = 0;
+        size_t start = _pos;
+        for ( ; !AtEnd() && Peek() >= '0' && Peek() <= '9'; _pos++ )
+        {
+            count = count * 10 + (Peek() - '0');
+            if ( count > MaximumRepeat )
+                Fail("repeat count too large");
+        }
+        if ( _pos == start )
+            Fail("bad repeat count");
+        return count;
+    }
+    
+    uint32_t Append(Op op, uint32_t arg=0, uint32_t x=0, uint32_t y=0)
+    {
+        if ( _target._program.size() >= MaximumProgramSize )
+            Fail("pattern too large");
+        _target._program.push_back(Instruction{op, arg, x, y});
+        return static_cast<uint32_t>(_target._program.size() - 1);
+    }
+    uint32_t Next() const
+    {
+        return static_cast<uint32_t>(_target._program.size());
+    }
+    
+    // a split preferring `next` to `other`, or the reverse if `lazy`
+    void PatchSplit(uint32_t split, uint32_t next, uint32_t other, bool lazy)
+    {
+        Instruction& inst = _target._program[split];
+        inst.x = (lazy ? other : next);
+        inst.y = (lazy ? next : other);
+    }
+    
+    void Emit(const Node& node)
+    {
+        switch ( node.kind )
+        {
+            case Node::Char:
+            {
+                bool fold = (_target._options & CaseInsensitive) != 0;
+                Append(Op::Char, (fold ? CodePoints::FoldCase(node.arg) : node.arg));
+                break;
+            }
+            case Node::Any:
+                Append(Op::Any);
+                break;
+            case Node::Class:
+                Append(Op::Class, node.arg);
+                break;
+            case Node::Assert:
+                Append(Op::Assert, node.arg);
+                break;
+            case Node::Concat:
+                for ( const Node& child : node.children )
+                    Emit(child);
+                break;
+            case Node::Alternate:
+            {
+                // each alternative but the last: split(alt, next split); alt; jump(end)
+                std::vector<uint32_t> jumps;
+                for ( size_t i = 0; i < node.children.size(); i++ )
+                {
+                    if ( i + 1 == node.children.size() )
+                    {
+                        Emit(node.children[i]);
+                        break;
+                    }
+                    
+                    uint32_t split = Append(Op::Split);
+                    Emit(node.children[i]);
+                    jumps.push_back(Append(Op::Jump));
+                    PatchSplit(split, split+1, Next(), false);
+                }
+                for ( uint32_t jump : jumps )
+                    _target._program[jump].x = Next();
+                break;
+            }
+            case Node::Repeat:
+            {
+                const Node& operand = node.children.front();
+                for ( uint32_t i = 0; i < node.min; i++ )
+                    Emit(operand);
+                
+                if ( node.max == Unbounded )
+                {
+                    // split(operand, end); operand; jump(split)
+                    uint32_t split = Append(Op::Split);
+                    Emit(operand);
+                    Append(Op::Jump, 0, split);
+                    PatchSplit(split, split+1, Next(), node.lazy);
+                    break;
+                }
+                
+                // nested optional copies: (x(x(x)?)?)?
+                std::vector<uint32_t> splits;
+                for ( uint32_t i = node.min; i < node.max; i++ )
+                {
+                    splits.push_back(Append(Op::Split));
+                    Emit(operand);
+                }
+                for ( uint32_t split : splits )
+                    PatchSplit(split, split+1, Next(), node.lazy);
+                break;
+            }
+        }
+    }
+    
+};
+
+TextPattern::TextPattern(const std::string& pattern, unsigned int options) : _pattern(pattern), _options(options), _program(), _classes(), _firstInstructions(), _latin1Starts()
+{
+    Compiler(*this).Compile();
+    
+    // Find what the first code point of a match must look like, so the search can skip
+    //  anything else. Assertions are passed over, which can only make the set larger.
+    std::vector<bool> seen(_program.size(), false);
+    std::vector<uint32_t> stack(1, 0);
+    while ( !stack.empty() )
+    {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if ( seen[pc] )
+            continue;
+        seen[pc] = true;
+        
+        const Instruction& inst = _program[pc];
+        switch ( inst.op )
+        {
+            case Op::Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Op::Jump:
+                stack.push_back(inst.x);
+                break;
+            case Op::Assert:
+                stack.push_back(pc + 1);
+                break;
+            case Op::Char:
+            case Op::Class:
+                _firstInstructions.push_back(pc);
+                break;
+            default:
+                // `.` or an empty match: nothing can be skipped
+                _firstInstructions.clear();
+                return;
+        }
+    }
+    
+    // most text is Latin-1, so those answers are worked out now
+    _latin1Starts.resize(256);
+    for ( uint32_t ch = 0; ch < 256; ch++ )
+        _latin1Starts[ch] = std::any_of(_firstInstructions.begin(), _firstInstructions.end(), [&](uint32_t pc) { return Matches(_program[pc], ch); });
+}
+bool TextPattern::Matches(const Instruction &inst, uint32_t ch) const
+{
+    bool fold = (_options & CaseInsensitive) != 0;
+    switch ( inst.op )
+    {
+        case Op::Char:
+            return (fold ? CodePoints::FoldCase(ch) : ch) == inst.arg;
+        case Op::Any:
+            return true;
+        case Op::Class:
+        {
+            const CharacterClass& cls = _classes[inst.arg];
+            if ( !fold )
+                return cls.Contains(ch);
+            
+            // either case will do; for a negated class, neither case may be excluded
+            if ( cls.negated )
+                return cls.Contains(ch) && cls.Contains(CodePoints::FoldCase(ch)) && cls.Contains(CodePoints::UpperCase(ch));
+            return cls.Contains(ch) || cls.Contains(CodePoints::FoldCase(ch)) || cls.Contains(CodePoints::UpperCase(ch));
+        }
+        default:
+            return false;
+    }
+}
+bool TextPattern::CanStartMatch(uint32_t ch) const
+{
+    if ( ch < _latin1Starts.size() )
+        return _latin1Starts[ch];
+    if ( _firstInstructions.empty() )
+        return true;
+    for ( uint32_t pc : _firstInstructions )
+    {
+        if ( Matches(_program[pc], ch) )
+            return true;
+    }
+    return false;
+}
+bool TextPattern::Holds(uint32_t assertion, const uint32_t *text, size_t length, size_t pos) const
+{
+    switch ( assertion )
+    {
+        case TextStart:
+            return pos == 0;
+        case TextEnd:
+            return pos == length;
+        case WordBoundary:
+        case NotWordBoundary:
+        {
+            bool before = (pos > 0 && IsWordCodePoint(text[pos-1]));
+            bool after = (pos < length && IsWordCodePoint(text[pos]));
+            return (before != after) == (assertion == WordBoundary);
+        }
+        default:
+            return false;
+    }
+}
+bool TextPattern::FindAll(const uint32_t *text, size_t length, const MatchHandler &handler) const
+{
+    // A thread is a candidate match: where it started, and the instruction it's
+    //  waiting on. Each list holds the threads waiting on one code point, in
+    //  priority order, and at most one thread per instruction.
+    struct Thread
+    {
+        uint32_t    pc;
+        size_t      start;
+    };
+    std::vector<Thread> current, next;
+    current.reserve(_program.size());
+    next.reserve(_program.size());
+    std::vector<uint32_t> stack;
+    
+    // marks[pc] is the generation of the list which last added it
+    std::vector<size_t> marks(_program.size(), 0);
+    size_t generation = 1, currentGeneration = 1;
+    
+    // follows jumps, splits and assertions from `pc`, adding the threads they lead to
+    auto addThread = [&](std::vector<Thread>& list, size_t gen, uint32_t pc, size_t start, size_t pos) {
+        stack.push_back(pc);
+        while ( !stack.empty() )
+        {
+            pc = stack.back();
+            stack.pop_back();
+            if ( marks[pc] == gen )
+                continue;
+            marks[pc] = gen;
+            
+            const Instruction& inst = _program[pc];
+            switch ( inst.op )
+            {
+                case Op::Jump:
+                    stack.push_back(inst.x);
+                    break;
+                case Op::Split:
+                    // pushed in reverse, so `x` and everything it leads to come first
+                    stack.push_back(inst.y);
+                    stack.push_back(inst.x);
+                    break;
+                case Op::Assert:
+                    if ( Holds(inst.arg, text, length, pos) )
+                        stack.push_back(pc + 1);
+                    break;
+                default:
+                    list.push_back(Thread{pc, start});
+                    break;
+            }
+        }
+    };
+    
+    bool matched = false;
+    size_t matchStart = 0, matchEnd = 0;
+    size_t pos = 0;
+    for ( ;; )
+    {
+        if ( !matched )
+        {
+            if ( current.empty() )
+            {
+                while ( pos < length && !CanStartMatch(text[pos]) )
+                    pos++;
+                currentGeneration = ++generation;
+            }
+            
+            // a new candidate starting here, at the lowest priority
+            addThread(current, currentGeneration, 0, pos, pos);
+        }
+        
+        size_t nextGeneration = ++generation;
+        for ( const Thread& thread : current )
+        {
+            const Instruction& inst = _program[thread.pc];
+            if ( inst.op == Op::Match )
+            {
+                if ( pos == thread.start )
+                    continue;
+                
+                // this beats every lower-priority thread, so drop them
+                matched = true;
+                matchStart = thread.start;
+                matchEnd = pos;
+                break;
+            }
+            
+            if ( pos < length && Matches(inst, text[pos]) )
+                addThread(next, nextGeneration, thread.pc + 1, thread.start, pos + 1);
+        }
+        
+        current.swap(next);
+        next.clear();
+        currentGeneration = nextGeneration;
+        
+        if ( current.empty() && matched )
+        {
+            // no higher-priority thread can do better: report it, and carry on after it
+            if ( !handler(matchStart, matchEnd) )
+                return false;
+            matched = false;
+            pos = matchEnd;
+            continue;
+        }
+        
+        if ( pos >= length )
+            break;
+        pos++;
+    }
+    
+    return true;
+}
+
+EPUB3_END_NAMESPACE
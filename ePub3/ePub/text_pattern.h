@@ -0,0 +1,169 @@
+//
+//  text_pattern.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__text_pattern__
+#define __ePub3__text_pattern__
+
+#include "epub3.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A literal string or regular expression, matched against text in time linear in the
+ length of the text.
+ 
+ Patterns are compiled to a small program and run by a Pike VM, which steps every
+ candidate match forward one code point at a time rather than backtracking, so no
+ pattern can take exponential time. Matching works on Unicode code points, and
+ offsets are in code points.
+ 
+ The regular expression syntax is a subset of ECMAScript's:
+ 
+ - `.` matches any code point.
+ - `[abc]`, `[a-z]` and `[^abc]` match classes of code points.
+ - `\d`, `\w`, `\s` and their negations `\D`, `\W`, `\S` match digits, word characters
+ and whitespace, both alone and within classes. Word characters are as for
+ SearchIndex::Tokenize(), plus `_`.
+ - `\b` and `\B` assert a word boundary, or its absence.
+ - `^` and `$` match at the start and end of the text.
+ - `(...)` and `(?:...)` group; there are no captures.
+ - `|` separates alternatives.
+ - `*`, `+`, `?`, `{n}`, `{n,}` and `{n,m}` repeat; follow them with `?` to make them
+ lazy. Counted repeats may not exceed MaximumRepeat.
+ - `\` escapes any other character; `\n`, `\r`, `\t` and `\uXXXX` are also accepted.
+ 
+ Matches are found leftmost-first, as in ECMAScript, and never overlap. Empty matches
+ are not reported. Package::FindText() uses this to search a book without an index.
+ */
+class TextPattern
+{
+public:
+    enum Options : unsigned int
+    {
+        Literal             = 1<<0,     ///< The pattern is plain text, in which any run of whitespace matches any other.
+        CaseInsensitive     = 1<<1      ///< ASCII and Latin-1 letters match either case.
+    };
+    
+    ///
+    /// The largest count allowed in a `{n,m}` repeat.
+    static const uint32_t MaximumRepeat = 256;
+    
+    /**
+     Called for each match with its start and (exclusive) end; return `false` to stop.
+     */
+    typedef std::function<bool(size_t start, size_t end)> MatchHandler;
+    
+    /**
+     Compiles a pattern.
+     @param pattern The pattern, in UTF-8.
+     @param options A combination of the Options flags.
+     @throws std::invalid_argument if the pattern is empty, or isn't a valid regular
+     expression.
+     */
+                        TextPattern(const std::string& pattern, unsigned int options=0);
+                        TextPattern(const TextPattern&) = default;
+                        TextPattern(TextPattern&&) = default;
+                        ~TextPattern() {}
+    
+    TextPattern&        operator=(const TextPattern&) = default;
+    TextPattern&        operator=(TextPattern&&) = default;
+    
+    const std::string&  Pattern()                       const   { return _pattern; }
+    
+    /**
+     Finds every match in some text, in order.
+     @param text The text, as code points.
+     @param length The number of code points in `text`.
+     @param handler Called once for each match.
+     @result `false` if the handler stopped the search.
+     */
+    bool                FindAll(const uint32_t* text, size_t length, const MatchHandler& handler) const;
+    
+    /**
+     Decodes UTF-8, appending the code points to a buffer. Malformed bytes are taken
+     as Latin-1, as by SearchIndex::Tokenize().
+     */
+    static void         AppendCodePoints(const std::string& utf8, std::vector<uint32_t>& codePoints);
+    
+protected:
+    enum class Op : uint8_t
+    {
+        Char,               ///< Matches `arg`.
+        Any,                ///< Matches any code point.
+        Class,              ///< Matches the class at `_classes[arg]`.
+        Split,              ///< Continues at `x`, then (at lower priority) at `y`.
+        Jump,               ///< Continues at `x`.
+        Assert,             ///< Continues only if the Assertion `arg` holds.
+        Match               ///< A match ends here.
+    };
+    
+    enum Assertion : uint32_t
+    {
+        TextStart,
+        TextEnd,
+        WordBoundary,
+        NotWordBoundary
+    };
+    
+    struct Instruction
+    {
+        Op          op;
+        uint32_t    arg;
+        uint32_t    x;
+        uint32_t    y;
+    };
+    
+    struct CharacterClass
+    {
+        std::vector<std::pair<uint32_t, uint32_t>>  ranges;     // inclusive
+        uint8_t                                     builtins;   // see Builtin in the .cpp
+        bool                                        negated;
+        
+        bool                Contains(uint32_t ch)       const;
+    };
+    
+    class Compiler;
+    
+    std::string                 _pattern;
+    unsigned int                _options;
+    std::vector<Instruction>    _program;
+    std::vector<CharacterClass> _classes;
+    
+    // the instructions which can consume the first code point of a match, or none if
+    //  any code point might start one
+    std::vector<uint32_t>       _firstInstructions;
+    
+    // CanStartMatch() for each Latin-1 code point
+    std::vector<bool>           _latin1Starts;
+    
+    bool                Matches(const Instruction& inst, uint32_t ch)   const;
+    bool                CanStartMatch(uint32_t ch)                      const;
+    bool                Holds(uint32_t assertion, const uint32_t* text, size_t length, size_t pos) const;
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__text_pattern__) */
@@ -21,11 +21,62 @@
 
 #include "zip_archive.h"
 #include "zipint.h"
+#include "archive_cache.h"
+#include "crc32.h"
+#include "worker_pool.h"
 #include <unistd.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <deque>
 
 EPUB3_BEGIN_NAMESPACE
 
+// A seekable stdio stream over a block of memory, used to hand in-memory archives
+// to libzip. Reads come from a fixed region; writes (if an output vector is
+// supplied) go into a growable vector.
+class MemoryStream
+{
+public:
+    static FILE* OpenForReading(const void* data, size_t len);
+    static FILE* OpenForWriting(std::vector<uint8_t>* output);
+    
+private:
+    MemoryStream(const void* data, size_t len, std::vector<uint8_t>* output) : _data(reinterpret_cast<const uint8_t*>(data)), _len(len), _output(output), _pos(0) {}
+    
+    const uint8_t*          _data;
+    size_t                  _len;
+    std::vector<uint8_t>*   _output;
+    off_t                   _pos;
+    
+    FILE*   Open();
+    
+    ssize_t Read(char* buf, size_t len);
+    ssize_t Write(const char* buf, size_t len);
+    off_t   Seek(off_t offset, int whence);
+    
+#if defined(__APPLE__) || defined(__FreeBSD__)
+    static int      _read_cb(void* cookie, char* buf, int len)          { return static_cast<int>(reinterpret_cast<MemoryStream*>(cookie)->Read(buf, len)); }
+    static int      _write_cb(void* cookie, const char* buf, int len)   { return static_cast<int>(reinterpret_cast<MemoryStream*>(cookie)->Write(buf, len)); }
+    static fpos_t   _seek_cb(void* cookie, fpos_t offset, int whence)   { return reinterpret_cast<MemoryStream*>(cookie)->Seek(offset, whence); }
+#else
+    static ssize_t  _read_cb(void* cookie, char* buf, size_t len)       { return reinterpret_cast<MemoryStream*>(cookie)->Read(buf, len); }
+    static ssize_t  _write_cb(void* cookie, const char* buf, size_t len){ return reinterpret_cast<MemoryStream*>(cookie)->Write(buf, len); }
+    static int      _seek_cb(void* cookie, off64_t* offset, int whence) {
+        off_t r = reinterpret_cast<MemoryStream*>(cookie)->Seek(*offset, whence);
+        if ( r < 0 )
+            return -1;
+        *offset = r;
+        return 0;
+    }
+#endif
+    static int      _close_cb(void* cookie)                             { delete reinterpret_cast<MemoryStream*>(cookie); return 0; }
+};
+
 class ZipReader : public ArchiveReader
 {
 public:
@@ -40,12 +91,42 @@ private:
     struct zip_file * _file;
 };
 
+// Serves an uncompressed entry straight from memory: either from the buffer of an
+//  in-memory archive, or from a mapping of the archive file which it owns.
+class ZipInPlaceReader : public ArchiveReader
+{
+public:
+    ZipInPlaceReader(const uint8_t* data, size_t len, void* mapping=nullptr, size_t mappingLen=0)
+        : _data(data), _len(len), _pos(0), _mapping(mapping), _mappingLen(mappingLen) {}
+    virtual ~ZipInPlaceReader() { if (_mapping != nullptr) ::munmap(_mapping, _mappingLen); }
+    
+    virtual bool operator !() const { return _pos >= _len; }
+    virtual ssize_t read(void* p, size_t len) const {
+        size_t toRead = std::min(len, _len - _pos);
+        ::memcpy(p, _data + _pos, toRead);
+        _pos += toRead;
+        return static_cast<ssize_t>(toRead);
+    }
+    virtual bool ContiguousData(const void** data, size_t* len) const {
+        *data = _data + _pos;
+        *len = _len - _pos;
+        return true;
+    }
+    
+private:
+    const uint8_t*  _data;
+    size_t          _len;
+    mutable size_t  _pos;
+    void*           _mapping;
+    size_t          _mappingLen;
+};
+
 class ZipWriter : public ArchiveWriter
 {
     class DataBlob
     {
     public:
-        DataBlob() {}
+        DataBlob() : _buf(nullptr), _cap(0), _off(0) {}
         DataBlob(const DataBlob&) = delete;
         DataBlob(DataBlob&& o) : _buf(o._buf), _cap(o._cap), _off(o._off) { o._buf = nullptr; o._cap = o._off = 0; }
         ~DataBlob() { if (_buf != nullptr) ::free(_buf); }
@@ -87,11 +168,92 @@ protected:
 ZipArchive::ZipItemInfo::ZipItemInfo(struct zip_stat & info)
 {
     SetPath(info.name);
-    SetIsCompressed(info.comp_method == ZIP_CM_STORE);
+    SetIsCompressed(info.comp_method != ZIP_CM_STORE);
+    SetMethod(info.comp_method);
+    SetCRC(info.crc);
     SetCompressedSize(info.comp_size);
     SetUncompressedSize(info.size);
 }
 
+FILE* MemoryStream::OpenForReading(const void *data, size_t len)
+{
+    return (new MemoryStream(data, len, nullptr))->Open();
+}
+FILE* MemoryStream::OpenForWriting(std::vector<uint8_t> *output)
+{
+    output->clear();
+    return (new MemoryStream(nullptr, 0, output))->Open();
+}
+FILE* MemoryStream::Open()
+{
+#if defined(__APPLE__) || defined(__FreeBSD__)
+    FILE* f = ::funopen(this, &_read_cb, (_output != nullptr ? &_write_cb : nullptr), &_seek_cb, &_close_cb);
+#else
+    cookie_io_functions_t fns = { &_read_cb, (_output != nullptr ? &_write_cb : nullptr), &_seek_cb, &_close_cb };
+    FILE* f = ::fopencookie(this, (_output != nullptr ? "w+b" : "rb"), fns);
+#endif
+    if ( f == nullptr )
+        delete this;
+    return f;
+}
+ssize_t MemoryStream::Read(char *buf, size_t len)
+{
+    const uint8_t* base = (_output != nullptr ? _output->data() : _data);
+    size_t size = (_output != nullptr ? _output->size() : _len);
+    if ( _pos >= static_cast<off_t>(size) )
+        return 0;
+    
+    size_t toRead = std::min(len, size - static_cast<size_t>(_pos));
+    ::memcpy(buf, base + _pos, toRead);
+    _pos += toRead;
+    return static_cast<ssize_t>(toRead);
+}
+ssize_t MemoryStream::Write(const char *buf, size_t len)
+{
+    if ( _output == nullptr )
+        return -1;
+    
+    // libzip seeks back to rewrite local headers, so writes can land anywhere
+    size_t end = static_cast<size_t>(_pos) + len;
+    if ( end > _output->size() )
+        _output->resize(end);
+    ::memcpy(_output->data() + _pos, buf, len);
+    _pos += len;
+    return static_cast<ssize_t>(len);
+}
+off_t MemoryStream::Seek(off_t offset, int whence)
+{
+    off_t size = static_cast<off_t>(_output != nullptr ? _output->size() : _len);
+    off_t newPos = 0;
+    switch ( whence )
+    {
+        case SEEK_SET:
+            newPos = offset;
+            break;
+        case SEEK_CUR:
+            newPos = _pos + offset;
+            break;
+        case SEEK_END:
+            newPos = size + offset;
+            break;
+        default:
+            return -1;
+    }
+    
+    if ( newPos < 0 || (_output == nullptr && newPos > size) )
+        return -1;
+    
+    _pos = newPos;
+    return _pos;
+}
+
+static std::string ZipErrorString(int zerr)
+{
+    char buf[128];
+    zip_error_to_str(buf, sizeof(buf), zerr, errno);
+    return buf;
+}
+
 std::string ZipArchive::TempFilePath()
 {
     char *buf = new char[22];
@@ -111,33 +273,132 @@ std::string ZipArchive::TempFilePath()
     ::close(fd);
     return std::string(pathbuf);
 }
-ZipArchive::ZipArchive(const std::string & path)
+ZipArchive::ZipArchive(const std::string & path) : _buffer(nullptr), _memory(nullptr), _memoryLength(0)
 {
     int zerr = 0;
     _zip = zip_open(path.c_str(), ZIP_CREATE, &zerr);
     if ( _zip == nullptr )
-        throw std::runtime_error(std::string("zip_open() failed: ") + zError(zerr));
+        throw std::runtime_error(std::string("zip_open() failed: ") + ZipErrorString(zerr));
     _path = path;
+    _cacheID = path;
+}
+ZipArchive::ZipArchive(const void * data, size_t len) : _buffer(nullptr), _memory(reinterpret_cast<const uint8_t*>(data)), _memoryLength(len), _cacheID(UniqueCacheIdentity())
+{
+    FILE* f = MemoryStream::OpenForReading(data, len);
+    if ( f == nullptr )
+        throw std::runtime_error(std::string("Failed to create memory stream: ") + strerror(errno));
+    
+    int zerr = 0;
+    _zip = zip_open_filep(f, 0, &zerr);     // takes ownership of f, even on failure
+    if ( _zip == nullptr )
+        throw std::runtime_error(std::string("zip_open_filep() failed: ") + ZipErrorString(zerr));
+}
+ZipArchive::ZipArchive(std::vector<uint8_t> & buffer) : ZipArchive(buffer.data(), buffer.size())
+{
+    _buffer = &buffer;
 }
 ZipArchive::~ZipArchive()
 {
-    if ( _zip != nullptr )
-        zip_close(_zip);
+    Close();
 }
 Archive & ZipArchive::operator = (ZipArchive &&o)
 {
-    if ( _zip != nullptr )
-        zip_close(_zip);
+    Close();
     _zip = o._zip;
+    _buffer = o._buffer;
+    _memory = o._memory;
+    _memoryLength = o._memoryLength;
+    _cacheID = std::move(o._cacheID);
     o._zip = nullptr;
+    o._buffer = nullptr;
+    o._memory = nullptr;
+    o._memoryLength = 0;
     return dynamic_cast<Archive&>(*this);
 }
+bool ZipArchive::IsZipData(const void *data, size_t len)
+{
+    // an empty buffer becomes a new archive
+    if ( len == 0 )
+        return true;
+    if ( len < 4 )
+        return false;
+    
+    // local file header, or end of central directory for an archive with no entries
+    const char* p = reinterpret_cast<const char*>(data);
+    return (::memcmp(p, "PK\003\004", 4) == 0 || ::memcmp(p, "PK\005\006", 4) == 0);
+}
+bool ZipArchive::Close()
+{
+    if ( _zip == nullptr )
+        return true;
+    
+    // nothing else can ever look up entries from an archive that only existed in memory
+    if ( _zip->zn == nullptr )
+        ArchiveCache::SharedCache()->Purge(_cacheID);
+    
+    bool saved = true;
+    if ( _buffer != nullptr )
+    {
+        // the archive is still reading from _buffer, so write into a new vector first
+        std::vector<uint8_t> output;
+        FILE* f = MemoryStream::OpenForWriting(&output);
+        if ( f == nullptr )
+        {
+            saved = false;
+        }
+        else
+        {
+            int result = zip_close_filep(_zip, f);
+            bool flushed = (fclose(f) == 0);        // flushes any buffered output
+            if ( result < 0 )
+            {
+                saved = false;
+            }
+            else
+            {
+                // the archive is closed, whether or not its output was flushed
+                _zip = nullptr;
+                if ( result == 0 )
+                {
+                    saved = flushed;
+                    if ( saved )
+                        _buffer->swap(output);      // empty if every entry was deleted
+                }
+            }
+        }
+    }
+    else if ( _zip->zn != nullptr )
+    {
+        if ( zip_close(_zip) == 0 )
+            _zip = nullptr;
+        else
+            saved = false;
+    }
+    
+    // read-only, or the changes couldn't be saved: throw them away
+    if ( _zip != nullptr )
+        zip_discard(_zip);
+    
+    _zip = nullptr;
+    _buffer = nullptr;
+    _memory = nullptr;
+    _memoryLength = 0;
+    return saved;
+}
+bool ZipArchive::IsReadOnly() const
+{
+    // in-memory archives opened from a caller-owned region have nowhere to save changes
+    return _zip != nullptr && _zip->zn == nullptr && _buffer == nullptr;
+}
 bool ZipArchive::ContainsItem(const std::string & path) const
 {
     return (zip_name_locate(_zip, Sanitized(path).c_str(), 0) >= 0);
 }
 bool ZipArchive::DeleteItem(const std::string & path)
 {
+    if ( IsReadOnly() )
+        return false;
+    
     int idx = zip_name_locate(_zip, Sanitized(path).c_str(), 0);
     if ( idx >= 0 )
         return (zip_delete(_zip, idx) >= 0);
@@ -145,6 +406,9 @@ bool ZipArchive::DeleteItem(const std::string & path)
 }
 bool ZipArchive::CreateFolder(const std::string & path)
 {
+    if ( IsReadOnly() )
+        return false;
+    
     return (zip_add_dir(_zip, Sanitized(path).c_str()) >= 0);
 }
 ArchiveReader* ZipArchive::ReaderAtPath(const std::string & path) const
@@ -152,23 +416,141 @@ ArchiveReader* ZipArchive::ReaderAtPath(const std::string & path) const
     if (_zip == nullptr)
         return nullptr;
     
-    struct zip_file* file = zip_fopen(_zip, Sanitized(path).c_str(), 0);
+    int idx = zip_name_locate(_zip, Sanitized(path).c_str(), 0);
+    if (idx < 0 || !IsVerified(idx))
+        return nullptr;
+    
+    // stored entries in an in-memory archive are already resident: no need to cache them
+    if (_memory != nullptr)
+    {
+        ArchiveReader* reader = InPlaceReader(idx);
+        if (reader != nullptr)
+            return reader;
+    }
+    
+    // small, unmodified entries are served from the shared cache
+    ArchiveCache* cache = ArchiveCache::SharedCache();
+    struct zip_stat sbuf;
+    bool unchanged = (_zip->entry[idx].state == ZIP_ST_UNCHANGED && zip_stat_index(_zip, idx, 0, &sbuf) == 0);
+    if (unchanged && cache->ShouldCache(sbuf.size))
+    {
+        ArchiveCache::Key key{_cacheID, sbuf.name, sbuf.crc, sbuf.mtime};
+        ArchiveCache::Buffer buffer = cache->Lookup(key);
+        if (buffer != nullptr)
+            return new CachedArchiveReader(buffer);
+        
+        struct zip_file* file = zip_fopen_index(_zip, idx, 0);
+        if (file == nullptr)
+            return nullptr;
+        
+        std::vector<uint8_t> data(sbuf.size);
+        size_t total = 0;
+        while (total < data.size())
+        {
+            ssize_t num = zip_fread(file, data.data() + total, data.size() - total);
+            if (num <= 0)
+                break;
+            total += num;
+        }
+        zip_fclose(file);
+        if (total != data.size())
+            return nullptr;
+        
+        return new CachedArchiveReader(cache->Insert(key, std::move(data)));
+    }
+    
+    // larger stored entries are mapped from the file
+    if (unchanged && sbuf.comp_method == ZIP_CM_STORE)
+    {
+        ArchiveReader* reader = InPlaceReader(idx);
+        if (reader != nullptr)
+            return reader;
+    }
+    
+    struct zip_file* file = zip_fopen_index(_zip, idx, 0);
     if (file == nullptr)
         return nullptr;
     
     return new ZipReader(file);
 }
-ArchiveWriter* ZipArchive::WriterAtPath(const std::string & path, bool compressed, bool create)
+ArchiveReader* ZipArchive::InPlaceReader(int idx) const
+{
+    if (_zip->cdir == nullptr || idx >= _zip->cdir->nentry || _zip->entry[idx].state != ZIP_ST_UNCHANGED)
+        return nullptr;
+    
+    const struct zip_dirent& de = _zip->cdir->entry[idx];
+    if (de.comp_method != ZIP_CM_STORE || de.comp_size == 0 || de.comp_size != de.uncomp_size)
+        return nullptr;
+    
+    // libzip locates the data past the local header when the entry is opened
+    struct zip_file* file = zip_fopen_index(_zip, idx, ZIP_FL_COMPRESSED);
+    if (file == nullptr)
+        return nullptr;
+    off_t start = file->fpos;
+    zip_fclose(file);
+    
+    size_t len = de.comp_size;
+    if (start < 0)
+        return nullptr;
+    
+    // NB: these bypass zip_fread(), so the CRC is only checked when verifying reads
+    if (_memory != nullptr)
+    {
+        if (static_cast<size_t>(start) > _memoryLength || len > _memoryLength - start)
+            return nullptr;
+        return new ZipInPlaceReader(_memory + start, len);
+    }
+    
+    int fd = (_zip->zp == nullptr ? -1 : ::fileno(_zip->zp));
+    if (fd < 0)
+        return nullptr;
+    
+    // touching a mapped page past the end of a truncated file would raise SIGBUS
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || start + static_cast<off_t>(len) > st.st_size)
+        return nullptr;
+    
+    static const off_t pageMask = static_cast<off_t>(::sysconf(_SC_PAGESIZE)) - 1;
+    off_t mapStart = start & ~pageMask;
+    size_t mapLen = len + static_cast<size_t>(start - mapStart);
+    void* mapping = ::mmap(nullptr, mapLen, PROT_READ, MAP_PRIVATE, fd, mapStart);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+    
+    return new ZipInPlaceReader(reinterpret_cast<const uint8_t*>(mapping) + (start - mapStart), len, mapping, mapLen);
+}
+ArchiveReader* ZipArchive::RawReaderAtPath(const std::string & path) const
 {
     if (_zip == nullptr)
         return nullptr;
     
-    int idx = zip_name_locate(_zip, Sanitized(path).c_str(), (create ? ZIP_CREATE : 0));
-    if (idx == -1)
+    int idx = zip_name_locate(_zip, Sanitized(path).c_str(), 0);
+    if (idx < 0 || !IsVerified(idx))
+        return nullptr;
+    
+    // modified entries have no compressed data until the archive is written
+    struct zip_stat sbuf;
+    if (_zip->entry[idx].state != ZIP_ST_UNCHANGED || zip_stat_index(_zip, idx, 0, &sbuf) != 0 || sbuf.comp_method != ZIP_CM_DEFLATE)
+        return nullptr;
+    
+    struct zip_file* file = zip_fopen_index(_zip, idx, ZIP_FL_COMPRESSED);
+    if (file == nullptr)
+        return nullptr;
+    
+    return new ZipReader(file);
+}
+ArchiveWriter* ZipArchive::WriterAtPath(const std::string & path, bool compressed, bool create)
+{
+    if (_zip == nullptr || IsReadOnly())
+        return nullptr;
+    
+    int idx = zip_name_locate(_zip, Sanitized(path).c_str(), 0);
+    if (idx == -1 && !create)
         return nullptr;
     
     ZipWriter* writer = new ZipWriter(_zip, Sanitized(path), compressed);
-    if ( zip_replace(_zip, idx, writer->ZipSource()) == -1 )
+    int result = (idx == -1 ? zip_add(_zip, Sanitized(path).c_str(), writer->ZipSource()) : zip_replace(_zip, idx, writer->ZipSource()));
+    if ( result == -1 )
     {
         delete writer;
         return nullptr;
@@ -183,6 +565,382 @@ ArchiveItemInfo ZipArchive::InfoAtPath(const std::string & path) const
         throw std::runtime_error(std::string("zip_stat("+path+") - " + zip_strerror(_zip)));
     return ZipItemInfo(sbuf);
 }
+// an entry to be read during a sequential sweep of the archive
+struct SweepItem
+{
+    std::string     path;
+    size_t          slot;           // caller-defined
+    int             idx;
+    unsigned int    offset;
+    unsigned short  method;
+    size_t          compressedSize;
+    size_t          uncompressedSize;
+    uint32_t        crc;
+    
+    SweepItem(struct zip* za, int i, const std::string& p, size_t s=0) : path(p), slot(s), idx(i) {
+        const struct zip_dirent& de = za->cdir->entry[i];
+        offset = de.offset;
+        method = de.comp_method;
+        compressedSize = de.comp_size;
+        uncompressedSize = de.uncomp_size;
+        crc = de.crc;
+    }
+};
+
+// an entry's stored bytes, or nullptr on error
+static Auto<std::vector<uint8_t>> ReadRawEntry(struct zip* za, const SweepItem& item)
+{
+    struct zip_file* file = zip_fopen_index(za, item.idx, ZIP_FL_COMPRESSED);
+    if ( file == nullptr )
+        return nullptr;
+    
+    Auto<std::vector<uint8_t>> raw(new std::vector<uint8_t>(item.compressedSize));
+    size_t total = 0;
+    while ( total < raw->size() )
+    {
+        ssize_t num = zip_fread(file, raw->data() + total, raw->size() - total);
+        if ( num <= 0 )
+            break;
+        total += num;
+    }
+    zip_fclose(file);
+    
+    if ( total != raw->size() )
+        return nullptr;
+    return raw;
+}
+
+// Reads the stored bytes of each item in archive order. The bytes are passed to
+//  `process`, which runs on the shared worker pool if `parallel` is set; its result
+//  is then passed to `deliver`, always on the calling thread and in order.
+template <typename _Process, typename _Deliver>
+static void SweepEntries(struct zip* za, std::vector<SweepItem>& items, bool parallel, _Process process, _Deliver deliver)
+{
+    typedef decltype(process(items.front(), Auto<std::vector<uint8_t>>())) _Result;
+    
+    // owns an entry's bytes until it runs
+    struct Task
+    {
+        _Process                    process;
+        const SweepItem*            item;
+        Auto<std::vector<uint8_t>>  raw;
+        
+        _Result operator()() { return process(*item, std::move(raw)); }
+    };
+    
+    std::sort(items.begin(), items.end(), [](const SweepItem& a, const SweepItem& b) { return a.offset < b.offset; });
+    
+    // a window of entries is processed while the next ones are read
+    TaskWindow<_Result> pending(WorkerPool::Shared());
+    std::deque<const SweepItem*> order;
+    auto collect = [&]() {
+        const SweepItem* item = order.front();
+        order.pop_front();
+        deliver(*item, pending.Next());
+    };
+    
+    for ( const SweepItem& item : items )
+    {
+        Auto<std::vector<uint8_t>> raw = ReadRawEntry(za, item);
+        if ( !parallel )
+        {
+            deliver(item, process(item, std::move(raw)));
+            continue;
+        }
+        
+        pending.Submit(Task{process, &item, std::move(raw)});
+        order.push_back(&item);
+        while ( pending.IsFull() )
+            collect();
+    }
+    
+    while ( !pending.IsEmpty() )
+        collect();
+}
+
+// inflates (if necessary) and verifies an entry's stored bytes; returns nullptr on error
+static Auto<std::vector<uint8_t>> DecodeEntry(const SweepItem& item, Auto<std::vector<uint8_t>> raw)
+{
+    if ( !raw )
+        return nullptr;
+    
+    Auto<std::vector<uint8_t>> result;
+    if ( item.method == ZIP_CM_STORE )
+    {
+        result = std::move(raw);
+    }
+    else if ( item.method == ZIP_CM_DEFLATE )
+    {
+        result.reset(new std::vector<uint8_t>(item.uncompressedSize));
+        
+        z_stream strm;
+        ::memset(&strm, 0, sizeof(strm));
+        if ( inflateInit2(&strm, -MAX_WBITS) != Z_OK )
+            return nullptr;
+        
+        strm.next_in = raw->data();
+        strm.avail_in = static_cast<uInt>(raw->size());
+        strm.next_out = result->data();
+        strm.avail_out = static_cast<uInt>(result->size());
+        int zerr = inflate(&strm, Z_FINISH);
+        inflateEnd(&strm);
+        
+        if ( zerr != Z_STREAM_END || strm.total_out != item.uncompressedSize )
+            return nullptr;
+    }
+    else
+    {
+        return nullptr;
+    }
+    
+    if ( result->size() != item.uncompressedSize || CRC32(0, result->data(), result->size()) != item.crc )
+        return nullptr;
+    
+    return result;
+}
+
+// checks an entry's stored bytes without keeping the decompressed data
+static ArchiveItemVerification VerifyEntry(const SweepItem& item, Auto<std::vector<uint8_t>> raw)
+{
+    ArchiveItemVerification result{item.path, ArchiveItemVerification::Valid, item.crc, 0};
+    if ( !raw )
+    {
+        result.status = ArchiveItemVerification::ReadError;
+        return result;
+    }
+    
+    uint64_t total = 0;
+    if ( item.method == ZIP_CM_STORE )
+    {
+        result.actualCRC = CRC32(0, raw->data(), raw->size());
+        total = raw->size();
+    }
+    else if ( item.method == ZIP_CM_DEFLATE )
+    {
+        z_stream strm;
+        ::memset(&strm, 0, sizeof(strm));
+        if ( inflateInit2(&strm, -MAX_WBITS) != Z_OK )
+        {
+            result.status = ArchiveItemVerification::ReadError;
+            return result;
+        }
+        
+        strm.next_in = raw->data();
+        strm.avail_in = static_cast<uInt>(raw->size());
+        
+        uint8_t buf[65536];
+        int zerr = Z_OK;
+        while ( zerr == Z_OK )
+        {
+            strm.next_out = buf;
+            strm.avail_out = sizeof(buf);
+            zerr = inflate(&strm, Z_NO_FLUSH);
+            
+            size_t num = sizeof(buf) - strm.avail_out;
+            result.actualCRC = CRC32(result.actualCRC, buf, num);
+            total += num;
+        }
+        inflateEnd(&strm);
+        
+        if ( zerr != Z_STREAM_END )
+        {
+            result.status = ArchiveItemVerification::ReadError;
+            return result;
+        }
+    }
+    else
+    {
+        result.status = ArchiveItemVerification::UnsupportedMethod;
+        return result;
+    }
+    
+    if ( total != item.uncompressedSize )
+        result.status = ArchiveItemVerification::SizeMismatch;
+    else if ( result.actualCRC != result.expectedCRC )
+        result.status = ArchiveItemVerification::CRCMismatch;
+    
+    return result;
+}
+
+void ZipArchive::ReadItems(const std::vector<std::string> &paths, BatchReadCallback callback, bool parallel) const
+{
+    // modified or missing entries go through the regular path, as do cached ones
+    std::vector<SweepItem> sweep;
+    std::vector<std::string> others;
+    ArchiveCache* cache = ArchiveCache::SharedCache();
+    for ( auto& path : paths )
+    {
+        int idx = (_zip == nullptr ? -1 : zip_name_locate(_zip, Sanitized(path).c_str(), 0));
+        if ( idx < 0 || _zip->cdir == nullptr || idx >= _zip->cdir->nentry || _zip->entry[idx].state != ZIP_ST_UNCHANGED )
+        {
+            others.push_back(path);
+            continue;
+        }
+        
+        const struct zip_dirent& de = _zip->cdir->entry[idx];
+        if ( cache->ShouldCache(de.uncomp_size) && cache->Contains(ArchiveCache::Key{_cacheID, de.filename, de.crc, de.last_mod}) )
+            others.push_back(path);
+        else
+            sweep.emplace_back(_zip, idx, path);
+    }
+    
+    if ( !others.empty() )
+        Archive::ReadItems(others, callback, false);
+    
+    SweepEntries(_zip, sweep, parallel, DecodeEntry, [&](const SweepItem& item, Auto<std::vector<uint8_t>> data) {
+        callback(item.path, data.get());
+    });
+}
+ArchiveVerificationReport ZipArchive::Verify(bool parallel) const
+{
+    ArchiveVerificationReport report;
+    if ( _zip == nullptr || _zip->cdir == nullptr )
+        return report;
+    
+    // entries added or changed since opening have no stored data to check yet
+    std::vector<SweepItem> sweep;
+    for ( int i = 0; i < _zip->cdir->nentry && i < _zip->nentry; i++ )
+    {
+        if ( _zip->entry[i].state != ZIP_ST_UNCHANGED )
+            continue;
+        
+        const struct zip_dirent& de = _zip->cdir->entry[i];
+        report.push_back(ArchiveItemVerification{std::string(de.filename, de.filename_len), ArchiveItemVerification::Valid, de.crc, 0});
+        sweep.emplace_back(_zip, i, report.back().path, report.size()-1);
+    }
+    
+    SweepEntries(_zip, sweep, parallel, VerifyEntry, [&](const SweepItem& item, ArchiveItemVerification result) {
+        report[item.slot] = std::move(result);
+    });
+    
+    return report;
+}
+bool ZipArchive::IsVerified(int idx) const
+{
+    if ( !_verifyReads || _zip->cdir == nullptr || idx >= _zip->cdir->nentry || _zip->entry[idx].state != ZIP_ST_UNCHANGED )
+        return true;
+    
+    std::lock_guard<std::mutex> _(_verifyLock);
+    if ( _verified.size() < static_cast<size_t>(_zip->cdir->nentry) )
+        _verified.resize(_zip->cdir->nentry, Unverified);
+    
+    if ( _verified[idx] == Unverified )
+    {
+        SweepItem item(_zip, idx, _zip->cdir->entry[idx].filename);
+        bool valid = (VerifyEntry(item, ReadRawEntry(_zip, item)).status == ArchiveItemVerification::Valid);
+        _verified[idx] = (valid ? VerifiedValid : VerifiedCorrupt);
+    }
+    
+    return _verified[idx] == VerifiedValid;
+}
+void ZipArchive::Prefetch(const std::vector<std::string> &paths) const
+{
+    if ( _zip == nullptr || _zip->zp == nullptr || _zip->cdir == nullptr )
+        return;
+    
+    // in-memory archives have no descriptor, and are resident anyway
+    int fd = ::fileno(_zip->zp);
+    if ( fd < 0 )
+        return;
+    
+    typedef std::pair<off_t, off_t> Range;
+    std::vector<Range> ranges;
+    for ( auto& path : paths )
+    {
+        int idx = zip_name_locate(_zip, Sanitized(path).c_str(), 0);
+        if ( idx < 0 || idx >= _zip->cdir->nentry )
+            continue;
+        
+        // the local header repeats the name and extra field ahead of the data
+        const struct zip_dirent& de = _zip->cdir->entry[idx];
+        off_t start = de.offset;
+        off_t end = start + LENTRYSIZE + de.filename_len + de.extrafield_len + de.comp_size;
+        ranges.emplace_back(start, end);
+    }
+    
+    if ( ranges.empty() )
+        return;
+    
+    // coalesce nearby ranges into fewer, larger requests
+    static const off_t MaxGap = 64 * 1024;
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<Range> merged(1, ranges[0]);
+    for ( size_t i = 1; i < ranges.size(); i++ )
+    {
+        if ( ranges[i].first <= merged.back().second + MaxGap )
+            merged.back().second = std::max(merged.back().second, ranges[i].second);
+        else
+            merged.push_back(ranges[i]);
+    }
+    
+    for ( auto& range : merged )
+    {
+#if defined(__APPLE__)
+        struct radvisory advice;
+        advice.ra_offset = range.first;
+        advice.ra_count = static_cast<int>(std::min<off_t>(range.second - range.first, INT_MAX));
+        ::fcntl(fd, F_RDADVISE, &advice);
+#elif defined(POSIX_FADV_WILLNEED)
+        ::posix_fadvise(fd, range.first, range.second - range.first, POSIX_FADV_WILLNEED);
+#endif
+    }
+}
+size_t ZipArchive::EntryCount() const
+{
+    return (_zip == nullptr ? 0 : static_cast<size_t>(_zip->nentry));
+}
+bool ZipArchive::EntryAtIndex(size_t idx, ArchiveEntry *entry) const
+{
+    if ( _zip == nullptr || idx >= static_cast<size_t>(_zip->nentry) )
+        return false;
+    
+    const struct zip_entry& ze = _zip->entry[idx];
+    if ( ze.state == ZIP_ST_DELETED )
+        return false;
+    
+    const struct zip_dirent* de = nullptr;
+    if ( _zip->cdir != nullptr && idx < static_cast<size_t>(_zip->cdir->nentry) )
+        de = &_zip->cdir->entry[idx];
+    
+    if ( ze.ch_filename != nullptr )
+    {
+        entry->path = ze.ch_filename;
+        entry->pathLength = ::strlen(ze.ch_filename);
+    }
+    else if ( de != nullptr )
+    {
+        entry->path = de->filename;
+        entry->pathLength = de->filename_len;
+    }
+    else
+    {
+        return false;
+    }
+    
+    if ( de != nullptr && (ze.state == ZIP_ST_UNCHANGED || ze.state == ZIP_ST_RENAMED) )
+    {
+        entry->compressedSize = de->comp_size;
+        entry->uncompressedSize = de->uncomp_size;
+        entry->localHeaderOffset = de->offset;
+        entry->modified = de->last_mod;
+        entry->crc = de->crc;
+        entry->method = de->comp_method;
+    }
+    else
+    {
+        entry->compressedSize = entry->uncompressedSize = entry->localHeaderOffset = 0;
+        entry->modified = 0;
+        entry->crc = 0;
+        entry->method = ArchiveItemInfo::StoredMethod;
+    }
+    
+    return true;
+}
+std::string ZipArchive::UniqueCacheIdentity()
+{
+    static std::atomic<unsigned long> __counter(0);
+    return _Str("memory:", ++__counter);
+}
 std::string ZipArchive::Sanitized(const std::string& path) const
 {
     if ( path.find('/') == 0 )
@@ -246,8 +1004,10 @@ ssize_t ZipWriter::_source_callback(void *state, void *data, size_t len, enum zi
             zip_stat_init(st);
             st->mtime = ::time(NULL);
             st->size = writer->_data.Size();
-            st->comp_method = (writer->_compressed ? ZIP_CM_DEFLATE : ZIP_CM_STORE);
+            // our data is uncompressed; libzip deflates it as it writes the archive
+            st->comp_method = ZIP_CM_STORE;
             r = sizeof(struct zip_stat);
+            break;
         }
         case ZIP_SOURCE_ERROR:
         default:
@@ -25,6 +25,7 @@
 #include "archive.h"
 #include "zip.h"
 #include <list>
+#include <mutex>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -42,29 +43,73 @@ private:
 public:
     ZipArchive() : ZipArchive(TempFilePath()) {}
     ZipArchive(const std::string & path);
-    ZipArchive(ZipArchive &&o) : _zip(o._zip) { o._zip = nullptr; }
-    explicit ZipArchive(struct zip * aZip) : _zip(aZip) {}
+    ZipArchive(const void * data, size_t len);          // read-only, caller owns the data
+    ZipArchive(std::vector<uint8_t> & buffer);          // changes are written back into buffer
+    ZipArchive(ZipArchive &&o) : _zip(o._zip), _buffer(o._buffer), _memory(o._memory), _memoryLength(o._memoryLength), _cacheID(std::move(o._cacheID)) { o._zip = nullptr; o._buffer = nullptr; o._memory = nullptr; o._memoryLength = 0; }
+    explicit ZipArchive(struct zip * aZip) : _zip(aZip), _buffer(nullptr), _memory(nullptr), _memoryLength(0), _cacheID(UniqueCacheIdentity()) {}
     virtual ~ZipArchive();
     
     Archive & operator = (ZipArchive &&o);
     
+    // true if the data looks like the start of a zip file (or is empty)
+    static bool IsZipData(const void * data, size_t len);
+    
     virtual bool ContainsItem(const std::string & path) const;
     virtual bool DeleteItem(const std::string & path);;
     
     virtual bool CreateFolder(const std::string & path);
     
     virtual ArchiveReader* ReaderAtPath(const std::string & path) const;
+    virtual ArchiveReader* RawReaderAtPath(const std::string & path) const;
     virtual ArchiveWriter* WriterAtPath(const std::string & path, bool compress=true, bool create=true);
         
+    virtual ArchiveVerificationReport Verify(bool parallel=true) const;
+    virtual void ReadItems(const std::vector<std::string>& paths, BatchReadCallback callback, bool parallel=false) const;
+    virtual void Prefetch(const std::vector<std::string>& paths) const;
+    
     virtual ArchiveItemInfo InfoAtPath(const std::string & path) const;
     
+    virtual bool Close();
+    
+    virtual size_t EntryCount() const;
+    virtual bool EntryAtIndex(size_t idx, ArchiveEntry* entry) const;
+    
+    // identifies this archive's entries in the shared ArchiveCache
+    const std::string & CacheIdentity() const { return _cacheID; }
+    
 protected:
     struct zip *    _zip;
     
+    // the caller's vector, for in-memory archives opened for writing
+    std::vector<uint8_t> *  _buffer;
+    
+    // the archive's bytes, for in-memory archives
+    const uint8_t *         _memory;
+    size_t                  _memoryLength;
+    
+    // the path for archives on disk, otherwise unique to this instance
+    std::string     _cacheID;
+    
     typedef std::list<zip_source*>  ZipSourceList;
     ZipSourceList   _liveSources;
     
     std::string Sanitized(const std::string& path) const;
+    
+    // a reader over a stored entry's bytes in place, or nullptr if they can't be mapped
+    ArchiveReader* InPlaceReader(int idx) const;
+    
+    static std::string UniqueCacheIdentity();
+    
+    
+    // verify-on-read state, indexed by entry
+    enum : uint8_t { Unverified, VerifiedValid, VerifiedCorrupt };
+    mutable std::mutex              _verifyLock;
+    mutable std::vector<uint8_t>    _verified;
+    
+    // true if the entry passes its CRC check, or if verification is off
+    bool IsVerified(int idx) const;
+    
+    bool IsReadOnly() const;
 };
 
 EPUB3_END_NAMESPACE
@@ -0,0 +1,157 @@
+//
+//  code_points.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__code_points__
+#define __ePub3__code_points__
+
+#include "epub3.h"
+#include <cstdint>
+#include <string>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ The code point classification, case folding and UTF-8 conversion shared by the
+ text search facilities, so that TextPattern and SearchIndex agree on what a word
+ is and how its case is ignored.
+
+ Only ASCII and Latin-1 letters change case; anything else is compared as is.
+ */
+class CodePoints
+{
+public:
+    /**
+     Decodes one code point, advancing `p` past it.
+
+     Bytes which aren't part of a valid UTF-8 sequence are taken as Latin-1.
+     @param p The start of the code point; must be before `end`.
+     @param end The end of the text.
+     */
+    static uint32_t     Next(const uint8_t*& p, const uint8_t* end)
+    {
+        uint32_t ch = *p++;
+        int extra = (ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : ch >= 0xC0 ? 1 : 0);
+        if ( extra > 0 && end - p >= extra )
+        {
+            ch &= (0x3F >> extra);
+            for ( int i = 0; i < extra; i++ )
+                ch = (ch << 6) | (*p++ & 0x3F);
+        }
+        return ch;
+    }
+
+    // appends one code point to some UTF-8 text
+    static void         AppendUTF8(std::string& str, uint32_t ch)
+    {
+        if ( ch < 0x80 )
+        {
+            str += static_cast<char>(ch);
+        }
+        else if ( ch < 0x800 )
+        {
+            str += static_cast<char>(0xC0 | (ch >> 6));
+            str += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else if ( ch < 0x10000 )
+        {
+            str += static_cast<char>(0xE0 | (ch >> 12));
+            str += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            str += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else
+        {
+            str += static_cast<char>(0xF0 | (ch >> 18));
+            str += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+            str += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            str += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+    }
+
+    /**
+     Whether a code point is part of a word: an ASCII letter or digit, or any
+     non-ASCII character other than Latin-1 symbols, general punctuation and CJK
+     punctuation.
+     */
+    static bool         IsWord(uint32_t ch)
+    {
+        if ( ch < 0x80 )
+            return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9');
+
+        if ( ch <= 0xBF || ch == 0xD7 || ch == 0xF7 )
+            return false;
+        if ( ch >= 0x2000 && ch <= 0x206F )
+            return false;
+        if ( ch >= 0x3000 && ch <= 0x303F )
+            return false;
+        return true;
+    }
+
+    /**
+     Whether a code point is a Chinese, Japanese or Korean character: a CJK
+     ideograph, kana, or a Hangul syllable. These scripts don't separate their
+     words with spaces.
+     */
+    static bool         IsCJK(uint32_t ch)
+    {
+        return (ch >= 0x3040 && ch <= 0x30FF) ||        // hiragana, katakana
+               (ch >= 0x3400 && ch <= 0x4DBF) ||        // extension A
+               (ch >= 0x4E00 && ch <= 0x9FFF) ||        // unified ideographs
+               (ch >= 0xAC00 && ch <= 0xD7AF) ||        // Hangul syllables
+               (ch >= 0xF900 && ch <= 0xFAFF) ||        // compatibility ideographs
+               (ch >= 0xFF66 && ch <= 0xFF9F) ||        // half-width katakana
+               (ch >= 0x20000 && ch <= 0x2FFFF);        // supplementary ideographs
+    }
+
+    static bool         IsSpace(uint32_t ch)
+    {
+        switch ( ch )
+        {
+            case ' ': case '\t': case '\n': case '\r': case '\f': case '\v':
+            case 0xA0: case 0x1680: case 0x2028: case 0x2029: case 0x202F: case 0x205F: case 0x3000: case 0xFEFF:
+                return true;
+            default:
+                return ch >= 0x2000 && ch <= 0x200A;
+        }
+    }
+
+    static uint32_t     FoldCase(uint32_t ch)
+    {
+        if ( ch >= 'A' && ch <= 'Z' )
+            return ch + 0x20;
+        if ( ch >= 0xC0 && ch <= 0xDE && ch != 0xD7 )
+            return ch + 0x20;
+        return ch;
+    }
+    static uint32_t     UpperCase(uint32_t ch)
+    {
+        if ( ch >= 'a' && ch <= 'z' )
+            return ch - 0x20;
+        if ( ch >= 0xE0 && ch <= 0xFE && ch != 0xF7 )
+            return ch - 0x20;
+        return ch;
+    }
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__code_points__) */
@@ -0,0 +1,255 @@
+//
+//  crc32.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "crc32.h"
+#include <zlib.h>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define EPUB_CRC32_PCLMUL 1
+# include <immintrin.h>
+#elif defined(__aarch64__)
+# define EPUB_CRC32_ARMV8 1
+# include <arm_acle.h>
+# if defined(__linux__)
+#  include <sys/auxv.h>
+#  include <asm/hwcap.h>
+# endif
+#endif
+
+EPUB3_BEGIN_NAMESPACE
+
+// inputs shorter than this aren't worth the setup cost of the vector path
+static const size_t MinimumAcceleratedLength = 64;
+
+#if EPUB_CRC32_PCLMUL
+
+// Folding by four 128-bit lanes, as described in Intel's "Fast CRC Computation for
+//  Generic Polynomials Using PCLMULQDQ Instruction". The constants are the bit-
+//  reflected x^n mod P(x) values for the zip polynomial, followed by the Barrett
+//  reduction constants. `len` must be a multiple of 16, and at least 64. `crc` is
+//  the raw (non-inverted) register value.
+alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t CRC32Fold(uint32_t crc, const uint8_t* buf, size_t len)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+    buf += 64;
+    len -= 64;
+
+    // fold four lanes in parallel, 64 bytes at a time
+    while ( len >= 64 )
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    // fold the four lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // any remaining 16-byte blocks
+    while ( len >= 16 )
+    {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    // fold 128 bits down to 64
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static bool HasAcceleratedCRC()
+{
+#if defined(__APPLE__)
+    // every Intel Mac which runs a supported OS has PCLMULQDQ
+    return true;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static uint32_t AcceleratedCRC32(uint32_t crc, const uint8_t* buf, size_t len)
+{
+    size_t blocks = len & ~static_cast<size_t>(15);
+    crc = ~CRC32Fold(~crc, buf, blocks);
+    if ( blocks == len )
+        return crc;
+    return static_cast<uint32_t>(::crc32(crc, buf + blocks, static_cast<uInt>(len - blocks)));
+}
+
+#elif EPUB_CRC32_ARMV8
+
+#if defined(__clang__)
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t AcceleratedCRC32(uint32_t crc, const uint8_t* buf, size_t len)
+{
+    crc = ~crc;
+
+    // align for the 8-byte loads
+    while ( len > 0 && (reinterpret_cast<uintptr_t>(buf) & 7) != 0 )
+    {
+        crc = __crc32b(crc, *buf++);
+        len--;
+    }
+
+    while ( len >= 32 )
+    {
+        uint64_t v[4];
+        std::memcpy(v, buf, sizeof(v));
+        crc = __crc32d(crc, v[0]);
+        crc = __crc32d(crc, v[1]);
+        crc = __crc32d(crc, v[2]);
+        crc = __crc32d(crc, v[3]);
+        buf += 32;
+        len -= 32;
+    }
+
+    while ( len >= 8 )
+    {
+        uint64_t v;
+        std::memcpy(&v, buf, sizeof(v));
+        crc = __crc32d(crc, v);
+        buf += 8;
+        len -= 8;
+    }
+
+    while ( len > 0 )
+    {
+        crc = __crc32b(crc, *buf++);
+        len--;
+    }
+
+    return ~crc;
+}
+
+static bool HasAcceleratedCRC()
+{
+#if defined(__APPLE__)
+    // all Apple ARMv8 cores implement the CRC32 extension
+    return true;
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+    return (::getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif
+
+uint32_t CRC32(uint32_t crc, const void* data, size_t len)
+{
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(data);
+
+#if EPUB_CRC32_PCLMUL || EPUB_CRC32_ARMV8
+    static const bool accelerated = HasAcceleratedCRC();
+    if ( accelerated && len >= MinimumAcceleratedLength )
+        return AcceleratedCRC32(crc, buf, len);
+#endif
+
+    // zlib takes a 32-bit length
+    while ( len > 0 )
+    {
+        uInt chunk = static_cast<uInt>(std::min<size_t>(len, 1u << 30));
+        crc = static_cast<uint32_t>(::crc32(crc, buf, chunk));
+        buf += chunk;
+        len -= chunk;
+    }
+    return crc;
+}
+
+EPUB3_END_NAMESPACE
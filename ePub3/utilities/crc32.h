@@ -0,0 +1,46 @@
+//
+//  crc32.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__crc32__
+#define __ePub3__crc32__
+
+#include "epub3.h"
+#include <cstdint>
+#include <cstddef>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Computes the CRC-32 used by zip and gzip, using the fastest implementation the CPU
+ supports.
+
+ On x86 processors with PCLMULQDQ, 64-byte blocks are folded using carry-less
+ multiplication; on ARMv8 processors with the CRC32 extension, the dedicated CRC
+ instructions are used. Anywhere else this falls back to zlib's `crc32()`.
+
+ The result is identical to zlib's: pass zero as the initial value, and pass the
+ result of one call as the `crc` argument to the next to continue a running CRC.
+ */
+uint32_t CRC32(uint32_t crc, const void* data, size_t len);
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__crc32__) */
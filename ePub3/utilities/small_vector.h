@@ -0,0 +1,325 @@
+//
+//  small_vector.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__small_vector__
+#define __ePub3__small_vector__
+
+#include "epub3.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <utility>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ The body of a SmallVector, independent of its inline capacity.
+ 
+ This behaves like a `std::vector` (as far as the parts of that interface it
+ implements), except that its first few elements live inside the object itself, so
+ short vectors don't touch the heap at all. Functions which accept or modify
+ SmallVectors of any capacity should take a `SmallVectorImpl<T>&`.
+ 
+ Iterators are plain pointers, and are invalidated by any insertion or removal.
+ */
+template <typename T>
+class SmallVectorImpl
+{
+public:
+    typedef T                   value_type;
+    typedef T&                  reference;
+    typedef const T&            const_reference;
+    typedef T*                  pointer;
+    typedef const T*            const_pointer;
+    typedef T*                  iterator;
+    typedef const T*            const_iterator;
+    typedef size_t              size_type;
+    typedef ptrdiff_t           difference_type;
+    
+    SmallVectorImpl(const SmallVectorImpl&) = delete;
+    
+    iterator            begin()                             { return _data; }
+    iterator            end()                               { return _data + _size; }
+    const_iterator      begin()                     const   { return _data; }
+    const_iterator      end()                       const   { return _data + _size; }
+    
+    size_type           size()                      const   { return _size; }
+    size_type           capacity()                  const   { return _capacity; }
+    bool                empty()                     const   { return _size == 0; }
+    
+    reference           operator[](size_type i)             { return _data[i]; }
+    const_reference     operator[](size_type i)     const   { return _data[i]; }
+    reference           front()                             { return _data[0]; }
+    const_reference     front()                     const   { return _data[0]; }
+    reference           back()                              { return _data[_size-1]; }
+    const_reference     back()                      const   { return _data[_size-1]; }
+    
+    SmallVectorImpl&    operator=(const SmallVectorImpl& o)
+    {
+        if ( this != &o )
+            assign(o.begin(), o.end());
+        return *this;
+    }
+    SmallVectorImpl&    operator=(SmallVectorImpl&& o)
+    {
+        if ( this == &o )
+            return *this;
+        
+        clear();
+        if ( !o.IsInline() )
+        {
+            // take its heap storage outright
+            ReleaseStorage();
+            _data = o._data;
+            _capacity = o._capacity;
+            _size = o._size;
+            o._data = o._inline;
+            o._capacity = o._inlineCapacity;
+            o._size = 0;
+            return *this;
+        }
+        
+        reserve(o._size);
+        for ( size_type i = 0; i < o._size; i++ )
+            ::new (_data + i) T(std::move(o._data[i]));
+        _size = o._size;
+        o.clear();
+        return *this;
+    }
+    
+    bool                operator==(const SmallVectorImpl& o)    const   { return _size == o._size && std::equal(begin(), end(), o.begin()); }
+    bool                operator!=(const SmallVectorImpl& o)    const   { return !(*this == o); }
+    
+    void                reserve(size_type n)
+    {
+        if ( n > _capacity )
+            Grow(n);
+    }
+    void                clear()
+    {
+        DestroyRange(begin(), end());
+        _size = 0;
+    }
+    
+    void                push_back(const T& value)           { emplace_back(value); }
+    void                push_back(T&& value)                { emplace_back(std::move(value)); }
+    template <typename... _Args>
+    void                emplace_back(_Args&&... args)
+    {
+        if ( _size == _capacity )
+        {
+            // construct first, in case the arguments refer to our own elements
+            T value(std::forward<_Args>(args)...);
+            Grow(_size + 1);
+            ::new (end()) T(std::move(value));
+        }
+        else
+        {
+            ::new (end()) T(std::forward<_Args>(args)...);
+        }
+        _size++;
+    }
+    void                pop_back()
+    {
+        _size--;
+        end()->~T();
+    }
+    
+    template <typename _InputIter>
+    void                assign(_InputIter first, _InputIter last)
+    {
+        size_type n = static_cast<size_type>(std::distance(first, last));
+        if ( n > _capacity )
+        {
+            // the source can't be a part of this vector, as it's too big
+            clear();
+            MoveInto(Allocate(n), n);
+        }
+        
+        // assign over the elements we have, front to back, so the source may be a later
+        //  part of this same vector
+        size_type i = 0;
+        for ( ; i < _size && first != last; ++i, ++first )
+            _data[i] = *first;
+        
+        if ( first == last )
+        {
+            DestroyRange(_data + i, end());
+            _size = static_cast<uint32_t>(i);
+            return;
+        }
+        
+        for ( ; first != last; ++first )
+        {
+            ::new (end()) T(*first);
+            _size++;
+        }
+    }
+    
+    template <typename _InputIter>
+    iterator            insert(const_iterator pos, _InputIter first, _InputIter last)
+    {
+        size_type offset = static_cast<size_type>(pos - begin());
+        size_type oldSize = _size;
+        size_type n = static_cast<size_type>(std::distance(first, last));
+        
+        if ( _size + n > _capacity )
+        {
+            // build the new elements in the new storage while the old storage is intact,
+            //  in case the source is a part of this vector
+            size_type capacity = std::max<size_type>(_size + n, _capacity * 2);
+            T* storage = Allocate(capacity);
+            size_type built = 0;
+            try
+            {
+                for ( ; first != last; ++first, ++built )
+                    ::new (storage + _size + built) T(*first);
+            }
+            catch (...)
+            {
+                DestroyRange(storage + _size, storage + _size + built);
+                Deallocate(storage);
+                throw;
+            }
+            MoveInto(storage, capacity);
+            _size = static_cast<uint32_t>(oldSize + n);
+        }
+        else
+        {
+            for ( ; first != last; ++first )
+            {
+                ::new (end()) T(*first);
+                _size++;
+            }
+        }
+        
+        // the new elements are at the end; rotate them into place
+        std::rotate(begin() + offset, begin() + oldSize, end());
+        return begin() + offset;
+    }
+    iterator            insert(const_iterator pos, const T& value)          { return insert(pos, &value, &value + 1); }
+    
+    iterator            erase(const_iterator first, const_iterator last)
+    {
+        iterator dest = begin() + (first - begin());
+        if ( first == last )
+            return dest;    // avoids self-move-assignment
+        iterator moved = std::move(begin() + (last - begin()), end(), dest);
+        DestroyRange(moved, end());
+        _size = static_cast<uint32_t>(moved - begin());
+        return dest;
+    }
+    iterator            erase(const_iterator pos)                           { return erase(pos, pos + 1); }
+    
+protected:
+    T*                  _data;
+    uint32_t            _size;
+    uint32_t            _capacity;
+    T* const            _inline;
+    const uint32_t      _inlineCapacity;
+    
+                        SmallVectorImpl(T* inlineStorage, uint32_t inlineCapacity)
+                            : _data(inlineStorage), _size(0), _capacity(inlineCapacity), _inline(inlineStorage), _inlineCapacity(inlineCapacity) {}
+                        ~SmallVectorImpl()
+    {
+        clear();
+        ReleaseStorage();
+    }
+    
+    bool                IsInline()                  const   { return _data == _inline; }
+    
+    static T*           Allocate(size_type n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    static void         Deallocate(T* storage)
+    {
+        ::operator delete(storage);
+    }
+    static void         DestroyRange(T* first, T* last)
+    {
+        for ( ; first != last; ++first )
+            first->~T();
+    }
+    void                ReleaseStorage()
+    {
+        if ( !IsInline() )
+            Deallocate(_data);
+        _data = _inline;
+        _capacity = _inlineCapacity;
+    }
+    
+    // moves the existing elements into new storage, which becomes ours
+    void                MoveInto(T* storage, size_type capacity)
+    {
+        for ( size_type i = 0; i < _size; i++ )
+        {
+            ::new (storage + i) T(std::move(_data[i]));
+            _data[i].~T();
+        }
+        if ( !IsInline() )
+            Deallocate(_data);
+        _data = storage;
+        _capacity = static_cast<uint32_t>(capacity);
+    }
+    void                Grow(size_type minimum)
+    {
+        size_type capacity = std::max<size_type>(minimum, _capacity * 2);
+        MoveInto(Allocate(capacity), capacity);
+    }
+    
+};
+
+/**
+ A vector which holds up to `N` elements without allocating.
+ */
+template <typename T, unsigned N>
+class SmallVector : public SmallVectorImpl<T>
+{
+    typedef SmallVectorImpl<T>  _Base;
+    
+public:
+                        SmallVector()                               : _Base(Storage(), N) {}
+                        SmallVector(const SmallVector& o)           : _Base(Storage(), N) { _Base::assign(o.begin(), o.end()); }
+                        SmallVector(const _Base& o)                 : _Base(Storage(), N) { _Base::assign(o.begin(), o.end()); }
+                        SmallVector(SmallVector&& o)                : _Base(Storage(), N) { _Base::operator=(std::move(o)); }
+                        SmallVector(_Base&& o)                      : _Base(Storage(), N) { _Base::operator=(std::move(o)); }
+    template <typename _InputIter>
+                        SmallVector(_InputIter first, _InputIter last) : _Base(Storage(), N) { _Base::assign(first, last); }
+                        ~SmallVector()                              {}
+    
+    SmallVector&        operator=(const SmallVector& o)             { _Base::operator=(o); return *this; }
+    SmallVector&        operator=(const _Base& o)                   { _Base::operator=(o); return *this; }
+    SmallVector&        operator=(SmallVector&& o)                  { _Base::operator=(std::move(o)); return *this; }
+    SmallVector&        operator=(_Base&& o)                        { _Base::operator=(std::move(o)); return *this; }
+    
+private:
+    alignas(T) unsigned char    _storage[N * sizeof(T)];
+    
+    T*                  Storage()                                   { return reinterpret_cast<T*>(_storage); }
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__small_vector__) */
@@ -0,0 +1,117 @@
+//
+//  spsc_ring_buffer.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "spsc_ring_buffer.h"
+#include <algorithm>
+
+EPUB3_BEGIN_NAMESPACE
+
+SPSCRingBuffer::SPSCRingBuffer(std::size_t size) : _written(0), _read(0), _finished(false), _cancelled(false), _sleepers(0)
+{
+    std::size_t capacity = 1;
+    while ( capacity < size )
+        capacity <<= 1;
+    
+    _buffer = new uint8_t[capacity];
+    _mask = capacity - 1;
+}
+SPSCRingBuffer::~SPSCRingBuffer()
+{
+    delete [] _buffer;
+}
+std::size_t SPSCRingBuffer::WritableRegion(uint8_t **region) noexcept
+{
+    // only this thread changes _written; acquire the consumer's progress
+    std::size_t written = _written.load(std::memory_order_relaxed);
+    std::size_t space = Capacity() - (written - _read.load(std::memory_order_acquire));
+    
+    // don't run past the end of the backing store
+    std::size_t pos = written & _mask;
+    *region = _buffer + pos;
+    return std::min(space, Capacity() - pos);
+}
+void SPSCRingBuffer::Commit(std::size_t len) noexcept
+{
+    // sequentially consistent, so either Wake() sees a sleeper or the sleeper sees this
+    _written.store(_written.load(std::memory_order_relaxed) + len);
+    Wake();
+}
+void SPSCRingBuffer::Finish() noexcept
+{
+    _finished.store(true);
+    Wake();
+}
+void SPSCRingBuffer::WaitToWrite()
+{
+    std::unique_lock<std::mutex> lock(_waitLock);
+    _sleepers++;
+    _wake.wait(lock, [this]() {
+        return _cancelled.load() || _written.load() - _read.load() < Capacity();
+    });
+    _sleepers--;
+}
+std::size_t SPSCRingBuffer::ReadableRegion(const uint8_t **region) noexcept
+{
+    std::size_t read = _read.load(std::memory_order_relaxed);
+    std::size_t avail = _written.load(std::memory_order_acquire) - read;
+    
+    std::size_t pos = read & _mask;
+    *region = _buffer + pos;
+    return std::min(avail, Capacity() - pos);
+}
+void SPSCRingBuffer::Consume(std::size_t len) noexcept
+{
+    _read.store(_read.load(std::memory_order_relaxed) + len);
+    Wake();
+}
+bool SPSCRingBuffer::AtEnd() const noexcept
+{
+    // check the flag first: anything written before Finish() is then visible
+    if ( !_finished.load(std::memory_order_acquire) )
+        return false;
+    return _written.load(std::memory_order_acquire) == _read.load(std::memory_order_relaxed);
+}
+void SPSCRingBuffer::WaitToRead()
+{
+    std::unique_lock<std::mutex> lock(_waitLock);
+    _sleepers++;
+    _wake.wait(lock, [this]() {
+        return _cancelled.load() || _finished.load() || _written.load() != _read.load();
+    });
+    _sleepers--;
+}
+void SPSCRingBuffer::Cancel() noexcept
+{
+    _cancelled.store(true);
+    Wake();
+}
+void SPSCRingBuffer::Wake() noexcept
+{
+    if ( _sleepers.load() == 0 )
+        return;
+    
+    // taking the lock means the sleeper is either waiting already or yet to check
+    std::lock_guard<std::mutex> _(_waitLock);
+    _wake.notify_all();
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,159 @@
+//
+//  spsc_ring_buffer.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__spsc_ring_buffer__
+#define __ePub3__spsc_ring_buffer__
+
+#include "epub3.h"
+#include "basic.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A lock-free ring buffer with exactly one producer thread and one consumer thread.
+ 
+ Unlike RingBuffer, no lock is ever taken: the producer owns the write position and
+ the consumer owns the read position, and each publishes its own with a release
+ store. Both sides work on the buffer's memory in place: the producer asks for the
+ free region with WritableRegion(), fills some of it, then calls Commit(); the
+ consumer asks for the filled region with ReadableRegion(), uses some of it, then
+ calls Consume(). Neither method ever blocks. A side with nothing to do can sleep in
+ WaitToWrite() or WaitToRead() until the other side makes progress; only then is a
+ lock taken, so a pipeline which keeps both sides busy stays lock-free.
+ 
+ The producer calls Finish() once it has written everything; either side can call
+ Cancel() to tell the other to give up.
+ */
+class SPSCRingBuffer
+{
+public:
+    ///
+    /// Constructs a buffer of at least `size` bytes, rounded up to a power of two.
+                    SPSCRingBuffer(std::size_t size=64*1024);
+                    SPSCRingBuffer(const SPSCRingBuffer&)   = delete;
+                    SPSCRingBuffer(SPSCRingBuffer&&)        = delete;
+    virtual         ~SPSCRingBuffer();
+    
+    SPSCRingBuffer& operator=(const SPSCRingBuffer&)        = delete;
+    
+    /**
+     @return The maximum number of bytes the buffer can hold.
+     */
+    std::size_t     Capacity()              const noexcept  { return _mask + 1; }
+    
+    /**
+     @defgroup Producer Producer Operations
+     These may only be called from the producer thread.
+     @{
+     */
+    
+    /**
+     Obtains the largest contiguous region which may currently be written.
+     @param region Set to the start of the region.
+     @result The length of the region, which is zero when the buffer is full.
+     */
+    std::size_t     WritableRegion(uint8_t** region)        noexcept;
+    
+    /**
+     Makes bytes written into the writable region available to the consumer.
+     @param len The number of bytes written, no more than WritableRegion() returned.
+     */
+    void            Commit(std::size_t len)                 noexcept;
+    
+    /**
+     Marks the end of the data. Nothing may be written afterwards.
+     */
+    void            Finish()                                noexcept;
+    
+    /**
+     Sleeps until there's space to write, or the buffer is cancelled.
+     */
+    void            WaitToWrite();
+    
+    /** @} */
+    
+    /**
+     @defgroup Consumer Consumer Operations
+     These may only be called from the consumer thread.
+     @{
+     */
+    
+    /**
+     Obtains the largest contiguous region which may currently be read.
+     @param region Set to the start of the region.
+     @result The length of the region, which is zero when the buffer is empty.
+     */
+    std::size_t     ReadableRegion(const uint8_t** region)  noexcept;
+    
+    /**
+     Releases bytes from the readable region, making the space available to the producer.
+     @param len The number of bytes used, no more than ReadableRegion() returned.
+     */
+    void            Consume(std::size_t len)                noexcept;
+    
+    /**
+     @result `true` once the producer has called Finish() and all data has been consumed.
+     */
+    bool            AtEnd()                 const noexcept;
+    
+    /**
+     Sleeps until there's data to read, the producer has finished, or the buffer is
+     cancelled.
+     */
+    void            WaitToRead();
+    
+    /** @} */
+    
+    /**
+     Tells the other side to stop. Either thread may call this.
+     */
+    void            Cancel()                                noexcept;
+    bool            IsCancelled()           const noexcept  { return _cancelled.load(std::memory_order_acquire); }
+    
+protected:
+    uint8_t*                    _buffer;
+    std::size_t                 _mask;
+    
+    // total bytes ever written and read; kept on separate cache lines, since each
+    //  is written by a different thread
+    alignas(64) std::atomic<std::size_t>    _written;
+    alignas(64) std::atomic<std::size_t>    _read;
+    
+    std::atomic<bool>           _finished;
+    std::atomic<bool>           _cancelled;
+    
+    // for a side waiting on the other; _sleepers says whether anyone needs waking
+    std::mutex                  _waitLock;
+    std::condition_variable     _wake;
+    std::atomic<int>            _sleepers;
+    
+    void            Wake()                                  noexcept;
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__spsc_ring_buffer__) */
@@ -0,0 +1,103 @@
+//
+//  utf_offset_map.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "utf_offset_map.h"
+#include <algorithm>
+
+EPUB3_BEGIN_NAMESPACE
+
+// the length of the UTF-8 sequence starting at `p`, or 1 if it isn't a valid one
+static uint32_t SequenceLength(const uint8_t* p, const uint8_t* end)
+{
+    uint32_t length;
+    if ( *p < 0x80 )
+        return 1;
+    else if ( *p >= 0xC2 && *p < 0xE0 )
+        length = 2;
+    else if ( *p >= 0xE0 && *p < 0xF0 )
+        length = 3;
+    else if ( *p >= 0xF0 && *p < 0xF5 )
+        length = 4;
+    else
+        return 1;
+    
+    if ( static_cast<size_t>(end - p) < length )
+        return 1;
+    for ( uint32_t i = 1; i < length; i++ )
+    {
+        if ( (p[i] & 0xC0) != 0x80 )
+            return 1;
+    }
+    return length;
+}
+
+UTFOffsetMap::UTFOffsetMap(const char *utf8, size_t length)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(utf8);
+    const uint8_t* end = p + length;
+    uint32_t codePoints = 0, utf16 = 0;
+    
+    while ( p < end )
+    {
+        uint32_t width = SequenceLength(p, end);
+        if ( _runs.empty() || _runs.back().width != width )
+        {
+            _runs.push_back(Run{{static_cast<uint32_t>(p - reinterpret_cast<const uint8_t*>(utf8)), utf16, codePoints}, width});
+        }
+        
+        p += width;
+        codePoints++;
+        utf16 += (width == 4 ? 2 : 1);
+    }
+    
+    _runs.push_back(Run{{static_cast<uint32_t>(length), utf16, codePoints}, 0});
+    _runs.shrink_to_fit();
+}
+uint32_t UTFOffsetMap::Convert(uint32_t offset, Unit from, Unit to) const
+{
+    int f = static_cast<int>(from);
+    if ( offset >= _runs.back().start[f] )
+        return Length(to);
+    
+    // the last run starting at or before the offset; the end marker is never it
+    auto run = std::upper_bound(_runs.begin(), _runs.end() - 1, offset, [f](uint32_t value, const Run& r) {
+        return value < r.start[f];
+    }) - 1;
+    
+    uint32_t codePoints = (offset - run->start[f]) / UnitWidth(*run, from);
+    return run->start[static_cast<int>(to)] + codePoints * UnitWidth(*run, to);
+}
+uint32_t UTFOffsetMap::UnitWidth(const Run &run, Unit unit)
+{
+    switch ( unit )
+    {
+        case Unit::UTF8:
+            return run.width;
+        case Unit::UTF16:
+            return (run.width == 4 ? 2 : 1);
+        case Unit::CodePoint:
+        default:
+            return 1;
+    }
+}
+
+EPUB3_END_NAMESPACE
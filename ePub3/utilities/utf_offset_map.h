@@ -0,0 +1,96 @@
+//
+//  utf_offset_map.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3__utf_offset_map__
+#define __ePub3__utf_offset_map__
+
+#include "epub3.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Converts offsets within a piece of UTF-8 text between bytes, UTF-16 code units
+ and code points, in logarithmic time.
+ 
+ The text is divided into runs of code points which all take the same number of
+ bytes. Within a run every unit is a fixed multiple of the others, so only the
+ start of each run is stored: ASCII text, or text in a single script such as
+ Chinese, is one run however long it is, and only text which switches between
+ widths (CJK with emoji, say) needs more.
+ 
+ Bytes which aren't part of a valid UTF-8 sequence count as one code point, and one
+ UTF-16 code unit, each.
+ */
+class UTFOffsetMap
+{
+public:
+    enum class Unit : uint8_t
+    {
+        UTF8,           ///< Bytes of UTF-8.
+        UTF16,          ///< UTF-16 code units, as counted by JavaScript.
+        CodePoint,      ///< Unicode code points, as counted by ePub3::string.
+    };
+    
+                    UTFOffsetMap()                              : _runs(1, Run{{0, 0, 0}, 0}) {}
+                    UTFOffsetMap(const char* utf8, size_t length);
+                    UTFOffsetMap(const UTFOffsetMap&)           = default;
+                    UTFOffsetMap(UTFOffsetMap&& o)              : _runs(std::move(o._runs)) {}
+                    ~UTFOffsetMap() {}
+    
+    UTFOffsetMap&   operator=(const UTFOffsetMap&)              = default;
+    UTFOffsetMap&   operator=(UTFOffsetMap&& o)                 { _runs = std::move(o._runs); return *this; }
+    
+    // the length of the whole text
+    uint32_t        Length(Unit unit)                   const   { return _runs.back().start[static_cast<int>(unit)]; }
+    
+    /**
+     Converts an offset from one unit to another.
+     
+     An offset which falls within a code point, such as between the two halves of a
+     UTF-16 surrogate pair, is taken to mean the start of that code point. One beyond
+     the end of the text is taken to mean the end.
+     */
+    uint32_t        Convert(uint32_t offset, Unit from, Unit to)    const;
+    
+    // the heap memory held by the map, in bytes
+    size_t          MemoryUsage()                       const   { return _runs.capacity() * sizeof(Run); }
+    
+protected:
+    struct Run
+    {
+        uint32_t    start[3];       // indexed by Unit
+        uint32_t    width;          // bytes per code point; zero for the end marker
+    };
+    
+    // the last entry marks the end of the text
+    std::vector<Run>    _runs;
+    
+    static uint32_t     UnitWidth(const Run& run, Unit unit);
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__utf_offset_map__) */
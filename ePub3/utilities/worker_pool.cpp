@@ -0,0 +1,81 @@
+//
+//  worker_pool.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "worker_pool.h"
+#include <algorithm>
+
+EPUB3_BEGIN_NAMESPACE
+
+WorkerPool::WorkerPool(std::size_t threads) : _stopping(false)
+{
+    if ( threads == 0 )
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    
+    _threads.reserve(threads);
+    for ( std::size_t i = 0; i < threads; i++ )
+        _threads.emplace_back(&WorkerPool::Run, this);
+}
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    
+    for ( std::thread& thread : _threads )
+        thread.join();
+}
+WorkerPool* WorkerPool::Shared()
+{
+    static WorkerPool pool;
+    return &pool;
+}
+void WorkerPool::Enqueue(std::function<void()>&& task)
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        _queue.push_back(std::move(task));
+    }
+    _wake.notify_one();
+}
+void WorkerPool::Run()
+{
+    for ( ;; )
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _wake.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+            if ( _queue.empty() )
+                return;         // stopping, with nothing left to do
+            
+            task = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        
+        // packaged_task catches anything the task throws, and stores it in the future
+        task();
+    }
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,159 @@
+//
+//  worker_pool.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__worker_pool__
+#define __ePub3__worker_pool__
+
+#include "epub3.h"
+#include "basic.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A fixed set of threads which run tasks from a shared queue.
+ 
+ The library's batch operations (searching a publication, reading or verifying many
+ archive entries, re-anchoring many CFIs) hand their per-item work to Shared(), so
+ however many of them run at once, no more threads are busy than there are cores.
+ Callers still bound how much work they queue ahead, since each queued task usually
+ holds an item's data.
+ 
+ A task must never wait on another task from the same pool: with every thread
+ waiting, nothing would be left to run the task being waited for.
+ */
+class WorkerPool
+{
+public:
+    ///
+    /// Starts `threads` threads; zero means one per core.
+                    WorkerPool(std::size_t threads=0);
+                    WorkerPool(const WorkerPool&)   = delete;
+                    WorkerPool(WorkerPool&&)        = delete;
+    ///
+    /// Runs any tasks still queued, then stops the threads.
+    virtual         ~WorkerPool();
+    
+    WorkerPool&     operator=(const WorkerPool&)    = delete;
+    
+    /**
+     The pool shared by the whole library, with one thread per core.
+     */
+    static WorkerPool*  Shared();
+    
+    /**
+     @result The number of threads running tasks.
+     */
+    std::size_t     ThreadCount()           const noexcept  { return _threads.size(); }
+    
+    /**
+     Queues a task to run on one of the pool's threads.
+     @param fn A callable taking no arguments.
+     @result A future for the task's result; any exception the task throws is
+     rethrown from its get().
+     */
+    template <typename _Fn>
+    std::future<typename std::result_of<_Fn()>::type>   Submit(_Fn&& fn)
+    {
+        typedef typename std::result_of<_Fn()>::type _Result;
+        auto task = std::make_shared<std::packaged_task<_Result()>>(std::forward<_Fn>(fn));
+        std::future<_Result> result = task->get_future();
+        Enqueue([task]() { (*task)(); });
+        return result;
+    }
+    
+protected:
+    std::vector<std::thread>            _threads;
+    std::deque<std::function<void()>>   _queue;
+    std::mutex                          _lock;          // guards _queue and _stopping
+    std::condition_variable             _wake;
+    bool                                _stopping;
+    
+    void            Enqueue(std::function<void()>&& task);
+    void            Run();
+    
+};
+
+/**
+ A bounded run of tasks on a WorkerPool, whose results are collected in the order
+ the tasks were submitted.
+ 
+ The caller submits tasks until IsFull(), then collects the oldest with Next(), and
+ so only ever has a set number of tasks queued or running. Destroying the window
+ waits for any tasks still outstanding, so they may refer to the caller's locals
+ even if the caller leaves early, such as by an exception.
+ */
+template <typename _Result>
+class TaskWindow
+{
+public:
+    ///
+    /// Allows `limit` tasks at once; zero means two per pool thread.
+                    TaskWindow(WorkerPool* pool, std::size_t limit=0)
+                        : _pool(pool), _limit(limit == 0 ? 2 * pool->ThreadCount() : limit) {}
+                    TaskWindow(const TaskWindow&)   = delete;
+                    ~TaskWindow()
+                        {
+                            for ( auto& task : _pending )
+                                task.wait();
+                        }
+    
+    TaskWindow&     operator=(const TaskWindow&)    = delete;
+    
+    bool            IsFull()                const noexcept  { return _pending.size() >= _limit; }
+    bool            IsEmpty()               const noexcept  { return _pending.empty(); }
+    
+    /**
+     Queues a task on the pool.
+     @param fn A callable taking no arguments and returning `_Result`.
+     */
+    template <typename _Fn>
+    void            Submit(_Fn&& fn)                        { _pending.push_back(_pool->Submit(std::forward<_Fn>(fn))); }
+    
+    /**
+     Waits for the oldest outstanding task.
+     @result The task's result; anything it threw is rethrown here.
+     */
+    _Result         Next()
+                        {
+                            std::future<_Result> task(std::move(_pending.front()));
+                            _pending.pop_front();
+                            return task.get();
+                        }
+    
+protected:
+    WorkerPool*                         _pool;
+    std::size_t                         _limit;
+    std::deque<std::future<_Result>>    _pending;
+    
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__worker_pool__) */
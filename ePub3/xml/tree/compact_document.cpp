@@ -0,0 +1,393 @@
+//
+//  compact_document.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "compact_document.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+const CompactDocument::NodeIndex CompactDocument::NoNode;
+const CompactDocument::NameIndex CompactDocument::NoName;
+
+static const char* const XMLNamespaceURI = "http://www.w3.org/XML/1998/namespace";
+
+// holds the interning tables, which aren't needed once the document is built
+class CompactDocument::Builder
+{
+public:
+    Builder(CompactDocument* doc) : _doc(doc) {}
+    
+    void Build(xmlNodePtr root);
+    
+protected:
+    struct Frame
+    {
+        xmlNodePtr  next;           // the next libxml child to copy
+        NodeIndex   index;
+        NodeIndex   lastChild;
+    };
+    
+    CompactDocument*                            _doc;
+    std::unordered_map<std::string, uint32_t>   _stringTable;
+    std::unordered_map<uint64_t, NameIndex>     _nameTable;
+    
+    uint32_t    String(const char* str);
+    NameIndex   Name(const xmlChar* localName, xmlNsPtr ns);
+    NodeIndex   AddNode(Frame* parent, NameIndex name, uint32_t data, uint32_t length);
+    NodeIndex   AddElement(Frame* parent, xmlNodePtr node);
+    void        AddText(Frame* parent, const char* text, size_t length);
+    
+};
+
+uint32_t CompactDocument::Builder::String(const char *str)
+{
+    auto found = _stringTable.find(str);
+    if ( found != _stringTable.end() )
+        return found->second;
+    
+    uint32_t offset = static_cast<uint32_t>(_doc->_strings.size());
+    _doc->_strings.insert(_doc->_strings.end(), str, str + strlen(str) + 1);
+    _stringTable.emplace(str, offset);
+    return offset;
+}
+CompactDocument::NameIndex CompactDocument::Builder::Name(const xmlChar* localName, xmlNsPtr ns)
+{
+    uint32_t local = String(reinterpret_cast<const char*>(localName));
+    uint32_t uri = String(ns != nullptr && ns->href != nullptr ? reinterpret_cast<const char*>(ns->href) : "");
+    
+    uint64_t key = (static_cast<uint64_t>(local) << 32) | uri;
+    auto found = _nameTable.find(key);
+    if ( found != _nameTable.end() )
+        return found->second;
+    
+    NameIndex index = static_cast<NameIndex>(_doc->_names.size());
+    _doc->_names.push_back(QName{local, uri});
+    _nameTable.emplace(key, index);
+    return index;
+}
+CompactDocument::NodeIndex CompactDocument::Builder::AddNode(Frame* parent, NameIndex name, uint32_t data, uint32_t length)
+{
+    NodeIndex index = static_cast<NodeIndex>(_doc->_nodes.size());
+    NodeIndex parentIndex = (parent == nullptr ? NoNode : parent->index);
+    _doc->_nodes.push_back(Node{parentIndex, NoNode, NoNode, name, data, length});
+    
+    if ( parent != nullptr )
+    {
+        if ( parent->lastChild == NoNode )
+            _doc->_nodes[parent->index].firstChild = index;
+        else
+            _doc->_nodes[parent->lastChild].nextSibling = index;
+        parent->lastChild = index;
+    }
+    
+    return index;
+}
+CompactDocument::NodeIndex CompactDocument::Builder::AddElement(Frame* parent, xmlNodePtr node)
+{
+    uint32_t firstAttr = static_cast<uint32_t>(_doc->_attributes.size());
+    NameIndex name = Name(node->name, node->ns);
+    NodeIndex index = static_cast<NodeIndex>(_doc->_nodes.size());
+    
+    for ( xmlAttrPtr attr = node->properties; attr != nullptr; attr = attr->next )
+    {
+        xmlChar* value = xmlNodeGetContent(reinterpret_cast<xmlNodePtr>(attr));
+        uint32_t valueOffset = String(value != nullptr ? reinterpret_cast<const char*>(value) : "");
+        if ( value != nullptr )
+            xmlFree(value);
+        
+        _doc->_attributes.push_back(Attr{Name(attr->name, attr->ns), valueOffset});
+        
+        bool xmlNS = (attr->ns != nullptr && xmlStrEqual(attr->ns->href, BAD_CAST XMLNamespaceURI));
+        if ( xmlStrEqual(attr->name, BAD_CAST "id") && (attr->ns == nullptr || xmlNS) )
+            _doc->_ids.push_back(Attr{index, valueOffset});
+    }
+    
+    uint32_t numAttrs = static_cast<uint32_t>(_doc->_attributes.size()) - firstAttr;
+    return AddNode(parent, name, firstAttr, numAttrs);
+}
+void CompactDocument::Builder::AddText(Frame* parent, const char* text, size_t length)
+{
+    // character data following more character data extends it
+    if ( parent->lastChild != NoNode && _doc->_nodes[parent->lastChild].name == NoName )
+    {
+        _doc->_text.append(text, length);
+        _doc->_nodes[parent->lastChild].length += static_cast<uint32_t>(length);
+        return;
+    }
+    
+    uint32_t offset = static_cast<uint32_t>(_doc->_text.size());
+    _doc->_text.append(text, length);
+    AddNode(parent, NoName, offset, static_cast<uint32_t>(length));
+}
+void CompactDocument::Builder::Build(xmlNodePtr root)
+{
+    std::vector<Frame> stack;
+    stack.push_back(Frame{root->children, AddElement(nullptr, root), NoNode});
+    
+    // walk iteratively: content documents can be deeply nested
+    while ( !stack.empty() )
+    {
+        Frame& frame = stack.back();
+        xmlNodePtr node = frame.next;
+        if ( node == nullptr )
+        {
+            stack.pop_back();
+            continue;
+        }
+        frame.next = node->next;
+        
+        switch ( node->type )
+        {
+            case XML_ELEMENT_NODE:
+            {
+                NodeIndex index = AddElement(&frame, node);
+                stack.push_back(Frame{node->children, index, NoNode});
+                break;
+            }
+            case XML_TEXT_NODE:
+            case XML_CDATA_SECTION_NODE:
+                if ( node->content != nullptr )
+                    AddText(&frame, reinterpret_cast<const char*>(node->content), strlen(reinterpret_cast<const char*>(node->content)));
+                break;
+            case XML_ENTITY_REF_NODE:
+            {
+                xmlChar* content = xmlNodeGetContent(node);
+                if ( content != nullptr )
+                {
+                    AddText(&frame, reinterpret_cast<const char*>(content), strlen(reinterpret_cast<const char*>(content)));
+                    xmlFree(content);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    
+    const std::vector<char>& strings = _doc->_strings;
+    std::stable_sort(_doc->_ids.begin(), _doc->_ids.end(), [&strings](const Attr& a, const Attr& b) {
+        return strcmp(&strings[a.value], &strings[b.value]) < 0;
+    });
+    
+    // the tables were grown by doubling; give back the slack
+    _doc->_nodes.shrink_to_fit();
+    _doc->_names.shrink_to_fit();
+    _doc->_attributes.shrink_to_fit();
+    _doc->_strings.shrink_to_fit();
+    _doc->_text.shrink_to_fit();
+    _doc->_ids.shrink_to_fit();
+}
+
+CompactDocument::CompactDocument(xmlDocPtr doc)
+{
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    if ( root == nullptr )
+        throw InternalError("CompactDocument: document has no root element");
+    
+    Builder(this).Build(root);
+    BuildChildTables();
+}
+CompactDocument::CompactDocument(CompactDocument&& o) : _nodes(std::move(o._nodes)), _names(std::move(o._names)), _attributes(std::move(o._attributes)), _strings(std::move(o._strings)), _text(std::move(o._text)), _ids(std::move(o._ids)), _childOffsets(std::move(o._childOffsets)), _childElements(std::move(o._childElements)), _ordinals(std::move(o._ordinals)), _offsetMaps(std::move(o._offsetMaps))
+{
+}
+CompactDocument& CompactDocument::operator=(CompactDocument &&o)
+{
+    _nodes = std::move(o._nodes);
+    _names = std::move(o._names);
+    _attributes = std::move(o._attributes);
+    _strings = std::move(o._strings);
+    _text = std::move(o._text);
+    _ids = std::move(o._ids);
+    _childOffsets = std::move(o._childOffsets);
+    _childElements = std::move(o._childElements);
+    _ordinals = std::move(o._ordinals);
+    _offsetMaps = std::move(o._offsetMaps);
+    return *this;
+}
+void CompactDocument::BuildChildTables()
+{
+    // count each node's child elements, then turn the counts into offsets
+    _childOffsets.assign(_nodes.size() + 1, 0);
+    for ( const Node& node : _nodes )
+    {
+        if ( node.name != NoName && node.parent != NoNode )
+            _childOffsets[node.parent + 1]++;
+    }
+    for ( size_t i = 1; i < _childOffsets.size(); i++ )
+        _childOffsets[i] += _childOffsets[i-1];
+    
+    _childElements.resize(_childOffsets.back());
+    _ordinals.resize(_nodes.size());
+    for ( NodeIndex parent = 0; parent < _nodes.size(); parent++ )
+    {
+        uint32_t elements = 0;
+        for ( NodeIndex child = _nodes[parent].firstChild; child != NoNode; child = _nodes[child].nextSibling )
+        {
+            if ( _nodes[child].name != NoName )
+                _childElements[_childOffsets[parent] + elements++] = child;
+            _ordinals[child] = elements;
+        }
+    }
+    
+    // the root has no parent to number it
+    if ( !_ordinals.empty() )
+        _ordinals[0] = 0;
+}
+const char* CompactDocument::Name(NodeIndex n) const
+{
+    const Node& node = _nodes[n];
+    if ( node.name == NoName )
+        return "";
+    return &_strings[_names[node.name].localName];
+}
+const char* CompactDocument::NamespaceURI(NodeIndex n) const
+{
+    const Node& node = _nodes[n];
+    if ( node.name == NoName )
+        return "";
+    return &_strings[_names[node.name].namespaceURI];
+}
+const char* CompactDocument::Attribute(NodeIndex n, const char *name, const char *nsURI) const
+{
+    const Node& node = _nodes[n];
+    if ( node.name == NoName )
+        return nullptr;
+    
+    for ( uint32_t i = node.data, end = node.data + node.length; i < end; i++ )
+    {
+        const QName& qname = _names[_attributes[i].name];
+        if ( strcmp(&_strings[qname.localName], name) != 0 )
+            continue;
+        if ( strcmp(&_strings[qname.namespaceURI], (nsURI == nullptr ? "" : nsURI)) != 0 )
+            continue;
+        return &_strings[_attributes[i].value];
+    }
+    
+    return nullptr;
+}
+const char* CompactDocument::Text(NodeIndex n, size_t *length) const
+{
+    const Node& node = _nodes[n];
+    if ( node.name != NoName )
+    {
+        *length = 0;
+        return "";
+    }
+    
+    *length = node.length;
+    return _text.data() + node.data;
+}
+std::string CompactDocument::Content(NodeIndex n) const
+{
+    if ( IsText(n) )
+        return _text.substr(_nodes[n].data, _nodes[n].length);
+    
+    // nodes are in document order, so the descendants' text is contiguous in the blob
+    //  and runs from the first text node inside the element to the last
+    NodeIndex end = n;
+    while ( end != NoNode && _nodes[end].nextSibling == NoNode )
+        end = _nodes[end].parent;
+    end = (end == NoNode ? static_cast<NodeIndex>(_nodes.size()) : _nodes[end].nextSibling);
+    
+    size_t first = std::string::npos, last = 0;
+    for ( NodeIndex i = n + 1; i < end; i++ )
+    {
+        if ( _nodes[i].name != NoName )
+            continue;
+        if ( first == std::string::npos )
+            first = _nodes[i].data;
+        last = _nodes[i].data + _nodes[i].length;
+    }
+    
+    if ( first == std::string::npos )
+        return std::string();
+    return _text.substr(first, last - first);
+}
+CompactDocument::NodeIndex CompactDocument::ElementWithID(const char *ident) const
+{
+    auto pos = std::lower_bound(_ids.begin(), _ids.end(), ident, [this](const Attr& entry, const char* value) {
+        return strcmp(&_strings[entry.value], value) < 0;
+    });
+    if ( pos == _ids.end() || strcmp(&_strings[pos->value], ident) != 0 )
+        return NoNode;
+    return pos->name;
+}
+CompactDocument::NodeIndex CompactDocument::ChildAtCFIIndex(NodeIndex parent, uint32_t index) const
+{
+    // odd index 2k+1 is the character data after the k'th element
+    uint32_t elementsBefore = index / 2;
+    if ( index == 0 || elementsBefore > ChildElementCount(parent) )
+        return NoNode;
+    
+    const NodeIndex* elements = _childElements.data() + _childOffsets[parent];
+    if ( (index % 2) == 0 )
+        return elements[elementsBefore - 1];
+    
+    // adjacent character data is merged, so the chunk is at most one node
+    NodeIndex text = (elementsBefore == 0 ? _nodes[parent].firstChild : _nodes[elements[elementsBefore - 1]].nextSibling);
+    if ( text == NoNode || _nodes[text].name != NoName )
+        return NoNode;
+    return text;
+}
+uint32_t CompactDocument::CFIIndex(NodeIndex n) const
+{
+    if ( _nodes[n].parent == NoNode )
+        return 0;
+    return (IsElement(n) ? _ordinals[n] * 2 : _ordinals[n] * 2 + 1);
+}
+const UTFOffsetMap& CompactDocument::OffsetMap(NodeIndex text) const
+{
+    {
+        std::lock_guard<std::mutex> _(_offsetMapLock);
+        auto found = _offsetMaps.find(text);
+        if ( found != _offsetMaps.end() )
+            return found->second;
+    }
+    
+    // build it without holding the lock; if another thread beats us to it, theirs is kept
+    size_t length = 0;
+    const char* data = Text(text, &length);
+    UTFOffsetMap map(data, length);
+    
+    // elements of an unordered_map never move, so the reference stays valid
+    std::lock_guard<std::mutex> _(_offsetMapLock);
+    return _offsetMaps.emplace(text, std::move(map)).first->second;
+}
+size_t CompactDocument::MemoryUsage() const
+{
+    size_t offsetMaps = 0;
+    {
+        std::lock_guard<std::mutex> _(_offsetMapLock);
+        for ( auto& pair : _offsetMaps )
+            offsetMaps += sizeof(pair) + pair.second.MemoryUsage();
+    }
+    
+    return _nodes.capacity() * sizeof(Node) + _names.capacity() * sizeof(QName)
+         + _attributes.capacity() * sizeof(Attr) + _strings.capacity()
+         + _text.capacity() + _ids.capacity() * sizeof(Attr)
+         + (_childOffsets.capacity() + _ordinals.capacity()) * sizeof(uint32_t) + _childElements.capacity() * sizeof(NodeIndex)
+         + offsetMaps;
+}
+
+EPUB3_XML_END_NAMESPACE
@@ -0,0 +1,178 @@
+//
+//  compact_document.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3_xml_compact_document__
+#define __ePub3_xml_compact_document__
+
+#include "base.h"
+#include "utf_offset_map.h"
+#include <libxml/tree.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ An immutable, compact copy of a parsed document, for documents which are held in
+ memory to be searched or to resolve CFIs against.
+ 
+ Nodes live in one array in document order, and refer to one another by index.
+ Element and attribute names are interned, attribute values are pooled, and all
+ character data lives in a single UTF-8 blob, so a document takes not much more
+ memory than its source.
+ 
+ Only elements and character data are kept. Comments and processing instructions
+ are dropped, and adjacent text, CDATA and entity content is merged into one text
+ node, which is how EPUB CFIs count them.
+ */
+class CompactDocument
+{
+public:
+    typedef uint32_t NodeIndex;
+    static const NodeIndex NoNode = UINT32_MAX;
+    
+    /**
+     Copies a parsed document. The libxml document isn't referenced afterwards, and
+     can be freed.
+     @throws InternalError if the document has no root element.
+     */
+    explicit CompactDocument(xmlDocPtr doc);
+    CompactDocument(CompactDocument&& o);
+    CompactDocument(const CompactDocument&) = delete;
+    ~CompactDocument() {}
+    
+    CompactDocument& operator=(CompactDocument&& o);
+    
+    NodeIndex Root()                                    const   { return 0; }
+    size_t NodeCount()                                  const   { return _nodes.size(); }
+    
+    bool IsElement(NodeIndex n)                         const   { return _nodes[n].name != NoName; }
+    bool IsText(NodeIndex n)                            const   { return _nodes[n].name == NoName; }
+    
+    NodeIndex Parent(NodeIndex n)                       const   { return _nodes[n].parent; }
+    NodeIndex FirstChild(NodeIndex n)                   const   { return _nodes[n].firstChild; }
+    NodeIndex NextSibling(NodeIndex n)                  const   { return _nodes[n].nextSibling; }
+    
+    // an element's local name, or an empty string for text
+    const char* Name(NodeIndex n)                       const;
+    // an element's namespace URI, or an empty string if it has none
+    const char* NamespaceURI(NodeIndex n)               const;
+    
+    // returns nullptr if the element has no such attribute
+    const char* Attribute(NodeIndex n, const char* name, const char* nsURI = nullptr)  const;
+    
+    // the character data of a text node; not nul-terminated
+    const char* Text(NodeIndex n, size_t* length)       const;
+    
+    // all the document's character data, in document order; each text node's data
+    //  is a contiguous part of it, starting TextOffset() bytes in
+    const char* DocumentText(size_t* length)            const   { *length = _text.size(); return _text.data(); }
+    uint32_t TextOffset(NodeIndex text)                 const   { return _nodes[text].data; }
+    
+    /**
+     Converts offsets within a text node between bytes, UTF-16 code units and code
+     points. Each node's map is built the first time it's asked for, and kept with the
+     document; it's safe to call this from several threads at once.
+     */
+    const UTFOffsetMap& OffsetMap(NodeIndex text)       const;
+    
+    // all character data within a node, as xmlNodeGetContent() would return it
+    std::string Content(NodeIndex n)                    const;
+    
+    // looks up an element by its `id` or `xml:id` attribute
+    NodeIndex ElementWithID(const char* ident)          const;
+    
+    /**
+     Finds a child by its CFI step index: even indices select child elements, and odd
+     indices the character data between them. This takes constant time.
+     @result The child, or NoNode. For an odd index, NoNode means that the chunk of
+     character data is empty.
+     */
+    NodeIndex ChildAtCFIIndex(NodeIndex parent, uint32_t index)    const;
+    
+    // the number of child elements of a node; its last CFI step index is twice this, plus one
+    uint32_t ChildElementCount(NodeIndex n)             const   { return _childOffsets[n+1] - _childOffsets[n]; }
+    
+    // the CFI step index of a node within its parent, in constant time
+    uint32_t CFIIndex(NodeIndex n)                      const;
+    
+    // the heap memory held by the document, in bytes
+    size_t MemoryUsage()                                const;
+    
+protected:
+    typedef uint32_t NameIndex;
+    static const NameIndex NoName = UINT32_MAX;
+    
+    struct Node
+    {
+        NodeIndex   parent;
+        NodeIndex   firstChild;
+        NodeIndex   nextSibling;
+        NameIndex   name;           // NoName for text
+        uint32_t    data;           // elements: first attribute; text: offset in _text
+        uint32_t    length;         // elements: attribute count; text: byte count
+    };
+    
+    struct QName
+    {
+        uint32_t    localName;      // offsets into _strings
+        uint32_t    namespaceURI;
+    };
+    
+    struct Attr
+    {
+        uint32_t    name;           // NameIndex, or NodeIndex in _ids
+        uint32_t    value;          // offset into _strings
+    };
+    
+    std::vector<Node>       _nodes;
+    std::vector<QName>      _names;
+    std::vector<Attr>       _attributes;
+    std::vector<char>       _strings;       // nul-terminated, each stored once
+    std::string             _text;
+    std::vector<Attr>       _ids;           // id values and their elements, sorted by value
+    
+    // Child-index tables, so CFI steps can be followed in constant time. The child
+    //  elements of node `n` are `_childElements[_childOffsets[n]]` up to (but not
+    //  including) `_childElements[_childOffsets[n+1]]`. A node's ordinal is its
+    //  1-based position among its parent's child elements, or for text, the number
+    //  of child elements before it.
+    std::vector<uint32_t>   _childOffsets;
+    std::vector<NodeIndex>  _childElements;
+    std::vector<uint32_t>   _ordinals;
+    
+    // offset maps for the text nodes which have needed one
+    mutable std::mutex                                      _offsetMapLock;
+    mutable std::unordered_map<NodeIndex, UTFOffsetMap>     _offsetMaps;
+    
+    class Builder;
+    
+    void BuildChildTables();
+    
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_compact_document__) */
@@ -24,6 +24,7 @@
 #include "ns.h"
 #include "xpath.h"
 #include "document.h"
+#include "document_arena.h"
 #include <string>
 #include <sstream>
 #include <cstdlib>
@@ -68,6 +69,9 @@ std::string TypeString(NodeType type)
 Node::Node(_xmlNode *xml) : _xml(xml)
 {
     _xml->_private = this;
+    
+    // releasing an arena in one step would leave this wrapper behind
+    DocumentArena::MarkModified(_xml->doc);
 }
 Node::Node(const string & name, NodeType type, const string & content, const class Namespace & ns)
 {
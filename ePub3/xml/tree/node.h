@@ -201,7 +201,7 @@ template <>
 inline Node * Wrapped<Node, _xmlNode>(xmlNode * n)
 {
     if ( n == nullptr ) return nullptr;
-    if ( n->_private == nullptr ) return reinterpret_cast<Node*>(n->_private);
+    if ( n->_private != nullptr ) return reinterpret_cast<Node*>(n->_private);
     
     // Node::Wrap() instantiates the correct WrapperBase subclass
     return dynamic_cast<Node*>(Node::Wrap(n));
@@ -0,0 +1,403 @@
+//
+//  document_arena.cpp
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "document_arena.h"
+#include <libxml/parser.h>
+#include <libxml/catalog.h>
+#include <libxml/nanohttp.h>
+#include <libxml/nanoftp.h>
+#include <libxml/globals.h>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+// Every block handed to libxml is preceded by one of these, so a block can be freed
+//  without knowing where it came from. Heap blocks have no arena.
+struct BlockHeader
+{
+    DocumentArena*  arena;
+    size_t          size;
+};
+
+static const size_t Alignment = 16;
+static_assert(sizeof(BlockHeader) <= Alignment, "BlockHeader must fit in one alignment unit");
+
+static inline size_t Aligned(size_t n)
+{
+    return (n + Alignment - 1) & ~(Alignment - 1);
+}
+static inline BlockHeader* HeaderOf(void* ptr)
+{
+    return reinterpret_cast<BlockHeader*>(reinterpret_cast<uint8_t*>(ptr) - Alignment);
+}
+
+static thread_local DocumentArena* tCurrentArena = nullptr;
+static std::atomic<bool> gAllocatorInstalled(false);
+
+static xmlRegisterNodeFunc gNextRegisterNode = nullptr;
+static xmlExternalEntityLoader gNextEntityLoader = nullptr;
+
+static void RegisterNode(xmlNodePtr node)
+{
+    // nodes parsed into an arena get their wrappers on demand, since releasing the
+    //  arena would lose any made here
+    if ( tCurrentArena != nullptr )
+        return;
+    
+    DocumentArena::MarkModified(node->doc);
+    if ( gNextRegisterNode != nullptr )
+        gNextRegisterNode(node);
+}
+static xmlParserInputPtr LoadEntity(const char* URL, const char* ID, xmlParserCtxtPtr ctxt)
+{
+    // loading may set up catalogs or network state, which must outlive the arena
+    DocumentArena::Scope heap(nullptr);
+    return gNextEntityLoader(URL, ID, ctxt);
+}
+
+bool DocumentArena::InstallAllocator()
+{
+    if ( gAllocatorInstalled )
+        return true;
+    if ( xmlMemSetup(&DocumentArena::FreeBlock, &DocumentArena::Malloc, &DocumentArena::Realloc, &DocumentArena::Strdup) != 0 )
+        return false;
+    gAllocatorInstalled = true;
+    
+    // set up libxml's global state now, so none of it is ever allocated in an arena
+    xmlInitParser();
+#ifdef LIBXML_CATALOG_ENABLED
+    xmlInitializeCatalog();
+#endif
+#ifdef LIBXML_HTTP_ENABLED
+    xmlNanoHTTPInit();
+#endif
+#ifdef LIBXML_FTP_ENABLED
+    xmlNanoFTPInit();
+#endif
+    
+    // state which libxml only creates on demand comes from loading external entities
+    gNextEntityLoader = xmlGetExternalEntityLoader();
+    xmlSetExternalEntityLoader(&LoadEntity);
+    
+    gNextRegisterNode = xmlRegisterNodeDefault(&RegisterNode);
+    xmlThrDefRegisterNodeDefault(&RegisterNode);
+    return true;
+}
+bool DocumentArena::IsInstalled()
+{
+    return gAllocatorInstalled;
+}
+DocumentArena* DocumentArena::Current()
+{
+    return tCurrentArena;
+}
+DocumentArena::Scope::Scope(DocumentArena* arena) : _previous(tCurrentArena)
+{
+    tCurrentArena = arena;
+}
+DocumentArena::Scope::~Scope()
+{
+    tCurrentArena = _previous;
+}
+xmlDocPtr DocumentArena::Parse(std::function<xmlDocPtr ()> parse)
+{
+    if ( !IsInstalled() )
+        return parse();
+    
+    DocumentArena* arena = new DocumentArena;
+    xmlDocPtr doc = nullptr;
+    try
+    {
+        Scope scope(arena);
+        doc = parse();
+        
+        // libxml keeps a copy of the last error in global storage
+        xmlResetLastError();
+    }
+    catch (...)
+    {
+        {
+            Scope scope(arena);
+            xmlResetLastError();
+        }
+        delete arena;
+        throw;
+    }
+    
+    if ( doc == nullptr )
+    {
+        delete arena;
+        return nullptr;
+    }
+    
+    arena->Adopt(doc);
+    return doc;
+}
+const DocumentArena* DocumentArena::ForDocument(xmlDocPtr doc)
+{
+    if ( doc == nullptr || !IsInstalled() )
+        return nullptr;
+    
+    DocumentArena* arena = HeaderOf(doc)->arena;
+    if ( arena == nullptr || arena->_owners[0] != doc )
+        return nullptr;
+    return arena;
+}
+void DocumentArena::FreeDocument(xmlDocPtr doc)
+{
+    DocumentArena* arena = const_cast<DocumentArena*>(ForDocument(doc));
+    if ( arena == nullptr )
+    {
+        xmlFreeDoc(doc);
+        return;
+    }
+    
+    // anything added since parsing came from the heap, and only xmlFreeDoc() can find it
+    if ( arena->IsModified(doc) )
+    {
+        xmlFreeDoc(doc);
+        return;
+    }
+    
+    // a dictionary from outside the arena still needs its reference dropped
+    if ( doc->dict != nullptr && HeaderOf(doc->dict)->arena != arena )
+        xmlDictFree(doc->dict);
+    
+    delete arena;
+}
+
+void DocumentArena::MarkModified(xmlDocPtr doc)
+{
+    DocumentArena* arena = const_cast<DocumentArena*>(ForDocument(doc));
+    if ( arena != nullptr )
+        arena->_modified = true;
+}
+
+DocumentArena::DocumentArena(size_t chunkSize) : _chunks(nullptr), _chunkSize(chunkSize), _chunkCount(0), _bytesReserved(0), _bytesUsed(0), _allocations(0), _bytesFreed(0), _owners{nullptr, nullptr}, _liveOwners(0), _modified(false), _dictSize(0), _idCount(0), _refCount(0)
+{
+}
+DocumentArena::~DocumentArena()
+{
+    while ( _chunks != nullptr )
+    {
+        Chunk* next = _chunks->next;
+        ::free(_chunks);
+        _chunks = next;
+    }
+}
+DocumentArena::Statistics DocumentArena::Stats() const
+{
+    return Statistics{_chunkCount, _bytesReserved, _bytesUsed, _bytesFreed, _allocations};
+}
+void* DocumentArena::Allocate(size_t size)
+{
+    size_t total = Alignment + Aligned(size);
+    
+    if ( _chunks == nullptr || _chunks->size - _chunks->used < total )
+    {
+        size_t chunkSize = Aligned(sizeof(Chunk)) + std::max(total, _chunkSize);
+        Chunk* chunk = reinterpret_cast<Chunk*>(::malloc(chunkSize));
+        if ( chunk == nullptr )
+            return nullptr;
+        chunk->size = chunkSize;
+        chunk->used = Aligned(sizeof(Chunk));
+        
+        _chunkCount++;
+        _bytesReserved += chunkSize;
+        
+        // an oversized block gets its own chunk, leaving the current one in use
+        if ( _chunks != nullptr && total > _chunkSize / 2 )
+        {
+            chunk->next = _chunks->next;
+            _chunks->next = chunk;
+        }
+        else
+        {
+            chunk->next = _chunks;
+            _chunks = chunk;
+        }
+    }
+    
+    Chunk* chunk = (_chunks->size - _chunks->used >= total ? _chunks : _chunks->next);
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(reinterpret_cast<uint8_t*>(chunk) + chunk->used);
+    header->arena = this;
+    header->size = size;
+    chunk->used += total;
+    
+    _bytesUsed += total;
+    _allocations++;
+    return reinterpret_cast<uint8_t*>(header) + Alignment;
+}
+void* DocumentArena::Reallocate(void *ptr, size_t size)
+{
+    BlockHeader* header = HeaderOf(ptr);
+    
+    // the most recent block can grow or shrink in place
+    uint8_t* end = reinterpret_cast<uint8_t*>(ptr) + Aligned(header->size);
+    if ( end == reinterpret_cast<uint8_t*>(_chunks) + _chunks->used )
+    {
+        size_t oldSize = Aligned(header->size);
+        size_t newSize = Aligned(size);
+        if ( newSize <= oldSize || newSize - oldSize <= _chunks->size - _chunks->used )
+        {
+            _chunks->used = _chunks->used - oldSize + newSize;
+            _bytesUsed = _bytesUsed - oldSize + newSize;
+            header->size = size;
+            return ptr;
+        }
+    }
+    
+    void* result = Allocate(size);
+    if ( result == nullptr )
+        return nullptr;
+    ::memcpy(result, ptr, std::min(header->size, size));
+    Free(ptr);
+    return result;
+}
+void DocumentArena::Free(void *ptr)
+{
+    BlockHeader* header = HeaderOf(ptr);
+    
+    if ( ptr == _owners[0] || ptr == _owners[1] )
+    {
+        // the document is gone: release everything
+        if ( --_liveOwners == 0 )
+            delete this;
+        return;
+    }
+    
+    // while parsing, short-lived buffers are often freed straight after allocation
+    if ( tCurrentArena == this )
+    {
+        uint8_t* end = reinterpret_cast<uint8_t*>(ptr) + Aligned(header->size);
+        if ( end == reinterpret_cast<uint8_t*>(_chunks) + _chunks->used )
+        {
+            size_t total = Alignment + Aligned(header->size);
+            _chunks->used -= total;
+            _bytesUsed -= total;
+            return;
+        }
+    }
+    
+    // outside the arena's scope, a part of a parsed document is being replaced
+    else if ( _liveOwners != 0 )
+    {
+        _modified = true;
+    }
+    
+    _bytesFreed += header->size;
+}
+void DocumentArena::Adopt(xmlDocPtr doc)
+{
+    int owners = 0;
+    _owners[owners++] = doc;
+    if ( doc->dict != nullptr && HeaderOf(doc->dict)->arena == this )
+        _owners[owners++] = doc->dict;
+    _liveOwners = owners;
+    
+    _dictSize = (owners > 1 ? static_cast<int>(xmlDictSize(doc->dict)) : 0);
+    _idCount = xmlHashSize(reinterpret_cast<xmlHashTablePtr>(doc->ids));
+    _refCount = xmlHashSize(reinterpret_cast<xmlHashTablePtr>(doc->refs));
+}
+bool DocumentArena::IsModified(xmlDocPtr doc) const
+{
+    if ( _modified )
+        return true;
+    
+    // new dictionary strings, IDs and references go into tables the arena owns, and
+    //  attaching a node made without a document only shows up there
+    if ( _owners[1] != nullptr && static_cast<int>(xmlDictSize(doc->dict)) != _dictSize )
+        return true;
+    if ( xmlHashSize(reinterpret_cast<xmlHashTablePtr>(doc->ids)) != _idCount )
+        return true;
+    if ( xmlHashSize(reinterpret_cast<xmlHashTablePtr>(doc->refs)) != _refCount )
+        return true;
+    return false;
+}
+
+void* DocumentArena::Malloc(size_t size)
+{
+    if ( tCurrentArena != nullptr )
+        return tCurrentArena->Allocate(size);
+    
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(::malloc(Alignment + size));
+    if ( header == nullptr )
+        return nullptr;
+    header->arena = nullptr;
+    header->size = size;
+    return reinterpret_cast<uint8_t*>(header) + Alignment;
+}
+void* DocumentArena::Realloc(void *ptr, size_t size)
+{
+    if ( ptr == nullptr )
+        return Malloc(size);
+    
+    BlockHeader* header = HeaderOf(ptr);
+    if ( header->arena == nullptr )
+    {
+        header = reinterpret_cast<BlockHeader*>(::realloc(header, Alignment + size));
+        if ( header == nullptr )
+            return nullptr;
+        header->size = size;
+        return reinterpret_cast<uint8_t*>(header) + Alignment;
+    }
+    
+    if ( header->arena == tCurrentArena )
+        return header->arena->Reallocate(ptr, size);
+    
+    // the arena isn't ours to allocate from, so the block moves to the heap, and its
+    //  document is no longer entirely in the arena
+    header->arena->_modified = true;
+    void* result = nullptr;
+    {
+        Scope heap(nullptr);
+        result = Malloc(size);
+    }
+    if ( result == nullptr )
+        return nullptr;
+    ::memcpy(result, ptr, std::min(header->size, size));
+    header->arena->Free(ptr);
+    return result;
+}
+void DocumentArena::FreeBlock(void *ptr)
+{
+    if ( ptr == nullptr )
+        return;
+    
+    BlockHeader* header = HeaderOf(ptr);
+    if ( header->arena != nullptr )
+        header->arena->Free(ptr);
+    else
+        ::free(header);
+}
+char* DocumentArena::Strdup(const char *str)
+{
+    size_t len = ::strlen(str) + 1;
+    char* result = reinterpret_cast<char*>(Malloc(len));
+    if ( result != nullptr )
+        ::memcpy(result, str, len);
+    return result;
+}
+
+EPUB3_XML_END_NAMESPACE
@@ -0,0 +1,183 @@
+//
+//  document_arena.h
+//  ePub3
+//
+//  Created by agent on 2026-10-18.
+//  Copyright (c) 2026 The Readium Foundation.
+//  
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3_xml_document_arena__
+#define __ePub3_xml_document_arena__
+
+#include "base.h"
+#include <atomic>
+#include <functional>
+#include <libxml/tree.h>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ A bump allocator holding everything libxml allocates while parsing one document.
+ 
+ Once InstallAllocator() has routed libxml's memory functions through this class,
+ any allocation made on a thread inside a DocumentArena::Scope is carved from that
+ arena, and anything freed there costs nothing. A document parsed that way owns its
+ arena: FreeDocument() releases the whole tree at once rather than walking it, and
+ plain xmlFreeDoc() also releases the arena when it's done.
+ 
+ Arena documents can still be modified, though anything added afterwards comes from
+ the ordinary heap, where releasing the arena won't reach it. The arena notices many
+ such changes, from the blocks libxml frees or moves out of it, new attributes, and
+ new names in the document's dictionary, and FreeDocument() then frees the document
+ through xmlFreeDoc() instead. It can't notice every change without walking the
+ tree, though: a node linked in with names the document already uses, or new text
+ which replaces a string from the dictionary, goes unseen. Free a document which may
+ have been changed with xmlFreeDoc(), or call MarkModified() after changing it.
+ Documents which will be modified gain nothing from an arena.
+ 
+ Nodes parsed into an arena have no xml::Node wrappers until one is asked for, and
+ asking marks the document as modified, since only xmlFreeDoc() deletes wrappers.
+ 
+ libxml creates some of its global state the first time it's needed, and anything it
+ creates inside a Scope is lost with the arena. InstallAllocator() sets up what it
+ can in advance, and loads external entities (DTDs, with the catalogs and network
+ connections they need) outside the arena. Anything else which makes libxml create
+ global state, such as registering encoding handlers, loading catalogs, or replacing
+ the external entity loader, must be done outside any Scope.
+ */
+class DocumentArena
+{
+public:
+    struct Statistics
+    {
+        size_t  chunks;             ///< The number of blocks obtained from the system.
+        size_t  bytesReserved;      ///< The total size of those blocks.
+        size_t  bytesUsed;          ///< The bytes handed out, including headers and padding.
+        size_t  bytesFreed;         ///< Bytes freed by libxml but not reclaimable.
+        size_t  allocations;        ///< The number of allocations made.
+    };
+    
+    static const size_t DefaultChunkSize = 64 * 1024;
+    
+    /**
+     Routes libxml's memory functions through the arena allocator, and initializes
+     libxml.
+     
+     This must be called before *anything* else uses libxml, since memory allocated
+     beforehand can't be freed through the new functions. It also installs libxml's
+     external entity loader and node registration callbacks, passing on to any
+     installed beforehand.
+     @result `false` if libxml refused the new functions.
+     */
+    static bool InstallAllocator();
+    static bool IsInstalled();
+    
+    /**
+     Makes an arena current on the calling thread for the lifetime of the scope.
+     Before the scope ends, anything libxml allocated in the arena must either have
+     been freed or belong to the parsed document.
+     */
+    class Scope
+    {
+    public:
+        Scope(DocumentArena* arena);
+        Scope(const Scope&) = delete;
+        ~Scope();
+        
+    private:
+        DocumentArena*  _previous;
+    };
+    
+    /**
+     Runs `parse` with a new arena current on the calling thread, and gives the arena
+     to the resulting document. If the allocator isn't installed, this just runs `parse`.
+     */
+    static xmlDocPtr Parse(std::function<xmlDocPtr()> parse);
+    
+    // the arena in scope on the calling thread, if any
+    static DocumentArena* Current();
+    
+    // returns nullptr if the document wasn't parsed in an arena
+    static const DocumentArena* ForDocument(xmlDocPtr doc);
+    
+    /**
+     Releases an arena document in one step, or calls xmlFreeDoc() for any other
+     document, or for an arena document known to have been modified since it was
+     parsed. Choosing between them takes constant time.
+     */
+    static void FreeDocument(xmlDocPtr doc);
+    
+    /**
+     Records that a document has gained parts outside its arena, so FreeDocument()
+     will use xmlFreeDoc(). Does nothing for documents without an arena.
+     */
+    static void MarkModified(xmlDocPtr doc);
+    
+    DocumentArena(size_t chunkSize = DefaultChunkSize);
+    DocumentArena(const DocumentArena&) = delete;
+    ~DocumentArena();
+    
+    Statistics Stats() const;
+    
+protected:
+    struct Chunk
+    {
+        Chunk*  next;
+        size_t  size;
+        size_t  used;
+    };
+    
+    Chunk*                  _chunks;        // most recent first
+    size_t                  _chunkSize;
+    size_t                  _chunkCount;
+    size_t                  _bytesReserved;
+    size_t                  _bytesUsed;
+    size_t                  _allocations;
+    std::atomic<size_t>     _bytesFreed;
+    
+    // the blocks whose freeing means the document is gone: the xmlDoc itself, and its
+    //  dictionary if that's in the arena too (xmlFreeDoc() frees that last)
+    void*                   _owners[2];
+    std::atomic<int>        _liveOwners;
+    
+    // set once the document has parts outside the arena
+    std::atomic<bool>       _modified;
+    
+    // the sizes of the document's tables when it was adopted, since anything added to
+    //  them later is allocated outside the arena
+    int                     _dictSize;
+    int                     _idCount;
+    int                     _refCount;
+    
+    void*   Allocate(size_t size);
+    void*   Reallocate(void* ptr, size_t size);
+    void    Free(void* ptr);
+    void    Adopt(xmlDocPtr doc);
+    
+    // whether any part of the document now lies outside this arena
+    bool    IsModified(xmlDocPtr doc)   const;
+    
+    static void*    Malloc(size_t size);
+    static void*    Realloc(void* ptr, size_t size);
+    static void     FreeBlock(void* ptr);
+    static char*    Strdup(const char* str);
+    
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_document_arena__) */
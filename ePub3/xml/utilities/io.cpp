@@ -20,6 +20,7 @@
 //
 
 #include "io.h"
+#include <climits>
 
 EPUB3_XML_BEGIN_NAMESPACE
 
@@ -46,12 +47,28 @@ int InputBuffer::close_cb(void *context)
 }
 xmlDocPtr InputBuffer::xmlReadDocument(const char * url, const char * encoding, int options)
 {
+    const char * data = nullptr;
+    size_t len = 0;
+    if ( contiguousData(&data, &len) && len <= INT_MAX )
+        return xmlReadMemory(data, static_cast<int>(len), url, encoding, options);
     return xmlReadIO(_buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
 }
 xmlDocPtr InputBuffer::htmlReadDocument(const char *url, const char *encoding, int options)
 {
+    const char * data = nullptr;
+    size_t len = 0;
+    if ( contiguousData(&data, &len) && len <= INT_MAX )
+        return htmlReadMemory(data, static_cast<int>(len), url, encoding, options);
     return htmlReadIO(_buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
 }
+xmlTextReaderPtr InputBuffer::xmlReaderForDocument(const char *url, const char *encoding, int options)
+{
+    const char * data = nullptr;
+    size_t len = 0;
+    if ( contiguousData(&data, &len) && len <= INT_MAX )
+        return xmlReaderForMemory(data, static_cast<int>(len), url, encoding, options);
+    return xmlReaderForIO(_buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
+}
 
 OutputBuffer::OutputBuffer(const std::string & encoding)
 {
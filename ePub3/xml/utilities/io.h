@@ -26,6 +26,7 @@
 #include <iostream>
 #include <libxml/xmlIO.h>
 #include <libxml/HTMLtree.h>
+#include <libxml/xmlreader.h>
 
 EPUB3_XML_BEGIN_NAMESPACE
 
@@ -41,8 +42,11 @@ public:
     operator xmlParserInputBuffer * () { return xmlBuffer(); }
     operator const xmlParserInputBuffer * () const { return xmlBuffer(); }
     
-    xmlDocPtr xmlReadDocument(const char * url, const char * encoding, int options);
-    xmlDocPtr htmlReadDocument(const char * url, const char * encoding, int options);
+    virtual xmlDocPtr xmlReadDocument(const char * url, const char * encoding, int options);
+    virtual xmlDocPtr htmlReadDocument(const char * url, const char * encoding, int options);
+    
+    // a streaming reader over the input; it must be freed before the buffer is
+    virtual xmlTextReaderPtr xmlReaderForDocument(const char * url, const char * encoding, int options);
     
 protected:
     xmlParserInputBufferPtr _buf;
@@ -50,6 +54,10 @@ protected:
     virtual size_t read(uint8_t * buf, size_t len) = 0;
     virtual bool close() { return false; }
     
+    // subclasses whose content is already in memory can return it here, and it will
+    //  be parsed in place rather than copied out through read()
+    virtual bool contiguousData(const char ** data, size_t * len) { return false; }
+    
     static int read_cb(void * context, char * buffer, int len);
     static int close_cb(void * context);
     